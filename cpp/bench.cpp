@@ -0,0 +1,910 @@
+// bench.cpp
+//
+// Micro and macro benchmarks for the simulation and render hot paths,
+// built on Google Benchmark. Rendering goes through the CPU mock in
+// mock_gl/ (compile with -Imock_gl), so this runs on any Linux box without
+// a display. Besides time per iteration every benchmark reports heap
+// allocations per iteration; the frame benchmarks also report GL calls,
+// draw calls and bytes uploaded per frame. Google Benchmark's own
+// bookkeeping adds a couple of allocations per run, which shows up as a
+// few allocations per million iterations.
+//
+// The profiler is compiled in (TVS_PROFILE) so its zone and overlay costs
+// can be measured; nothing else in the suite is instrumented.
+//
+// Usage: ./bench [Google Benchmark flags] [--baseline=FILE] [--threshold=PERCENT]
+//
+// Save a baseline with --benchmark_out=baseline.json --benchmark_out_format=json.
+// With --baseline, every benchmark that also appears in FILE is compared
+// on real time, and the exit status is 1 if any got slower by more than
+// --threshold percent (default 10).
+
+#define TVS_PROFILE
+
+#include <benchmark/benchmark.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#define STB_EASY_FONT_IMPLEMENTATION
+#include "stb_easy_font.h"
+
+#include "car.h"
+#include "driver.h"
+#include "fleet.h"
+#include "frame_writer.h"
+#include "hud.h"
+#include "integrator.h"
+#include "maneuver.h"
+#include "motor.h"
+#include "mpc.h"
+#include "profiler.h"
+#include "profiler_overlay.h"
+#include "renderer.h"
+#include "scenario.h"
+#include "snapshot.h"
+#include "surface.h"
+#include "tire.h"
+#include "vehicle4w.h"
+
+// Heap allocation counter, fed by the global operator new below
+static std::atomic<long> allocationCount(0);
+
+// The replacements are kept out of line, so the compiler does not see
+// malloc() and free() through them and pair them with new and delete at
+// every call site (-Wmismatched-new-delete)
+__attribute__((noinline)) void* operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+void* operator new[](size_t size) { return operator new(size); }
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, size_t) noexcept { operator delete[](p); }
+
+// Function to attach per-iteration allocation and GL counters to a run
+static void reportCounters(benchmark::State& state, long allocationsBefore, const MockGLStats* glBefore) {
+    state.counters["allocs"] = benchmark::Counter((double)(allocationCount.load() - allocationsBefore),
+                                                  benchmark::Counter::kAvgIterations);
+    if (glBefore) {
+        state.counters["gl_calls"] = benchmark::Counter((double)(mockGL.stats.calls - glBefore->calls),
+                                                        benchmark::Counter::kAvgIterations);
+        state.counters["draws"] = benchmark::Counter((double)(mockGL.stats.drawCalls - glBefore->drawCalls),
+                                                     benchmark::Counter::kAvgIterations);
+        state.counters["upload_bytes"] = benchmark::Counter((double)(mockGL.stats.bytesUploaded - glBefore->bytesUploaded),
+                                                            benchmark::Counter::kAvgIterations);
+    }
+}
+
+// Function to create an empty file under /tmp ending in 'suffix', for a
+// benchmark to fill and unlink; returns an empty path on error
+static std::string benchTempFile(const char* suffix) {
+    std::string path = std::string("/tmp/tvs_bench_XXXXXX") + suffix;
+    int fd = mkstemps(&path[0], (int)strlen(suffix));
+    if (fd < 0)
+        return std::string();
+    close(fd);
+    return path;
+}
+
+// A second of slalom inputs, so the step benchmarks do not time sinf()
+static const std::vector<DriverInput>& slalomInputs() {
+    static std::vector<DriverInput> inputs = [] {
+        std::vector<DriverInput> v(1024);
+        for (size_t i = 0; i < v.size(); i++)
+            v[i] = scriptedInput(MANEUVER_SLALOM, (float)i * 0.001f);
+        return v;
+    }();
+    return inputs;
+}
+
+// Bicycle model: driver input plus step, as in the 1 kHz loop, for each
+// fastmath.h policy
+template <typename Math>
+static void BM_StepCar(benchmark::State& state) {
+    const std::vector<DriverInput>& inputs = slalomInputs();
+    Car car = makeDefaultCar();
+    size_t i = 0;
+    long allocations = allocationCount.load();
+    for (auto _ : state) {
+        applyDriverInput(car, inputs[i++ & 1023], 0.001f);
+        StepOutput out = stepCar<Math>(car, 0.001f);
+        benchmark::DoNotOptimize(out);
+    }
+    state.SetItemsProcessed(state.iterations());
+    reportCounters(state, allocations, nullptr);
+}
+BENCHMARK_TEMPLATE(BM_StepCar, LibmMath);
+BENCHMARK_TEMPLATE(BM_StepCar, PolyMath);
+BENCHMARK_TEMPLATE(BM_StepCar, TableMath);
+
+// Bicycle step with the vehicle coefficients folded at compile time
+// (StaticBicycle), precomputed once (RuntimeBicycle), and derived from the
+// car on every step (stepCar, the BM_StepCar<LibmMath> row above)
+template <typename Config>
+static void stepBicycleLoop(benchmark::State& state, const Config& config) {
+    const std::vector<DriverInput>& inputs = slalomInputs();
+    Car car = makeCar(DEFAULT_VEHICLE);
+    size_t i = 0;
+    long allocations = allocationCount.load();
+    for (auto _ : state) {
+        applyDriverInput(car, inputs[i++ & 1023], 0.001f);
+        StepOutput out = stepBicycle<LibmMath>(car, config, 0.001f);
+        benchmark::DoNotOptimize(out);
+    }
+    state.SetItemsProcessed(state.iterations());
+    reportCounters(state, allocations, nullptr);
+}
+
+static void BM_StepBicycleStatic(benchmark::State& state) {
+    stepBicycleLoop(state, StaticBicycle<DEFAULT_VEHICLE>());
+}
+BENCHMARK(BM_StepBicycleStatic);
+
+static void BM_StepBicycleRuntime(benchmark::State& state) {
+    RuntimeBicycle config = makeRuntimeBicycle(makeCar(DEFAULT_VEHICLE));
+    benchmark::DoNotOptimize(config);
+    stepBicycleLoop(state, config);
+}
+BENCHMARK(BM_StepBicycleRuntime);
+
+// Math policies on their own. Each iteration evaluates 1024 arguments
+// spread over the range the steps use; 'err' is the max absolute error
+// against double-precision libm over a dense sweep of the same range.
+const float MATH_TAN_RANGE = 80.0f * DEG2RAD;     // swept maxSteer goes past 45°
+const float MATH_SINCOS_RANGE = 100.0f;           // heading is not wrapped
+
+template <typename Math>
+static void BM_MathTan(benchmark::State& state) {
+    double err = 0.0;
+    for (int i = -200000; i <= 200000; i++) {
+        float x = MATH_TAN_RANGE * (float)i / 200000.0f;
+        err = std::max(err, fabs((double)Math::tan(x) - std::tan((double)x)));
+    }
+    float args[1024];
+    for (int i = 0; i < 1024; i++)
+        args[i] = MATH_TAN_RANGE * ((float)i / 512.0f - 1.0f);
+
+    for (auto _ : state) {
+        for (float x : args)
+            benchmark::DoNotOptimize(Math::tan(x));
+    }
+    state.SetItemsProcessed(state.iterations() * 1024);
+    state.counters["err"] = err;
+}
+BENCHMARK_TEMPLATE(BM_MathTan, LibmMath);
+BENCHMARK_TEMPLATE(BM_MathTan, PolyMath);
+BENCHMARK_TEMPLATE(BM_MathTan, TableMath);
+
+template <typename Math>
+static void BM_MathAtan2(benchmark::State& state) {
+    double err = 0.0;
+    for (int i = 0; i < 200000; i++) {
+        double angle = 2.0 * M_PI * (double)i / 200000.0 - M_PI;
+        for (float radius : { 1e-3f, 1.0f, 1e3f }) {
+            float y = radius * (float)sin(angle);
+            float x = radius * (float)cos(angle);
+            err = std::max(err, fabs((double)Math::atan2(y, x) - std::atan2((double)y, (double)x)));
+        }
+    }
+    // As in stepCar(): atan2(k, 1) with k = lr tan(steer) / wheelbase
+    float args[1024];
+    for (int i = 0; i < 1024; i++)
+        args[i] = 0.5f * tanf(MATH_TAN_RANGE * ((float)i / 512.0f - 1.0f));
+
+    for (auto _ : state) {
+        for (float y : args)
+            benchmark::DoNotOptimize(Math::atan2(y, 1.0f));
+    }
+    state.SetItemsProcessed(state.iterations() * 1024);
+    state.counters["err"] = err;
+}
+BENCHMARK_TEMPLATE(BM_MathAtan2, LibmMath);
+BENCHMARK_TEMPLATE(BM_MathAtan2, PolyMath);
+BENCHMARK_TEMPLATE(BM_MathAtan2, TableMath);
+
+template <typename Math>
+static void BM_MathSinCos(benchmark::State& state) {
+    double err = 0.0;
+    for (int i = -1000000; i <= 1000000; i++) {
+        float x = MATH_SINCOS_RANGE * (float)i / 1000000.0f;
+        float s, c;
+        Math::sincos(x, &s, &c);
+        err = std::max(err, std::max(fabs((double)s - std::sin((double)x)), fabs((double)c - std::cos((double)x))));
+    }
+    float args[1024];
+    for (int i = 0; i < 1024; i++)
+        args[i] = MATH_SINCOS_RANGE * ((float)i / 512.0f - 1.0f);
+
+    for (auto _ : state) {
+        for (float x : args) {
+            float s, c;
+            Math::sincos(x, &s, &c);
+            benchmark::DoNotOptimize(s);
+            benchmark::DoNotOptimize(c);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * 1024);
+    state.counters["err"] = err;
+}
+BENCHMARK_TEMPLATE(BM_MathSinCos, LibmMath);
+BENCHMARK_TEMPLATE(BM_MathSinCos, PolyMath);
+BENCHMARK_TEMPLATE(BM_MathSinCos, TableMath);
+
+// Four-wheel model, with and without the torque-vectoring controller, on
+// linear or Magic Formula tires
+static void BM_StepVehicle4W(benchmark::State& state) {
+    const std::vector<DriverInput>& inputs = slalomInputs();
+    Vehicle4W vehicle = makeVehicle4W(makeDefaultCar());
+    Vehicle4WConstants constants = makeVehicle4WConstants(vehicle.car);
+    constants.tireModel = (TireModel)state.range(1);
+    bool torqueVectoring = state.range(0) != 0;
+    size_t i = 0;
+    long allocations = allocationCount.load();
+    for (auto _ : state) {
+        applyDriverInput(vehicle.car, inputs[i++ & 1023], 0.001f);
+        StepOutput out = stepVehicle4W(vehicle, constants, 0.001f, torqueVectoring);
+        benchmark::DoNotOptimize(out);
+    }
+    state.SetItemsProcessed(state.iterations());
+    reportCounters(state, allocations, nullptr);
+}
+BENCHMARK(BM_StepVehicle4W)->ArgNames({ "tv", "tires" })->Args({ 0, TIRE_LINEAR })->Args({ 1, TIRE_LINEAR })
+    ->Args({ 1, TIRE_MAGIC_FORMULA });
+
+// One tire's combined-slip forces, from the formula and from the tables,
+// over a spread of slips and loads
+static void BM_TireForces(benchmark::State& state) {
+    bool tables = state.range(0) != 0;
+    float cornering = makeVehicle4WConstants(makeDefaultCar()).stiffnessPerLoad[FRONT_LEFT];
+    float alpha[256], kappa[256], n[256];
+    for (int i = 0; i < 256; i++) {
+        alpha[i] = 0.3f * ((float)(i % 97) / 48.0f - 1.0f);
+        kappa[i] = 0.12f * ((float)(i % 53) / 26.0f - 1.0f);
+        n[i] = 0.4f + 1.6f * (float)(i % 31) / 30.0f;
+    }
+    size_t i = 0;
+    long allocations = allocationCount.load();
+    for (auto _ : state) {
+        size_t j = i++ & 255;
+        TireForces f = tables ? tableTireForces(alpha[j], kappa[j], n[j], cornering, 1.0f)
+                              : magicFormulaForces<float>(alpha[j], kappa[j], n[j], cornering, 1.0f);
+        benchmark::DoNotOptimize(f);
+    }
+    state.SetItemsProcessed(state.iterations());
+    reportCounters(state, allocations, nullptr);
+}
+BENCHMARK(BM_TireForces)->ArgName("tables")->Arg(0)->Arg(1);
+
+// SIMD fleet kernel; items are car-steps
+static void BM_StepFleet(benchmark::State& state) {
+    size_t n = (size_t)state.range(0);
+    Fleet fleet;
+    fleet.reserve(n);
+    for (size_t k = 0; k < n; k++)
+        fleet.addCar(makeFleetCar(k, n));
+    for (size_t k = 0; k < n; k++) {
+        fleet.steerInput[k] = 0.5f;
+        fleet.throttleInput[k] = 0.3f;
+    }
+    long allocations = allocationCount.load();
+    for (auto _ : state) {
+        stepFleet(fleet, 0.001f);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * (int64_t)n);
+    reportCounters(state, allocations, nullptr);
+}
+BENCHMARK(BM_StepFleet)->Arg(64)->Arg(4096);
+
+// A 100k-point oval (7 mm between points), built once
+static const Track& benchTrack() {
+    static Track track;
+    if (track.x.empty())
+        makeOvalTrack(track, 100000, makeDefaultDriverParams());
+    return track;
+}
+
+// Cold nearest-segment query through the track grid, from points up to
+// 'offset' metres off the line anywhere around it
+static void BM_TrackNearest(benchmark::State& state) {
+    float maxOffset = (float)state.range(0);
+    const Track& track = benchTrack();
+    std::vector<float> px(1024), pz(1024);
+    srand(1);
+    for (size_t k = 0; k < px.size(); k++) {
+        Car car = makeDefaultCar();
+        placeOnTrack(car, track, track.length * (float)rand() / (float)RAND_MAX);
+        float offset = maxOffset * (2.0f * (float)rand() / (float)RAND_MAX - 1.0f);
+        px[k] = car.x - offset * sinf(car.heading);
+        pz[k] = car.z + offset * cosf(car.heading);
+    }
+    size_t i = 0;
+    long allocations = allocationCount.load();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(nearestSegment(track, px[i & 1023], pz[i & 1023]));
+        i++;
+    }
+    state.SetItemsProcessed(state.iterations());
+    reportCounters(state, allocations, nullptr);
+}
+BENCHMARK(BM_TrackNearest)->ArgName("offset")->Arg(1)->Arg(20);
+
+// Track driver plus bicycle step for N cars spread around the track, each
+// with its own driver state; items are car-steps
+static void BM_TrackDriver(benchmark::State& state) {
+    const Track& track = benchTrack();
+    size_t n = (size_t)state.range(0);
+    std::vector<Car> cars(n, makeDefaultCar());
+    std::vector<RuntimeBicycle> bicycles(n);
+    std::vector<DriverState> drivers(n, makeDriverState());
+    for (size_t k = 0; k < n; k++) {
+        placeOnTrack(cars[k], track, track.length * (float)k / (float)n);
+        bicycles[k] = makeRuntimeBicycle(cars[k]);
+    }
+    float t = 0.0f;
+    long allocations = allocationCount.load();
+    for (auto _ : state) {
+        for (size_t k = 0; k < n; k++) {
+            applyDriverInput(cars[k], trackDriverInput(track, drivers[k], cars[k], t, 0.001f), 0.001f);
+            StepOutput out = stepBicycle(cars[k], bicycles[k], 0.001f);
+            benchmark::DoNotOptimize(out);
+        }
+        t += 0.001f;
+    }
+    state.SetItemsProcessed(state.iterations() * (int64_t)n);
+    state.counters["laps"] = (double)drivers[0].laps;
+    reportCounters(state, allocations, nullptr);
+}
+BENCHMARK(BM_TrackDriver)->Arg(1)->Arg(4096);
+
+// Scripted input from a streamed drive-cycle file, one sample per 1 ms
+// step; the file holds 200 sine-with-dwell cycles (~81k keyframes), so the
+// loop keeps refilling chunks and rewinds at the end
+static void BM_ScenarioCursor(benchmark::State& state) {
+    std::string file = benchTempFile(state.range(0) ? ".bin" : ".txt");
+    const char* path = file.c_str();
+    ScenarioWriter writer;
+    if (file.empty() || !openScenarioWriter(writer, path)) {
+        state.SkipWithError("cannot write scenario file");
+        if (!file.empty())
+            unlink(path);
+        return;
+    }
+    writeDriveCycle(writer, CYCLE_SINE_WITH_DWELL, 200);
+    closeScenarioWriter(writer);
+    static Scenario scenario;
+    if (!openScenario(scenario, path)) {
+        state.SkipWithError("cannot open scenario file");
+        unlink(path);
+        return;
+    }
+    Car car = makeDefaultCar();
+    double t = 0.0;
+    long allocations = allocationCount.load();
+    for (auto _ : state) {
+        DriverInput input;
+        if (!scenarioInput(scenario, car, t, 0.001f, &input)) {
+            rewindScenario(scenario);
+            t = 0.0;
+        }
+        benchmark::DoNotOptimize(input);
+        t += 0.001;
+    }
+    state.SetItemsProcessed(state.iterations());
+    reportCounters(state, allocations, nullptr);
+    closeScenario(scenario);
+    unlink(path);
+}
+BENCHMARK(BM_ScenarioCursor)->ArgName("binary")->Arg(0)->Arg(1);
+
+// Friction and grade under the four wheels of n cars spread over a 1 km
+// wet-patch map (16 MB, every tile stored), driving across it; items are
+// wheel lookups. soa:0 samples each Vehicle4W, soa:1 looks up the same
+// contact points from structure-of-arrays x/z in one surfaceCells() call.
+static void BM_SurfaceLookup(benchmark::State& state) {
+    std::string file = benchTempFile(".bin");
+    const char* path = file.c_str();
+    SurfaceMap map;
+    if (file.empty() || !writeSurfaceMap(path, SURFACE_WET, 1000.0) || !openSurfaceMap(map, path)) {
+        state.SkipWithError("cannot write surface map");
+        if (!file.empty())
+            unlink(path);
+        return;
+    }
+    size_t n = (size_t)state.range(0);
+    bool soa = state.range(1) != 0;
+    std::vector<Vehicle4W> vehicles;
+    for (size_t k = 0; k < n; k++) {
+        Car car = makeDefaultCar();
+        car.x = -450.0f + 900.0f * (float)((k * 37) % n) / (float)n;
+        car.z = -450.0f + 900.0f * (float)k / (float)n;
+        car.heading = 0.1f * (float)(k % 63);
+        vehicles.push_back(makeVehicle4W(car));
+    }
+    Vehicle4WConstants constants = makeVehicle4WConstants(vehicles[0].car);
+    std::vector<float> x(n * CORNER_COUNT), z(n * CORNER_COUNT);
+    std::vector<SurfaceCell> cells(n * CORNER_COUNT);
+    for (size_t k = 0; k < n; k++) {
+        const Car& car = vehicles[k].car;
+        for (int c = 0; c < CORNER_COUNT; c++) {
+            x[k * CORNER_COUNT + c] = car.x + cosf(car.heading) * constants.cornerX[c] -
+                                      sinf(car.heading) * constants.cornerY[c];
+            z[k * CORNER_COUNT + c] = car.z + sinf(car.heading) * constants.cornerX[c] +
+                                      cosf(car.heading) * constants.cornerY[c];
+        }
+    }
+    long allocations = allocationCount.load();
+    for (auto _ : state) {
+        if (soa) {
+            for (float& px : x)
+                px += 0.01f;
+            surfaceCells(map, x.data(), z.data(), x.size(), cells.data());
+        } else {
+            for (size_t k = 0; k < n; k++) {
+                vehicles[k].car.x += 0.01f;
+                sampleWheelSurface(vehicles[k], constants, map);
+            }
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * (int64_t)n * CORNER_COUNT);
+    reportCounters(state, allocations, nullptr);
+    closeSurfaceMap(map);
+    unlink(path);
+}
+BENCHMARK(BM_SurfaceLookup)->ArgNames({ "cars", "soa" })->Args({ 1, 0 })->Args({ 4096, 0 })->Args({ 4096, 1 });
+
+// Motor and drivetrain, both integrators at the physics step
+static void BM_StepMotor(benchmark::State& state) {
+    MotorParams motor = makeDefaultMotor();
+    MotorStepper stepper = makeMotorStepper(motor, 1500.0f, 0.001f, (MotorIntegrator)state.range(0));
+    MotorState motorState = { 0.0f, 0.0f };
+    long allocations = allocationCount.load();
+    for (auto _ : state) {
+        stepMotor(motorState, stepper, motor.maxVoltage, 10.0f);
+        benchmark::DoNotOptimize(motorState);
+    }
+    state.SetItemsProcessed(state.iterations());
+    reportCounters(state, allocations, nullptr);
+}
+BENCHMARK(BM_StepMotor)->ArgName("explicit")->Arg(MOTOR_IMPLICIT)->Arg(MOTOR_EXPLICIT);
+
+// One simulated second of slalom per iteration, each integrator at its
+// default step or tolerance
+static void BM_IntegrateBicycle(benchmark::State& state) {
+    IntegratorSettings settings = makeIntegratorSettings((IntegratorMethod)state.range(0));
+    auto input = [](double t) { return scriptedInput(MANEUVER_SLALOM, (float)t); };
+    BicycleIntegrator b;
+    initBicycleIntegrator(b, makeDefaultCar(), settings, 0.0);
+    long allocations = allocationCount.load();
+    for (auto _ : state) {
+        integrateBicycle(b, input, b.t + 1.0);
+        benchmark::DoNotOptimize(b.y);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["evals"] = benchmark::Counter((double)b.stats.evaluations, benchmark::Counter::kAvgIterations);
+    reportCounters(state, allocations, nullptr);
+}
+BENCHMARK(BM_IntegrateBicycle)->ArgName("method")->DenseRange(0, INTEGRATOR_COUNT - 1);
+
+// Branching a warmed-up four-wheel run into N what-if copies
+static void BM_ForkRunState(benchmark::State& state) {
+    RunState parent;
+    initRunState(parent, makeDefaultCar(), MODEL_4W_TV, true, TIRE_LINEAR, 0.001f);
+    for (int i = 0; i < 1000; i++)
+        stepRunState(parent, scriptedInput(MANEUVER_STEP_STEER, i * 0.001f));
+    std::vector<RunState> children(state.range(0));
+    long allocations = allocationCount.load();
+    for (auto _ : state) {
+        forkRunState(parent, children.data(), children.size());
+        benchmark::DoNotOptimize(children.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * state.range(0) * (int64_t)sizeof(RunState));
+    reportCounters(state, allocations, nullptr);
+}
+BENCHMARK(BM_ForkRunState)->Arg(1)->Arg(64);
+
+// One predictive-controller solve mid-corner, warm-started from the last
+static void BM_SolveMpc(benchmark::State& state) {
+    RunState run;
+    initRunState(run, makeDefaultCar(), MODEL_4W_MPC, false, TIRE_LINEAR, 0.001f);
+    run.mpcSettings.samples = (int)state.range(0);
+    for (int i = 0; i < 3000; i++)
+        stepRunState(run, scriptedInput(MANEUVER_SLALOM, i * 0.001f));
+    MpcWorkspace& workspace = mpcWorkspace();
+    long allocations = allocationCount.load();
+    for (auto _ : state) {
+        solveMpc(run.mpcSettings, run.mpc, workspace, run.vehicle);
+        benchmark::DoNotOptimize(run.mpc);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0) * run.mpcSettings.iterations);
+    reportCounters(state, allocations, nullptr);
+}
+BENCHMARK(BM_SolveMpc)->ArgName("samples")->Arg(64)->Arg(256)->Arg(1024);
+
+// Load transfer: axle loads from a step plus the split over four corners
+static void BM_CornerLoads(benchmark::State& state) {
+    Car car = makeDefaultCar();
+    car.acceleration = 2.0f;
+    float a_lat = 0.0f;
+    float corners[CORNER_COUNT];
+    long allocations = allocationCount.load();
+    for (auto _ : state) {
+        a_lat += 0.001f;
+        computeCornerLoads(car, a_lat, corners);
+        benchmark::DoNotOptimize(corners);
+    }
+    state.SetItemsProcessed(state.iterations());
+    reportCounters(state, allocations, nullptr);
+}
+BENCHMARK(BM_CornerLoads);
+
+// One HUD value as hud.h formats it
+static void BM_FormatFixed(benchmark::State& state) {
+    char text[MAX_HUD_TEXT];
+    float value = 1234.5678f;
+    long allocations = allocationCount.load();
+    for (auto _ : state) {
+        value += 0.01f;
+        int length = formatFixed(value, 2, text, sizeof(text));
+        benchmark::DoNotOptimize(length);
+        benchmark::DoNotOptimize(text);
+    }
+    state.SetItemsProcessed(state.iterations());
+    reportCounters(state, allocations, nullptr);
+}
+BENCHMARK(BM_FormatFixed);
+
+// The same value through std::ostringstream, as main() used to build its
+// HUD strings; kept as the reference formatFixed() replaced
+static void BM_FormatStringstream(benchmark::State& state) {
+    float value = 1234.5678f;
+    long allocations = allocationCount.load();
+    for (auto _ : state) {
+        value += 0.01f;
+        std::ostringstream out;
+        out << "Speed: " << std::fixed << std::setprecision(2) << value << " m/s";
+        std::string text = out.str();
+        benchmark::DoNotOptimize(text);
+    }
+    state.SetItemsProcessed(state.iterations());
+    reportCounters(state, allocations, nullptr);
+}
+BENCHMARK(BM_FormatStringstream);
+
+// Startup geometry: cube, arrow and the ground tile of every level of detail
+static void BM_BuildMeshes(benchmark::State& state) {
+    long allocations = allocationCount.load();
+    for (auto _ : state) {
+        std::vector<MeshVertex> cube = buildCubeMesh();
+        std::vector<MeshVertex> arrow = buildArrowMesh();
+        benchmark::DoNotOptimize(cube.data());
+        benchmark::DoNotOptimize(arrow.data());
+        for (int lod = 0; lod < TILE_LODS; lod++) {
+            std::vector<MeshVertex> ground = buildGroundTileMesh(TILE_LOD_SPACING[lod]);
+            benchmark::DoNotOptimize(ground.data());
+        }
+    }
+    reportCounters(state, allocations, nullptr);
+}
+BENCHMARK(BM_BuildMeshes);
+
+// Function to set up main.cpp's follow camera behind a car at (x, z)
+// heading along +x, at 16:9
+static glm::mat4 benchCamera(float x, float z, glm::vec3& eye) {
+    eye = glm::vec3(x - 8.0f, 5.0f, z);
+    glm::mat4 view = glm::lookAt(eye, glm::vec3(x, 0.5f, z), glm::vec3(0.0f, 1.0f, 0.0f));
+    return glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 1000.0f) * view;
+}
+
+// Per-frame scene submission: map the instance buffer, write every car
+// and its load arrows, cull and draw the ground tiles, bodies and arrows
+static void BM_SubmitFrame(benchmark::State& state) {
+    static Renderer renderer;
+    initRenderer(renderer);
+    GLsizei cars = (GLsizei)state.range(0);
+    glm::vec3 eye;
+    glm::mat4 viewProj = benchCamera(0.0f, 4.0f, eye);
+    float loads[CORNER_COUNT] = { 3500.0f, 3900.0f, 3600.0f, 4000.0f };
+    reserveInstances(renderer, cars);
+
+    long allocations = allocationCount.load();
+    MockGLStats gl = mockGL.stats;
+    for (auto _ : state) {
+        MeshInstance* bodies;
+        MeshInstance* arrows;
+        beginInstances(renderer, cars, &bodies, &arrows);
+        for (GLsizei k = 0; k < cars; k++) {
+            writeCarInstances(&bodies[k], &arrows[k * CORNER_COUNT], 6.0f * k, 0.5f, 4.0f, 0.01f * k,
+                              4.5f, 1.8f, 1.25f, 1.25f, 1.6f, loads);
+        }
+        drawScene(renderer, viewProj, eye, cars);
+    }
+    state.SetItemsProcessed(state.iterations() * cars);
+    reportCounters(state, allocations, &gl);
+}
+BENCHMARK(BM_SubmitFrame)->Arg(1)->Arg(1000);
+
+// World rendering per frame while driving the straight of an oval whose
+// straights are N km long at 50 m/s and 60 frames/s: stream the track
+// tiles, cull and draw ground and track. The cost should not grow with
+// the course; 'resident' is the track tiles held in GPU buffers.
+static void BM_WorldFrame(benchmark::State& state) {
+    static Track track;
+    float straight = 1000.0f * (float)state.range(0);
+    makeOvalTrack(track, (size_t)(2.5f * straight), makeDefaultDriverParams(), straight);
+    static Renderer renderer;
+    initRenderer(renderer);
+    TileStreamer tiles;
+    startTileStreamer(tiles, track.x, track.z);
+
+    // Start with the tiles around the start line resident
+    glm::vec3 eye;
+    glm::mat4 viewProj = benchCamera(0.0f, 0.0f, eye);
+    do {
+        streamTrackTiles(renderer, tiles, eye);
+        std::this_thread::yield();
+    } while (!tiles.indexed.load() || renderer.trackTiles.size() != tiles.wanted.size());
+
+    long allocations = allocationCount.load();
+    MockGLStats gl = mockGL.stats;
+    float x = 0.0f;
+    size_t resident = 0;
+    for (auto _ : state) {
+        x = x + 50.0f / 60.0f < straight ? x + 50.0f / 60.0f : 0.0f;
+        viewProj = benchCamera(x, 0.0f, eye);
+        MeshInstance* bodies;
+        MeshInstance* arrows;
+        beginInstances(renderer, 0, &bodies, &arrows);
+        streamTrackTiles(renderer, tiles, eye);
+        drawScene(renderer, viewProj, eye, 0);
+        resident += renderer.trackTiles.size();
+    }
+    stopTileStreamer(tiles);
+    for (auto& tile : renderer.trackTiles)
+        deleteMesh(tile.second.mesh);
+    renderer.trackTiles.clear();
+    state.SetItemsProcessed(state.iterations());
+    state.counters["resident"] = benchmark::Counter((double)resident, benchmark::Counter::kAvgIterations);
+    reportCounters(state, allocations, &gl);
+}
+BENCHMARK(BM_WorldFrame)->ArgName("km")->Arg(1)->Arg(100);
+
+// Offscreen frame on the CPU: clear, grid, oval track, car, arrows and HUD at 1280x720
+static void BM_SoftRender(benchmark::State& state) {
+    static Track track;
+    parseTrack("oval", track);
+    static SoftScene scene;
+    initSoftScene(scene, track.x, track.z);
+    std::vector<uint8_t> pixels(1280 * 720 * 3);
+    SoftTarget target;
+    initSoftTarget(target, 1280, 720, pixels.data());
+    SoftFrame frame = {};
+    frame.car = makeDefaultCar();
+    placeOnTrack(frame.car, track, 0.0f);
+    frame.step = stepCar(frame.car, 0.0f);
+    computeCornerLoads(frame.car, frame.step.a_lat, frame.wheelLoads);
+    frame.onTrack = true;
+
+    long allocations = allocationCount.load();
+    for (auto _ : state) {
+        renderSoftFrame(target, scene, frame);
+        benchmark::DoNotOptimize(pixels.data());
+        frame.time += 1.0 / 30.0;
+    }
+    state.SetItemsProcessed(state.iterations());
+    reportCounters(state, allocations, nullptr);
+}
+BENCHMARK(BM_SoftRender);
+
+// Encoding one rendered 1280x720 frame, discarded to /dev/null
+static void BM_EncodeFrame(benchmark::State& state) {
+    static SoftScene scene;
+    initSoftScene(scene, std::vector<float>(), std::vector<float>());
+    std::vector<uint8_t> pixels(1280 * 720 * 3);
+    SoftTarget target;
+    initSoftTarget(target, 1280, 720, pixels.data());
+    SoftFrame frame = {};
+    frame.car = makeDefaultCar();
+    frame.step = stepCar(frame.car, 0.0f);
+    computeCornerLoads(frame.car, frame.step.a_lat, frame.wheelLoads);
+    renderSoftFrame(target, scene, frame);
+    FILE* sink = fopen("/dev/null", "wb");
+    PngScratch scratch;
+
+    long allocations = allocationCount.load();
+    for (auto _ : state) {
+        bool ok = state.range(0) == FRAME_PNG ? writePng(sink, pixels.data(), 1280, 720, false, scratch)
+                                              : writePpm(sink, pixels.data(), 1280, 720, false);
+        benchmark::DoNotOptimize(ok);
+    }
+    state.SetBytesProcessed(state.iterations() * (int64_t)pixels.size());
+    reportCounters(state, allocations, nullptr);
+    fclose(sink);
+}
+BENCHMARK(BM_EncodeFrame)->ArgName("png")->Arg(FRAME_PPM)->Arg(FRAME_PNG);
+
+// Per-frame HUD as main() drives it: six readouts that all change every
+// frame (the worst case), then the glyph rebuild and one multi-draw
+static void BM_HudFrame(benchmark::State& state) {
+    static Renderer renderer;
+    static Hud hud;
+    initRenderer(renderer);
+    initHud(hud, renderer, 10.0f, 20.0f);
+    int lines[6] = {
+        addHudLine(hud, "Speed: ", " m/s", 2),
+        addHudLine(hud, "Acceleration: ", " m/s^2", 2),
+        addHudLine(hud, "Steering Angle: ", " degrees", 2),
+        addHudLine(hud, "Heading: ", " degrees", 2),
+        addHudLine(hud, "Front Normal Load: ", " N", 2),
+        addHudLine(hud, "Rear Normal Load: ", " N", 2),
+    };
+    float value = 0.0f;
+
+    long allocations = allocationCount.load();
+    MockGLStats gl = mockGL.stats;
+    for (auto _ : state) {
+        value += 0.37f;
+        for (int line : lines)
+            setHudValue(hud, line, value * (float)(line + 1));
+        drawHud(hud, renderer, 1280, 720);
+    }
+    reportCounters(state, allocations, &gl);
+}
+BENCHMARK(BM_HudFrame);
+
+// Cost of one PROFILE_ZONE around an empty block: what every zone adds
+static void BM_ProfileZone(benchmark::State& state) {
+    initProfiler();
+    long allocations = allocationCount.load();
+    for (auto _ : state) {
+        PROFILE_ZONE("bench");
+        benchmark::ClobberMemory();
+    }
+    reportCounters(state, allocations, nullptr);
+}
+BENCHMARK(BM_ProfileZone);
+
+// Per-frame profiler work in main(): seven zones, profileFrame() and the
+// overlay, averaged over its rebuild period
+static void BM_ProfileFrame(benchmark::State& state) {
+    static Renderer renderer;
+    static ProfilerOverlay overlay;
+    initRenderer(renderer);
+    initProfiler();
+    static const char* const ZONES[7] = { "input", "physics", "scene", "hud", "overlay", "swap", "events" };
+    uint32_t zones[7];
+    for (int z = 0; z < 7; z++)
+        zones[z] = registerProfileZone(ZONES[z]);
+    for (int f = 0; f < PROFILE_WINDOW; f++)
+        profileFrame();
+
+    long allocations = allocationCount.load();
+    MockGLStats gl = mockGL.stats;
+    for (auto _ : state) {
+        for (int z = 0; z < 7; z++) {
+            ProfileScope scope(zones[z]);
+        }
+        profileFrame();
+        drawProfilerOverlay(overlay, renderer, 1280, 720, 1280.0f - PROFILE_OVERLAY_WIDTH, 20.0f);
+    }
+    reportCounters(state, allocations, &gl);
+}
+BENCHMARK(BM_ProfileFrame);
+
+// Reporter that prints as usual and keeps each run's real time (ns) by name
+class CollectingReporter : public benchmark::ConsoleReporter {
+public:
+    std::map<std::string, double> realTimes;
+
+    explicit CollectingReporter(OutputOptions options) : ConsoleReporter(options) {}
+
+    void ReportRuns(const std::vector<Run>& runs) override {
+        for (const Run& run : runs) {
+            double toNs = run.time_unit == benchmark::kSecond ? 1e9
+                        : run.time_unit == benchmark::kMillisecond ? 1e6
+                        : run.time_unit == benchmark::kMicrosecond ? 1e3 : 1.0;
+            realTimes[run.benchmark_name()] = run.GetAdjustedRealTime() * toNs;
+        }
+        ConsoleReporter::ReportRuns(runs);
+    }
+};
+
+// Function to read name -> real_time (ns) from a Google Benchmark JSON file
+static bool loadBaseline(const char* path, std::map<std::string, double>& realTimes) {
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return false;
+    std::string json;
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        json.append(buffer, n);
+    fclose(file);
+
+    // Each entry of "benchmarks" has "name", then "real_time" and "time_unit"
+    size_t pos = json.find("\"benchmarks\"");
+    while (pos != std::string::npos && (pos = json.find("\"name\": \"", pos)) != std::string::npos) {
+        size_t begin = pos + 9;
+        size_t end = json.find('"', begin);
+        size_t timePos = json.find("\"real_time\": ", end);
+        size_t unitPos = json.find("\"time_unit\": \"", end);
+        if (end == std::string::npos || timePos == std::string::npos || unitPos == std::string::npos)
+            break;
+        double value = atof(json.c_str() + timePos + 13);
+        std::string unit = json.substr(unitPos + 14, 2);
+        double toNs = unit == "ms" ? 1e6 : unit == "us" ? 1e3 : unit[0] == 's' ? 1e9 : 1.0;
+        realTimes[json.substr(begin, end - begin)] = value * toNs;
+        pos = end;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const char* baselinePath = nullptr;
+    double threshold = 10.0;
+    bool color = isatty(STDOUT_FILENO) != 0;
+
+    // Take our flags out before Google Benchmark sees the rest
+    int kept = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--baseline=", 11) == 0)
+            baselinePath = argv[i] + 11;
+        else if (strncmp(argv[i], "--threshold=", 12) == 0)
+            threshold = atof(argv[i] + 12);
+        else
+            argv[kept++] = argv[i];
+        if (strcmp(argv[i], "--benchmark_color=false") == 0)
+            color = false;
+    }
+    argc = kept;
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+
+    CollectingReporter reporter(color ? benchmark::ConsoleReporter::OO_ColorTabular
+                                      : benchmark::ConsoleReporter::OO_Tabular);
+    benchmark::RunSpecifiedBenchmarks(&reporter);
+    benchmark::Shutdown();
+
+    if (!baselinePath)
+        return 0;
+
+    std::map<std::string, double> baseline;
+    if (!loadBaseline(baselinePath, baseline)) {
+        fprintf(stderr, "Failed to read baseline %s\n", baselinePath);
+        return 1;
+    }
+
+    int regressions = 0;
+    printf("\nComparison with %s (threshold %.1f%%):\n", baselinePath, threshold);
+    for (const auto& entry : reporter.realTimes) {
+        auto old = baseline.find(entry.first);
+        if (old == baseline.end() || old->second <= 0.0)
+            continue;
+        double change = (entry.second / old->second - 1.0) * 100.0;
+        bool regressed = change > threshold;
+        regressions += regressed;
+        printf("%-40s %12.2f ns -> %12.2f ns  %+7.1f%%%s\n", entry.first.c_str(), old->second, entry.second,
+               change, regressed ? "  REGRESSION" : "");
+    }
+    return regressions > 0 ? 1 : 0;
+}
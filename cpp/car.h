@@ -0,0 +1,295 @@
+// car.h
+//
+// Vehicle state, parameters and the bicycle-model update. Nothing in here
+// touches GLFW or OpenGL, so the same step can drive the interactive window
+// (main.cpp) and the display-less batch runner (headless.cpp).
+
+#pragma once
+
+#include <cmath>
+
+#include "fastmath.h"
+
+// Constants (constexpr so vehicle definitions can be folded at compile time)
+constexpr float PI = 3.14159265358979323846f;
+constexpr float DEG2RAD = PI / 180.0f;
+constexpr float RAD2DEG = 180.0f / PI;
+constexpr float GRAVITY = 9.81f;
+
+// Speed limits applied after every step (m/s)
+const float MAX_FORWARD_SPEED = 55.0f;
+const float MAX_REVERSE_SPEED = -20.0f;
+
+// Steering rate when the driver holds full lock (radians per second)
+const float STEER_SPEED = 1.5f;
+
+// Define the initial position and orientation of the car
+struct Car {
+    // Position and orientation
+    float x, y, z;            // Position in world coordinates
+    float heading;            // Heading angle (radians)
+    float velocity;           // Speed (m/s)
+    float acceleration;       // Acceleration along the car's axis (m/s^2)
+    float steerAngle;         // Steering angle (radians)
+    float yawRate;            // Yaw rate (radians per second)
+
+    // Vehicle parameters
+    float mass;               // Mass of the car (kg)
+    float length;             // Total length of the car (m)
+    float width;              // Width of the car (m)
+    float wheelbase;          // Distance between front and rear axles (m)
+    float lf;                 // Distance from CG to front axle (m)
+    float lr;                 // Distance from CG to rear axle (m)
+    float Iz;                 // Yaw moment of inertia (kg·m²)
+    float Cf;                 // Cornering stiffness front (N/rad)
+    float Cr;                 // Cornering stiffness rear (N/rad)
+    float maxSteer;           // Maximum steering angle (radians)
+    float maxAcceleration;    // Maximum acceleration (m/s²)
+    float maxDeceleration;    // Maximum deceleration (m/s²)
+    float h_cg;               // Height of the center of gravity (m)
+    float trackWidth;         // Width between left and right wheels (m)
+};
+
+// Driver commands, normalized to [-1, 1]. The keyboard produces these in
+// processInput(); the headless runner produces them from a script.
+struct DriverInput {
+    float steer;              // +1 = steer left (A), -1 = steer right (D)
+    float throttle;           // +1 = accelerate (W), -1 = brake/reverse (S), 0 = coast
+};
+
+// Quantities computed during a step that are not part of the car state
+struct StepOutput {
+    float beta;               // Slip angle at the center of gravity (radians)
+    float a_lat;              // Lateral acceleration (m/s²)
+    float Fz_front;           // Front axle normal load (N)
+    float Fz_rear;            // Rear axle normal load (N)
+};
+
+// Wheel corners, in the order used by every per-wheel array
+enum Corner {
+    FRONT_LEFT,
+    FRONT_RIGHT,
+    REAR_LEFT,
+    REAR_RIGHT,
+    CORNER_COUNT
+};
+
+// Fixed parameters of a vehicle design, the same fields as in Car. A
+// production car is a constexpr VehicleParams; StaticBicycle<> then folds
+// its derived coefficients into the step at compile time.
+struct VehicleParams {
+    float mass;               // Mass of the car (kg)
+    float length;             // Total length of the car (m)
+    float width;              // Width of the car (m)
+    float wheelbase;          // Distance between front and rear axles (m)
+    float lf;                 // Distance from CG to front axle (m)
+    float lr;                 // Distance from CG to rear axle (m)
+    float Iz;                 // Yaw moment of inertia (kg·m²)
+    float Cf;                 // Cornering stiffness front (N/rad)
+    float Cr;                 // Cornering stiffness rear (N/rad)
+    float maxSteer;           // Maximum steering angle (radians)
+    float maxAcceleration;    // Maximum acceleration (m/s²)
+    float maxDeceleration;    // Maximum deceleration (m/s²)
+    float h_cg;               // Height of the center of gravity (m)
+    float trackWidth;         // Width between left and right wheels (m)
+};
+
+// The simulator's default car
+constexpr VehicleParams DEFAULT_VEHICLE = {
+    1500.0f,                  // mass (kg)
+    4.5f,                     // length (m)
+    1.8f,                     // width (m)
+    2.5f,                     // wheelbase (m)
+    1.25f,                    // lf (m)
+    1.25f,                    // lr (m)
+    2250.0f,                  // Iz (kg·m²)
+    80000.0f,                 // Cf (N/rad)
+    80000.0f,                 // Cr (N/rad)
+    30.0f * DEG2RAD,          // maxSteer (radians)
+    5.0f,                     // maxAcceleration (m/s²)
+    -10.0f,                   // maxDeceleration (m/s²)
+    0.55f,                    // h_cg (m)
+    1.6f                      // trackWidth (m)
+};
+
+// Function to create a car of design 'params' at rest at the origin
+inline Car makeCar(const VehicleParams& params) {
+    Car car = {
+        // Initial position and orientation
+        0.0f, 0.5f, 0.0f,         // x, y, z
+        0.0f,                     // heading
+        0.0f,                     // velocity
+        0.0f,                     // acceleration
+        0.0f,                     // steerAngle
+        0.0f,                     // yawRate
+
+        // Vehicle parameters
+        params.mass, params.length, params.width, params.wheelbase, params.lf, params.lr, params.Iz,
+        params.Cf, params.Cr, params.maxSteer, params.maxAcceleration, params.maxDeceleration,
+        params.h_cg, params.trackWidth
+    };
+    return car;
+}
+
+// Function to create the default car used by the simulator
+inline Car makeDefaultCar() {
+    return makeCar(DEFAULT_VEHICLE);
+}
+
+// Coefficients of the bicycle step that depend only on the vehicle
+// parameters. The SIMD fleet stores the same terms per car.
+struct BicycleCoefficients {
+    float invWheelbase;       // 1 / wheelbase (1/m)
+    float betaGain;           // lr / (lf + lr)
+    float Fz_front_static;    // Front axle load at rest (N)
+    float Fz_rear_static;     // Rear axle load at rest (N)
+    float longTransfer;       // Axle load transfer per m/s² of acceleration (kg)
+    float latTransfer;        // Per-axle load transfer per m/s² of lateral acceleration (kg)
+};
+
+// Function to derive the bicycle coefficients from a Car or VehicleParams
+template <typename Params>
+constexpr BicycleCoefficients makeBicycleCoefficients(const Params& p) {
+    return BicycleCoefficients{
+        1.0f / p.wheelbase,
+        p.lr / (p.lf + p.lr),
+        (p.lr / p.wheelbase) * p.mass * GRAVITY,
+        (p.lf / p.wheelbase) * p.mass * GRAVITY,
+        (p.h_cg / p.wheelbase) * p.mass,
+        (p.h_cg / p.trackWidth) * p.mass * 0.5f,
+    };
+}
+
+// Bicycle step configuration fixed at compile time: a car built with
+// makeCar(Params) steps with constants in place of per-step arithmetic
+template <const VehicleParams& Params>
+struct StaticBicycle {
+    static constexpr BicycleCoefficients coefficients = makeBicycleCoefficients(Params);
+};
+
+// Bicycle step configuration computed at run time, once per car (sweeps)
+struct RuntimeBicycle {
+    BicycleCoefficients coefficients;
+};
+
+// Function to precompute the run-time configuration of 'car'
+inline RuntimeBicycle makeRuntimeBicycle(const Car& car) {
+    return RuntimeBicycle{ makeBicycleCoefficients(car) };
+}
+
+// Function to turn driver commands into a steering angle and acceleration
+inline void applyDriverInput(Car& car, const DriverInput& input, float dt) {
+    // Update steering angle
+    car.steerAngle += STEER_SPEED * input.steer * dt;
+    if (car.steerAngle > car.maxSteer)
+        car.steerAngle = car.maxSteer;
+    if (car.steerAngle < -car.maxSteer)
+        car.steerAngle = -car.maxSteer;
+
+    // Update acceleration
+    if (input.throttle > 0.0f) {
+        car.acceleration = car.maxAcceleration * input.throttle;
+    } else if (input.throttle < 0.0f) {
+        car.acceleration = -car.maxDeceleration * input.throttle;
+    } else {
+        // Apply rolling resistance and aerodynamic drag when no input
+        float rollingResistance = -0.015f * car.velocity;
+        float aerodynamicDrag = -0.001f * car.velocity * fabsf(car.velocity);
+        car.acceleration = rollingResistance + aerodynamicDrag;
+    }
+}
+
+// Function to advance the vehicle dynamics by dt using the bicycle model.
+// 'Config' is StaticBicycle<> or RuntimeBicycle and supplies the vehicle
+// coefficients; the car's own parameter fields are not read. 'Math' is a
+// fastmath.h policy; tan(steerAngle) is evaluated once and shared by the
+// slip angle, lateral acceleration and yaw rate.
+template <typename Math = DefaultMath, typename Config>
+inline StepOutput stepBicycle(Car& car, const Config& config, float dt) {
+    const BicycleCoefficients& k = config.coefficients;
+    StepOutput out;
+    float tanSteer = Math::tan(car.steerAngle);
+    float curvature = tanSteer * k.invWheelbase;
+
+    // Slip angle at vehicle center of gravity
+    out.beta = 0.0f;
+    if (fabsf(car.velocity) > 0.1f) {
+        out.beta = Math::atan2(k.betaGain * tanSteer, 1.0f);
+    }
+
+    // Lateral acceleration
+    out.a_lat = car.velocity * car.velocity * curvature;
+
+    // Longitudinal acceleration is car.acceleration
+
+    // Normal loads: static, minus/plus the longitudinal transfer, minus the
+    // lateral transfer (assumed to affect front and rear axles equally)
+    float deltaFz_long = k.longTransfer * car.acceleration;
+    float deltaFz_lat = k.latTransfer * out.a_lat;
+    out.Fz_front = k.Fz_front_static - deltaFz_long - deltaFz_lat;
+    out.Fz_rear = k.Fz_rear_static + deltaFz_long - deltaFz_lat;
+
+    // Update position and heading
+    float sinCourse, cosCourse;
+    Math::sincos(car.heading + out.beta, &sinCourse, &cosCourse);
+    float velocityX = car.velocity * cosCourse;
+    float velocityZ = car.velocity * sinCourse;
+
+    car.x += velocityX * dt;
+    car.z += velocityZ * dt;
+
+    car.yawRate = car.velocity * curvature;
+    car.heading += car.yawRate * dt;
+
+    // Update velocity
+    car.velocity += car.acceleration * dt;
+
+    // Limit speed
+    if (car.velocity > MAX_FORWARD_SPEED)
+        car.velocity = MAX_FORWARD_SPEED;
+    if (car.velocity < MAX_REVERSE_SPEED)
+        car.velocity = MAX_REVERSE_SPEED;
+
+    return out;
+}
+
+// Function to advance the vehicle dynamics by dt using the bicycle model,
+// deriving the coefficients from the car's parameter fields on every call
+template <typename Math = DefaultMath>
+inline StepOutput stepCar(Car& car, float dt) {
+    return stepBicycle<Math>(car, makeRuntimeBicycle(car), dt);
+}
+
+// Function to split the normal load over the four wheels. Longitudinal
+// transfer is shared evenly by the two wheels of an axle; the total lateral
+// transfer moves load from the left wheels (inside for a_lat > 0) to the
+// right ones, split between the axles in proportion to their static load.
+// Unlike StepOutput's axle loads the four corners always sum to m * g.
+inline void computeCornerLoads(const Car& car, float a_lat, float corners[CORNER_COUNT]) {
+    float frontShare = car.lr / car.wheelbase;
+    float deltaFz_long = (car.h_cg / car.wheelbase) * car.mass * car.acceleration;
+    float deltaFz_lat = (car.h_cg / car.trackWidth) * car.mass * a_lat;
+    float front = 0.5f * (frontShare * car.mass * GRAVITY - deltaFz_long);
+    float rear = 0.5f * ((1.0f - frontShare) * car.mass * GRAVITY + deltaFz_long);
+
+    corners[FRONT_LEFT] = front - deltaFz_lat * frontShare;
+    corners[FRONT_RIGHT] = front + deltaFz_lat * frontShare;
+    corners[REAR_LEFT] = rear - deltaFz_lat * (1.0f - frontShare);
+    corners[REAR_RIGHT] = rear + deltaFz_lat * (1.0f - frontShare);
+}
+
+// Function to split the normal load over the four wheels from precomputed
+// coefficients; same result as computeCornerLoads(car, ...) up to rounding
+inline void computeCornerLoads(const BicycleCoefficients& k, float acceleration, float a_lat,
+                               float corners[CORNER_COUNT]) {
+    float frontShare = k.betaGain;
+    float deltaFz_long = k.longTransfer * acceleration;
+    float deltaFz_lat = 2.0f * k.latTransfer * a_lat;
+    float front = 0.5f * (k.Fz_front_static - deltaFz_long);
+    float rear = 0.5f * (k.Fz_rear_static + deltaFz_long);
+
+    corners[FRONT_LEFT] = front - deltaFz_lat * frontShare;
+    corners[FRONT_RIGHT] = front + deltaFz_lat * frontShare;
+    corners[REAR_LEFT] = rear - deltaFz_lat * (1.0f - frontShare);
+    corners[REAR_RIGHT] = rear + deltaFz_lat * (1.0f - frontShare);
+}
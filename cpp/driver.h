@@ -0,0 +1,537 @@
+// driver.h
+//
+// Closed-loop driver that follows a track centerline, for unattended runs.
+//
+// A Track is a closed polyline (a CSV of x,z points or a generated oval)
+// with the arc length at every point, a target speed profile, and a
+// uniform grid over its segments for nearest-segment queries from
+// anywhere. Each driver remembers the segment it was nearest to and the
+// segment holding its lookahead point, and moves both forward by a few
+// segments per step (at 1 kHz a car travels far less than a segment), so
+// a step costs the same on a 100-point and a 100k-point track. The grid
+// is only used to acquire the track, or to find it again after leaving
+// it. A Track is read-only once built, so any number of cars and threads
+// can share one.
+//
+// Steering is pure pursuit: the lookahead point lies
+// Ld = lookaheadMin + lookaheadGain * v along the centerline from the
+// car's projection, and the steering angle is atan(2 L y / d²) for a point
+// at distance d and lateral offset y in the car frame. Speed follows the
+// profile (lateral acceleration and braking limits) with a proportional
+// throttle. Both come out as a DriverInput, so steering rate limits, the
+// motor and the four-wheel model apply exactly as for keyboard input.
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "car.h"
+
+// Grid cells per track at most; the cell size grows to stay under this
+const size_t MAX_TRACK_GRID_CELLS = 1 << 20;
+
+// Smallest grid cell (m). Finer cells hold shorter runs, but a query from
+// off the track searches more rings of them; 8 m was fastest on a
+// 100k-point oval for points up to 20 m away (BM_TrackNearest).
+const float MIN_TRACK_GRID_CELL = 8.0f;
+
+// Off-track distance beyond which the driver re-acquires the track through
+// the grid instead of following its previous segment (m)
+const float TRACK_REACQUIRE_DISTANCE = 10.0f;
+
+// Segments the previous nearest segment may move per step before the
+// driver falls back to the grid
+const int TRACK_MAX_CLIMB = 64;
+
+struct DriverParams {
+    float lookaheadMin;       // Pure-pursuit lookahead at standstill (m)
+    float lookaheadGain;      // Lookahead per m/s of speed (s)
+    float maxLatAccel;        // Lateral acceleration the speed profile allows (m/s²)
+    float maxBrake;           // Deceleration the speed profile plans with (m/s²)
+    float maxSpeed;           // Speed on straights (m/s)
+    float speedGain;          // Throttle per m/s of speed error (s/m)
+};
+
+// Uniform grid over the track segments, in compressed rows. A dense
+// centerline crosses a cell in a run of consecutive segments, so cells
+// list runs: cell c holds segments runFirst[k] .. runLast[k] for k in
+// [cellStart[c], cellStart[c + 1]).
+struct TrackGrid {
+    float originX, originZ;   // Corner of cell (0, 0) (m)
+    float cellSize;           // (m)
+    float invCellSize;
+    int columns, rows;
+    std::vector<uint32_t> cellStart;
+    std::vector<uint32_t> runFirst;
+    std::vector<uint32_t> runLast;
+};
+
+// Closed centerline; segment i runs from point i to point (i + 1) % n
+struct Track {
+    std::vector<float> x, z;          // Points (m)
+    std::vector<float> s;             // Arc length at each point, s[n] = length (m)
+    std::vector<float> targetSpeed;   // Speed profile at each point (m/s)
+    float length;                     // (m)
+    DriverParams params;              // Used for the profile and by the drivers
+    TrackGrid grid;
+};
+
+// Per-car driver state
+struct DriverState {
+    int32_t segment;          // Nearest segment at the last step, -1 before the first
+    int32_t target;           // Segment holding the lookahead point
+    float distance;           // Arc length driven from the start line, negative before reaching it (m)
+    float crossTrack;         // Offset from the centerline, left positive (m)
+    int laps;                 // Completed laps
+    float lapStart;           // Time the current lap began (s)
+    float lastLap;            // Duration of the last completed lap (s)
+    float bestLap;            // Fastest completed lap (s), INFINITY before the first
+};
+
+// Function to get the default driver tuning
+inline DriverParams makeDefaultDriverParams() {
+    DriverParams params = {
+        4.0f,                     // lookaheadMin (m)
+        0.4f,                     // lookaheadGain (s)
+        6.0f,                     // maxLatAccel (m/s²)
+        6.0f,                     // maxBrake (m/s²)
+        40.0f,                    // maxSpeed (m/s)
+        0.5f                      // speedGain (s/m)
+    };
+    return params;
+}
+
+// Function to create a driver that has not seen the track yet
+inline DriverState makeDriverState(float t = 0.0f) {
+    DriverState state = { -1, -1, 0.0f, 0.0f, 0, t, 0.0f, INFINITY };
+    return state;
+}
+
+// Function to get the squared distance from (px, pz) to segment i and the
+// position t in [0, 1] of the closest point along it
+inline float segmentDistance2(const Track& track, int i, float px, float pz, float* t) {
+    int j = i + 1 < (int)track.x.size() ? i + 1 : 0;
+    float ax = track.x[i], az = track.z[i];
+    float dx = track.x[j] - ax, dz = track.z[j] - az;
+    float len2 = dx * dx + dz * dz;
+    float u = len2 > 0.0f ? ((px - ax) * dx + (pz - az) * dz) / len2 : 0.0f;
+    u = u < 0.0f ? 0.0f : (u > 1.0f ? 1.0f : u);
+    float ex = ax + u * dx - px, ez = az + u * dz - pz;
+    *t = u;
+    return ex * ex + ez * ez;
+}
+
+// Function to find the nearest of segments first .. last to (px, pz),
+// improving on *best at distance *bestD. Any point of those segments is
+// within (arc length) of both ends of the run, so none is closer than
+// half of (distance to the first point + distance past the last - arc):
+// runs whose bound cannot beat *bestD are dropped, others are halved.
+inline void nearestInRun(const Track& track, uint32_t first, uint32_t last, float px, float pz,
+                         int* best, float* bestD) {
+    size_t n = track.x.size();
+    auto pointDistance = [&](uint32_t i) {
+        size_t k = i < n ? i : 0;
+        return hypotf(track.x[k] - px, track.z[k] - pz);
+    };
+    struct Span { uint32_t first, last; float dFirst, dEnd; };
+    Span stack[64];
+    int top = 0;
+    stack[top++] = { first, last, pointDistance(first), pointDistance(last + 1) };
+    while (top > 0) {
+        Span span = stack[--top];
+        float arc = track.s[span.last + 1] - track.s[span.first];
+        if (0.5f * (span.dFirst + span.dEnd - arc) >= *bestD)
+            continue;
+        if (span.last - span.first < 4 || top >= 62) {
+            for (uint32_t i = span.first; i <= span.last; i++) {
+                float t;
+                float d = sqrtf(segmentDistance2(track, (int)i, px, pz, &t));
+                if (d < *bestD) {
+                    *bestD = d;
+                    *best = (int)i;
+                }
+            }
+            continue;
+        }
+        uint32_t mid = span.first + (span.last - span.first) / 2;
+        float dMid = pointDistance(mid + 1);
+        // Nearer half on top, so it tightens the bound for the other
+        Span lower = { span.first, mid, span.dFirst, dMid };
+        Span upper = { mid + 1, span.last, dMid, span.dEnd };
+        bool lowerFirst = span.dFirst < span.dEnd;
+        stack[top++] = lowerFirst ? upper : lower;
+        stack[top++] = lowerFirst ? lower : upper;
+    }
+}
+
+// Function to find the segment nearest to (px, pz) through the grid. Rings
+// of cells are searched outwards until no unsearched cell can be closer.
+inline int nearestSegment(const Track& track, float px, float pz) {
+    const TrackGrid& g = track.grid;
+    int cx = (int)floorf((px - g.originX) * g.invCellSize);
+    int cz = (int)floorf((pz - g.originZ) * g.invCellSize);
+    cx = cx < 0 ? 0 : (cx >= g.columns ? g.columns - 1 : cx);
+    cz = cz < 0 ? 0 : (cz >= g.rows ? g.rows - 1 : cz);
+
+    int best = -1;
+    float bestD = INFINITY;
+    int maxRing = g.columns > g.rows ? g.columns : g.rows;
+    for (int r = 0; r <= maxRing; r++) {
+        for (int dz = -r; dz <= r; dz++) {
+            int row = cz + dz;
+            if (row < 0 || row >= g.rows)
+                continue;
+            // Full row on the ring's top and bottom edges, two cells otherwise
+            int step = (dz == -r || dz == r) ? 1 : 2 * r;
+            for (int dx = -r; dx <= r; dx += step > 0 ? step : 1) {
+                int column = cx + dx;
+                if (column < 0 || column >= g.columns)
+                    continue;
+                // Skip cells wholly farther than the best segment so far
+                float ex = fmaxf(fmaxf(g.originX + (float)column * g.cellSize - px,
+                                       px - g.originX - (float)(column + 1) * g.cellSize), 0.0f);
+                float ez = fmaxf(fmaxf(g.originZ + (float)row * g.cellSize - pz,
+                                       pz - g.originZ - (float)(row + 1) * g.cellSize), 0.0f);
+                if (ex * ex + ez * ez >= bestD * bestD)
+                    continue;
+                int cell = row * g.columns + column;
+                for (uint32_t k = g.cellStart[cell]; k < g.cellStart[cell + 1]; k++)
+                    nearestInRun(track, g.runFirst[k], g.runLast[k], px, pz, &best, &bestD);
+            }
+        }
+        // Cells of the next ring are at least r cells away from the point
+        if (best >= 0 && (float)r * g.cellSize >= bestD)
+            break;
+    }
+    return best;
+}
+
+// Function to build the grid over the track's segments
+inline void buildTrackGrid(Track& track) {
+    TrackGrid& g = track.grid;
+    size_t n = track.x.size();
+    float minX = track.x[0], maxX = minX, minZ = track.z[0], maxZ = minZ;
+    for (size_t i = 1; i < n; i++) {
+        minX = fminf(minX, track.x[i]);
+        maxX = fmaxf(maxX, track.x[i]);
+        minZ = fminf(minZ, track.z[i]);
+        maxZ = fmaxf(maxZ, track.z[i]);
+    }
+
+    // A few segments per cell, within the cell budget
+    float width = maxX - minX, depth = maxZ - minZ;
+    g.cellSize = fmaxf(4.0f * track.length / (float)n, sqrtf(width * depth / (float)MAX_TRACK_GRID_CELLS));
+    g.cellSize = fmaxf(g.cellSize, MIN_TRACK_GRID_CELL);
+    g.invCellSize = 1.0f / g.cellSize;
+    g.originX = minX - g.cellSize;
+    g.originZ = minZ - g.cellSize;
+    g.columns = (int)(width * g.invCellSize) + 3;
+    g.rows = (int)(depth * g.invCellSize) + 3;
+
+    // Count, prefix-sum, then fill the cells each segment's bounding box covers
+    auto forEachCell = [&](size_t i, auto visit) {
+        size_t j = i + 1 < n ? i + 1 : 0;
+        int x0 = (int)((fminf(track.x[i], track.x[j]) - g.originX) * g.invCellSize);
+        int x1 = (int)((fmaxf(track.x[i], track.x[j]) - g.originX) * g.invCellSize);
+        int z0 = (int)((fminf(track.z[i], track.z[j]) - g.originZ) * g.invCellSize);
+        int z1 = (int)((fmaxf(track.z[i], track.z[j]) - g.originZ) * g.invCellSize);
+        for (int row = z0; row <= z1; row++)
+            for (int column = x0; column <= x1; column++)
+                visit(row * g.columns + column);
+    };
+    std::vector<uint32_t> counts((size_t)g.columns * g.rows + 1, 0);
+    for (size_t i = 0; i < n; i++)
+        forEachCell(i, [&](int cell) { counts[cell + 1]++; });
+    for (size_t c = 1; c < counts.size(); c++)
+        counts[c] += counts[c - 1];
+    std::vector<uint32_t> segments(counts.back());
+    std::vector<uint32_t> fill(counts.begin(), counts.end() - 1);
+    for (size_t i = 0; i < n; i++)
+        forEachCell(i, [&](int cell) { segments[fill[cell]++] = (uint32_t)i; });
+
+    // Segments went in in order, so each cell's list splits into runs
+    g.cellStart.assign(counts.size(), 0);
+    g.runFirst.clear();
+    g.runLast.clear();
+    for (size_t c = 0; c + 1 < counts.size(); c++) {
+        g.cellStart[c] = (uint32_t)g.runFirst.size();
+        for (uint32_t k = counts[c]; k < counts[c + 1]; k++) {
+            if (k > counts[c] && segments[k] == g.runLast.back() + 1) {
+                g.runLast.back() = segments[k];
+            } else {
+                g.runFirst.push_back(segments[k]);
+                g.runLast.push_back(segments[k]);
+            }
+        }
+    }
+    g.cellStart.back() = (uint32_t)g.runFirst.size();
+}
+
+// Function to plan the target speed at every point: the lateral limit from
+// the local curvature (through points about 2.5 m either side, so dense
+// tracks are not noisy), then a backward pass so the car can brake down to
+// every corner
+inline void buildSpeedProfile(Track& track) {
+    const DriverParams& p = track.params;
+    size_t n = track.x.size();
+    track.targetSpeed.assign(n, p.maxSpeed);
+
+    size_t span = (size_t)(2.5f * (float)n / track.length + 0.5f);
+    span = span < 1 ? 1 : (span > (n - 1) / 2 ? (n - 1) / 2 : span);
+    for (size_t i = 0; i < n; i++) {
+        size_t back = (i + n - span) % n;
+        size_t ahead = (i + span) % n;
+
+        // Menger curvature: 4 * triangle area / product of the side lengths
+        float ax = track.x[back] - track.x[i], az = track.z[back] - track.z[i];
+        float bx = track.x[ahead] - track.x[i], bz = track.z[ahead] - track.z[i];
+        float cross = fabsf(ax * bz - az * bx);
+        float sides = sqrtf((ax * ax + az * az) * (bx * bx + bz * bz)
+                            * ((bx - ax) * (bx - ax) + (bz - az) * (bz - az)));
+        float curvature = sides > 0.0f ? 2.0f * cross / sides : 0.0f;
+        if (curvature > 0.0f)
+            track.targetSpeed[i] = fminf(p.maxSpeed, sqrtf(p.maxLatAccel / curvature));
+    }
+
+    // Braking: v² <= v_next² + 2 a ds, twice around so the loop closes
+    for (size_t pass = 0; pass < 2 * n; pass++) {
+        size_t i = n - 1 - pass % n;
+        size_t j = i + 1 < n ? i + 1 : 0;
+        float ds = track.s[i + 1] - track.s[i];
+        float limit = sqrtf(track.targetSpeed[j] * track.targetSpeed[j] + 2.0f * p.maxBrake * ds);
+        track.targetSpeed[i] = fminf(track.targetSpeed[i], limit);
+    }
+}
+
+// Function to finish a track once its points are set: drops a closing
+// point that repeats the first, then builds arc lengths, grid and profile.
+// Returns false for fewer than three distinct points.
+inline bool prepareTrack(Track& track, const DriverParams& params) {
+    size_t n = track.x.size();
+    if (n > 1 && track.x[n - 1] == track.x[0] && track.z[n - 1] == track.z[0]) {
+        track.x.pop_back();
+        track.z.pop_back();
+        n--;
+    }
+    if (n < 3)
+        return false;
+
+    track.params = params;
+    track.s.resize(n + 1);
+    track.s[0] = 0.0f;
+    for (size_t i = 0; i < n; i++) {
+        size_t j = i + 1 < n ? i + 1 : 0;
+        track.s[i + 1] = track.s[i] + hypotf(track.x[j] - track.x[i], track.z[j] - track.z[i]);
+    }
+    track.length = track.s[n];
+    if (!(track.length > 0.0f))
+        return false;
+
+    buildTrackGrid(track);
+    buildSpeedProfile(track);
+    return true;
+}
+
+// Function to load a track from a CSV of "x,z" lines (m). Lines that do
+// not start with a number (headers, '#' comments) are skipped.
+inline bool loadTrack(Track& track, const char* path, const DriverParams& params) {
+    FILE* file = fopen(path, "r");
+    if (!file)
+        return false;
+    track.x.clear();
+    track.z.clear();
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        char* end;
+        float x = strtof(line, &end);
+        if (end == line)
+            continue;
+        while (*end == ',' || *end == ' ' || *end == '\t' || *end == ';')
+            end++;
+        char* zEnd;
+        float z = strtof(end, &zEnd);
+        if (zEnd == end)
+            continue;
+        track.x.push_back(x);
+        track.z.push_back(z);
+    }
+    fclose(file);
+    return prepareTrack(track, params);
+}
+
+// Function to generate a stadium oval of 'points' points: two 'straight'
+// metre straights joined by half circles of 'radius', starting at the
+// origin heading along +x and turning left
+inline bool makeOvalTrack(Track& track, size_t points, const DriverParams& params,
+                          float straight = 200.0f, float radius = 50.0f) {
+    float length = 2.0f * straight + 2.0f * PI * radius;
+    track.x.resize(points);
+    track.z.resize(points);
+    for (size_t i = 0; i < points; i++) {
+        float d = length * (float)i / (float)points;
+        float x, z;
+        if (d < straight) {
+            x = d;
+            z = 0.0f;
+        } else if (d < straight + PI * radius) {
+            float a = (d - straight) / radius;
+            x = straight + radius * sinf(a);
+            z = radius - radius * cosf(a);
+        } else if (d < 2.0f * straight + PI * radius) {
+            x = straight - (d - straight - PI * radius);
+            z = 2.0f * radius;
+        } else {
+            float a = (d - 2.0f * straight - PI * radius) / radius;
+            x = -radius * sinf(a);
+            z = radius + radius * cosf(a);
+        }
+        track.x[i] = x;
+        track.z[i] = z;
+    }
+    return prepareTrack(track, params);
+}
+
+// Function to set up a track from a command-line spec: "oval", "oval:N"
+// (N points) or the path of a CSV file
+inline bool parseTrack(const char* spec, Track& track) {
+    DriverParams params = makeDefaultDriverParams();
+    if (strcmp(spec, "oval") == 0)
+        return makeOvalTrack(track, 1000, params);
+    if (strncmp(spec, "oval:", 5) == 0) {
+        long points = atol(spec + 5);
+        return points >= 3 && makeOvalTrack(track, (size_t)points, params);
+    }
+    return loadTrack(track, spec, params);
+}
+
+// Function to place a car on the centerline 'distance' metres along the
+// track (negative: behind the start), pointing along it
+inline void placeOnTrack(Car& car, const Track& track, float distance) {
+    float d = fmodf(distance, track.length);
+    if (d < 0.0f)
+        d += track.length;
+    // Binary search for the segment holding d
+    size_t lo = 0, hi = track.x.size();
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (track.s[mid] <= d)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    size_t j = lo + 1 < track.x.size() ? lo + 1 : 0;
+    float dx = track.x[j] - track.x[lo], dz = track.z[j] - track.z[lo];
+    float len = track.s[lo + 1] - track.s[lo];
+    float u = len > 0.0f ? (d - track.s[lo]) / len : 0.0f;
+    car.x = track.x[lo] + u * dx;
+    car.z = track.z[lo] + u * dz;
+    car.heading = atan2f(dz, dx);
+}
+
+// Function to compute the driver's input for 'car' at simulation time t;
+// dt is the step the input will be applied over. Math is a fastmath.h policy.
+template <typename Math = DefaultMath>
+DriverInput trackDriverInput(const Track& track, DriverState& state, const Car& car, float t, float dt) {
+    const DriverParams& p = track.params;
+    int n = (int)track.x.size();
+    auto next = [n](int i) { return i + 1 < n ? i + 1 : 0; };
+    auto back = [n](int i) { return i > 0 ? i - 1 : n - 1; };
+
+    // Nearest segment: climb from the previous one, or ask the grid
+    float u = 0.0f;
+    int i = state.segment;
+    float d2 = INFINITY;
+    if (i >= 0) {
+        d2 = segmentDistance2(track, i, car.x, car.z, &u);
+        int moved = 0;
+        for (int dir = 0; dir < 2; dir++) {
+            for (; moved < TRACK_MAX_CLIMB; moved++) {
+                int k = dir == 0 ? next(i) : back(i);
+                float tk;
+                float dk = segmentDistance2(track, k, car.x, car.z, &tk);
+                if (dk >= d2)
+                    break;
+                i = k;
+                d2 = dk;
+                u = tk;
+            }
+        }
+        if (moved >= TRACK_MAX_CLIMB || d2 > TRACK_REACQUIRE_DISTANCE * TRACK_REACQUIRE_DISTANCE)
+            i = -1;
+    }
+    if (i < 0) {
+        i = nearestSegment(track, car.x, car.z);
+        d2 = segmentDistance2(track, i, car.x, car.z, &u);
+        state.target = -1;
+    }
+
+    // Progress along the track and lap timing. A lap is timed from one
+    // forward crossing of the start line to the next, or from the start of
+    // the run for a car that starts on the line; a car first seen anywhere
+    // else counts as short of the line.
+    float segmentLength = track.s[i + 1] - track.s[i];
+    float along = track.s[i] + u * segmentLength;
+    float previous = state.distance;
+    if (state.segment < 0 && state.laps == 0) {
+        previous = along > 1.0f ? along - track.length : along;
+        state.distance = previous;
+    } else {
+        float delta = along - (previous - track.length * floorf(previous / track.length));
+        delta -= delta > 0.5f * track.length ? track.length : (delta < -0.5f * track.length ? -track.length : 0.0f);
+        state.distance = previous + delta;
+    }
+    int lapBefore = (int)floorf(previous / track.length);
+    int lapAfter = (int)floorf(state.distance / track.length);
+    if (lapAfter > lapBefore && lapAfter > state.laps) {
+        state.laps = lapAfter;
+        state.lastLap = t - state.lapStart;
+        state.bestLap = fminf(state.bestLap, state.lastLap);
+        state.lapStart = t;
+    } else if (lapAfter > lapBefore && lapAfter == 0) {
+        state.lapStart = t;
+    }
+    int j = next(i);
+    float dx = track.x[j] - track.x[i], dz = track.z[j] - track.z[i];
+    state.crossTrack = segmentLength > 0.0f
+        ? (-(car.x - track.x[i]) * dz + (car.z - track.z[i]) * dx) / segmentLength : 0.0f;
+    state.segment = i;
+
+    // Lookahead point: walk the target segment forward from where it was.
+    // 'ahead' is the arc from point i to the start of a segment.
+    float lookahead = fminf(p.lookaheadMin + p.lookaheadGain * fabsf(car.velocity), 0.5f * track.length);
+    float need = u * segmentLength + lookahead;
+    auto ahead = [&](int k) {
+        float a = track.s[k] - track.s[i];
+        return a < 0.0f ? a + track.length : a;
+    };
+    int target = state.target >= 0 && ahead(state.target) <= need ? state.target : i;
+    for (int guard = 0; guard < n && ahead(target) + (track.s[target + 1] - track.s[target]) <= need; guard++)
+        target = next(target);
+    state.target = target;
+    float targetLength = track.s[target + 1] - track.s[target];
+    float v = targetLength > 0.0f ? (need - ahead(target)) / targetLength : 0.0f;
+    int targetNext = next(target);
+    float px = track.x[target] + v * (track.x[targetNext] - track.x[target]);
+    float pz = track.z[target] + v * (track.z[targetNext] - track.z[target]);
+
+    // Pure pursuit in the car frame: +x forward, +y left
+    float s, c;
+    Math::sincos(car.heading, &s, &c);
+    float lx = (px - car.x) * c + (pz - car.z) * s;
+    float ly = -(px - car.x) * s + (pz - car.z) * c;
+    float steer = Math::atan2(2.0f * car.wheelbase * ly, lx * lx + ly * ly);
+    steer = fminf(fmaxf(steer, -car.maxSteer), car.maxSteer);
+
+    // Speed profile at the car's projection
+    float targetSpeed = track.targetSpeed[i] + u * (track.targetSpeed[j] - track.targetSpeed[i]);
+
+    DriverInput input;
+    input.steer = fminf(fmaxf((steer - car.steerAngle) / (STEER_SPEED * dt), -1.0f), 1.0f);
+    input.throttle = fminf(fmaxf(p.speedGain * (targetSpeed - car.velocity), -1.0f), 1.0f);
+    return input;
+}
@@ -0,0 +1,126 @@
+// fastmath.h
+//
+// Compile-time math policies for the scalar vehicle steps. A policy is a
+// struct of static tan / atan2 / sincos functions. stepCar() and
+// stepVehicle4W() take one as a template parameter, so the choice costs
+// nothing at run time:
+//
+//   LibmMath    the C library; the reference, and bit-identical to the
+//               steps before policies existed
+//   PolyMath    the branch-free rational and polynomial approximations of
+//               simd.h (the ones the SIMD fleet kernel uses)
+//   TableMath   linearly interpolated lookup tables
+//
+// Max absolute error against double-precision libm, and time per call,
+// as measured by the BM_Math* benchmarks in bench.cpp (glibc 2.36, -march=native on AVX-512):
+//
+//               tan, |x| < 80°       atan2               sincos, |x| < 100
+//   LibmMath    2.5e-7  10.8 ns      2.4e-7  8.9 ns      3.3e-8  4.8 ns
+//   PolyMath    2.1e-6   2.7 ns      2.5e-7  4.3 ns      9.2e-8  5.1 ns
+//   TableMath   2.4e-6   4.4 ns      3.4e-7  3.5 ns      6.3e-6  3.1 ns
+//
+// (tan reaches 5.7 at 80°, so its absolute errors are a few ulp.) Within
+// a whole stepCar() the calls form one dependency chain and the gain is
+// smaller than these numbers suggest; see BM_StepCar.
+//
+// tan is needed over the steering range, |x| <= maxSteer. Both
+// approximations are built for |x| <= pi/4 and use tan(x) = 1 / tan(pi/2 - x)
+// beyond it, so a swept maxSteer past 45° keeps a bounded relative error.
+//
+// DefaultMath, used when a step is called without a policy, is LibmMath
+// unless the build defines TVS_MATH_POLY or TVS_MATH_TABLE.
+
+#pragma once
+
+#include <cmath>
+
+#include "simd.h"
+
+// The C library
+struct LibmMath {
+    static float tan(float x) { return tanf(x); }
+    static float atan2(float y, float x) { return atan2f(y, x); }
+    static void sincos(float x, float* s, float* c) {
+        *s = sinf(x);
+        *c = cosf(x);
+    }
+};
+
+// simd.h approximations
+struct PolyMath {
+    static float tan(float x) { return fastTanWide(x); }
+    static float atan2(float y, float x) { return fastAtan2(y, x); }
+    static void sincos(float x, float* s, float* c) { fastSinCos(x, s, c); }
+};
+
+// Lookup tables, built once at startup from libm
+const int MATH_TABLE_SIZE = 1024;         // intervals per table
+
+struct MathTables {
+    float tan[MATH_TABLE_SIZE + 1];       // tan over [0, pi/4]
+    float atan[MATH_TABLE_SIZE + 1];      // atan over [0, 1]
+    float sin[MATH_TABLE_SIZE + MATH_TABLE_SIZE / 4 + 1]; // sin over 1.25 turns; cos reads a quarter turn on
+};
+
+// Function to fill the lookup tables
+inline MathTables buildMathTables() {
+    MathTables t;
+    for (int i = 0; i <= MATH_TABLE_SIZE; i++) {
+        double u = (double)i / MATH_TABLE_SIZE;
+        t.tan[i] = (float)std::tan(u * M_PI / 4.0);
+        t.atan[i] = (float)std::atan(u);
+    }
+    for (int i = 0; i <= MATH_TABLE_SIZE + MATH_TABLE_SIZE / 4; i++)
+        t.sin[i] = (float)std::sin(2.0 * M_PI * (double)i / MATH_TABLE_SIZE);
+    return t;
+}
+
+inline const MathTables MATH_TABLES = buildMathTables();
+
+// Function to interpolate 'table' at u in [0, MATH_TABLE_SIZE]
+inline float lerpTable(const float* table, float u) {
+    int i = (int)u;
+    i = i < MATH_TABLE_SIZE - 1 ? i : MATH_TABLE_SIZE - 1;
+    float f = u - (float)i;
+    return table[i] + f * (table[i + 1] - table[i]);
+}
+
+struct TableMath {
+    static float tan(float x) {
+        // The table covers [0, pi/4]; tan(x) = 1 / tan(pi/2 - x) beyond it
+        const float PI_2 = 1.57079632679489662f;
+        float a = absf(x);
+        bool reflect = a > 0.785398163397448310f;
+        float t = lerpTable(MATH_TABLES.tan, (reflect ? PI_2 - a : a) * (float)(4.0 / M_PI * MATH_TABLE_SIZE));
+        t = reflect ? 1.0f / t : t;
+        return x < 0.0f ? -t : t;
+    }
+    static float atan2(float y, float x) {
+        // Same octant reduction as fastAtan2(), with the table on [0, 1]
+        const float PI = 3.14159265358979324f;
+        float ax = absf(x);
+        float ay = absf(y);
+        bool steep = ay > ax;
+        float ratio = (steep ? ax : ay) / maxf(maxf(ax, ay), 1e-30f);
+        float t = lerpTable(MATH_TABLES.atan, ratio * (float)MATH_TABLE_SIZE);
+        t = steep ? 1.57079632679489662f - t : t;
+        t = x < 0.0f ? PI - t : t;
+        return y < 0.0f ? -t : t;
+    }
+    static void sincos(float x, float* s, float* c) {
+        // Position in turns, reduced to [0, 1)
+        float turns = x * (float)(0.5 / M_PI);
+        turns -= floorf(turns);
+        float u = turns * (float)MATH_TABLE_SIZE;
+        *s = lerpTable(MATH_TABLES.sin, u);
+        *c = lerpTable(MATH_TABLES.sin + MATH_TABLE_SIZE / 4, u);
+    }
+};
+
+#if defined(TVS_MATH_TABLE)
+typedef TableMath DefaultMath;
+#elif defined(TVS_MATH_POLY)
+typedef PolyMath DefaultMath;
+#else
+typedef LibmMath DefaultMath;
+#endif
@@ -0,0 +1,246 @@
+// fleet.h
+//
+// Structure-of-arrays container for simulating many cars at once. Every
+// state variable and parameter of Car lives in its own 64-byte aligned
+// array, padded to a multiple of SIMD_WIDTH, so stepFleet() can advance
+// SIMD_WIDTH cars per instruction with the kernels from simd.h.
+//
+// Parameters that only appear in derived form in the bicycle model (static
+// axle loads, load-transfer gains, 1/wheelbase) are precomputed once in
+// addCar() instead of being rederived every step.
+
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "car.h"
+#include "simd.h"
+
+// Heap array of floats aligned for vector loads
+struct AlignedArray {
+    float* data;
+
+    AlignedArray() : data(nullptr) {}
+    ~AlignedArray() { free(data); }
+    AlignedArray(const AlignedArray&) = delete;
+    AlignedArray& operator=(const AlignedArray&) = delete;
+
+    // Function to grow the array to 'capacity' floats, keeping the first 'count'
+    void reserve(size_t capacity, size_t count) {
+        float* grown = (float*)aligned_alloc(64, capacity * sizeof(float));
+        if (!grown)
+            throw std::bad_alloc();
+        memset(grown, 0, capacity * sizeof(float));
+        if (data)
+            memcpy(grown, data, count * sizeof(float));
+        free(data);
+        data = grown;
+    }
+
+    float& operator[](size_t i) { return data[i]; }
+    const float& operator[](size_t i) const { return data[i]; }
+};
+
+struct Fleet {
+    size_t count;             // Number of cars
+    size_t capacity;          // Allocated lanes (multiple of 16)
+
+    // State
+    AlignedArray x, z;        // Position in world coordinates (m)
+    AlignedArray heading;     // Heading angle (radians)
+    AlignedArray velocity;    // Speed (m/s)
+    AlignedArray acceleration; // Longitudinal acceleration (m/s²)
+    AlignedArray steerAngle;  // Steering angle (radians)
+    AlignedArray yawRate;     // Yaw rate (radians per second)
+
+    // Driver commands for the next step, normalized to [-1, 1]
+    AlignedArray steerInput;
+    AlignedArray throttleInput;
+
+    // Outputs of the last step
+    AlignedArray a_lat;       // Lateral acceleration (m/s²)
+    AlignedArray Fz_front;    // Front axle normal load (N)
+    AlignedArray Fz_rear;     // Rear axle normal load (N)
+
+    // Parameters, stored in the form the kernel consumes them
+    AlignedArray maxSteer;        // Maximum steering angle (radians)
+    AlignedArray maxAcceleration; // Maximum acceleration (m/s²)
+    AlignedArray maxDeceleration; // Maximum deceleration (m/s²)
+    AlignedArray invWheelbase;    // 1 / wheelbase (1/m)
+    AlignedArray betaGain;        // lr / (lf + lr)
+    AlignedArray Fz_front_static; // lr / wheelbase * mass * g (N)
+    AlignedArray Fz_rear_static;  // lf / wheelbase * mass * g (N)
+    AlignedArray longTransfer;    // h_cg / wheelbase * mass (kg)
+    AlignedArray latTransfer;     // h_cg / trackWidth * mass / 2 (kg), split over both axles
+
+    // Geometry, only read when drawing
+    AlignedArray lf, lr;          // CG to front / rear axle (m)
+    AlignedArray length, width;   // Body size (m)
+    AlignedArray trackWidth;      // Width between left and right wheels (m)
+
+    Fleet() : count(0), capacity(0) {}
+
+    // Function to list every array so allocation stays in one place
+    template <typename F>
+    void forEachArray(F f) {
+        AlignedArray* arrays[] = {
+            &x, &z, &heading, &velocity, &acceleration, &steerAngle, &yawRate,
+            &steerInput, &throttleInput, &a_lat, &Fz_front, &Fz_rear,
+            &maxSteer, &maxAcceleration, &maxDeceleration, &invWheelbase, &betaGain,
+            &Fz_front_static, &Fz_rear_static, &longTransfer, &latTransfer,
+            &lf, &lr, &length, &width, &trackWidth,
+        };
+        for (AlignedArray* a : arrays)
+            f(*a);
+    }
+
+    // Function to make room for at least n cars
+    void reserve(size_t n) {
+        if (n <= capacity)
+            return;
+        size_t grown = capacity ? capacity : 64;
+        while (grown < n)
+            grown *= 2;
+        forEachArray([&](AlignedArray& a) { a.reserve(grown, count); });
+        capacity = grown;
+    }
+
+    // Function to append a car; returns its index
+    size_t addCar(const Car& car) {
+        reserve(count + 1);
+        size_t i = count++;
+        x[i] = car.x;
+        z[i] = car.z;
+        heading[i] = car.heading;
+        velocity[i] = car.velocity;
+        acceleration[i] = car.acceleration;
+        steerAngle[i] = car.steerAngle;
+        yawRate[i] = car.yawRate;
+        steerInput[i] = 0.0f;
+        throttleInput[i] = 0.0f;
+
+        maxSteer[i] = car.maxSteer;
+        maxAcceleration[i] = car.maxAcceleration;
+        maxDeceleration[i] = car.maxDeceleration;
+        BicycleCoefficients k = makeBicycleCoefficients(car);
+        invWheelbase[i] = k.invWheelbase;
+        betaGain[i] = k.betaGain;
+        Fz_front_static[i] = k.Fz_front_static;
+        Fz_rear_static[i] = k.Fz_rear_static;
+        longTransfer[i] = k.longTransfer;
+        latTransfer[i] = k.latTransfer;
+
+        lf[i] = car.lf;
+        lr[i] = car.lr;
+        length[i] = car.length;
+        width[i] = car.width;
+        trackWidth[i] = car.trackWidth;
+        return i;
+    }
+
+    // Function to write the state of car i back into a Car record
+    void getCar(size_t i, Car& car) const {
+        car.x = x[i];
+        car.z = z[i];
+        car.heading = heading[i];
+        car.velocity = velocity[i];
+        car.acceleration = acceleration[i];
+        car.steerAngle = steerAngle[i];
+        car.yawRate = yawRate[i];
+    }
+};
+
+// Function to split car i's normal load over its four wheels after a step;
+// same convention as computeCornerLoads() in car.h
+inline void fleetCornerLoads(const Fleet& fleet, size_t i, float corners[CORNER_COUNT]) {
+    float frontShare = fleet.betaGain[i];
+    float deltaFz_long = fleet.longTransfer[i] * fleet.acceleration[i];
+    float deltaFz_lat = 2.0f * fleet.latTransfer[i] * fleet.a_lat[i];
+    float front = 0.5f * (fleet.Fz_front_static[i] - deltaFz_long);
+    float rear = 0.5f * (fleet.Fz_rear_static[i] + deltaFz_long);
+
+    corners[FRONT_LEFT] = front - deltaFz_lat * frontShare;
+    corners[FRONT_RIGHT] = front + deltaFz_lat * frontShare;
+    corners[REAR_LEFT] = rear - deltaFz_lat * (1.0f - frontShare);
+    corners[REAR_RIGHT] = rear + deltaFz_lat * (1.0f - frontShare);
+}
+
+// Function to build the i-th of n car setups for a fleet run. Mass, CG
+// height and weight distribution are spread evenly across the fleet.
+inline Car makeFleetCar(size_t i, size_t n) {
+    Car car = makeDefaultCar();
+    float u = n > 1 ? (float)i / (float)(n - 1) : 0.5f;
+    car.mass = 1200.0f + 600.0f * u;
+    car.h_cg = 0.45f + 0.2f * u;
+    car.lf = 1.0f + 0.5f * u;
+    car.lr = car.wheelbase - car.lf;
+    return car;
+}
+
+// Function to advance every car in the fleet by dt. Mirrors
+// applyDriverInput() followed by stepCar() lane for lane, with branches
+// turned into selects and libm calls replaced by the simd.h approximations.
+//
+// atan2 is not needed at all: with k = lr * tan(steer) / wheelbase,
+// cos(beta) = 1 / sqrt(1 + k²) and sin(beta) = k * cos(beta), so
+// cos/sin(heading + beta) follow from the angle-sum identities.
+inline void stepFleet(Fleet& fleet, float dt) {
+    const vfloat vdt = splat(dt);
+    const vfloat steerStep = splat(STEER_SPEED * dt);
+
+    for (size_t i = 0; i < fleet.count; i += SIMD_WIDTH) {
+        vfloat velocity = loadv(&fleet.velocity[i]);
+        vfloat steer = loadv(&fleet.steerAngle[i]);
+        vfloat maxSteer = loadv(&fleet.maxSteer[i]);
+        vfloat throttle = loadv(&fleet.throttleInput[i]);
+
+        // Driver input: steering rate limit and clamp
+        steer = steer + steerStep * loadv(&fleet.steerInput[i]);
+        steer = minf(maxf(steer, -maxSteer), maxSteer);
+
+        // Driver input: throttle, brake, or coast-down resistance
+        vfloat coast = -0.015f * velocity - 0.001f * velocity * absf(velocity);
+        vfloat accel = selectf(throttle > 0.0f, loadv(&fleet.maxAcceleration[i]) * throttle,
+                       selectf(throttle < 0.0f, -loadv(&fleet.maxDeceleration[i]) * throttle, coast));
+
+        // Bicycle model
+        vfloat tanSteer = fastTanWide(steer);
+        vfloat invWheelbase = loadv(&fleet.invWheelbase[i]);
+        vfloat k = loadv(&fleet.betaGain[i]) * tanSteer;
+        k = selectf(absf(velocity) > 0.1f, k, splat(0.0f));
+        vfloat cosBeta = fastRsqrt(1.0f + k * k);
+        vfloat sinBeta = k * cosBeta;
+
+        vfloat heading = loadv(&fleet.heading[i]);
+        vfloat sinHeading, cosHeading;
+        fastSinCos(heading, &sinHeading, &cosHeading);
+
+        vfloat curvature = tanSteer * invWheelbase;
+        vfloat a_lat = velocity * velocity * curvature;
+        vfloat yawRate = velocity * curvature;
+
+        // Normal loads with longitudinal and lateral transfer
+        vfloat deltaFz_long = loadv(&fleet.longTransfer[i]) * accel;
+        vfloat deltaFz_lat = loadv(&fleet.latTransfer[i]) * a_lat;
+        storev(&fleet.Fz_front[i], loadv(&fleet.Fz_front_static[i]) - deltaFz_long - deltaFz_lat);
+        storev(&fleet.Fz_rear[i], loadv(&fleet.Fz_rear_static[i]) + deltaFz_long - deltaFz_lat);
+        storev(&fleet.a_lat[i], a_lat);
+
+        // Integrate pose and speed
+        vfloat cosCourse = cosHeading * cosBeta - sinHeading * sinBeta;
+        vfloat sinCourse = sinHeading * cosBeta + cosHeading * sinBeta;
+        storev(&fleet.x[i], loadv(&fleet.x[i]) + velocity * cosCourse * vdt);
+        storev(&fleet.z[i], loadv(&fleet.z[i]) + velocity * sinCourse * vdt);
+        storev(&fleet.heading[i], heading + yawRate * vdt);
+
+        velocity = velocity + accel * vdt;
+        velocity = minf(maxf(velocity, splat(MAX_REVERSE_SPEED)), splat(MAX_FORWARD_SPEED));
+
+        storev(&fleet.velocity[i], velocity);
+        storev(&fleet.acceleration[i], accel);
+        storev(&fleet.steerAngle[i], steer);
+        storev(&fleet.yawRate[i], yawRate);
+    }
+}
@@ -0,0 +1,78 @@
+// frame_capture.h
+//
+// Asynchronous readback of the rendered window into a FrameWriter.
+//
+// glReadPixels into a bound pixel-pack buffer returns at once and the copy
+// runs on the GPU; the buffer is only mapped FRAME_CAPTURE_BUFFERS - 1
+// frames later, when it has long finished, so capturing never stalls the
+// pipeline waiting for the frame just drawn. The mapped pixels go into a
+// free FrameWriter slot (bottom row first, as GL returns them) and are
+// encoded on the writer's threads. If every slot is still busy the frame
+// is dropped rather than holding up the render loop.
+
+#pragma once
+
+#include <GL/glew.h>
+#include <cstring>
+
+#include "frame_writer.h"
+
+// Pixel-pack buffers in flight
+const int FRAME_CAPTURE_BUFFERS = 3;
+
+struct FrameCapture {
+    GLuint pbo[FRAME_CAPTURE_BUFFERS];
+    int width, height;
+    long frame;               // Frames read back so far
+};
+
+// Function to create the pixel-pack buffers for a width x height framebuffer
+inline void initFrameCapture(FrameCapture& capture, int width, int height) {
+    capture.width = width;
+    capture.height = height;
+    capture.frame = 0;
+    glGenBuffers(FRAME_CAPTURE_BUFFERS, capture.pbo);
+    for (int i = 0; i < FRAME_CAPTURE_BUFFERS; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbo[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 3, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+// Function to hand the frame read back into buffer 'index' to the writer
+inline void collectFrame(FrameCapture& capture, FrameWriter& writer, long index) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbo[index % FRAME_CAPTURE_BUFFERS]);
+    size_t size = (size_t)capture.width * capture.height * 3;
+    const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)size, GL_MAP_READ_BIT);
+    if (pixels) {
+        int slot = acquireFrameSlot(writer, false);
+        if (slot >= 0) {
+            memcpy(frameSlotPixels(writer, slot), pixels, size);
+            submitFramePixels(writer, slot, index, true);
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+// Function to start reading back the frame just drawn (call before the
+// buffer swap) and pass on the oldest one still in flight
+inline void captureFrame(FrameCapture& capture, FrameWriter& writer) {
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbo[capture.frame % FRAME_CAPTURE_BUFFERS]);
+    glReadPixels(0, 0, capture.width, capture.height, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    capture.frame++;
+
+    long oldest = capture.frame - FRAME_CAPTURE_BUFFERS;
+    if (oldest >= 0)
+        collectFrame(capture, writer, oldest);
+}
+
+// Function to pass on the frames still in flight and free the buffers
+inline void finishFrameCapture(FrameCapture& capture, FrameWriter& writer) {
+    long first = capture.frame - FRAME_CAPTURE_BUFFERS + 1;
+    for (long index = first > 0 ? first : 0; index < capture.frame; index++)
+        collectFrame(capture, writer, index);
+    glDeleteBuffers(FRAME_CAPTURE_BUFFERS, capture.pbo);
+}
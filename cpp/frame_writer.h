@@ -0,0 +1,421 @@
+// frame_writer.h
+//
+// Pipelined image-sequence output for offscreen frames.
+//
+// A FrameWriter owns a fixed pool of RGB8 frame slots and a set of worker
+// threads. The producer takes a free slot, hands it over with either the
+// pixels already in it (GL readback in main.cpp) or a SoftFrame to
+// rasterize (headless), and goes straight back to simulating; workers
+// render if needed, encode and write DIR/frame_NNNNNN.ppm or .png, and
+// return the slot. Frames are independent, so every worker encodes a
+// different one and throughput scales with the thread count. As with
+// telemetry, a real-time producer never waits for a slot and drops the
+// frame instead; batch runs wait.
+//
+// PNG is written without zlib: one fixed-Huffman deflate block whose only
+// matches are against the previous pixel and the pixel above (distance 3
+// and one row). The scene is flat color and thin lines, so that gets most
+// of what a general LZ77 search would at a fraction of the cost.
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+#include "soft_raster.h"
+
+enum FrameFormat {
+    FRAME_PPM,                // Binary P6, no compression
+    FRAME_PNG,                // RGB8 PNG
+    FRAME_FORMAT_COUNT
+};
+
+const char* const FRAME_FORMAT_NAMES[FRAME_FORMAT_COUNT] = { "ppm", "png" };
+
+// Function to look up an image format by name
+inline bool parseFrameFormat(const char* name, FrameFormat* format) {
+    for (int i = 0; i < FRAME_FORMAT_COUNT; i++) {
+        if (strcmp(name, FRAME_FORMAT_NAMES[i]) == 0) {
+            *format = (FrameFormat)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function to write a P6 PPM; 'bottomUp' pixels (GL readback) are flipped
+inline bool writePpm(FILE* file, const uint8_t* pixels, int width, int height, bool bottomUp) {
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    size_t stride = (size_t)width * 3;
+    for (int y = 0; y < height; y++) {
+        const uint8_t* row = pixels + stride * (bottomUp ? height - 1 - y : y);
+        if (fwrite(row, 1, stride, file) != stride)
+            return false;
+    }
+    return true;
+}
+
+// Deflate output, least significant bit first
+struct DeflateBits {
+    std::vector<uint8_t>* out;
+    uint64_t bits;
+    int count;
+};
+
+inline void putBits(DeflateBits& b, uint32_t value, int length) {
+    b.bits |= (uint64_t)value << b.count;
+    b.count += length;
+    while (b.count >= 8) {
+        b.out->push_back((uint8_t)b.bits);
+        b.bits >>= 8;
+        b.count -= 8;
+    }
+}
+
+// Function to reverse the low 'length' bits (Huffman codes go MSB first)
+inline uint32_t reverseBits(uint32_t code, int length) {
+    uint32_t r = 0;
+    for (int i = 0; i < length; i++)
+        r |= ((code >> i) & 1u) << (length - 1 - i);
+    return r;
+}
+
+// Fixed Huffman code of literal/length symbol 'symbol', ready for putBits()
+inline void fixedLiteralCode(int symbol, uint32_t* code, int* length) {
+    if (symbol < 144) {
+        *code = 0x30 + symbol; *length = 8;
+    } else if (symbol < 256) {
+        *code = 0x190 + symbol - 144; *length = 9;
+    } else if (symbol < 280) {
+        *code = symbol - 256; *length = 7;
+    } else {
+        *code = 0xC0 + symbol - 280; *length = 8;
+    }
+    *code = reverseBits(*code, *length);
+}
+
+// Function to compress 'data' into a zlib stream (fixed Huffman, matches at
+// distances 'pixel' and 'row' only)
+inline void deflateFixed(const uint8_t* data, size_t size, size_t pixel, size_t row, std::vector<uint8_t>& out) {
+    static const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                              35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                              3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const uint16_t DIST_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385,
+                                            513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    static const uint8_t DIST_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7,
+                                            8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    // Code tables: every literal/length symbol, and the two distances
+    uint32_t symbolCode[286];
+    int symbolLength[286];
+    for (int s = 0; s < 286; s++)
+        fixedLiteralCode(s, &symbolCode[s], &symbolLength[s]);
+    uint8_t lengthSymbol[259];
+    for (int i = 0, len = 3; len <= 258; len++) {
+        while (i < 28 && LENGTH_BASE[i + 1] <= len)
+            i++;
+        lengthSymbol[len] = (uint8_t)i;
+    }
+    size_t distances[2] = { pixel, row <= 32768 ? row : 0 };
+    uint32_t distCode[2], distExtra[2];
+    int distExtraBits[2];
+    for (int k = 0; k < 2; k++) {
+        int i = 0;
+        while (i < 29 && DIST_BASE[i + 1] <= distances[k])
+            i++;
+        distCode[k] = reverseBits((uint32_t)i, 5);
+        distExtra[k] = (uint32_t)(distances[k] - DIST_BASE[i]);
+        distExtraBits[k] = DIST_EXTRA[i];
+    }
+
+    out.push_back(0x78);      // zlib: deflate, 32 KiB window
+    out.push_back(0x01);
+    DeflateBits bits = { &out, 0, 0 };
+    putBits(bits, 1, 1);      // Final block
+    putBits(bits, 1, 2);      // Fixed Huffman
+
+    size_t i = 0;
+    while (i < size) {
+        size_t limit = std::min<size_t>(258, size - i);
+        size_t best = 0;
+        int bestDistance = 0;
+        for (int k = 0; k < 2; k++) {
+            size_t d = distances[k];
+            if (d == 0 || d > i)
+                continue;
+            const uint8_t* a = data + i;
+            const uint8_t* b = a - d;
+            size_t len = 0;
+            while (len < limit && a[len] == b[len])
+                len++;
+            if (len > best) {
+                best = len;
+                bestDistance = k;
+            }
+        }
+        if (best >= 3) {
+            int l = lengthSymbol[best];
+            putBits(bits, symbolCode[257 + l], symbolLength[257 + l]);
+            putBits(bits, (uint32_t)(best - LENGTH_BASE[l]), LENGTH_EXTRA[l]);
+            putBits(bits, distCode[bestDistance], 5);
+            putBits(bits, distExtra[bestDistance], distExtraBits[bestDistance]);
+            i += best;
+        } else {
+            putBits(bits, symbolCode[data[i]], symbolLength[data[i]]);
+            i++;
+        }
+    }
+    putBits(bits, symbolCode[256], symbolLength[256]);
+    putBits(bits, 0, 7);      // Flush to a byte boundary
+
+    // Adler-32 of the uncompressed data, big-endian
+    uint32_t s1 = 1, s2 = 0;
+    for (size_t p = 0; p < size;) {
+        size_t n = std::min<size_t>(5552, size - p);
+        for (size_t e = p + n; p < e; p++) {
+            s1 += data[p];
+            s2 += s1;
+        }
+        s1 %= 65521;
+        s2 %= 65521;
+    }
+    uint32_t adler = (s2 << 16) | s1;
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back((uint8_t)(adler >> shift));
+}
+
+// Function to continue a CRC-32 over 'data'; start from 0
+inline uint32_t pngCrc(uint32_t crc, const uint8_t* data, size_t size) {
+    static uint32_t table[256];
+    static bool ready = [] {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        return true;
+    }();
+    (void)ready;
+    uint32_t c = crc ^ 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++)
+        c = table[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+// Function to write one PNG chunk
+inline bool writePngChunk(FILE* file, const char type[4], const uint8_t* data, size_t size) {
+    uint32_t crc = pngCrc(pngCrc(0, (const uint8_t*)type, 4), data, size);
+    uint8_t length[4] = { (uint8_t)(size >> 24), (uint8_t)(size >> 16), (uint8_t)(size >> 8), (uint8_t)size };
+    uint8_t tail[4] = { (uint8_t)(crc >> 24), (uint8_t)(crc >> 16), (uint8_t)(crc >> 8), (uint8_t)crc };
+    return fwrite(length, 1, 4, file) == 4 && fwrite(type, 1, 4, file) == 4 &&
+           fwrite(data, 1, size, file) == size && fwrite(tail, 1, 4, file) == 4;
+}
+
+// Reusable buffers of one encoder thread
+struct PngScratch {
+    std::vector<uint8_t> raw;         // Filter byte + row, per row
+    std::vector<uint8_t> compressed;
+};
+
+// Function to write an RGB8 PNG; 'bottomUp' pixels (GL readback) are flipped
+inline bool writePng(FILE* file, const uint8_t* pixels, int width, int height, bool bottomUp, PngScratch& scratch) {
+    static const uint8_t SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    size_t stride = (size_t)width * 3;
+    scratch.raw.resize((stride + 1) * height);
+    for (int y = 0; y < height; y++) {
+        uint8_t* row = &scratch.raw[(stride + 1) * y];
+        row[0] = 0;           // Filter: none
+        memcpy(row + 1, pixels + stride * (bottomUp ? height - 1 - y : y), stride);
+    }
+    scratch.compressed.clear();
+    deflateFixed(scratch.raw.data(), scratch.raw.size(), 3, stride + 1, scratch.compressed);
+
+    uint8_t header[13] = {
+        (uint8_t)(width >> 24), (uint8_t)(width >> 16), (uint8_t)(width >> 8), (uint8_t)width,
+        (uint8_t)(height >> 24), (uint8_t)(height >> 16), (uint8_t)(height >> 8), (uint8_t)height,
+        8, 2, 0, 0, 0,        // 8-bit RGB, deflate, adaptive filtering, no interlace
+    };
+    return fwrite(SIGNATURE, 1, 8, file) == 8 && writePngChunk(file, "IHDR", header, 13) &&
+           writePngChunk(file, "IDAT", scratch.compressed.data(), scratch.compressed.size()) &&
+           writePngChunk(file, "IEND", nullptr, 0);
+}
+
+// A frame on its way to disk
+struct FrameTask {
+    int slot;                 // Pixels in FrameWriter::slots
+    bool render;              // Rasterize 'frame' into the slot first
+    bool bottomUp;            // Rows run bottom to top (GL readback)
+    long index;               // Frame number in the file name
+    SoftFrame frame;
+};
+
+struct FrameWriter {
+    std::string directory;
+    FrameFormat format;
+    int width, height;
+    const SoftScene* scene;   // For rendered tasks
+    long stepsPerFrame;       // Simulation steps between frames, for producers that step
+
+    std::vector<std::vector<uint8_t>> slots;
+    std::vector<int> freeSlots;
+    std::deque<FrameTask> tasks;
+    std::mutex mutex;
+    std::condition_variable taskReady;
+    std::condition_variable slotFreed;
+    bool stopping;
+    std::vector<std::thread> workers;
+
+    long written;             // Frames on disk
+    long dropped;             // Frames skipped because every slot was busy
+    long failed;              // Frames that could not be written
+};
+
+// Function to write one finished frame to its file
+inline bool writeFrameFile(FrameWriter& writer, const FrameTask& task, const uint8_t* pixels, PngScratch& scratch) {
+    char name[32];
+    snprintf(name, sizeof(name), "/frame_%06ld.%s", task.index, FRAME_FORMAT_NAMES[writer.format]);
+    std::string path = writer.directory + name;
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file)
+        return false;
+    bool ok = writer.format == FRAME_PNG ? writePng(file, pixels, writer.width, writer.height, task.bottomUp, scratch)
+                                         : writePpm(file, pixels, writer.width, writer.height, task.bottomUp);
+    return fclose(file) == 0 && ok;
+}
+
+// Function run by each worker: render and encode tasks until stopped
+inline void frameWorker(FrameWriter& writer) {
+    SoftTarget target;
+    PngScratch scratch;
+    for (;;) {
+        FrameTask task;
+        {
+            std::unique_lock<std::mutex> lock(writer.mutex);
+            writer.taskReady.wait(lock, [&] { return writer.stopping || !writer.tasks.empty(); });
+            if (writer.tasks.empty())
+                return;
+            task = writer.tasks.front();
+            writer.tasks.pop_front();
+        }
+
+        uint8_t* pixels = writer.slots[task.slot].data();
+        if (task.render) {
+            initSoftTarget(target, writer.width, writer.height, pixels);
+            renderSoftFrame(target, *writer.scene, task.frame);
+        }
+        bool ok = writeFrameFile(writer, task, pixels, scratch);
+
+        std::lock_guard<std::mutex> lock(writer.mutex);
+        if (ok)
+            writer.written++;
+        else
+            writer.failed++;
+        writer.freeSlots.push_back(task.slot);
+        writer.slotFreed.notify_one();
+    }
+}
+
+// Function to create the output directory and start 'threads' workers;
+// 'scene' may be nullptr if every frame arrives as pixels
+inline bool startFrameWriter(FrameWriter& writer, const char* directory, FrameFormat format, int width, int height,
+                             int threads, const SoftScene* scene) {
+    mkdir(directory, 0755);
+    struct stat st;
+    if (stat(directory, &st) != 0 || !S_ISDIR(st.st_mode) || width <= 0 || height <= 0)
+        return false;
+    if (threads < 1)
+        threads = 1;
+
+    writer.directory = directory;
+    writer.format = format;
+    writer.width = width;
+    writer.height = height;
+    writer.scene = scene;
+    writer.stepsPerFrame = 1;
+    writer.stopping = false;
+    writer.written = writer.dropped = writer.failed = 0;
+
+    // Two frames per worker in flight, plus one being filled
+    int slotCount = 2 * threads + 1;
+    writer.slots.assign(slotCount, std::vector<uint8_t>((size_t)width * height * 3));
+    writer.freeSlots.clear();
+    for (int i = 0; i < slotCount; i++)
+        writer.freeSlots.push_back(i);
+    for (int i = 0; i < threads; i++)
+        writer.workers.emplace_back(frameWorker, std::ref(writer));
+    return true;
+}
+
+// Function to take a free slot to fill; -1 (and the frame counted as
+// dropped) if none is free and 'wait' is false
+inline int acquireFrameSlot(FrameWriter& writer, bool wait) {
+    std::unique_lock<std::mutex> lock(writer.mutex);
+    if (writer.freeSlots.empty()) {
+        if (!wait) {
+            writer.dropped++;
+            return -1;
+        }
+        writer.slotFreed.wait(lock, [&] { return !writer.freeSlots.empty(); });
+    }
+    int slot = writer.freeSlots.back();
+    writer.freeSlots.pop_back();
+    return slot;
+}
+
+// Function to get a slot's pixels, width * height RGB8
+inline uint8_t* frameSlotPixels(FrameWriter& writer, int slot) {
+    return writer.slots[slot].data();
+}
+
+// Function to queue a slot for encoding as frame 'index'
+inline void submitFramePixels(FrameWriter& writer, int slot, long index, bool bottomUp) {
+    FrameTask task;
+    task.slot = slot;
+    task.render = false;
+    task.bottomUp = bottomUp;
+    task.index = index;
+    std::lock_guard<std::mutex> lock(writer.mutex);
+    writer.tasks.push_back(task);
+    writer.taskReady.notify_one();
+}
+
+// Function to queue a frame to be rasterized and encoded by a worker;
+// false if it was dropped (only when not waiting)
+inline bool submitSoftFrame(FrameWriter& writer, const SoftFrame& frame, bool wait) {
+    int slot = acquireFrameSlot(writer, wait);
+    if (slot < 0)
+        return false;
+    FrameTask task;
+    task.slot = slot;
+    task.render = true;
+    task.bottomUp = false;
+    task.index = frame.index;
+    task.frame = frame;
+    std::lock_guard<std::mutex> lock(writer.mutex);
+    writer.tasks.push_back(task);
+    writer.taskReady.notify_one();
+    return true;
+}
+
+// Function to finish every queued frame and stop the workers
+inline void stopFrameWriter(FrameWriter& writer) {
+    {
+        std::lock_guard<std::mutex> lock(writer.mutex);
+        writer.stopping = true;
+        writer.taskReady.notify_all();
+    }
+    for (std::thread& t : writer.workers)
+        t.join();
+    writer.workers.clear();
+}
@@ -0,0 +1,1032 @@
+// headless.cpp
+//
+// Display-less batch runner. Advances the same vehicle models as the
+// interactive simulator at a fixed time step, driven by a scripted
+// maneuver instead of the keyboard, as fast as the CPU allows.
+//
+// Usage: ./headless [--maneuver NAME] [--model NAME] [--motor] [--tires NAME] [--steps N] [--dt SECONDS] [--repeat N]
+//                   [--mpc-samples N] [--mpc-horizon N]
+//                   [--record FILE] [--track FILE|oval[:N]] [--scenario FILE]
+//                   [--write-scenario CYCLE[:N] FILE] [--convert-scenario IN OUT]
+//                   [--surface FILE] [--write-surface KIND[:METRES] FILE]
+//                   [--fleet N]
+//                   [--frames DIR] [--frame-rate HZ] [--frame-size WxH] [--frame-format ppm|png]
+//                   [--integrator euler|semi-implicit|rk4|dopri5]
+//                   [--motor-bench] [--integrator-bench] [--tire-bench]
+//                   [--sweep AXIS]... [--zip] [--fork SECONDS] [--threads N] [--csv FILE]
+//                   [--save-state FILE] [--load-state FILE]
+//                   [--optimize NAME=LO:HI]... [--objective lap-time|yaw-tracking] [--generations N]
+//                   [--population N] [--seed N] [--opt-state FILE]
+//
+// --model selects the kinematic bicycle (default), the four-wheel dynamic
+// model with an even left/right torque split (4w), with the yaw-moment
+// torque-vectoring controller (4w-tv) or with the predictive controller of
+// mpc.h (4w-mpc), whose candidate count and horizon --mpc-samples and
+// --mpc-horizon set; its runs also report the solve-time distribution
+// against the controller's budget. The single-run report includes how
+// many times faster than real time the chosen model runs at --dt. --motor
+// drives the car through the parameters.m DC motor instead of commanding
+// a fixed acceleration. --tires magic gives the 4w models the Magic
+// Formula tires of tire.h instead of the linear ones. --record writes
+// every step of one run to a telemetry file (see telemetry.h), which
+// ./main --replay plays back.
+//
+// --frames renders a single run to DIR/frame_NNNNNN.png (or .ppm) at
+// --frame-rate frames per simulated second (30 by default) and
+// --frame-size (1280x720), with the software rasterizer of soft_raster.h:
+// the same follow camera, grid, track, car, load arrows and HUD as ./main,
+// with no display or GPU needed. Frames are rendered and encoded on
+// --threads workers while the simulation runs ahead (see frame_writer.h).
+//
+// --motor-bench runs the parameters.m motor and vehicle on its own (full
+// voltage from rest) with the implicit and the sub-stepped explicit
+// integrator over a range of step sizes, and reports steps per second and
+// the error against a finely sub-stepped reference.
+//
+// --integrator runs the bicycle through --maneuver with that integrator
+// of integrator.h instead of stepCar(), the fixed-step methods at --dt
+// (dopri5 adapts its step from there); it has no track, scenario,
+// recording, frames or checkpoints.
+//
+// --integrator-bench drives the bicycle through --maneuver for --steps x
+// --dt seconds with stepCar() and with each integrator of integrator.h
+// over a range of steps (or dopri5 tolerances), and reports derivative
+// evaluations, wall time and the final pose error against a dopri5
+// reference at a tolerance of 1e-12.
+//
+// --tire-bench compares the tire tables of tire.h with the Magic Formula
+// itself over the tables' whole range, and times both.
+//
+// With --fleet, N cars with a spread of setups are advanced both by looping
+// the scalar stepCar() and by the SIMD fleet kernel, and the two are
+// compared for throughput and agreement.
+//
+// --track replaces the maneuver with the closed-loop track driver of
+// driver.h on a centerline CSV ("x,z" per line, in metres) or a generated
+// oval (N points, 1000 by default); the report adds laps and lap times.
+//
+// --scenario plays a drive-cycle file (see scenario.h) instead of the
+// maneuver, until it ends unless --steps is given. --write-scenario writes
+// one of the standard cycles (step-steer, sine-dwell, brake-in-turn), N
+// times back to back, and --convert-scenario streams a scenario from one
+// form to the other; either form is chosen by the ".bin" extension.
+//
+// --surface gives the 4w models the friction and grade under each wheel
+// from a road-surface map (see surface.h), in single runs, sweeps and
+// optimizations alike. --write-surface generates one METRES square (1000
+// by default) of split-mu, wet patches, an ice band or rolling hills.
+//
+// With one or more --sweep axes ("name=v1,v2,..." or "name=start:stop:count"
+// over Cf, Cr, Iz, mass, h_cg, maxSteer, lf, for the 4w models
+// frontDrive, tvKp, tvKi, and with --motor the gear ratio GR and wheel
+// radius Rw of parameters.m), every combination is run on --threads workers
+// and the per-scenario peaks and final pose are printed or written to
+// --csv. --zip pairs the i-th values instead of crossing them. --fork runs
+// the unmodified car for SECONDS once and starts every scenario from a
+// copy of that state, its values taking effect from there.
+//
+// With one or more --optimize bounds (the --sweep names, "name=lo:hi")
+// the setup is searched for the lowest --objective, the best lap time on
+// --track or the RMS yaw-rate error against the torque-vectoring reference
+// on the maneuver or scenario (the default without a track), for
+// --generations generations of --population candidates from the default
+// setup (see optimizer.h). Each generation is scored on --threads workers;
+// --opt-state saves the search after every generation and resumes it from
+// the file when it already exists.
+//
+// --save-state writes the complete state at the end of a single run to a
+// checkpoint file (see snapshot.h); --load-state resumes from one for
+// --steps more steps, with the model, motor, tires and dt it was saved with
+// (so not together with --sweep, --optimize or --fleet, which start every
+// run from rest).
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "car.h"
+#include "driver.h"
+#include "fleet.h"
+#include "integrator.h"
+#include "maneuver.h"
+#include "motor.h"
+#include "mpc.h"
+#include "optimizer.h"
+#include "scenario.h"
+#include "surface.h"
+#include "sweep.h"
+#include "tire.h"
+
+// Function to time the scalar loop against the SIMD fleet kernel
+void runFleetComparison(Maneuver maneuver, size_t fleetSize, long steps, float dt) {
+    std::vector<Car> cars(fleetSize);
+    Fleet fleet;
+    fleet.reserve(fleetSize);
+    for (size_t i = 0; i < fleetSize; i++) {
+        cars[i] = makeFleetCar(i, fleetSize);
+        fleet.addCar(cars[i]);
+    }
+
+    // Scalar reference: one stepCar() per car per step
+    float loadChecksum = 0.0f;
+    auto start = std::chrono::steady_clock::now();
+    for (long s = 0; s < steps; s++) {
+        DriverInput input = scriptedInput(maneuver, (float)s * dt);
+        for (size_t i = 0; i < fleetSize; i++) {
+            applyDriverInput(cars[i], input, dt);
+            loadChecksum += stepCar(cars[i], dt).Fz_front;
+        }
+    }
+    auto mid = std::chrono::steady_clock::now();
+
+    // SIMD fleet
+    for (long s = 0; s < steps; s++) {
+        DriverInput input = scriptedInput(maneuver, (float)s * dt);
+        for (size_t i = 0; i < fleetSize; i++) {
+            fleet.steerInput[i] = input.steer;
+            fleet.throttleInput[i] = input.throttle;
+        }
+        stepFleet(fleet, dt);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double scalarSeconds = std::chrono::duration<double>(mid - start).count();
+    double fleetSeconds = std::chrono::duration<double>(end - mid).count();
+    double carSteps = (double)fleetSize * steps;
+
+    // Largest disagreement in final pose between the two paths
+    float maxPosError = 0.0f;
+    float maxHeadingError = 0.0f;
+    for (size_t i = 0; i < fleetSize; i++) {
+        Car simd = cars[i];
+        fleet.getCar(i, simd);
+        float dx = simd.x - cars[i].x;
+        float dz = simd.z - cars[i].z;
+        maxPosError = std::max(maxPosError, sqrtf(dx * dx + dz * dz));
+        maxHeadingError = std::max(maxHeadingError, fabsf(simd.heading - cars[i].heading));
+    }
+
+    printf("Fleet of %zu cars, %ld steps of %.4f s, SIMD width %d\n", fleetSize, steps, dt, SIMD_WIDTH);
+    printf("Scalar: %.2f M car-steps/s (%.1f ns/car-step, checksum %.0f)\n",
+           carSteps / scalarSeconds * 1e-6, scalarSeconds / carSteps * 1e9, loadChecksum);
+    printf("SIMD:   %.2f M car-steps/s (%.1f ns/car-step), speedup %.1fx\n",
+           carSteps / fleetSeconds * 1e-6, fleetSeconds / carSteps * 1e9, scalarSeconds / fleetSeconds);
+    printf("Max final deviation: position %.2e m, heading %.2e rad\n", maxPosError, maxHeadingError);
+}
+
+// Function to run the parameters.m motor from rest at full voltage for
+// 'duration' seconds; returns the final state and the peak current
+MotorState runMotor(const MotorStepper& stepper, float duration, float* peakCurrent) {
+    MotorState state = { 0.0f, 0.0f };
+    long steps = (long)lroundf(duration / stepper.dt);
+    *peakCurrent = 0.0f;
+    for (long s = 0; s < steps; s++) {
+        stepMotor(state, stepper, stepper.maxVoltage, 0.0f);
+        *peakCurrent = std::max(*peakCurrent, fabsf(state.current));
+    }
+    return state;
+}
+
+// Function to compare the motor integrators across step sizes. The
+// current limit is lifted so the response is the bare parameters.m model.
+void runMotorBenchmark(int repeat) {
+    const float duration = 0.25f;
+    const float stepSizes[] = { 0.0001f, 0.001f, 0.005f, 0.02f, 0.05f };
+    MotorParams motor = makeDefaultMotor();
+
+    // Reference: forward Euler in double precision at 0.1 us
+    double current = 0.0, speed = 0.0, peak = 0.0;
+    double ratio = motor.Rw / motor.GR;
+    double Je = motor.J + motor.m * ratio * ratio;
+    for (long s = 0; s < (long)(duration / 1e-7); s++) {
+        double di = (motor.maxVoltage - motor.R * current - motor.Kb * speed) / motor.L;
+        double dw = (motor.Km * current - motor.b * speed) / Je;
+        current += 1e-7 * di;
+        speed += 1e-7 * dw;
+        peak = std::max(peak, fabs(current));
+    }
+    MotorState exact = { (float)current, (float)speed };
+    float peakReference = (float)peak;
+
+    printf("parameters.m motor, %.0f V step from rest for %.2f s, L/R = %.2f ms\n",
+           motor.maxVoltage, duration, motor.L / motor.R * 1e3f);
+    printf("Reference: speed %.3f rad/s, current %.2f A, peak current %.0f A\n",
+           exact.speed, exact.current, peakReference);
+    printf("%-9s %-8s %9s %14s %12s %12s\n", "dt (s)", "method", "substeps", "M steps/s", "speed err", "peak err");
+    for (float dt : stepSizes) {
+        // Implicit, sub-stepped explicit, and explicit with a single step for contrast
+        for (int method = 0; method < 3; method++) {
+            MotorStepper stepper = method == 0 ? makeMotorStepper(motor, motor.m, dt, MOTOR_IMPLICIT)
+                                 : method == 1 ? makeMotorStepper(motor, motor.m, dt, MOTOR_EXPLICIT)
+                                               : makeMotorStepper(motor, motor.m, dt, MOTOR_EXPLICIT, dt);
+            if (method == 2 && dt <= 0.25f * motor.L / motor.R)
+                continue;
+            stepper.currentLimit = INFINITY;
+            MotorState state;
+            float peak = 0.0f;
+            auto start = std::chrono::steady_clock::now();
+            for (int r = 0; r < repeat; r++)
+                state = runMotor(stepper, duration, &peak);
+            auto end = std::chrono::steady_clock::now();
+            double seconds = std::chrono::duration<double>(end - start).count();
+            double totalSteps = (double)lroundf(duration / dt) * repeat;
+            printf("%-9g %-8s %9d %14.2f %12.2e %12.2e\n", dt,
+                   method == 0 ? "implicit" : "explicit", stepper.substeps,
+                   totalSteps / seconds * 1e-6, fabsf(state.speed - exact.speed) / fabsf(exact.speed),
+                   fabsf(peak - peakReference) / peakReference);
+        }
+    }
+}
+
+// Function to integrate the bicycle through 'maneuver' up to 'duration'.
+// It goes piecewise between the input's jumps, each piece seeing the input
+// from its own side of the boundary.
+void integrateManeuver(BicycleIntegrator& b, Maneuver maneuver, double duration) {
+    while (b.t < duration) {
+        double end = std::min(duration, (double)nextManeuverChange(maneuver, (float)b.t));
+        float last = end < duration ? nextafterf((float)end, 0.0f) : INFINITY;
+        integrateBicycle(b, [maneuver, last](double t) { return scriptedInput(maneuver, std::min((float)t, last)); },
+                         end);
+    }
+}
+
+// Function to run the bicycle through 'maneuver' with one integrator of
+// integrator.h instead of stepCar(), 'repeat' times for the timing; fixed
+// step methods step at 'dt', which is also dopri5's first trial step
+void runIntegratorCommand(Maneuver maneuver, IntegratorMethod method, double duration, float dt, int repeat) {
+    IntegratorSettings settings = makeIntegratorSettings(method);
+    settings.step = dt;
+    BicycleIntegrator b;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeat; r++) {
+        initBicycleIntegrator(b, makeDefaultCar(), settings, 0.0);
+        integrateManeuver(b, maneuver, duration);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("Simulated %.1f s with %s in %ld steps (x%d): %ld evaluations, %ld rejected, %ld events\n", duration,
+           INTEGRATOR_NAMES[method], b.stats.accepted, repeat, b.stats.evaluations, b.stats.rejected, b.stats.events);
+    printf("Final pose: x=%.3f m, z=%.3f m, heading=%.2f deg, speed=%.3f m/s\n", b.y[STATE_X], b.y[STATE_Z],
+           b.y[STATE_HEADING] * RAD2DEG, b.y[STATE_VELOCITY]);
+    printf("Wall time: %.3f s, %.1f us per run (%.0fx real time)\n", seconds, seconds / repeat * 1e6,
+           duration * repeat / seconds);
+}
+
+// Function to compare the bicycle integrators on one maneuver, 'repeat'
+// times each for the timing
+void runIntegratorBenchmark(Maneuver maneuver, double duration, int repeat) {
+    const float stepCarSizes[] = { 0.01f, 0.001f, 0.0001f };
+    const double eulerSizes[] = { 0.01, 0.001, 0.0001 };
+    const double rk4Sizes[] = { 0.1, 0.01, 0.001 };
+    const double tolerances[] = { 1e-4, 1e-6, 1e-8, 1e-10 };
+    const Car start = makeDefaultCar();
+
+    IntegratorSettings exact = makeIntegratorSettings(INTEGRATOR_DOPRI5);
+    exact.relTolerance = exact.absTolerance = 1e-12;
+    static BicycleIntegrator reference;
+    initBicycleIntegrator(reference, start, exact, 0.0);
+    integrateManeuver(reference, maneuver, duration);
+    const double* ref = reference.y;
+
+    printf("%s for %.1f s: reference x=%.4f m, z=%.4f m, heading=%.4f rad, speed=%.4f m/s (%ld steps)\n",
+           maneuver == MANEUVER_STRAIGHT ? "straight" : maneuver == MANEUVER_SLALOM ? "slalom" : "step-steer",
+           duration, ref[STATE_X], ref[STATE_Z], ref[STATE_HEADING], ref[STATE_VELOCITY], reference.stats.accepted);
+    printf("%-14s %-9s %10s %9s %8s %7s %12s %11s %11s %11s\n", "method", "step/tol", "evals", "steps", "rejected",
+           "events", "us per run", "pos err", "head err", "speed err");
+    auto report = [&](const char* name, double setting, const IntegratorStats& stats, double seconds,
+                      double x, double z, double heading, double velocity) {
+        printf("%-14s %-9g %10ld %9ld %8ld %7ld %12.1f %11.2e %11.2e %11.2e\n", name, setting, stats.evaluations,
+               stats.accepted, stats.rejected, stats.events, seconds / repeat * 1e6,
+               hypot(x - ref[STATE_X], z - ref[STATE_Z]), fabs(heading - ref[STATE_HEADING]),
+               fabs(velocity - ref[STATE_VELOCITY]));
+    };
+
+    // The simulator's own step: input sampled at the start of each step, float state
+    for (float dt : stepCarSizes) {
+        long steps = lround(duration / dt);
+        Car car = start;
+        auto begin = std::chrono::steady_clock::now();
+        for (int r = 0; r < repeat; r++) {
+            car = start;
+            for (long s = 0; s < steps; s++) {
+                applyDriverInput(car, scriptedInput(maneuver, (float)s * dt), dt);
+                stepCar(car, dt);
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        report("stepCar", dt, IntegratorStats{ steps, steps, 0, 0 }, seconds, car.x, car.z, car.heading, car.velocity);
+    }
+
+    for (int m = 0; m < INTEGRATOR_COUNT; m++) {
+        IntegratorMethod method = (IntegratorMethod)m;
+        const double* settings = method == INTEGRATOR_DOPRI5 ? tolerances : method == INTEGRATOR_RK4 ? rk4Sizes : eulerSizes;
+        int count = method == INTEGRATOR_DOPRI5 ? 4 : 3;
+        for (int i = 0; i < count; i++) {
+            IntegratorSettings s = makeIntegratorSettings(method);
+            if (method == INTEGRATOR_DOPRI5)
+                s.relTolerance = s.absTolerance = settings[i];
+            else
+                s.step = settings[i];
+            BicycleIntegrator b;
+            auto begin = std::chrono::steady_clock::now();
+            for (int r = 0; r < repeat; r++) {
+                initBicycleIntegrator(b, start, s, 0.0);
+                integrateManeuver(b, maneuver, duration);
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            report(INTEGRATOR_NAMES[method], settings[i], b.stats, seconds,
+                   b.y[STATE_X], b.y[STATE_Z], b.y[STATE_HEADING], b.y[STATE_VELOCITY]);
+        }
+    }
+}
+
+// Function to compare the tire tables with the Magic Formula in double
+// precision on a grid that falls between the table nodes, and to time
+// both over 'repeat' passes of a batch of tires
+void runTireBenchmark(int repeat) {
+    Vehicle4WConstants k = makeVehicle4WConstants(makeDefaultCar());
+    float cornering = k.stiffnessPerLoad[FRONT_LEFT];
+    const int loads = 97, angles = 101, ratios = 103;
+    const float frictions[] = { 1.0f, 0.4f };
+
+    // Errors per unit of mu * Fz0: formula in float, tables, and the
+    // drive force the looked-up slip ratio actually makes
+    double formulaError[2] = { 0.0, 0.0 }, tableError[2] = { 0.0, 0.0 }, driveError = 0.0;
+    for (float mu : frictions) {
+        for (int i = 0; i < loads; i++) {
+            double n = (i + 0.5) * TIRE_LOAD_MAX / loads;
+            for (int j = 0; j < angles; j++) {
+                double alpha = mu * (2.0 * (j + 0.5) / angles - 1.0) * TIRE_WEIGHT_ANGLE_MAX;
+                for (int l = 0; l < ratios; l++) {
+                    double kappa = mu * (2.0 * (l + 0.5) / ratios - 1.0) * TIRE_WEIGHT_RATIO_MAX;
+                    TireForces exact = magicFormulaForces<double>(alpha, kappa, n, cornering, mu);
+                    TireForces single = magicFormulaForces<float>((float)alpha, (float)kappa, (float)n, cornering, mu);
+                    TireForces table = tableTireForces((float)alpha, (float)kappa, (float)n, cornering, mu);
+                    formulaError[0] = std::max(formulaError[0], fabs((double)single.Fx - exact.Fx) / mu);
+                    formulaError[1] = std::max(formulaError[1], fabs((double)single.Fy - exact.Fy) / mu);
+                    tableError[0] = std::max(tableError[0], fabs((double)table.Fx - exact.Fx) / mu);
+                    tableError[1] = std::max(tableError[1], fabs((double)table.Fy - exact.Fy) / mu);
+                }
+            }
+            for (int l = 0; l < ratios; l++) {
+                double drive = mu * longitudinalPeak(n) * (l + 0.5) / ratios;
+                float kappa = slipRatioForDrive((float)drive, (float)n, mu);
+                double made = mu * pureLongitudinalForce<double>(kappa / mu, n);
+                driveError = std::max(driveError, fabs(made - drive) / mu);
+            }
+        }
+    }
+
+    // A batch of tires spread over the useful range, as a step would see them
+    const int batch = 4096;
+    std::vector<float> alphas(batch), kappas(batch), normals(batch);
+    for (int i = 0; i < batch; i++) {
+        alphas[i] = 0.3f * ((float)(i % 97) / 48.0f - 1.0f);
+        kappas[i] = 0.12f * ((float)(i % 53) / 26.0f - 1.0f);
+        normals[i] = 0.4f + 1.6f * (float)(i % 31) / 30.0f;
+    }
+    auto timeTires = [&](auto forces) {
+        float sum = 0.0f;
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < repeat; r++) {
+            for (int i = 0; i < batch; i++) {
+                TireForces f = forces(alphas[i], kappas[i], normals[i]);
+                sum += f.Fx + f.Fy;
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        volatile float sink = sum;
+        (void)sink;
+        return seconds / ((double)repeat * batch) * 1e9;
+    };
+    double formulaTime = timeTires([cornering](float alpha, float kappa, float n) {
+        return magicFormulaForces<float>(alpha, kappa, n, cornering, 1.0f);
+    });
+    double tableTime = timeTires([cornering](float alpha, float kappa, float n) {
+        return tableTireForces(alpha, kappa, n, cornering, 1.0f);
+    });
+
+    printf("Magic Formula tires, K0/Fz0 = %.2f /rad, tables of %zu bytes\n", cornering, sizeof(TireTables));
+    printf("Max error per mu Fz0 over |alpha|/mu <= %g rad, |kappa|/mu <= %g, n <= %g, mu = 1 and 0.4\n",
+           TIRE_WEIGHT_ANGLE_MAX, TIRE_WEIGHT_RATIO_MAX, TIRE_LOAD_MAX);
+    printf("%-22s %10s %10s %12s\n", "", "Fx", "Fy", "ns per tire");
+    printf("%-22s %10.2e %10.2e %12.1f\n", "magicFormulaForces", formulaError[0], formulaError[1], formulaTime);
+    printf("%-22s %10.2e %10.2e %12.1f\n", "tableTireForces", tableError[0], tableError[1], tableTime);
+    printf("slipRatioForDrive: max drive force error %.2e per mu Fz0\n", driveError);
+}
+
+// Function to write 'repeats' runs of a standard drive cycle to 'path'
+int writeScenarioCommand(const char* spec, const char* path) {
+    std::string name(spec, strcspn(spec, ":"));
+    long repeats = spec[name.size()] == ':' ? atol(spec + name.size() + 1) : 1;
+    DriveCycle cycle;
+    if (!parseDriveCycle(name.c_str(), &cycle) || repeats < 1) {
+        std::cerr << "Unknown drive cycle: " << spec << "\n";
+        return -1;
+    }
+    ScenarioWriter writer;
+    if (!openScenarioWriter(writer, path)) {
+        std::cerr << "Failed to open " << path << "\n";
+        return -1;
+    }
+    double length = writeDriveCycle(writer, cycle, repeats);
+    if (!closeScenarioWriter(writer)) {
+        std::cerr << "Failed to write " << path << "\n";
+        return -1;
+    }
+    printf("Wrote %ld x %s (%.1f s) to %s\n", repeats, name.c_str(), length * repeats, path);
+    return 0;
+}
+
+// Function to write a generated road-surface map of 'spec' to 'path'
+int writeSurfaceCommand(const char* spec, const char* path) {
+    std::string name(spec, strcspn(spec, ":"));
+    double size = spec[name.size()] == ':' ? atof(spec + name.size() + 1) : 1000.0;
+    SurfaceKind kind;
+    if (!parseSurfaceKind(name.c_str(), &kind) || size <= 0.0) {
+        std::cerr << "Unknown surface: " << spec << "\n";
+        return -1;
+    }
+    if (!writeSurfaceMap(path, kind, size)) {
+        std::cerr << "Failed to write " << path << "\n";
+        return -1;
+    }
+    SurfaceMap map;
+    if (!openSurfaceMap(map, path)) {
+        std::cerr << "Failed to read back " << path << "\n";
+        return -1;
+    }
+    printf("Wrote %s, %u of %u tiles stored (%.1f MB), to %s\n", name.c_str(),
+           ((const SurfaceHeader*)map.data)->tileCount,
+           map.tilesX * map.tilesZ, map.size / 1048576.0, path);
+    closeSurfaceMap(map);
+    return 0;
+}
+
+// Function to stream a scenario file into the other form
+int convertScenarioCommand(const char* inPath, const char* outPath) {
+    Scenario scenario;
+    if (!openScenario(scenario, inPath)) {
+        std::cerr << "Failed to read scenario " << inPath << "\n";
+        return -1;
+    }
+    ScenarioWriter writer;
+    if (!openScenarioWriter(writer, outPath)) {
+        std::cerr << "Failed to open " << outPath << "\n";
+        closeScenario(scenario);
+        return -1;
+    }
+    long count = 1;
+    writeScenarioKey(writer, scenario.previous);
+    if (scenario.hasNext) {
+        writeScenarioKey(writer, scenario.next);
+        count++;
+        ScenarioKey key;
+        while (nextScenarioKey(scenario, &key)) {
+            writeScenarioKey(writer, key);
+            count++;
+        }
+    }
+    bool failed = scenario.failed;
+    closeScenario(scenario);
+    if (!closeScenarioWriter(writer) || failed) {
+        std::cerr << "Failed to convert " << inPath << "\n";
+        return -1;
+    }
+    printf("Converted %ld keyframes to %s\n", count, outPath);
+    return 0;
+}
+
+// Function to run a sweep and report the results
+int runSweepCommand(const SweepGrid& grid, int threads, const char* csvPath) {
+    std::vector<ScenarioResult> results;
+    auto start = std::chrono::steady_clock::now();
+    if (!runSweep(grid, results, threads)) {
+        std::cerr << "Failed to read scenario " << grid.scenarioPath << " in a sweep run\n";
+        return -1;
+    }
+    auto end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+
+    // Steps before the fork were run once, not once per scenario
+    long forkStep = std::min(grid.forkStep, grid.steps);
+    double totalSteps = (double)forkStep;
+    for (const ScenarioResult& r : results)
+        totalSteps += (double)(r.steps - std::min(r.steps, forkStep));
+
+    FILE* out = stdout;
+    if (csvPath) {
+        out = fopen(csvPath, "w");
+        if (!out) {
+            std::cerr << "Failed to open " << csvPath << "\n";
+            return -1;
+        }
+    }
+
+    fprintf(out, "scenario");
+    for (const SweepAxis& axis : grid.axes)
+        fprintf(out, ",%s", SWEEP_PARAM_NAMES[axis.param]);
+    fprintf(out, ",maxFzFront,maxFzRear,maxLatAccel,x,z,heading,velocity%s\n", grid.track ? ",laps,bestLap" : "");
+    for (size_t i = 0; i < results.size(); i++) {
+        const ScenarioResult& r = results[i];
+        size_t index = i;
+        fprintf(out, "%zu", i);
+        for (const SweepAxis& axis : grid.axes) {
+            size_t n = axis.values.size();
+            fprintf(out, ",%g", axis.values[grid.zip ? i : index % n]);
+            if (!grid.zip)
+                index /= n;
+        }
+        fprintf(out, ",%.1f,%.1f,%.3f,%.3f,%.3f,%.4f,%.3f",
+                r.maxFzFront, r.maxFzRear, r.maxLatAccel, r.x, r.z, r.heading, r.velocity);
+        if (grid.track)
+            fprintf(out, ",%d,%.3f", r.laps, r.bestLap);
+        fprintf(out, "\n");
+    }
+    if (out != stdout)
+        fclose(out);
+
+    printf("Swept %zu scenarios, %.0f steps in all, on %d threads in %.3f s: %.2f M steps/s\n",
+           results.size(), totalSteps, threads, seconds, totalSteps / seconds * 1e-6);
+    if (forkStep > 0)
+        printf("Branched at t=%.3f s: %.0f warm-up steps saved\n", forkStep * grid.dt,
+               (double)forkStep * ((double)results.size() - 1.0));
+    return 0;
+}
+
+// Function to search the setup for the lowest objective, resuming from
+// and saving to 'statePath' when given
+int runOptimizeCommand(const OptimizeProblem& problem, int generations, int population, uint64_t seed, int threads,
+                       const char* statePath) {
+    static OptimizerState state;
+    OptimizerCache cache;
+    FILE* existing = statePath ? fopen(statePath, "rb") : nullptr;
+    if (existing) {
+        fclose(existing);
+        if (!readOptimizerCheckpoint(statePath, problem, state, cache)) {
+            std::cerr << "Failed to resume " << statePath << " (another build or another problem?)\n";
+            return -1;
+        }
+        printf("Resumed %s at generation %d, %zu setups cached\n", statePath, state.generation, cache.size());
+    } else {
+        initOptimizer(state, problem, population, seed);
+    }
+
+    OptimizerTiming timing = {};
+    while (state.generation < generations) {
+        long evaluations = state.evaluations;
+        if (!stepOptimizer(state, problem, cache, threads, timing)) {
+            std::cerr << "Failed to read scenario " << problem.scenarioPath << " in an optimizer run\n";
+            return -1;
+        }
+        printf("Generation %3d: best %.5f (this generation %.5f), sigma %.4f, %ld run, %ld cached\n",
+               state.generation, state.bestValue, state.lastBest, state.sigma, state.evaluations - evaluations,
+               (long)state.population - (state.evaluations - evaluations));
+        if (statePath && !writeOptimizerCheckpoint(statePath, state, cache)) {
+            std::cerr << "Failed to write " << statePath << "\n";
+            return -1;
+        }
+    }
+
+    printf("Best %s: %.5f %s\n", problem.objective == OBJECTIVE_LAP_TIME ? "lap time" : "yaw-rate error",
+           state.bestValue, problem.objective == OBJECTIVE_LAP_TIME ? "s" : "rad/s");
+    for (int d = 0; d < state.dims; d++) {
+        const OptimizeBound& bound = problem.bounds[d];
+        printf("  %s=%g\n", SWEEP_PARAM_NAMES[bound.param], boundValue(bound, snapToGrid(state.best[d])));
+    }
+    printf("%ld setups run, %ld taken from the cache, %d generations of %d\n", state.evaluations, state.cacheHits,
+           state.generation, state.population);
+    if (timing.wall > 0.0) {
+        int workers = std::min(threads, state.population);
+        printf("Wall time: %.3f s, %.2f M steps/s, workers simulating %.1f%% of it\n", timing.wall,
+               timing.steps / timing.wall * 1e-6, 100.0 * timing.simulation / (workers * timing.wall));
+    }
+    return 0;
+}
+
+// Function to print how long the predictive controller's solves took
+void printMpcTiming(const MpcSettings& settings, const MpcTiming& timing) {
+    if (timing.solves == 0)
+        return;
+    printf("MPC: %ld solves of %d samples x %d knots x %d iterations, mean %.1f us, worst %.1f us, "
+           "%ld over the %.0f us budget\n",
+           timing.solves, settings.samples, settings.horizon, settings.iterations, timing.total / timing.solves * 1e6,
+           timing.worst * 1e6, timing.misses, MPC_BUDGET * 1e6);
+    for (int b = 0; b < MPC_TIMING_BUCKETS; b++) {
+        if (timing.buckets[b] == 0)
+            continue;
+        if (b == 0)
+            printf("  < 1 us: ");
+        else if (b == MPC_TIMING_BUCKETS - 1)
+            printf("  >= %d us: ", 1 << (b - 1));
+        else
+            printf("  %d-%d us: ", 1 << (b - 1), 1 << b);
+        printf("%ld (%.1f%%)\n", timing.buckets[b], 100.0 * timing.buckets[b] / timing.solves);
+    }
+}
+
+void printUsage() {
+    std::cerr << "Usage: headless [--maneuver straight|step-steer|slalom] [--model bicycle|4w|4w-tv|4w-mpc] [--motor]\n"
+                 "                [--tires linear|magic] [--mpc-samples N] [--mpc-horizon N]\n"
+                 "                [--steps N] [--dt SECONDS] [--repeat N] [--record FILE] [--track FILE|oval[:N]]\n"
+                 "                [--scenario FILE] [--write-scenario step-steer|sine-dwell|brake-in-turn[:N] FILE]\n"
+                 "                [--convert-scenario IN OUT]\n"
+                 "                [--surface FILE] [--write-surface split-mu|wet|ice|hills[:METRES] FILE]\n"
+                 "                [--fleet N]\n"
+                 "                [--frames DIR] [--frame-rate HZ] [--frame-size WxH] [--frame-format ppm|png]\n"
+                 "                [--integrator euler|semi-implicit|rk4|dopri5]\n"
+                 "                [--motor-bench] [--integrator-bench] [--tire-bench]\n"
+                 "                [--sweep NAME=V1,V2,...|NAME=START:STOP:COUNT]... [--zip] [--fork SECONDS]\n"
+                 "                [--threads N] [--csv FILE] [--save-state FILE] [--load-state FILE]\n"
+                 "                [--optimize NAME=LO:HI]... [--objective lap-time|yaw-tracking] [--generations N]\n"
+                 "                [--population N] [--seed N] [--opt-state FILE]\n";
+}
+
+int main(int argc, char** argv) {
+    Maneuver maneuver = MANEUVER_STEP_STEER;
+    VehicleModel model = MODEL_BICYCLE;
+    bool motor = false;
+    bool motorBench = false;
+    bool integratorBench = false;
+    bool integratorGiven = false;
+    IntegratorMethod integrator = INTEGRATOR_EULER;
+    bool tireBench = false;
+    TireModel tires = TIRE_LINEAR;
+    int mpcSamples = 0, mpcHorizon = 0;
+    long steps = 0;
+    float dt = 0.001f;
+    int repeat = 100;
+    long fleetSize = 0;
+    int threads = (int)std::thread::hardware_concurrency();
+    const char* csvPath = nullptr;
+    const char* recordPath = nullptr;
+    const char* scenarioPath = nullptr;
+    const char* writeScenarioSpec = nullptr;
+    const char* writeScenarioPath = nullptr;
+    const char* convertInPath = nullptr;
+    const char* convertOutPath = nullptr;
+    const char* framesPath = nullptr;
+    const char* saveStatePath = nullptr;
+    const char* loadStatePath = nullptr;
+    float forkSeconds = 0.0f;
+    float frameRate = 30.0f;
+    int frameWidth = 1280, frameHeight = 720;
+    FrameFormat frameFormat = FRAME_PNG;
+    static Track track;
+    const Track* trackPtr = nullptr;
+    const char* surfacePath = nullptr;
+    const char* writeSurfaceSpec = nullptr;
+    const char* writeSurfacePath = nullptr;
+    static SurfaceMap surface;
+    const SurfaceMap* surfacePtr = nullptr;
+    OptimizeProblem problem;
+    problem.objective = OBJECTIVE_YAW_TRACKING;
+    bool objectiveGiven = false;
+    int generations = 30, population = 0;
+    uint64_t seed = 1;
+    const char* optStatePath = nullptr;
+    SweepGrid grid;
+    grid.zip = false;
+    grid.forkStep = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--maneuver") == 0 && i + 1 < argc) {
+            if (!parseManeuver(argv[++i], &maneuver)) {
+                std::cerr << "Unknown maneuver: " << argv[i] << "\n";
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--model") == 0 && i + 1 < argc) {
+            if (!parseVehicleModel(argv[++i], &model)) {
+                std::cerr << "Unknown model: " << argv[i] << "\n";
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--motor") == 0) {
+            motor = true;
+        } else if (strcmp(argv[i], "--tires") == 0 && i + 1 < argc) {
+            if (!parseTireModel(argv[++i], &tires)) {
+                std::cerr << "Unknown tire model: " << argv[i] << "\n";
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--mpc-samples") == 0 && i + 1 < argc) {
+            mpcSamples = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--mpc-horizon") == 0 && i + 1 < argc) {
+            mpcHorizon = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--tire-bench") == 0) {
+            tireBench = true;
+        } else if (strcmp(argv[i], "--motor-bench") == 0) {
+            motorBench = true;
+        } else if (strcmp(argv[i], "--integrator") == 0 && i + 1 < argc) {
+            if (!parseIntegrator(argv[++i], &integrator)) {
+                std::cerr << "Unknown integrator: " << argv[i] << "\n";
+                return -1;
+            }
+            integratorGiven = true;
+        } else if (strcmp(argv[i], "--integrator-bench") == 0) {
+            integratorBench = true;
+        } else if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+            steps = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--dt") == 0 && i + 1 < argc) {
+            dt = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--fleet") == 0 && i + 1 < argc) {
+            fleetSize = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--sweep") == 0 && i + 1 < argc) {
+            SweepAxis axis;
+            if (!parseSweepAxis(argv[++i], &axis)) {
+                std::cerr << "Invalid sweep axis: " << argv[i] << "\n";
+                return -1;
+            }
+            grid.axes.push_back(axis);
+        } else if (strcmp(argv[i], "--optimize") == 0 && i + 1 < argc) {
+            OptimizeBound bound;
+            if (!parseOptimizeBound(argv[++i], &bound)) {
+                std::cerr << "Invalid optimize bound: " << argv[i] << "\n";
+                return -1;
+            }
+            problem.bounds.push_back(bound);
+        } else if (strcmp(argv[i], "--objective") == 0 && i + 1 < argc) {
+            if (!parseObjective(argv[++i], &problem.objective)) {
+                std::cerr << "Unknown objective: " << argv[i] << "\n";
+                return -1;
+            }
+            objectiveGiven = true;
+        } else if (strcmp(argv[i], "--generations") == 0 && i + 1 < argc) {
+            generations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--population") == 0 && i + 1 < argc) {
+            population = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--opt-state") == 0 && i + 1 < argc) {
+            optStatePath = argv[++i];
+        } else if (strcmp(argv[i], "--zip") == 0) {
+            grid.zip = true;
+        } else if (strcmp(argv[i], "--fork") == 0 && i + 1 < argc) {
+            forkSeconds = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--save-state") == 0 && i + 1 < argc) {
+            saveStatePath = argv[++i];
+        } else if (strcmp(argv[i], "--load-state") == 0 && i + 1 < argc) {
+            loadStatePath = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if (strcmp(argv[i], "--track") == 0 && i + 1 < argc) {
+            if (!parseTrack(argv[++i], track)) {
+                std::cerr << "Failed to load track " << argv[i] << "\n";
+                return -1;
+            }
+            trackPtr = &track;
+        } else if (strcmp(argv[i], "--scenario") == 0 && i + 1 < argc) {
+            scenarioPath = argv[++i];
+        } else if (strcmp(argv[i], "--write-scenario") == 0 && i + 2 < argc) {
+            writeScenarioSpec = argv[++i];
+            writeScenarioPath = argv[++i];
+        } else if (strcmp(argv[i], "--convert-scenario") == 0 && i + 2 < argc) {
+            convertInPath = argv[++i];
+            convertOutPath = argv[++i];
+        } else if (strcmp(argv[i], "--surface") == 0 && i + 1 < argc) {
+            surfacePath = argv[++i];
+        } else if (strcmp(argv[i], "--write-surface") == 0 && i + 2 < argc) {
+            writeSurfaceSpec = argv[++i];
+            writeSurfacePath = argv[++i];
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            framesPath = argv[++i];
+        } else if (strcmp(argv[i], "--frame-rate") == 0 && i + 1 < argc) {
+            frameRate = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--frame-size") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &frameWidth, &frameHeight) != 2 || frameWidth <= 0 || frameHeight <= 0) {
+                std::cerr << "Invalid frame size: " << argv[i] << "\n";
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--frame-format") == 0 && i + 1 < argc) {
+            if (!parseFrameFormat(argv[++i], &frameFormat)) {
+                std::cerr << "Unknown frame format: " << argv[i] << "\n";
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            csvPath = argv[++i];
+        } else {
+            printUsage();
+            return -1;
+        }
+    }
+
+    // File commands run on their own, once every argument has been read
+    if (writeScenarioSpec)
+        return writeScenarioCommand(writeScenarioSpec, writeScenarioPath);
+    if (convertInPath)
+        return convertScenarioCommand(convertInPath, convertOutPath);
+    if (writeSurfaceSpec)
+        return writeSurfaceCommand(writeSurfaceSpec, writeSurfacePath);
+
+    // A resumed run takes its configuration from the checkpoint. Only a
+    // single run resumes; sweeps and searches start every run from rest.
+    static RunState loaded;
+    if (loadStatePath) {
+        if (!grid.axes.empty() || !problem.bounds.empty() || fleetSize > 0) {
+            std::cerr << "--load-state resumes a single run and cannot be combined with --sweep, --optimize"
+                         " or --fleet\n";
+            return -1;
+        }
+        if (!readCheckpoint(loadStatePath, loaded)) {
+            std::cerr << "Failed to read checkpoint " << loadStatePath << "\n";
+            return -1;
+        }
+        model = loaded.model;
+        tires = loaded.constants.tireModel;
+        motor = loaded.motor;
+        dt = loaded.dt;
+    }
+
+    // A scenario file runs to its end unless the step count is given
+    if (steps == 0)
+        steps = scenarioPath && fleetSize == 0 ? LONG_MAX : 20000;
+    if (steps <= 0 || dt <= 0.0f || repeat <= 0 || frameRate <= 0.0f || mpcSamples < 0 ||
+        mpcSamples > MPC_MAX_SAMPLES || mpcHorizon < 0 || mpcHorizon > MPC_MAX_HORIZON) {
+        printUsage();
+        return -1;
+    }
+
+    static Scenario scenario;
+    if (scenarioPath && !openScenario(scenario, scenarioPath)) {
+        std::cerr << "Failed to read scenario " << scenarioPath << "\n";
+        return -1;
+    }
+    if (surfacePath) {
+        if (!openSurfaceMap(surface, surfacePath)) {
+            std::cerr << "Failed to load surface map " << surfacePath << "\n";
+            return -1;
+        }
+        surfacePtr = &surface;
+    }
+
+    if (motorBench) {
+        runMotorBenchmark(repeat);
+        return 0;
+    }
+
+    if (integratorBench) {
+        runIntegratorBenchmark(maneuver, (double)steps * dt, repeat);
+        return 0;
+    }
+
+    if (tireBench) {
+        runTireBenchmark(repeat);
+        return 0;
+    }
+
+    if (integratorGiven) {
+        if (model != MODEL_BICYCLE || motor || fleetSize > 0 || !grid.axes.empty() || !problem.bounds.empty() ||
+            trackPtr || scenarioPath || recordPath || framesPath || saveStatePath || loadStatePath) {
+            std::cerr << "--integrator runs the bicycle model through a maneuver on its own\n";
+            return -1;
+        }
+        runIntegratorCommand(maneuver, integrator, (double)steps * dt, dt, repeat);
+        return 0;
+    }
+
+    if (fleetSize > 0) {
+        runFleetComparison(maneuver, (size_t)fleetSize, steps, dt);
+        return 0;
+    }
+
+    if (!problem.bounds.empty()) {
+        if (!objectiveGiven && trackPtr)
+            problem.objective = OBJECTIVE_LAP_TIME;
+        if (problem.objective == OBJECTIVE_LAP_TIME && !trackPtr) {
+            std::cerr << "The lap-time objective needs a --track\n";
+            return -1;
+        }
+        if ((int)problem.bounds.size() > OPT_MAX_PARAMS || generations < 1 || population > OPT_MAX_POPULATION) {
+            printUsage();
+            return -1;
+        }
+        problem.base = makeDefaultCar();
+        problem.maneuver = maneuver;
+        problem.model = model;
+        problem.motor = motor;
+        problem.tires = tires;
+        problem.steps = steps;
+        problem.dt = dt;
+        problem.track = trackPtr;
+        problem.scenarioPath = scenarioPath;
+        problem.surface = surfacePtr;
+        return runOptimizeCommand(problem, generations, population, seed, threads > 0 ? threads : 1, optStatePath);
+    }
+
+    if (!grid.axes.empty()) {
+        grid.base = makeDefaultCar();
+        grid.maneuver = maneuver;
+        grid.model = model;
+        grid.motor = motor;
+        grid.tires = tires;
+        grid.steps = steps;
+        grid.dt = dt;
+        grid.track = trackPtr;
+        grid.scenarioPath = scenarioPath;
+        grid.surface = surfacePtr;
+        grid.forkStep = lroundf(forkSeconds / dt);
+        return runSweepCommand(grid, threads > 0 ? threads : 1, csvPath);
+    }
+
+    // A recording holds a single run
+    static TelemetryRecorder recorder;
+    if (recordPath) {
+        if (!startTelemetry(recorder, recordPath, dt)) {
+            std::cerr << "Failed to open " << recordPath << "\n";
+            return -1;
+        }
+        repeat = 1;
+    }
+
+    // So do rendered frames
+    static SoftScene scene;
+    static FrameWriter frames;
+    if (framesPath) {
+        initSoftScene(scene, trackPtr ? track.x : std::vector<float>(), trackPtr ? track.z : std::vector<float>());
+        if (!startFrameWriter(frames, framesPath, frameFormat, frameWidth, frameHeight, threads, &scene)) {
+            std::cerr << "Failed to create " << framesPath << "\n";
+            return -1;
+        }
+        frames.stepsPerFrame = std::max(1L, lroundf(1.0f / (frameRate * dt)));
+        repeat = 1;
+    }
+    if (saveStatePath || loadStatePath)
+        repeat = 1;
+
+    static RunState state;
+    long firstStep = loadStatePath ? loaded.step : 0;
+    long lastStep = steps > LONG_MAX - firstStep ? LONG_MAX : firstStep + steps;
+    ScenarioResult result;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeat; r++) {
+        if (scenarioPath && r > 0)
+            rewindScenario(scenario);
+        if (loadStatePath)
+            state = loaded;
+        else
+            initRunState(state, makeDefaultCar(), model, motor, tires, dt, trackPtr);
+        if (mpcSamples > 0)
+            state.mpcSettings.samples = mpcSamples;
+        if (mpcHorizon > 0)
+            state.mpcSettings.horizon = mpcHorizon;
+        result = continueScenario(state, maneuver, lastStep, recordPath ? &recorder : nullptr, trackPtr,
+                                  scenarioPath ? &scenario : nullptr, framesPath ? &frames : nullptr, surfacePtr);
+    }
+    if (framesPath)
+        stopFrameWriter(frames);
+    auto end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+    long runSteps = result.steps - firstStep;
+    double totalSteps = (double)runSteps * repeat;
+
+    if (loadStatePath)
+        printf("Resumed %s at t=%.3f s\n", loadStatePath, firstStep * dt);
+    printf("Simulated %.1f s in %ld steps of %.4f s (x%d)\n", runSteps * dt, runSteps, dt, repeat);
+    printf("Final pose: x=%.3f m, z=%.3f m, heading=%.2f deg, speed=%.3f m/s\n",
+           result.x, result.z, result.heading * RAD2DEG, result.velocity);
+    printf("Peak loads: front=%.1f N, rear=%.1f N, |a_lat|=%.3f m/s^2\n",
+           result.maxFzFront, result.maxFzRear, result.maxLatAccel);
+    if (trackPtr) {
+        printf("Track: %zu points, %.1f m; %d laps", track.x.size(), track.length, result.laps);
+        if (result.laps > 0)
+            printf(", best %.3f s (%.1f km/h average)", result.bestLap, track.length / result.bestLap * 3.6f);
+        printf("\n");
+    }
+    printf("Wall time: %.3f s, %.2f M steps/s, %.1f ns/step (%.0fx real time)\n",
+           seconds, totalSteps / seconds * 1e-6, seconds / totalSteps * 1e9, totalSteps * dt / seconds);
+    if (model == MODEL_4W_MPC)
+        printMpcTiming(state.mpcSettings, mpcWorkspace().timing);
+    if (recordPath) {
+        if (!stopTelemetry(recorder)) {
+            std::cerr << "Failed to write telemetry " << recordPath << "\n";
+            return -1;
+        }
+        printf("Recorded %llu samples to %s (%llu dropped)\n", (unsigned long long)recorder.header.sampleCount,
+               recordPath, (unsigned long long)recorder.header.droppedCount);
+    }
+    if (saveStatePath) {
+        if (!writeCheckpoint(saveStatePath, state)) {
+            std::cerr << "Failed to write checkpoint " << saveStatePath << "\n";
+            return -1;
+        }
+        printf("Saved state at t=%.3f s to %s (%zu bytes)\n", result.steps * dt, saveStatePath, sizeof(RunState));
+    }
+    if (framesPath) {
+        printf("Wrote %ld %dx%d frames to %s (%.1f frames/s", frames.written, frameWidth, frameHeight, framesPath,
+               frames.written / seconds);
+        if (frames.failed > 0)
+            printf(", %ld failed", frames.failed);
+        printf(")\n");
+        if (frames.failed > 0)
+            return -1;
+    }
+    return 0;
+}
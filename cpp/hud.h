@@ -0,0 +1,187 @@
+// hud.h
+//
+// Heads-up display of labelled numeric readouts. Every line owns fixed
+// buffers for its text and a fixed slot of quads in one GPU vertex buffer.
+// Values are formatted with formatFixed() into those buffers (no streams,
+// no heap), and a line's quads are rebuilt with stb_easy_font and
+// re-uploaded only when its displayed text actually changes. All lines are
+// then drawn with a single glMultiDrawElementsBaseVertex call.
+
+#pragma once
+
+#include <GL/glew.h>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "renderer.h"
+#include "stb_easy_font.h"
+
+const int MAX_HUD_LINES = 16;
+const int MAX_HUD_TEXT = 64;          // characters per line
+const int MAX_HUD_LINE_QUADS = 512;   // stb_easy_font quads per line
+const int HUD_LINE_HEIGHT = 12;       // pixels, as stb_easy_font advances on '\n'
+
+struct HudLine {
+    const char* label;        // e.g. "Speed: "
+    const char* unit;         // e.g. " m/s"
+    int decimals;
+    char text[MAX_HUD_TEXT];  // label + value + unit as displayed
+    int quadCount;
+};
+
+struct Hud {
+    float x, y;               // Top-left of the first line (pixels)
+    int lineCount;
+    HudLine lines[MAX_HUD_LINES];
+    uint32_t dirtyMask;       // Lines whose quads must be rebuilt
+
+    GLuint vao;
+    GLuint vertexBuffer;
+    char quads[MAX_HUD_LINE_QUADS * 4 * 16]; // stb_easy_font output for one line
+};
+
+// Function to write 'value' with a fixed number of decimals (0-6) into
+// 'out'; returns the length. Mirrors std::fixed, except that exact ties
+// round away from zero and values which round to zero never print a minus
+// sign (so a car at rest does not flicker between "0.00" and "-0.00").
+inline int formatFixed(float value, int decimals, char* out, int size) {
+    static const int64_t POW10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+    char digits[32];
+    int n = 0;
+
+    if (size < 2) {
+        if (size == 1)
+            out[0] = '\0';
+        return 0;
+    }
+    if (decimals < 0)
+        decimals = 0;
+    if (decimals > 6)
+        decimals = 6;
+    if (!(fabsf(value) < 1e12f)) {
+        const char* text = value != value ? "nan" : (value < 0.0f ? "-inf" : "inf");
+        int len = (int)strlen(text);
+        if (len > size - 1)
+            len = size - 1;
+        memcpy(out, text, len);
+        out[len] = '\0';
+        return len;
+    }
+
+    int64_t scaled = (int64_t)llround(fabs((double)value) * (double)POW10[decimals]);
+    bool negative = value < 0.0f && scaled != 0;
+
+    // Digits are produced least significant first
+    for (int d = 0; d < decimals; d++) {
+        digits[n++] = (char)('0' + scaled % 10);
+        scaled /= 10;
+    }
+    if (decimals > 0)
+        digits[n++] = '.';
+    do {
+        digits[n++] = (char)('0' + scaled % 10);
+        scaled /= 10;
+    } while (scaled > 0);
+    if (negative)
+        digits[n++] = '-';
+
+    int len = n < size - 1 ? n : size - 1;
+    for (int i = 0; i < len; i++)
+        out[i] = digits[n - 1 - i];
+    out[len] = '\0';
+    return len;
+}
+
+// Function to create the HUD's GPU buffer; text is drawn with the
+// renderer's text program and shared quad index buffer
+inline void initHud(Hud& hud, Renderer& renderer, float x, float y) {
+    hud.x = x;
+    hud.y = y;
+    hud.lineCount = 0;
+    hud.dirtyMask = 0;
+
+    glGenVertexArrays(1, &hud.vao);
+    glBindVertexArray(hud.vao);
+    glGenBuffers(1, &hud.vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, hud.vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, MAX_HUD_LINES * sizeof(hud.quads), NULL, GL_DYNAMIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 16, (void*)0);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer.textIndexBuffer);
+    glBindVertexArray(0);
+}
+
+// Function to add a readout line; returns its index for setHudValue()
+inline int addHudLine(Hud& hud, const char* label, const char* unit, int decimals) {
+    if (hud.lineCount >= MAX_HUD_LINES)
+        return -1;
+    int index = hud.lineCount++;
+    HudLine& line = hud.lines[index];
+    line.label = label;
+    line.unit = unit;
+    line.decimals = decimals;
+    line.text[0] = '\0';
+    line.quadCount = 0;
+    hud.dirtyMask |= 1u << index;
+    return index;
+}
+
+// Function to update a readout. Cheap when the displayed text is unchanged.
+inline void setHudValue(Hud& hud, int index, float value) {
+    if (index < 0 || index >= hud.lineCount)
+        return;
+    HudLine& line = hud.lines[index];
+    char text[MAX_HUD_TEXT];
+    int len = 0;
+
+    int labelLength = (int)strlen(line.label);
+    if (labelLength > MAX_HUD_TEXT - 1)
+        labelLength = MAX_HUD_TEXT - 1;
+    memcpy(text, line.label, labelLength);
+    len = labelLength;
+    len += formatFixed(value, line.decimals, text + len, MAX_HUD_TEXT - len);
+    int unitLength = (int)strlen(line.unit);
+    if (unitLength > MAX_HUD_TEXT - 1 - len)
+        unitLength = MAX_HUD_TEXT - 1 - len;
+    memcpy(text + len, line.unit, unitLength);
+    len += unitLength;
+    text[len] = '\0';
+
+    if (memcmp(text, line.text, len + 1) != 0) {
+        memcpy(line.text, text, len + 1);
+        hud.dirtyMask |= 1u << index;
+    }
+}
+
+// Function to rebuild and upload changed lines, then draw every line
+inline void drawHud(Hud& hud, Renderer& renderer, int width, int height) {
+    glBindBuffer(GL_ARRAY_BUFFER, hud.vertexBuffer);
+    for (int i = 0; i < hud.lineCount; i++) {
+        if (!(hud.dirtyMask & (1u << i)))
+            continue;
+        HudLine& line = hud.lines[i];
+        line.quadCount = stb_easy_font_print(hud.x, hud.y + (float)(i * HUD_LINE_HEIGHT), line.text, NULL,
+                                             hud.quads, sizeof(hud.quads));
+        glBufferSubData(GL_ARRAY_BUFFER, i * sizeof(hud.quads), line.quadCount * 4 * 16, hud.quads);
+    }
+    hud.dirtyMask = 0;
+
+    GLsizei counts[MAX_HUD_LINES];
+    const void* offsets[MAX_HUD_LINES];
+    GLint baseVertices[MAX_HUD_LINES];
+    for (int i = 0; i < hud.lineCount; i++) {
+        counts[i] = hud.lines[i].quadCount * 6;
+        offsets[i] = (const void*)0;
+        baseVertices[i] = i * MAX_HUD_LINE_QUADS * 4;
+    }
+
+    glDisable(GL_DEPTH_TEST);
+    glUseProgram(renderer.textProgram);
+    glUniform2f(renderer.textScreenSize, (float)width, (float)height);
+    glUniform3f(renderer.textColor, 1.0f, 1.0f, 1.0f); // White color
+    glBindVertexArray(hud.vao);
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts, GL_UNSIGNED_INT, offsets, hud.lineCount, baseVertices);
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+}
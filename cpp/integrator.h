@@ -0,0 +1,367 @@
+// integrator.h
+//
+// Pluggable integrators for the kinematic bicycle.
+//
+// stepBicycle() in car.h is one explicit Euler step with the speed clamped
+// afterwards, so it is only accurate at a small fixed dt. Here the same
+// model is written as an ODE y' = f(t, y) over a packed double state
+// (x, z, heading, velocity, steer) with the driver input a function of
+// time, and advanced by one of:
+//   - explicit Euler, all derivatives from the start of the step
+//   - semi-implicit Euler: velocity and steer first, then position and
+//     heading from the new values
+//   - classic fourth-order Runge-Kutta at a fixed step
+//   - Dormand-Prince 5(4): the embedded fourth-order solution gives a local
+//     error estimate, and a PI controller sizes the next step from it, so
+//     straights take long steps and transients short ones. The last stage
+//     is the derivative at the new point and starts the next step (FSAL).
+//
+// The speed limits and the steering lock are events rather than clamps.
+// When a step carries a limited component past its bound, the crossing is
+// located on a cubic Hermite interpolant, the step is retaken up to it,
+// and the component is held at the bound for as long as the input keeps
+// pushing against it.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "car.h"
+
+enum IntegratorMethod {
+    INTEGRATOR_EULER,         // Explicit Euler
+    INTEGRATOR_SEMI_IMPLICIT, // Semi-implicit (symplectic) Euler
+    INTEGRATOR_RK4,           // Classic Runge-Kutta, fixed step
+    INTEGRATOR_DOPRI5,        // Dormand-Prince 5(4), adaptive step
+    INTEGRATOR_COUNT
+};
+
+const char* const INTEGRATOR_NAMES[INTEGRATOR_COUNT] = { "euler", "semi-implicit", "rk4", "dopri5" };
+
+// Function to look up an integrator by name
+inline bool parseIntegrator(const char* name, IntegratorMethod* method) {
+    for (int i = 0; i < INTEGRATOR_COUNT; i++) {
+        if (strcmp(name, INTEGRATOR_NAMES[i]) == 0) {
+            *method = (IntegratorMethod)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Components of the packed state
+enum BicycleStateIndex {
+    STATE_X,                  // (m)
+    STATE_Z,                  // (m)
+    STATE_HEADING,            // (radians)
+    STATE_VELOCITY,           // (m/s)
+    STATE_STEER,              // (radians)
+    STATE_SIZE
+};
+
+struct IntegratorSettings {
+    IntegratorMethod method;
+    double step;              // Fixed step, or the first trial step for dopri5 (s)
+    double maxStep;           // Longest dopri5 step (s)
+    double relTolerance;      // dopri5 error tolerance relative to the state
+    double absTolerance;      // and absolute, per component
+};
+
+// Function to get reasonable settings for 'method'
+inline IntegratorSettings makeIntegratorSettings(IntegratorMethod method) {
+    IntegratorSettings settings = {
+        method,
+        method == INTEGRATOR_DOPRI5 ? 0.01 : 0.001,   // step (s)
+        0.5,                                          // maxStep (s)
+        1e-6,                                         // relTolerance
+        1e-6,                                         // absTolerance
+    };
+    return settings;
+}
+
+struct IntegratorStats {
+    long evaluations;         // Derivative evaluations
+    long accepted;            // Steps taken
+    long rejected;            // dopri5 steps retried for too large an error
+    long events;              // Steps cut short at a speed limit or the steering lock
+};
+
+struct BicycleIntegrator {
+    IntegratorSettings settings;
+    BicycleCoefficients k;
+    float maxSteer;           // (radians)
+    float maxAcceleration;    // (m/s²)
+    float maxDeceleration;    // (m/s²)
+
+    double t;                 // Time of 'y' (s)
+    double y[STATE_SIZE];
+    int velocityLimit;        // +1 held at MAX_FORWARD_SPEED, -1 at MAX_REVERSE_SPEED, 0 free
+    int steerLimit;           // +1 held at left lock, -1 at right lock, 0 free
+
+    double h;                 // Next dopri5 trial step (s)
+    double previousError;     // Error norm of the last accepted step, for the PI controller
+    double f[STATE_SIZE];     // Derivative at (t, y) when 'fValid'
+    bool fValid;
+    IntegratorStats stats;
+};
+
+// Function to set up an integrator at time 't' from the state and
+// parameters of 'car'; a car already at a limit starts held there
+inline void initBicycleIntegrator(BicycleIntegrator& b, const Car& car, const IntegratorSettings& settings,
+                                  double t) {
+    b.settings = settings;
+    b.k = makeBicycleCoefficients(car);
+    b.maxSteer = car.maxSteer;
+    b.maxAcceleration = car.maxAcceleration;
+    b.maxDeceleration = car.maxDeceleration;
+    b.t = t;
+    b.y[STATE_X] = car.x;
+    b.y[STATE_Z] = car.z;
+    b.y[STATE_HEADING] = car.heading;
+    b.y[STATE_VELOCITY] = std::min(std::max(car.velocity, MAX_REVERSE_SPEED), MAX_FORWARD_SPEED);
+    b.y[STATE_STEER] = std::min(std::max(car.steerAngle, -car.maxSteer), car.maxSteer);
+    b.velocityLimit = b.y[STATE_VELOCITY] == MAX_FORWARD_SPEED ? 1 : b.y[STATE_VELOCITY] == MAX_REVERSE_SPEED ? -1 : 0;
+    b.steerLimit = b.y[STATE_STEER] == car.maxSteer ? 1 : b.y[STATE_STEER] == -car.maxSteer ? -1 : 0;
+    b.h = settings.step;
+    b.previousError = 1e-4;
+    b.fValid = false;
+    b.stats = IntegratorStats{ 0, 0, 0, 0 };
+}
+
+// Function to get the longitudinal acceleration commanded by 'throttle' at
+// speed 'v', as applyDriverInput() sets it
+inline double bicycleAcceleration(const BicycleIntegrator& b, double v, float throttle) {
+    if (throttle > 0.0f)
+        return (double)b.maxAcceleration * throttle;
+    if (throttle < 0.0f)
+        return -(double)b.maxDeceleration * throttle;
+    return -0.015 * v - 0.001 * v * fabs(v);
+}
+
+// Function to evaluate the bicycle ODE at (t, y)
+template <typename Input>
+inline void bicycleDerivative(BicycleIntegrator& b, Input& input, double t, const double y[STATE_SIZE],
+                              double dy[STATE_SIZE]) {
+    b.stats.evaluations++;
+    DriverInput u = input(t);
+    double v = y[STATE_VELOCITY];
+    double tanSteer = tan(y[STATE_STEER]);
+    double beta = fabs(v) > 0.1 ? atan(b.k.betaGain * tanSteer) : 0.0;
+    dy[STATE_X] = v * cos(y[STATE_HEADING] + beta);
+    dy[STATE_Z] = v * sin(y[STATE_HEADING] + beta);
+    dy[STATE_HEADING] = v * tanSteer * b.k.invWheelbase;
+
+    // A held component stays put while the input pushes it against its bound
+    double a = bicycleAcceleration(b, v, u.throttle);
+    dy[STATE_VELOCITY] = b.velocityLimit * a > 0.0 ? 0.0 : a;
+    double steerRate = STEER_SPEED * u.steer;
+    dy[STATE_STEER] = b.steerLimit * steerRate > 0.0 ? 0.0 : steerRate;
+}
+
+// Function to take one step of 'h' from (t, y) with a fixed-step method;
+// 'f0' is the derivative at the start
+template <typename Input>
+inline void fixedBicycleStep(BicycleIntegrator& b, Input& input, double h, const double f0[STATE_SIZE],
+                             double y1[STATE_SIZE]) {
+    const double* y0 = b.y;
+    double tmp[STATE_SIZE], k2[STATE_SIZE], k3[STATE_SIZE], k4[STATE_SIZE];
+    switch (b.settings.method) {
+    case INTEGRATOR_SEMI_IMPLICIT:
+        for (int i = 0; i < STATE_SIZE; i++)
+            tmp[i] = y0[i];
+        tmp[STATE_VELOCITY] += h * f0[STATE_VELOCITY];
+        tmp[STATE_STEER] += h * f0[STATE_STEER];
+        bicycleDerivative(b, input, b.t, tmp, k2);
+        for (int i = 0; i < STATE_SIZE; i++)
+            y1[i] = i == STATE_VELOCITY || i == STATE_STEER ? tmp[i] : y0[i] + h * k2[i];
+        break;
+    case INTEGRATOR_RK4:
+        for (int i = 0; i < STATE_SIZE; i++)
+            tmp[i] = y0[i] + 0.5 * h * f0[i];
+        bicycleDerivative(b, input, b.t + 0.5 * h, tmp, k2);
+        for (int i = 0; i < STATE_SIZE; i++)
+            tmp[i] = y0[i] + 0.5 * h * k2[i];
+        bicycleDerivative(b, input, b.t + 0.5 * h, tmp, k3);
+        for (int i = 0; i < STATE_SIZE; i++)
+            tmp[i] = y0[i] + h * k3[i];
+        bicycleDerivative(b, input, b.t + h, tmp, k4);
+        for (int i = 0; i < STATE_SIZE; i++)
+            y1[i] = y0[i] + h / 6.0 * (f0[i] + 2.0 * k2[i] + 2.0 * k3[i] + k4[i]);
+        break;
+    default:
+        for (int i = 0; i < STATE_SIZE; i++)
+            y1[i] = y0[i] + h * f0[i];
+        break;
+    }
+}
+
+// Function to take one Dormand-Prince step of 'h' from (t, y). Writes the
+// fifth-order solution, the derivative there (the FSAL stage) and returns
+// the RMS error norm against the tolerances; below 1 is acceptable.
+template <typename Input>
+inline double dopriBicycleStep(BicycleIntegrator& b, Input& input, double h, const double f0[STATE_SIZE],
+                               double y1[STATE_SIZE], double f1[STATE_SIZE]) {
+    static const double C2 = 1.0 / 5, C3 = 3.0 / 10, C4 = 4.0 / 5, C5 = 8.0 / 9;
+    static const double A21 = 1.0 / 5;
+    static const double A31 = 3.0 / 40, A32 = 9.0 / 40;
+    static const double A41 = 44.0 / 45, A42 = -56.0 / 15, A43 = 32.0 / 9;
+    static const double A51 = 19372.0 / 6561, A52 = -25360.0 / 2187, A53 = 64448.0 / 6561, A54 = -212.0 / 729;
+    static const double A61 = 9017.0 / 3168, A62 = -355.0 / 33, A63 = 46732.0 / 5247, A64 = 49.0 / 176,
+                        A65 = -5103.0 / 18656;
+    static const double B1 = 35.0 / 384, B3 = 500.0 / 1113, B4 = 125.0 / 192, B5 = -2187.0 / 6784, B6 = 11.0 / 84;
+    // Fifth- minus fourth-order weights
+    static const double E1 = 71.0 / 57600, E3 = -71.0 / 16695, E4 = 71.0 / 1920, E5 = -17253.0 / 339200,
+                        E6 = 22.0 / 525, E7 = -1.0 / 40;
+
+    const double* y0 = b.y;
+    double k2[STATE_SIZE], k3[STATE_SIZE], k4[STATE_SIZE], k5[STATE_SIZE], k6[STATE_SIZE], tmp[STATE_SIZE];
+    for (int i = 0; i < STATE_SIZE; i++)
+        tmp[i] = y0[i] + h * A21 * f0[i];
+    bicycleDerivative(b, input, b.t + C2 * h, tmp, k2);
+    for (int i = 0; i < STATE_SIZE; i++)
+        tmp[i] = y0[i] + h * (A31 * f0[i] + A32 * k2[i]);
+    bicycleDerivative(b, input, b.t + C3 * h, tmp, k3);
+    for (int i = 0; i < STATE_SIZE; i++)
+        tmp[i] = y0[i] + h * (A41 * f0[i] + A42 * k2[i] + A43 * k3[i]);
+    bicycleDerivative(b, input, b.t + C4 * h, tmp, k4);
+    for (int i = 0; i < STATE_SIZE; i++)
+        tmp[i] = y0[i] + h * (A51 * f0[i] + A52 * k2[i] + A53 * k3[i] + A54 * k4[i]);
+    bicycleDerivative(b, input, b.t + C5 * h, tmp, k5);
+    for (int i = 0; i < STATE_SIZE; i++)
+        tmp[i] = y0[i] + h * (A61 * f0[i] + A62 * k2[i] + A63 * k3[i] + A64 * k4[i] + A65 * k5[i]);
+    bicycleDerivative(b, input, b.t + h, tmp, k6);
+    for (int i = 0; i < STATE_SIZE; i++)
+        y1[i] = y0[i] + h * (B1 * f0[i] + B3 * k3[i] + B4 * k4[i] + B5 * k5[i] + B6 * k6[i]);
+    bicycleDerivative(b, input, b.t + h, y1, f1);
+
+    double sum = 0.0;
+    for (int i = 0; i < STATE_SIZE; i++) {
+        double e = h * (E1 * f0[i] + E3 * k3[i] + E4 * k4[i] + E5 * k5[i] + E6 * k6[i] + E7 * f1[i]);
+        // Heading only grows with laps driven, so its error is measured against 1 rad
+        double magnitude = i == STATE_HEADING ? 1.0 : std::max(fabs(y0[i]), fabs(y1[i]));
+        double scale = b.settings.absTolerance + b.settings.relTolerance * magnitude;
+        sum += (e / scale) * (e / scale);
+    }
+    return sqrt(sum / STATE_SIZE);
+}
+
+// Function to find where component 'c' first passes 'bound' between y0 and
+// y1, as a fraction of the step, on the cubic Hermite interpolant through
+// both ends; with no end derivative (f1 == nullptr) it is linear
+inline double locateCrossing(const double y0[STATE_SIZE], const double y1[STATE_SIZE], const double f0[STATE_SIZE],
+                             const double* f1, double h, int c, double bound) {
+    double p0 = y0[c] - bound, p1 = y1[c] - bound;
+    double m0 = f1 ? h * f0[c] : y1[c] - y0[c];
+    double m1 = f1 ? h * f1[c] : y1[c] - y0[c];
+    double lo = 0.0, hi = 1.0;
+    for (int i = 0; i < 40; i++) {
+        double s = 0.5 * (lo + hi);
+        double s2 = s * s, s3 = s2 * s;
+        double p = (2 * s3 - 3 * s2 + 1) * p0 + (s3 - 2 * s2 + s) * m0 + (-2 * s3 + 3 * s2) * p1 + (s3 - s2) * m1;
+        if ((p > 0.0) == (p1 > 0.0))
+            hi = s;
+        else
+            lo = s;
+    }
+    return hi;
+}
+
+// Function to advance the integrator to 'tEnd' under input(t), which
+// returns the DriverInput at time t. The first derivative of every call is
+// evaluated afresh, so the input may change freely between calls.
+template <typename Input>
+inline void integrateBicycle(BicycleIntegrator& b, Input input, double tEnd) {
+    const bool adaptive = b.settings.method == INTEGRATOR_DOPRI5;
+    double y1[STATE_SIZE], f1[STATE_SIZE];
+    b.fValid = false;
+
+    while (tEnd - b.t > 1e-12 * std::max(1.0, fabs(tEnd))) {
+        if (!b.fValid) {
+            bicycleDerivative(b, input, b.t, b.y, b.f);
+            b.fValid = true;
+        }
+        double trial = adaptive ? std::min(b.h, b.settings.maxStep) : b.settings.step;
+        bool clipped = trial >= tEnd - b.t;
+        double h = clipped ? tEnd - b.t : trial;
+
+        double error = 0.0;
+        if (adaptive) {
+            error = dopriBicycleStep(b, input, h, b.f, y1, f1);
+            if (error > 1.0) {
+                b.stats.rejected++;
+                b.h = h * std::max(0.2, 0.9 * pow(error, -0.2));
+                continue;
+            }
+        } else {
+            fixedBicycleStep(b, input, h, b.f, y1);
+        }
+
+        // Cut the step at the earliest bound it crosses, if any
+        double cut = 1.0;
+        int cutComponent = -1, cutSide = 0;
+        const int components[2] = { STATE_VELOCITY, STATE_STEER };
+        const double upper[2] = { MAX_FORWARD_SPEED, b.maxSteer };
+        const double lower[2] = { MAX_REVERSE_SPEED, -b.maxSteer };
+        const int held[2] = { b.velocityLimit, b.steerLimit };
+        for (int j = 0; j < 2; j++) {
+            int c = components[j];
+            int side = held[j] != 0 ? 0 : y1[c] > upper[j] ? 1 : y1[c] < lower[j] ? -1 : 0;
+            if (side == 0)
+                continue;
+            double s = locateCrossing(b.y, y1, b.f, adaptive ? f1 : nullptr, h, c, side > 0 ? upper[j] : lower[j]);
+            if (s < cut) {
+                cut = s;
+                cutComponent = j;
+                cutSide = side;
+            }
+        }
+        if (cutComponent >= 0) {
+            h *= cut;
+            clipped = false;
+            if (adaptive)
+                dopriBicycleStep(b, input, h, b.f, y1, f1);
+            else
+                fixedBicycleStep(b, input, h, b.f, y1);
+            int c = components[cutComponent];
+            y1[c] = cutSide > 0 ? upper[cutComponent] : lower[cutComponent];
+            if (cutComponent == 0)
+                b.velocityLimit = cutSide;
+            else
+                b.steerLimit = cutSide;
+            b.stats.events++;
+        }
+
+        // Accept
+        b.t = cutComponent < 0 && h == tEnd - b.t ? tEnd : b.t + h;
+        memcpy(b.y, y1, sizeof(y1));
+        b.stats.accepted++;
+        if (b.velocityLimit != 0 && b.y[STATE_VELOCITY] != (b.velocityLimit > 0 ? MAX_FORWARD_SPEED : MAX_REVERSE_SPEED))
+            b.velocityLimit = 0;
+        if (b.steerLimit != 0 && b.y[STATE_STEER] != b.steerLimit * (double)b.maxSteer)
+            b.steerLimit = 0;
+        if (adaptive && cutComponent < 0) {
+            memcpy(b.f, f1, sizeof(f1));
+            // PI step control; a step shortened to land on tEnd keeps its longer proposal
+            double factor = 0.9 * pow(std::max(error, 1e-10), -0.17) * pow(b.previousError, 0.04);
+            factor = std::min(5.0, std::max(0.2, factor));
+            b.h = clipped ? std::max(b.h, h * factor) : h * factor;
+            b.previousError = std::max(error, 1e-4);
+        } else {
+            b.fValid = false;
+        }
+    }
+}
+
+// Function to copy the integrated state back into 'car', with the
+// acceleration and yaw rate under 'input' as stepBicycle() leaves them
+inline void storeBicycleState(const BicycleIntegrator& b, Car& car, const DriverInput& input) {
+    car.x = (float)b.y[STATE_X];
+    car.z = (float)b.y[STATE_Z];
+    car.heading = (float)b.y[STATE_HEADING];
+    car.velocity = (float)b.y[STATE_VELOCITY];
+    car.steerAngle = (float)b.y[STATE_STEER];
+    car.acceleration = (float)bicycleAcceleration(b, b.y[STATE_VELOCITY], input.throttle);
+    car.yawRate = (float)(b.y[STATE_VELOCITY] * tan(b.y[STATE_STEER]) * b.k.invWheelbase);
+}
@@ -6,252 +6,372 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
 #include <cmath>
-#include <sstream>
-#include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
 
 // Include stb_easy_font.h for text rendering
 // Download from: https://github.com/nothings/stb/blob/master/stb_easy_font.h
 #define STB_EASY_FONT_IMPLEMENTATION
 #include "stb_easy_font.h"
 
-// Constants
-const float PI = 3.14159265358979323846f;
-const float DEG2RAD = PI / 180.0f;
-const float RAD2DEG = 180.0f / PI;
-const float GRAVITY = 9.81f;
-
-// Define the initial position and orientation of the car
-struct Car {
-    // Position and orientation
-    float x, y, z;            // Position in world coordinates
-    float heading;            // Heading angle (radians)
-    float velocity;           // Speed (m/s)
-    float acceleration;       // Acceleration along the car's axis (m/s^2)
-    float steerAngle;         // Steering angle (radians)
-    float yawRate;            // Yaw rate (radians per second)
-
-    // Vehicle parameters
-    float mass;               // Mass of the car (kg)
-    float length;             // Total length of the car (m)
-    float width;              // Width of the car (m)
-    float wheelbase;          // Distance between front and rear axles (m)
-    float lf;                 // Distance from CG to front axle (m)
-    float lr;                 // Distance from CG to rear axle (m)
-    float Iz;                 // Yaw moment of inertia (kg·m²)
-    float Cf;                 // Cornering stiffness front (N/rad)
-    float Cr;                 // Cornering stiffness rear (N/rad)
-    float maxSteer;           // Maximum steering angle (radians)
-    float maxAcceleration;    // Maximum acceleration (m/s²)
-    float maxDeceleration;    // Maximum deceleration (m/s²)
-    float h_cg;               // Height of the center of gravity (m)
-    float trackWidth;         // Width between left and right wheels (m)
-} car = {
-    // Initial position and orientation
-    0.0f, 0.5f, 0.0f,         // x, y, z
-    0.0f,                     // heading
-    0.0f,                     // velocity
-    0.0f,                     // acceleration
-    0.0f,                     // steerAngle
-    0.0f,                     // yawRate
-
-    // Vehicle parameters
-    1500.0f,                  // mass (kg)
-    4.5f,                     // length (m)
-    1.8f,                     // width (m)
-    2.5f,                     // wheelbase (m)
-    1.25f,                    // lf (m)
-    1.25f,                    // lr (m)
-    2250.0f,                  // Iz (kg·m²)
-    80000.0f,                 // Cf (N/rad)
-    80000.0f,                 // Cr (N/rad)
-    30.0f * DEG2RAD,          // maxSteer (radians)
-    5.0f,                     // maxAcceleration (m/s²)
-    -10.0f,                   // maxDeceleration (m/s²)
-    0.55f,                    // h_cg (m)
-    1.6f                      // trackWidth (m)
-};
-
-// Timing
-float deltaTime = 0.0f;
-float lastFrame = 0.0f;
+#include "car.h"
+#include "driver.h"
+#include "fleet.h"
+#include "frame_capture.h"
+#include "maneuver.h"
+#include "motor.h"
+#include "mpc.h"
+#include "profiler.h"
+#include "profiler_overlay.h"
+#include "hud.h"
+#include "renderer.h"
+#include "scenario.h"
+#include "sim_clock.h"
+#include "sim_thread.h"
+#include "surface.h"
+#include "telemetry.h"
+#include "vehicle4w.h"
+#include "world_tiles.h"
 
 // Function to process input
-void processInput(GLFWwindow* window) {
+DriverInput processInput(GLFWwindow* window) {
     // Close window on ESC
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
     // Handle steering
-    float steerInput = 0.0f;
+    DriverInput input = { 0.0f, 0.0f };
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
-        steerInput = 1.0f;
+        input.steer = 1.0f;
     }
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
-        steerInput = -1.0f;
+        input.steer = -1.0f;
     }
 
-    // Update steering angle
-    float steerSpeed = 1.5f; // Steering speed (radians per second)
-    car.steerAngle += steerSpeed * steerInput * deltaTime;
-    if (car.steerAngle > car.maxSteer)
-        car.steerAngle = car.maxSteer;
-    if (car.steerAngle < -car.maxSteer)
-        car.steerAngle = -car.maxSteer;
-
     // Handle acceleration and braking
-    float accelerationInput = 0.0f;
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-        accelerationInput = 1.0f;
+        input.throttle = 1.0f;
     }
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-        accelerationInput = -1.0f;
+        input.throttle = -1.0f;
     }
 
-    // Update acceleration
-    if (accelerationInput > 0.0f) {
-        car.acceleration = car.maxAcceleration * accelerationInput;
-    } else if (accelerationInput < 0.0f) {
-        car.acceleration = -car.maxDeceleration * accelerationInput;
-    } else {
-        // Apply rolling resistance and aerodynamic drag when no input
-        float rollingResistance = -0.015f * car.velocity;
-        float aerodynamicDrag = -0.001f * car.velocity * fabsf(car.velocity);
-        car.acceleration = rollingResistance + aerodynamicDrag;
-    }
+    return input;
 }
 
-// Function to set up basic lighting
-void setupLighting() {
-    glEnable(GL_LIGHTING);
-    glEnable(GL_LIGHT0);
+// Function to advance the replay position by one frame of 'frameTime'
+// seconds. Keys: LEFT/RIGHT rewind and fast-forward at 20x while held,
+// SPACE holds the picture, 0-9 jump to that tenth of the recording.
+double processReplayInput(GLFWwindow* window, double position, double frameTime, double duration) {
+    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+        glfwSetWindowShouldClose(window, true);
 
-    GLfloat light_position[] = { 5.0f, 5.0f, 5.0f, 1.0f };
-    GLfloat light_ambient[] = { 0.2f, 0.2f, 0.2f, 1.0f };
-    GLfloat light_diffuse[] = { 0.8f, 0.8f, 0.8f, 1.0f };
-    GLfloat light_specular[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    double rate = 1.0;
+    if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
+        rate = 20.0;
+    if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
+        rate = -20.0;
+    if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)
+        rate = 0.0;
+    position += rate * frameTime;
+
+    for (int digit = 0; digit <= 9; digit++) {
+        if (glfwGetKey(window, GLFW_KEY_0 + digit) == GLFW_PRESS)
+            position = duration * digit / 10.0;
+    }
 
-    glLightfv(GL_LIGHT0, GL_POSITION, light_position);
-    glLightfv(GL_LIGHT0, GL_AMBIENT, light_ambient);
-    glLightfv(GL_LIGHT0, GL_DIFFUSE, light_diffuse);
-    glLightfv(GL_LIGHT0, GL_SPECULAR, light_specular);
+    if (position > duration)
+        position = duration;
+    if (position < 0.0)
+        position = 0.0;
+    return position;
 }
 
-// Function to draw a simple cube centered at the origin
-void drawCube() {
-    glBegin(GL_QUADS);
-
-    // Front face (z = 1.0f)
-    glColor3f(0.8f, 0.0f, 0.0f);     // Dark Red
-    glVertex3f(-0.5f, -0.5f,  0.5f);
-    glVertex3f(0.5f, -0.5f,  0.5f);
-    glVertex3f(0.5f,  0.5f,  0.5f);
-    glVertex3f(-0.5f,  0.5f,  0.5f);
-
-    // Back face (z = -1.0f)
-    glColor3f(0.8f, 0.0f, 0.0f);     // Dark Red
-    glVertex3f(-0.5f, -0.5f, -0.5f);
-    glVertex3f(-0.5f,  0.5f, -0.5f);
-    glVertex3f(0.5f,  0.5f, -0.5f);
-    glVertex3f(0.5f, -0.5f, -0.5f);
-
-    // Left face (x = -1.0f)
-    glColor3f(0.8f, 0.0f, 0.0f);     // Dark Red
-    glVertex3f(-0.5f, -0.5f, -0.5f);
-    glVertex3f(-0.5f, -0.5f,  0.5f);
-    glVertex3f(-0.5f,  0.5f,  0.5f);
-    glVertex3f(-0.5f,  0.5f, -0.5f);
-
-    // Right face (x = 1.0f)
-    glColor3f(0.8f, 0.0f, 0.0f);     // Dark Red
-    glVertex3f(0.5f, -0.5f, -0.5f);
-    glVertex3f(0.5f,  0.5f, -0.5f);
-    glVertex3f(0.5f,  0.5f,  0.5f);
-    glVertex3f(0.5f, -0.5f,  0.5f);
-
-    // Top face (y = 1.0f)
-    glColor3f(0.9f, 0.1f, 0.1f);     // Lighter Red
-    glVertex3f(-0.5f, 0.5f, -0.5f);
-    glVertex3f(-0.5f, 0.5f,  0.5f);
-    glVertex3f(0.5f, 0.5f,  0.5f);
-    glVertex3f(0.5f, 0.5f, -0.5f);
-
-    // Bottom face (y = -1.0f)
-    glColor3f(0.6f, 0.0f, 0.0f);     // Darker Red
-    glVertex3f(-0.5f, -0.5f, -0.5f);
-    glVertex3f(0.5f, -0.5f, -0.5f);
-    glVertex3f(0.5f, -0.5f,  0.5f);
-    glVertex3f(-0.5f, -0.5f,  0.5f);
-
-    glEnd();
+// Function to place n scripted cars on a grid next to the start, spread
+// over the same setups as headless --fleet
+void populateFleet(Fleet& fleet, size_t n) {
+    size_t columns = (size_t)ceilf(sqrtf((float)n));
+    fleet.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        Car car = makeFleetCar(i, n);
+        car.x = 6.0f * (float)(i % columns);
+        car.z = 4.0f * (float)(i / columns + 1);
+        fleet.addCar(car);
+    }
 }
 
-// Function to draw an arrow representing normal load
-void drawArrow(float x, float y, float z, float load) {
-    float scale = 0.0005f;
-    float arrowHeight = load * scale;
-
-    glLineWidth(3.0f);
-    glBegin(GL_LINES);
-    glColor3f(0.0f, 1.0f, 1.0f); // Cyan color for load arrows
-    glVertex3f(x, y, z);
-    glVertex3f(x, y + arrowHeight, z);
-    glEnd();
-
-    // Arrowhead
-    glBegin(GL_TRIANGLES);
-    glColor3f(0.0f, 1.0f, 1.0f); // Same color
-    glVertex3f(x - 0.05f, y + arrowHeight, z - 0.05f);
-    glVertex3f(x + 0.05f, y + arrowHeight, z - 0.05f);
-    glVertex3f(x, y + arrowHeight + 0.1f, z);
-    glEnd();
+// Function to line the fleet up behind the start of a track, 8 m apart
+void placeFleetOnTrack(Fleet& fleet, const Track& track) {
+    for (size_t k = 0; k < fleet.count; k++) {
+        Car car = makeDefaultCar();
+        placeOnTrack(car, track, -8.0f * (float)(k + 1));
+        fleet.x[k] = car.x;
+        fleet.z[k] = car.z;
+        fleet.heading[k] = car.heading;
+    }
 }
 
-// Function to draw normal load arrows at front and rear axles
-void drawNormalLoadArrows(float frontLoad, float rearLoad) {
-    // Positions of the axles relative to the car's center
-    float frontZ = car.lf;
-    float rearZ = -car.lr;
-    float centerX = 0.0f;
+// Everything the physics steps touch. While the sim thread runs, only it
+// touches this; the render thread draws from SimSnapshots. The fleet's
+// geometry arrays are the one exception: they never change after setup,
+// so drawing reads them in place.
+struct Simulation {
+    VehicleModel model;           // Model for your car
+    bool motor;                   // Throttle drives the DC motor
+    Vehicle4W vehicle;            // Your car; the bicycle model steps vehicle.car directly
+    Vehicle4WConstants constants;
+    MotorState motorState;
+    MotorStepper motorStepper;
+    MpcSettings mpcSettings;      // Predictive controller (MODEL_4W_MPC)
+    MpcPlan mpc;
+    Fleet fleet;                  // Scripted cars alongside, or lapping the track
+    const Track* track;           // Track being lapped, or nullptr
+    std::vector<DriverState> drivers; // Track drivers: yours, then one per fleet car
+    Scenario* scenario;           // Scripted input until it runs out, or nullptr
+    double scenarioEnd;           // Script time the scenario ran out (s), negative until then
+    const SurfaceMap* surface;    // Road surface under your wheels (4w models), or nullptr
+    TelemetryRecorder* recorder;  // Per-step log, or nullptr
+    Car previousCar;              // State before the latest step, to interpolate the drawn pose
+    StepOutput step;              // Outputs of the latest step
+    float wheelLoads[CORNER_COUNT];
+};
 
-    // Front Axle
-    drawArrow(centerX, 0.5f, frontZ, frontLoad);
+// What one frame draws and shows on the HUD, copied out of the Simulation
+struct SimSnapshot {
+    Car previousCar, car;         // Your car before and after the latest step
+    float alpha;                  // How far wall time is into the next step (0..1)
+    StepOutput step;
+    float wheelLoads[CORNER_COUNT];
+    float yawMoment;              // Torque vectoring yaw moment (Nm)
+    float motorCurrent;           // Motor armature current (A)
+    float motorSpeed;             // Motor speed (rad/s)
+    int laps;
+    float lastLap, bestLap;       // Lap times (s), 0 before the first lap
+    double scenarioEnd;           // See Simulation
+    std::vector<float> fleetX, fleetZ, fleetHeading;
+    std::vector<float> fleetLoads; // CORNER_COUNT corner loads per fleet car (N)
+};
 
-    // Rear Axle
-    drawArrow(centerX, 0.5f, rearZ, rearLoad);
+// Function to take one physics step. Held keys win over the autopilot and
+// the script, which both keep running so lap times and script time stay
+// right while you take over.
+void stepSimulation(Simulation& sim, const DriverInput& keys, long stepIndex) {
+    typedef StaticBicycle<DEFAULT_VEHICLE> Bicycle;
+    const float dt = (float)PHYSICS_DT;
+    Car& car = sim.vehicle.car;
+    bool keysHeld = keys.steer != 0.0f || keys.throttle != 0.0f;
+    sim.previousCar = car;
+
+    DriverInput input = keys;
+    float t = (float)stepIndex * dt;
+    if (sim.track) {
+        DriverInput autopilot = trackDriverInput(*sim.track, sim.drivers[0], car, t, dt);
+        if (!keysHeld)
+            input = autopilot;
+    }
+    if (sim.scenario) {
+        // The script keeps its own time from the first step
+        double scriptTime = (double)stepIndex * PHYSICS_DT;
+        DriverInput script;
+        if (!scenarioInput(*sim.scenario, car, scriptTime, dt, &script)) {
+            // Reported and closed on the render thread; this may be the sim thread
+            sim.scenarioEnd = scriptTime;
+            sim.scenario = nullptr;
+        } else if (!keysHeld) {
+            input = script;
+        }
+    }
+    if (sim.motor)
+        applyMotorDrive(car, sim.motorState, sim.motorStepper, input);
+    else
+        applyDriverInput(car, input, dt);
+    if (sim.surface && sim.model != MODEL_BICYCLE)
+        sampleWheelSurface(sim.vehicle, sim.constants, *sim.surface);
+    if (sim.model == MODEL_BICYCLE) {
+        sim.step = stepBicycle(car, Bicycle(), dt);
+        computeCornerLoads(Bicycle::coefficients, car.acceleration, sim.step.a_lat, sim.wheelLoads);
+    } else if (sim.model == MODEL_4W_MPC) {
+        updateMpc(sim.mpcSettings, sim.mpc, mpcWorkspace(), sim.vehicle, dt);
+        sim.step =
+            stepVehicle4WControlled(sim.vehicle, sim.constants, dt, sim.mpc.yawMoment, sim.mpc.steerCorrection);
+        memcpy(sim.wheelLoads, sim.vehicle.load, sizeof(sim.wheelLoads));
+    } else {
+        sim.step = stepVehicle4W(sim.vehicle, sim.constants, dt, sim.model == MODEL_4W_TV);
+        memcpy(sim.wheelLoads, sim.vehicle.load, sizeof(sim.wheelLoads));
+    }
+    if (sim.recorder)
+        recordTelemetry(*sim.recorder, makeTelemetrySample(stepIndex, car, input, sim.step, sim.wheelLoads));
+
+    Fleet& fleet = sim.fleet;
+    if (fleet.count > 0 && sim.track) {
+        Car laneCar = makeDefaultCar();
+        for (size_t k = 0; k < fleet.count; k++) {
+            fleet.getCar(k, laneCar);
+            laneCar.wheelbase = 1.0f / fleet.invWheelbase[k];
+            laneCar.maxSteer = fleet.maxSteer[k];
+            DriverInput lane = trackDriverInput(*sim.track, sim.drivers[1 + k], laneCar, t, dt);
+            fleet.steerInput[k] = lane.steer;
+            fleet.throttleInput[k] = lane.throttle;
+        }
+        stepFleet(fleet, dt);
+    } else if (fleet.count > 0) {
+        DriverInput script = scriptedInput(MANEUVER_SLALOM, t);
+        for (size_t k = 0; k < fleet.count; k++) {
+            fleet.steerInput[k] = script.steer;
+            fleet.throttleInput[k] = script.throttle;
+        }
+        stepFleet(fleet, dt);
+    }
 }
 
-// Function to render text on the screen
-void renderText(float x, float y, const char* text) {
-    char buffer[99999]; // ~500 chars
-    int num_quads;
-
-    num_quads = stb_easy_font_print(x, y, (char*)text, NULL, buffer, sizeof(buffer));
-
-    glPushMatrix();
-    glLoadIdentity();
+// Function to size a snapshot's fleet arrays once, so filling it never allocates
+void initSnapshot(SimSnapshot& view, size_t fleetCount) {
+    view.fleetX.assign(fleetCount, 0.0f);
+    view.fleetZ.assign(fleetCount, 0.0f);
+    view.fleetHeading.assign(fleetCount, 0.0f);
+    view.fleetLoads.assign(fleetCount * CORNER_COUNT, 0.0f);
+}
 
-    glDisable(GL_TEXTURE_2D);
-    glColor3f(1, 1, 1); // White color
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glVertexPointer(2, GL_FLOAT, 16, buffer);
-    glDrawArrays(GL_QUADS, 0, num_quads * 4);
-    glDisableClientState(GL_VERTEX_ARRAY);
+// Function to copy the latest simulation state into a snapshot
+void writeSnapshot(const Simulation& sim, float alpha, SimSnapshot& view) {
+    view.previousCar = sim.previousCar;
+    view.car = sim.vehicle.car;
+    view.alpha = alpha;
+    view.step = sim.step;
+    memcpy(view.wheelLoads, sim.wheelLoads, sizeof(view.wheelLoads));
+    view.yawMoment = sim.vehicle.tv.yawMoment;
+    view.motorCurrent = sim.motorState.current;
+    view.motorSpeed = sim.motorState.speed;
+    view.scenarioEnd = sim.scenarioEnd;
+    if (sim.track) {
+        const DriverState& driver = sim.drivers[0];
+        view.laps = driver.laps;
+        view.lastLap = driver.lastLap;
+        view.bestLap = driver.laps > 0 ? driver.bestLap : 0.0f;
+    } else {
+        view.laps = 0;
+        view.lastLap = view.bestLap = 0.0f;
+    }
 
-    glPopMatrix();
+    const Fleet& fleet = sim.fleet;
+    for (size_t k = 0; k < fleet.count; k++) {
+        view.fleetX[k] = fleet.x[k];
+        view.fleetZ[k] = fleet.z[k];
+        view.fleetHeading[k] = fleet.heading[k];
+        fleetCornerLoads(fleet, k, &view.fleetLoads[k * CORNER_COUNT]);
+    }
 }
 
 // Main function
-int main() {
+// Usage: ./main [--fleet N] [--model bicycle|4w|4w-tv|4w-mpc] [--motor] [--tires linear|magic]
+//               [--record FILE | --replay FILE] [--trace FILE]
+//               [--track FILE|oval[:N]] [--scenario FILE] [--surface FILE] [--serial]
+//               [--frames DIR [--frame-format ppm|png]]
+//   --fleet N   N scripted cars are simulated and drawn next to yours
+//   --model     vehicle model for your car (default: bicycle)
+//   --motor     throttle drives the parameters.m DC motor instead of a fixed acceleration
+//   --tires     tire model of the 4w models: linear (default) or the Magic Formula of tire.h
+//   --record    log every physics step of your car to a telemetry file
+//   --replay    play a telemetry file (from --record or headless --record) instead of driving
+//   --trace     on exit, write the profiler zones as Chrome trace JSON (build with ./run.sh profile)
+//   --track     drive laps of a centerline CSV or generated oval; the fleet follows it too, and
+//               your car is on autopilot while none of W/A/S/D is held
+//   --scenario  drive your car from a scripted input file (headless --write-scenario); W/A/S/D
+//               still take over while held, and the keyboard has it back once the script ends
+//   --surface   friction and grade under each wheel of the 4w models from a road-surface map
+//               (headless --write-surface)
+//   --serial    step the physics on the render thread between frames instead of on its own
+//               thread (the physics zone then shows in the profiler overlay)
+//   --frames    also save every drawn frame to DIR/frame_NNNNNN.png (or .ppm), read back
+//               asynchronously and encoded off the render thread; the window is not resizable
+int main(int argc, char** argv) {
+    size_t fleetSize = 0;
+    VehicleModel model = MODEL_BICYCLE;
+    bool motor = false;
+    TireModel tires = TIRE_LINEAR;
+    const char* recordPath = nullptr;
+    const char* replayPath = nullptr;
+    const char* tracePath = nullptr;
+    static Track track;
+    bool onTrack = false;
+    static Scenario scenario;
+    const char* scenarioPath = nullptr;
+    static SurfaceMap surface;
+    const char* surfacePath = nullptr;
+    bool serial = false;
+    const char* framesPath = nullptr;
+    FrameFormat frameFormat = FRAME_PNG;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--fleet") == 0 && i + 1 < argc) {
+            fleetSize = (size_t)atol(argv[++i]);
+        } else if (strcmp(argv[i], "--model") == 0 && i + 1 < argc && parseVehicleModel(argv[i + 1], &model)) {
+            i++;
+        } else if (strcmp(argv[i], "--motor") == 0) {
+            motor = true;
+        } else if (strcmp(argv[i], "--tires") == 0 && i + 1 < argc && parseTireModel(argv[i + 1], &tires)) {
+            i++;
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (strcmp(argv[i], "--track") == 0 && i + 1 < argc) {
+            if (!parseTrack(argv[++i], track)) {
+                std::cerr << "Failed to load track " << argv[i] << "\n";
+                return -1;
+            }
+            onTrack = true;
+        } else if (strcmp(argv[i], "--scenario") == 0 && i + 1 < argc) {
+            scenarioPath = argv[++i];
+        } else if (strcmp(argv[i], "--surface") == 0 && i + 1 < argc) {
+            surfacePath = argv[++i];
+        } else if (strcmp(argv[i], "--serial") == 0) {
+            serial = true;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            framesPath = argv[++i];
+        } else if (strcmp(argv[i], "--frame-format") == 0 && i + 1 < argc && parseFrameFormat(argv[i + 1], &frameFormat)) {
+            i++;
+        } else {
+            std::cerr << "Usage: main [--fleet N] [--model bicycle|4w|4w-tv|4w-mpc] [--motor] [--tires linear|magic]"
+                         " [--record FILE | --replay FILE]"
+                         " [--trace FILE] [--track FILE|oval[:N]] [--scenario FILE] [--surface FILE] [--serial]"
+                         " [--frames DIR [--frame-format ppm|png]]\n";
+            return -1;
+        }
+    }
+
+    // Map the recording up front; replay reads it in place
+    TelemetryReplay replay;
+    if (replayPath && !openTelemetry(replay, replayPath)) {
+        std::cerr << "Failed to open telemetry file " << replayPath << "\n";
+        return -1;
+    }
+    if (scenarioPath && !openScenario(scenario, scenarioPath)) {
+        std::cerr << "Failed to open scenario " << scenarioPath << "\n";
+        return -1;
+    }
+    if (surfacePath && !openSurfaceMap(surface, surfacePath)) {
+        std::cerr << "Failed to open surface map " << surfacePath << "\n";
+        return -1;
+    }
+
     // Initialize GLFW
     if (!glfwInit()) {
         std::cerr << "Failed to initialize GLFW\n";
         return -1;
     }
 
-    // Remove OpenGL version hints to use default (compatibility profile)
-    // glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    // glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    // glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    // Request a 3.3 core profile; everything is drawn through renderer.h shaders
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+
+    // Captured frames all have the size of the first
+    if (framesPath)
+        glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
 
     // Create a windowed mode window and its OpenGL context
     GLFWwindow* window = glfwCreateWindow(1280, 720, "3D Car Controller with Realistic Physics", NULL, NULL);
@@ -264,7 +384,7 @@ int main() {
     // Make the window's context current
     glfwMakeContextCurrent(window);
 
-    // Initialize GLEW (optional for modern OpenGL)
+    // Initialize GLEW
     glewExperimental = GL_TRUE;
     if (glewInit() != GLEW_OK) {
         std::cerr << "Failed to initialize GLEW\n";
@@ -281,162 +401,316 @@ int main() {
     // Set a clear color
     glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
 
-    // Set up basic lighting
-    setupLighting();
+    // Build shaders and static meshes
+    static Renderer renderer;
+    if (!initRenderer(renderer)) {
+        glfwTerminate();
+        return -1;
+    }
 
-    // Set up 2D orthographic projection for text rendering
+    // Set up the HUD readouts, drawn in window pixel coordinates
     int width, height;
     glfwGetWindowSize(window, &width, &height);
-
-    // Main loop
-    while (!glfwWindowShouldClose(window)) {
-        // Calculate delta time
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-
-        // Process input
-        processInput(window);
-
-        // Update vehicle dynamics using the bicycle model
-        float beta = 0.0f; // Slip angle at vehicle center of gravity
-        if (fabsf(car.velocity) > 0.1f) {
-            beta = atan2f((car.lr * tanf(car.steerAngle)) / (car.lf + car.lr), 1.0f);
+    static Hud hud;
+    initHud(hud, renderer, 10.0f, 20.0f);
+    int hudSpeed = addHudLine(hud, "Speed: ", " m/s", 2);
+    int hudAcceleration = addHudLine(hud, "Acceleration: ", " m/s^2", 2);
+    int hudSteering = addHudLine(hud, "Steering Angle: ", " degrees", 2);
+    int hudHeading = addHudLine(hud, "Heading: ", " degrees", 2);
+    int hudFrontLoad = addHudLine(hud, "Front Normal Load: ", " N", 2);
+    int hudRearLoad = addHudLine(hud, "Rear Normal Load: ", " N", 2);
+    bool yawControl = model == MODEL_4W_TV || model == MODEL_4W_MPC;
+    int hudYawMoment = yawControl ? addHudLine(hud, "Yaw Moment: ", " Nm", 0) : -1;
+    int hudMotorCurrent = motor ? addHudLine(hud, "Motor Current: ", " A", 0) : -1;
+    int hudMotorSpeed = motor ? addHudLine(hud, "Motor Speed: ", " rad/s", 0) : -1;
+    int hudReplayTime = replayPath ? addHudLine(hud, "Replay Time: ", " s", 3) : -1;
+    int hudLap = onTrack ? addHudLine(hud, "Laps: ", "", 0) : -1;
+    int hudLastLap = onTrack ? addHudLine(hud, "Last Lap: ", " s", 3) : -1;
+    int hudBestLap = onTrack ? addHudLine(hud, "Best Lap: ", " s", 3) : -1;
+    static ProfilerOverlay overlay;
+
+    // Frame capture: read back on the GPU, encoded on the writer's threads
+    static FrameWriter frames;
+    static FrameCapture capture;
+    if (framesPath) {
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        int workers = (int)std::thread::hardware_concurrency() - 1;
+        if (!startFrameWriter(frames, framesPath, frameFormat, framebufferWidth, framebufferHeight,
+                              workers > 1 ? workers : 1, nullptr)) {
+            std::cerr << "Failed to create " << framesPath << "\n";
+            glfwTerminate();
+            return -1;
         }
+        initFrameCapture(capture, framebufferWidth, framebufferHeight);
+    }
 
-        // Lateral acceleration
-        float a_lat = (car.velocity * car.velocity * tanf(car.steerAngle)) / car.wheelbase;
-
-        // Longitudinal acceleration is car.acceleration
+    // Simulation state; see Simulation for which thread may touch it
+    static Simulation sim;
+    sim.model = model;
+    sim.motor = motor;
+
+    // Simulated vehicle. The bicycle model steps the Car directly; the
+    // four-wheel model keeps its extra state (lateral speed, per-wheel
+    // forces, controller) around the same Car record.
+    sim.vehicle = makeVehicle4W(makeCar(DEFAULT_VEHICLE));
+    sim.constants = makeVehicle4WConstants(sim.vehicle.car);
+    sim.constants.tireModel = tires;
+    sim.mpcSettings = makeMpcSettings(sim.vehicle.car);
+    sim.mpc = makeMpcPlan();
+    Car& car = sim.vehicle.car;
+
+    // Traction motor, integrated implicitly at the physics rate
+    sim.motorState = { 0.0f, 0.0f };
+    sim.motorStepper = makeMotorStepper(makeDefaultMotor(), car.mass, (float)PHYSICS_DT, MOTOR_IMPLICIT);
+
+    // Optional fleet driving a slalom alongside, or laps of the track
+    Fleet& fleet = sim.fleet;
+    populateFleet(fleet, fleetSize);
+
+    // Track drivers: yours, then one per fleet car
+    sim.track = onTrack ? &track : nullptr;
+    if (onTrack) {
+        placeOnTrack(car, track, 0.0f);
+        placeFleetOnTrack(fleet, track);
+        sim.drivers.assign(1 + fleet.count, makeDriverState());
+    }
+    sim.scenario = scenarioPath ? &scenario : nullptr;
+    sim.scenarioEnd = -1.0;
+    sim.surface = surfacePath ? &surface : nullptr;
 
-        // Calculate load transfers
-        // Static normal loads
-        float Fz_front_static = (car.lr / car.wheelbase) * car.mass * GRAVITY;
-        float Fz_rear_static = (car.lf / car.wheelbase) * car.mass * GRAVITY;
+    // State before the latest step, used to interpolate the rendered pose
+    sim.previousCar = car;
 
-        // Longitudinal load transfer
-        float deltaFz_long = (car.h_cg / car.wheelbase) * car.mass * car.acceleration;
+    // A zero-length step gives the loads at rest, shown until the first physics step
+    sim.step = stepCar(sim.previousCar, 0.0f);
+    computeCornerLoads(car, sim.step.a_lat, sim.wheelLoads);
 
-        // Lateral load transfer (assuming it equally affects front and rear axles)
-        float deltaFz_lat = (car.h_cg / car.trackWidth) * car.mass * a_lat;
+    // Telemetry: written from the physics loop without blocking it
+    static TelemetryRecorder recorder;
+    if (recordPath && !startTelemetry(recorder, recordPath, PHYSICS_DT)) {
+        std::cerr << "Failed to create telemetry file " << recordPath << "\n";
+        glfwTerminate();
+        return -1;
+    }
+    sim.recorder = recordPath ? &recorder : nullptr;
+
+    // Snapshots the frames draw from. The sim thread publishes through
+    // 'published'; replay and --serial fill 'local' on this thread.
+    static TripleBuffer<SimSnapshot> published;
+    static SimSnapshot local;
+    for (SimSnapshot* view : { &published.slots[0], &published.slots[1], &published.slots[2], &local }) {
+        initSnapshot(*view, fleet.count);
+        writeSnapshot(sim, 0.0f, *view);
+    }
 
-        // Total normal loads
-        float Fz_front = Fz_front_static - deltaFz_long - deltaFz_lat / 2.0f;
-        float Fz_rear = Fz_rear_static + deltaFz_long - deltaFz_lat / 2.0f;
+    // Physics on its own thread at a steady 1 kHz, whatever the frame rate.
+    // Keyboard input reaches it through 'inputs' and holds until the next.
+    static SpscQueue<DriverInput, 64> inputs;
+    static SimThread simThread;
+    bool threaded = !replayPath && !serial;
+    if (threaded) {
+        startSimThread(simThread, [keys = DriverInput{ 0.0f, 0.0f }](const SimClock& clock, int steps) mutable {
+            PROFILE_ZONE("physics");
+            DriverInput queued;
+            while (inputs.pop(queued))
+                keys = queued;
+            for (int i = 0; i < steps; i++)
+                stepSimulation(sim, keys, clock.stepCount - steps + i);
+            writeSnapshot(sim, interpolationAlpha(clock), published.writeSlot());
+            published.publish();
+        });
+    }
 
-        // Update position and heading
-        float velocityX = car.velocity * cosf(car.heading + beta);
-        float velocityZ = car.velocity * sinf(car.heading + beta);
+    // Fixed-step physics clock for --serial
+    SimClock clock = makeSimClock(glfwGetTime());
+    double replayPosition = 0.0;
+    double replayDuration = replayPath ? (double)(replay.sampleCount > 0 ? replay.sampleCount - 1 : 0) * replay.dt : 0.0;
+    double lastFrameTime = glfwGetTime();
+    initProfiler();
 
-        car.x += velocityX * deltaTime;
-        car.z += velocityZ * deltaTime;
+    // Track tiles are built on a loader thread as the camera nears them
+    static TileStreamer tiles;
+    if (onTrack)
+        startTileStreamer(tiles, track.x, track.z);
 
-        car.heading += (car.velocity / car.wheelbase) * tanf(car.steerAngle) * deltaTime;
+    // Main loop
+    bool scenarioReported = false;
+    while (!glfwWindowShouldClose(window)) {
+        double now = glfwGetTime();
+        double frameTime = now - lastFrameTime;
+        lastFrameTime = now;
+
+        const SimSnapshot* view = &local;
+        if (replayPath) {
+            // Replay: the drawn state is read straight from the mapped file
+            replayPosition = processReplayInput(window, replayPosition, frameTime, replayDuration);
+            uint64_t sample = (uint64_t)(replayPosition / replay.dt + 0.5);
+            if (sample >= replay.sampleCount)
+                sample = replay.sampleCount > 0 ? replay.sampleCount - 1 : 0;
+            if (replay.sampleCount > 0) {
+                local.car.x = telemetryValue(replay, sample, TLM_X);
+                local.car.z = telemetryValue(replay, sample, TLM_Z);
+                local.car.heading = telemetryValue(replay, sample, TLM_HEADING);
+                local.car.velocity = telemetryValue(replay, sample, TLM_VELOCITY);
+                local.car.acceleration = telemetryValue(replay, sample, TLM_ACCELERATION);
+                local.car.steerAngle = telemetryValue(replay, sample, TLM_STEER_ANGLE);
+                local.car.yawRate = telemetryValue(replay, sample, TLM_YAW_RATE);
+                local.step.a_lat = telemetryValue(replay, sample, TLM_A_LAT);
+                local.step.Fz_front = telemetryValue(replay, sample, TLM_FZ_FRONT);
+                local.step.Fz_rear = telemetryValue(replay, sample, TLM_FZ_REAR);
+                for (int c = 0; c < CORNER_COUNT; c++)
+                    local.wheelLoads[c] = telemetryValue(replay, sample, (TelemetryColumn)(TLM_LOAD_FL + c));
+            }
+            local.previousCar = local.car;
+        } else if (threaded) {
+            // Take the newest state the sim thread has published, if any
+            published.acquire();
+            view = &published.readSlot();
+        } else {
+            // Process input; it is held for every physics step of this frame
+            DriverInput keys;
+            {
+                PROFILE_ZONE("input");
+                keys = processInput(window);
+            }
+
+            // Update vehicle dynamics in fixed steps
+            int steps = advanceClock(clock, now);
+            {
+                PROFILE_ZONE("physics");
+                for (int i = 0; i < steps; i++)
+                    stepSimulation(sim, keys, clock.stepCount - steps + i);
+            }
+            writeSnapshot(sim, interpolationAlpha(clock), local);
+        }
 
-        // Update velocity
-        car.velocity += car.acceleration * deltaTime;
+        if (view->scenarioEnd >= 0.0 && !scenarioReported) {
+            std::cout << "Scenario finished at " << view->scenarioEnd << " s" << std::endl;
+            scenarioReported = true;
+        }
 
-        // Limit speed
-        if (car.velocity > 55.0f)
-            car.velocity = 55.0f;
-        if (car.velocity < -20.0f)
-            car.velocity = -20.0f;
+        // Pose to draw, between the last two physics states
+        CarPose pose = interpolatePose(view->previousCar, view->car, view->alpha);
 
         // Render here
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // Set up the camera (following the car from behind)
-        glm::vec3 eyePos = glm::vec3(car.x - 8.0f * cosf(car.heading), 5.0f, car.z - 8.0f * sinf(car.heading));
-        glm::vec3 centerPos = glm::vec3(car.x, car.y, car.z);
-        glm::vec3 upVec = glm::vec3(0.0f, 1.0f, 0.0f);
-        glm::mat4 view = glm::lookAt(eyePos, centerPos, upVec);
-
-        // Set up the projection matrix
-        glm::mat4 projection = glm::perspective(glm::radians(60.0f), (float)width / height, 0.1f, 1000.0f);
-
-        // Load the projection and view matrices
-        glMatrixMode(GL_PROJECTION);
-        glLoadIdentity();
-        glLoadMatrixf(&projection[0][0]);
-
-        glMatrixMode(GL_MODELVIEW);
-        glLoadIdentity();
-        glLoadMatrixf(&view[0][0]);
-
-        // Draw the ground plane (a large grid)
-        glColor3f(0.3f, 0.3f, 0.3f);
-        glBegin(GL_LINES);
-        for (int i = -100; i <= 100; i++) {
-            glVertex3f((float)i, 0.0f, -100.0f);
-            glVertex3f((float)i, 0.0f,  100.0f);
-            glVertex3f(-100.0f, 0.0f, (float)i);
-            glVertex3f( 100.0f, 0.0f, (float)i);
+        {
+            PROFILE_ZONE("scene");
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            // Set up the camera (following the car from behind)
+            float sinHeading, cosHeading;
+            DefaultMath::sincos(pose.heading, &sinHeading, &cosHeading);
+            glm::vec3 eyePos = glm::vec3(pose.x - 8.0f * cosHeading, 5.0f, pose.z - 8.0f * sinHeading);
+            glm::vec3 centerPos = glm::vec3(pose.x, pose.y, pose.z);
+            glm::vec3 upVec = glm::vec3(0.0f, 1.0f, 0.0f);
+            glm::mat4 view3d = glm::lookAt(eyePos, centerPos, upVec);
+
+            // Set up the projection matrix
+            glm::mat4 projection = glm::perspective(glm::radians(60.0f), (float)width / height, 0.1f, 1000.0f);
+
+            // Stream this frame's instances: your car first, then the fleet
+            MeshInstance* bodies;
+            MeshInstance* arrows;
+            const Car& drawn = view->car;
+            beginInstances(renderer, (GLsizei)(1 + fleet.count), &bodies, &arrows);
+            writeCarInstances(&bodies[0], &arrows[0], pose.x, pose.y, pose.z, pose.heading,
+                              drawn.length, drawn.width, drawn.lf, drawn.lr, drawn.trackWidth, view->wheelLoads);
+            for (size_t k = 0; k < fleet.count; k++) {
+                writeCarInstances(&bodies[1 + k], &arrows[(1 + k) * CORNER_COUNT], view->fleetX[k], drawn.y,
+                                  view->fleetZ[k], view->fleetHeading[k], fleet.length[k], fleet.width[k],
+                                  fleet.lf[k], fleet.lr[k], fleet.trackWidth[k], &view->fleetLoads[k * CORNER_COUNT]);
+            }
+
+            // Draw the ground, the track, the cars and their wheel load arrows
+            streamTrackTiles(renderer, tiles, eyePos);
+            drawScene(renderer, projection * view3d, eyePos, (GLsizei)(1 + fleet.count));
+        }
+
+        // Update and draw the HUD; only readouts whose text changed are rebuilt
+        {
+            PROFILE_ZONE("hud");
+            setHudValue(hud, hudSpeed, view->car.velocity);
+            setHudValue(hud, hudAcceleration, view->car.acceleration);
+            setHudValue(hud, hudSteering, view->car.steerAngle * RAD2DEG);
+            setHudValue(hud, hudHeading, view->car.heading * RAD2DEG);
+            setHudValue(hud, hudFrontLoad, view->step.Fz_front);
+            setHudValue(hud, hudRearLoad, view->step.Fz_rear);
+            setHudValue(hud, hudYawMoment, view->yawMoment);
+            setHudValue(hud, hudMotorCurrent, view->motorCurrent);
+            setHudValue(hud, hudMotorSpeed, view->motorSpeed);
+            setHudValue(hud, hudReplayTime, (float)replayPosition);
+            setHudValue(hud, hudLap, (float)view->laps);
+            setHudValue(hud, hudLastLap, view->lastLap);
+            setHudValue(hud, hudBestLap, view->bestLap);
+            drawHud(hud, renderer, width, height);
+        }
+
+        // Frame timeline overlay (profiling builds only)
+        {
+            PROFILE_ZONE("overlay");
+            drawProfilerOverlay(overlay, renderer, width, height, (float)width - PROFILE_OVERLAY_WIDTH, 20.0f);
+        }
+
+        // Start reading this frame back before it is swapped away
+        if (framesPath) {
+            PROFILE_ZONE("capture");
+            captureFrame(capture, frames);
         }
-        glEnd();
-
-        // Apply car transformations
-        glPushMatrix();
-        glTranslatef(car.x, car.y, car.z);
-        glRotatef(car.heading * RAD2DEG, 0.0f, 1.0f, 0.0f);
-
-        // Draw the car
-        glScalef(car.length, 1.0f, car.width); // Scale the cube to represent a car
-        drawCube();
-
-        glPopMatrix();
-
-        // Draw normal load arrows at front and rear axles
-        glPushMatrix();
-        glTranslatef(car.x, car.y, car.z);
-        glRotatef(car.heading * RAD2DEG, 0.0f, 1.0f, 0.0f);
-        drawNormalLoadArrows(Fz_front, Fz_rear);
-        glPopMatrix();
-
-        // Render text (switch to orthographic projection)
-        glMatrixMode(GL_PROJECTION);
-        glPushMatrix();
-        glLoadIdentity();
-        glOrtho(0, width, height, 0, -1, 1);
-
-        glMatrixMode(GL_MODELVIEW);
-        glPushMatrix();
-        glLoadIdentity();
-
-        // Disable lighting for text rendering
-        glDisable(GL_LIGHTING);
-
-        // Prepare text content
-        std::stringstream ss;
-        ss << std::fixed << std::setprecision(2);
-        ss << "Speed: " << car.velocity << " m/s\n";
-        ss << "Acceleration: " << car.acceleration << " m/s^2\n";
-        ss << "Steering Angle: " << car.steerAngle * RAD2DEG << " degrees\n";
-        ss << "Heading: " << car.heading * RAD2DEG << " degrees\n";
-        ss << "Front Normal Load: " << Fz_front << " N\n";
-        ss << "Rear Normal Load: " << Fz_rear << " N\n";
-
-        // Render text
-        renderText(10.0f, 20.0f, ss.str().c_str());
-
-        // Re-enable lighting
-        glEnable(GL_LIGHTING);
-
-        // Restore previous projection and modelview matrices
-        glMatrixMode(GL_MODELVIEW);
-        glPopMatrix();
-        glMatrixMode(GL_PROJECTION);
-        glPopMatrix();
 
         // Swap front and back buffers
-        glfwSwapBuffers(window);
+        {
+            PROFILE_ZONE("swap");
+            glfwSwapBuffers(window);
+        }
 
-        // Poll for and process events
-        glfwPollEvents();
+        // Poll for and process events, and hand the keys straight to the sim thread
+        {
+            PROFILE_ZONE("events");
+            glfwPollEvents();
+        }
+        if (threaded) {
+            PROFILE_ZONE("input");
+            inputs.push(processInput(window));
+        }
+        profileFrame();
 
         // Update window size (in case of window resize)
         glfwGetWindowSize(window, &width, &height);
     }
 
+    stopTileStreamer(tiles);
+    if (threaded) {
+        stopSimThread(simThread);
+        std::cout << "Sim thread: " << simThread.stepCount.load() << " steps, "
+                  << simThread.lateBatches.load() << " late wakeups" << std::endl;
+    }
+    if (framesPath) {
+        finishFrameCapture(capture, frames);
+        stopFrameWriter(frames);
+        std::cout << "Wrote " << frames.written << " frames to " << framesPath << " (" << frames.dropped
+                  << " dropped, " << frames.failed << " failed)" << std::endl;
+    }
+    if (tracePath) {
+        if (writeProfileTrace(tracePath))
+            std::cout << "Wrote profiler trace to " << tracePath << std::endl;
+        else
+            std::cerr << "Failed to write profiler trace " << tracePath << " (needs a TVS_PROFILE build)\n";
+    }
+    if (recordPath) {
+        if (stopTelemetry(recorder))
+            std::cout << "Recorded " << recorder.header.sampleCount << " steps to " << recordPath
+                      << " (" << recorder.header.droppedCount << " dropped)" << std::endl;
+        else
+            std::cerr << "Failed to write telemetry " << recordPath << "\n";
+    }
+    if (replayPath)
+        closeTelemetry(replay);
+    if (scenarioPath)
+        closeScenario(scenario);
+    if (surfacePath)
+        closeSurfaceMap(surface);
+
     glfwTerminate();
     return 0;
 }
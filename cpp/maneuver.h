@@ -0,0 +1,60 @@
+// maneuver.h
+//
+// Scripted driver inputs for unattended runs. Each maneuver is a pure
+// function of simulation time, so runs are reproducible and independent
+// simulations can share it freely across threads.
+
+#pragma once
+
+#include <cmath>
+#include <cstring>
+
+#include "car.h"
+
+// Scripted driver maneuvers
+enum Maneuver {
+    MANEUVER_STRAIGHT,        // Full throttle, wheel centered
+    MANEUVER_STEP_STEER,      // Accelerate for 2 s, then hold left lock
+    MANEUVER_SLALOM,          // Constant throttle, 0.5 Hz sinusoidal steering
+};
+
+// Function to map a maneuver name to its enum value
+inline bool parseManeuver(const char* name, Maneuver* maneuver) {
+    if (strcmp(name, "straight") == 0) {
+        *maneuver = MANEUVER_STRAIGHT;
+    } else if (strcmp(name, "step-steer") == 0) {
+        *maneuver = MANEUVER_STEP_STEER;
+    } else if (strcmp(name, "slalom") == 0) {
+        *maneuver = MANEUVER_SLALOM;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Function to produce the scripted driver input at simulation time t
+inline DriverInput scriptedInput(Maneuver maneuver, float t) {
+    DriverInput input = { 0.0f, 0.0f };
+    switch (maneuver) {
+    case MANEUVER_STRAIGHT:
+        input.throttle = 1.0f;
+        break;
+    case MANEUVER_STEP_STEER:
+        input.throttle = t < 2.0f ? 1.0f : 0.0f;
+        input.steer = t < 2.0f ? 0.0f : 1.0f;
+        break;
+    case MANEUVER_SLALOM:
+        input.throttle = 0.3f;
+        input.steer = sinf(2.0f * PI * 0.5f * t);
+        break;
+    }
+    return input;
+}
+
+// Function to get the first time after t at which the maneuver's input
+// jumps (INFINITY if it never does); integrators step up to it exactly
+inline float nextManeuverChange(Maneuver maneuver, float t) {
+    if (maneuver == MANEUVER_STEP_STEER && t < 2.0f)
+        return 2.0f;
+    return INFINITY;
+}
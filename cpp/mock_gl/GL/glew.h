@@ -0,0 +1,135 @@
+// mock_gl/GL/glew.h
+//
+// Stand-in for GLEW used by the benchmark build (-Imock_gl). It declares
+// just the GL entry points renderer.h and hud.h call, and implements them
+// on the CPU. Buffers are host memory, so glBufferSubData and mapped
+// writes cost what the CPU side of a real driver would. Draws and other
+// state calls only bump counters, which lets bench.cpp measure the
+// submission path without a display or GPU and report calls and bytes
+// per frame.
+
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+typedef unsigned int GLenum;
+typedef unsigned int GLuint;
+typedef int GLint;
+typedef int GLsizei;
+typedef float GLfloat;
+typedef unsigned char GLboolean;
+typedef unsigned int GLbitfield;
+typedef char GLchar;
+typedef std::ptrdiff_t GLsizeiptr;
+typedef std::ptrdiff_t GLintptr;
+
+#define GL_FALSE 0
+#define GL_TRUE 1
+#define GL_LINES 0x0001
+#define GL_TRIANGLES 0x0004
+#define GL_UNSIGNED_INT 0x1405
+#define GL_FLOAT 0x1406
+#define GL_DEPTH_TEST 0x0B71
+#define GL_ARRAY_BUFFER 0x8892
+#define GL_ELEMENT_ARRAY_BUFFER 0x8893
+#define GL_STREAM_DRAW 0x88E0
+#define GL_STATIC_DRAW 0x88E4
+#define GL_DYNAMIC_DRAW 0x88E8
+#define GL_FRAGMENT_SHADER 0x8B30
+#define GL_VERTEX_SHADER 0x8B31
+#define GL_COMPILE_STATUS 0x8B81
+#define GL_LINK_STATUS 0x8B82
+#define GL_MAP_WRITE_BIT 0x0002
+#define GL_MAP_INVALIDATE_BUFFER_BIT 0x0008
+
+// Work submitted since the last reset
+struct MockGLStats {
+    long calls;               // Every GL entry point
+    long drawCalls;           // glDraw* and glMultiDraw*
+    long bytesUploaded;       // glBufferData / glBufferSubData / mapped ranges
+};
+
+struct MockGL {
+    MockGLStats stats;
+    GLuint nextName;
+    GLuint boundBuffer[2];    // GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER
+    std::vector<std::vector<unsigned char>> buffers;
+};
+
+inline MockGL mockGL = { { 0, 0, 0 }, 1, { 0, 0 }, {} };
+
+inline std::vector<unsigned char>& mockBound(GLenum target) {
+    GLuint name = mockGL.boundBuffer[target == GL_ELEMENT_ARRAY_BUFFER];
+    if (name >= mockGL.buffers.size())
+        mockGL.buffers.resize(name + 1);
+    return mockGL.buffers[name];
+}
+
+// Objects
+inline void glGenBuffers(GLsizei n, GLuint* names) { mockGL.stats.calls++; for (GLsizei i = 0; i < n; i++) names[i] = mockGL.nextName++; }
+inline void glGenVertexArrays(GLsizei n, GLuint* names) { mockGL.stats.calls++; for (GLsizei i = 0; i < n; i++) names[i] = mockGL.nextName++; }
+inline void glDeleteBuffers(GLsizei, const GLuint*) { mockGL.stats.calls++; }
+inline void glDeleteVertexArrays(GLsizei, const GLuint*) { mockGL.stats.calls++; }
+inline void glBindVertexArray(GLuint) { mockGL.stats.calls++; }
+inline void glBindBuffer(GLenum target, GLuint name) { mockGL.stats.calls++; mockGL.boundBuffer[target == GL_ELEMENT_ARRAY_BUFFER] = name; }
+
+// Buffer contents
+inline void glBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum) {
+    mockGL.stats.calls++;
+    std::vector<unsigned char>& buffer = mockBound(target);
+    buffer.resize((size_t)size);
+    if (data) {
+        memcpy(buffer.data(), data, (size_t)size);
+        mockGL.stats.bytesUploaded += size;
+    }
+}
+inline void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data) {
+    mockGL.stats.calls++;
+    memcpy(mockBound(target).data() + offset, data, (size_t)size);
+    mockGL.stats.bytesUploaded += size;
+}
+inline void* glMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr size, GLbitfield) {
+    mockGL.stats.calls++;
+    mockGL.stats.bytesUploaded += size;
+    return mockBound(target).data() + offset;
+}
+inline GLboolean glUnmapBuffer(GLenum) { mockGL.stats.calls++; return GL_TRUE; }
+
+// Vertex layout
+inline void glVertexAttribPointer(GLuint, GLint, GLenum, GLboolean, GLsizei, const void*) { mockGL.stats.calls++; }
+inline void glEnableVertexAttribArray(GLuint) { mockGL.stats.calls++; }
+inline void glVertexAttribDivisor(GLuint, GLuint) { mockGL.stats.calls++; }
+
+// Shaders; compilation always succeeds
+inline GLuint glCreateShader(GLenum) { mockGL.stats.calls++; return mockGL.nextName++; }
+inline void glShaderSource(GLuint, GLsizei, const GLchar* const*, const GLint*) { mockGL.stats.calls++; }
+inline void glCompileShader(GLuint) { mockGL.stats.calls++; }
+inline void glGetShaderiv(GLuint, GLenum, GLint* value) { mockGL.stats.calls++; *value = GL_TRUE; }
+inline void glGetShaderInfoLog(GLuint, GLsizei, GLsizei* length, GLchar* log) { mockGL.stats.calls++; if (length) *length = 0; if (log) log[0] = '\0'; }
+inline void glDeleteShader(GLuint) { mockGL.stats.calls++; }
+inline GLuint glCreateProgram() { mockGL.stats.calls++; return mockGL.nextName++; }
+inline void glAttachShader(GLuint, GLuint) { mockGL.stats.calls++; }
+inline void glLinkProgram(GLuint) { mockGL.stats.calls++; }
+inline void glGetProgramiv(GLuint, GLenum, GLint* value) { mockGL.stats.calls++; *value = GL_TRUE; }
+inline void glGetProgramInfoLog(GLuint, GLsizei, GLsizei* length, GLchar* log) { mockGL.stats.calls++; if (length) *length = 0; if (log) log[0] = '\0'; }
+inline GLint glGetUniformLocation(GLuint, const GLchar*) { mockGL.stats.calls++; return 0; }
+inline void glUseProgram(GLuint) { mockGL.stats.calls++; }
+
+// Uniforms and state
+inline void glUniform1f(GLint, GLfloat) { mockGL.stats.calls++; }
+inline void glUniform2f(GLint, GLfloat, GLfloat) { mockGL.stats.calls++; }
+inline void glUniform3f(GLint, GLfloat, GLfloat, GLfloat) { mockGL.stats.calls++; }
+inline void glUniformMatrix4fv(GLint, GLsizei, GLboolean, const GLfloat*) { mockGL.stats.calls++; }
+inline void glEnable(GLenum) { mockGL.stats.calls++; }
+inline void glDisable(GLenum) { mockGL.stats.calls++; }
+inline void glDepthMask(GLboolean) { mockGL.stats.calls++; }
+
+// Draws
+inline void glDrawArraysInstanced(GLenum, GLint, GLsizei, GLsizei) { mockGL.stats.calls++; mockGL.stats.drawCalls++; }
+inline void glDrawElements(GLenum, GLsizei, GLenum, const void*) { mockGL.stats.calls++; mockGL.stats.drawCalls++; }
+inline void glMultiDrawElementsBaseVertex(GLenum, const GLsizei*, GLenum, const void* const*, GLsizei, const GLint*) {
+    mockGL.stats.calls++;
+    mockGL.stats.drawCalls++;
+}
@@ -0,0 +1,191 @@
+// motor.h
+//
+// DC traction motor and single-ratio drivetrain, ported from
+// matlab/tc-model/parameters.m (the Simulink motor_car model):
+//
+//   L di/dt  = u - R i - Kb w
+//   Je dw/dt = Km i - b w - T_load
+//
+// where w is the motor speed, the wheels turn at w / GR without slip, and
+// Je = J + m (Rw / GR)² is the motor inertia plus the vehicle mass
+// reflected through the gear. The electrical time constant L / R is about
+// 10 ms, so plain forward Euler needs sub-steps at large physics steps.
+// Two integrators are provided: backward Euler, whose 2x2 system matrix is
+// inverted once per (parameters, mass, dt) and is stable at any step, and
+// forward Euler sub-stepped below a fraction of L / R.
+//
+// parameters.m has no inverter current limit, and at full voltage the
+// stall current is u1 / R ~ 30 kA. Wheel force is therefore capped at the
+// traction limit of the driven axle, Q * m * g, by limiting the current
+// (an ideal traction controller).
+
+#pragma once
+
+#include <cmath>
+
+#include "car.h"
+
+struct MotorParams {
+    // Motor
+    float L;                  // Armature inductance (H)
+    float R;                  // Armature resistance (ohm)
+    float Kb;                 // Back-EMF constant (V·s/rad)
+    float Km;                 // Torque constant (N·m/A)
+    float J;                  // Rotor inertia (kg·m²)
+    float b;                  // Viscous friction (N·m·s/rad)
+
+    // Drivetrain
+    float GR;                 // Gear ratio, motor turns per wheel turn
+    float Rw;                 // Wheel radius (m)
+    float m;                  // Vehicle mass of the reference model (kg)
+    float Q;                  // Share of the weight on the driven axle
+
+    float maxVoltage;         // Supply voltage at full throttle, u1 (V)
+};
+
+struct MotorState {
+    float current;            // Armature current i (A)
+    float speed;              // Motor speed w (rad/s)
+};
+
+// Integration schemes for the motor
+enum MotorIntegrator {
+    MOTOR_IMPLICIT,           // Backward Euler, one 2x2 solve per step
+    MOTOR_EXPLICIT,           // Forward Euler, sub-stepped
+};
+
+// Everything a step needs for one (parameters, vehicle mass, dt) combination
+struct MotorStepper {
+    MotorIntegrator integrator;
+    float dt;                 // Physics step (s)
+    int substeps;             // Forward Euler steps per physics step
+    float h;                  // dt / substeps (s)
+
+    float R, Kb, Km, b;       // Copied from MotorParams
+    float invL;               // 1 / L
+    float invJe;              // 1 / (J + m (Rw / GR)²)
+    float maxVoltage;         // (V)
+    float currentLimit;       // Current giving the traction-limited wheel force (A)
+    float speedToVelocity;    // Rw / GR: vehicle speed per motor speed (m/rad)
+
+    // Backward Euler: inverse of (I - dt A), and the damping of the
+    // speed row used when the current is held at its limit
+    float inv11, inv12, inv21, inv22;
+    float speedDamping;       // 1 / (1 + dt b / Je)
+};
+
+// Function to create the motor and drivetrain of parameters.m
+inline MotorParams makeDefaultMotor() {
+    MotorParams motor = {
+        177e-6f,                  // L (H)
+        0.018f,                   // R (ohm)
+        0.6970f,                  // Kb (V·s/rad)
+        0.6970f,                  // Km = Kb (N·m/A)
+        0.0421f,                  // J (kg·m²)
+        3.97e-6f,                 // b (N·m·s/rad)
+        3.42f,                    // GR
+        0.1778f,                  // Rw (m)
+        250.0f,                   // m (kg)
+        0.5f,                     // Q
+        537.6f                    // u1 (V)
+    };
+    return motor;
+}
+
+// Function to precompute a stepper. Explicit sub-steps are no longer than
+// 'maxExplicitStep' (default: a quarter of the electrical time constant).
+inline MotorStepper makeMotorStepper(const MotorParams& motor, float vehicleMass, float dt,
+                                     MotorIntegrator integrator, float maxExplicitStep = 0.0f) {
+    MotorStepper s;
+    float ratio = motor.Rw / motor.GR;
+    float Je = motor.J + vehicleMass * ratio * ratio;
+
+    s.integrator = integrator;
+    s.dt = dt;
+    if (maxExplicitStep <= 0.0f)
+        maxExplicitStep = 0.25f * motor.L / motor.R;
+    s.substeps = integrator == MOTOR_EXPLICIT ? (int)ceilf(dt / maxExplicitStep) : 1;
+    if (s.substeps < 1)
+        s.substeps = 1;
+    s.h = dt / (float)s.substeps;
+
+    s.R = motor.R;
+    s.Kb = motor.Kb;
+    s.Km = motor.Km;
+    s.b = motor.b;
+    s.invL = 1.0f / motor.L;
+    s.invJe = 1.0f / Je;
+    s.maxVoltage = motor.maxVoltage;
+    s.currentLimit = motor.Q * vehicleMass * GRAVITY * ratio / motor.Km;
+    s.speedToVelocity = ratio;
+
+    // I - dt A with A = [[-R/L, -Kb/L], [Km/Je, -b/Je]]
+    float m11 = 1.0f + dt * motor.R / motor.L;
+    float m12 = dt * motor.Kb / motor.L;
+    float m21 = -dt * motor.Km / Je;
+    float m22 = 1.0f + dt * motor.b / Je;
+    float invDet = 1.0f / (m11 * m22 - m12 * m21);
+    s.inv11 = m22 * invDet;
+    s.inv12 = -m12 * invDet;
+    s.inv21 = -m21 * invDet;
+    s.inv22 = m11 * invDet;
+    s.speedDamping = 1.0f / m22;
+    return s;
+}
+
+// Function to advance the motor by one physics step with 'voltage' at the
+// terminals and 'loadTorque' (road load reflected to the motor shaft)
+inline void stepMotor(MotorState& state, const MotorStepper& s, float voltage, float loadTorque) {
+    float i = state.current;
+    float w = state.speed;
+
+    if (s.integrator == MOTOR_IMPLICIT) {
+        // (I - dt A) x' = x + dt B u
+        float r1 = i + s.dt * voltage * s.invL;
+        float r2 = w - s.dt * loadTorque * s.invJe;
+        i = s.inv11 * r1 + s.inv12 * r2;
+        w = s.inv21 * r1 + s.inv22 * r2;
+
+        // Traction limit: hold the current and redo the speed row
+        if (fabsf(i) > s.currentLimit) {
+            i = copysignf(s.currentLimit, i);
+            w = (state.speed + s.dt * (s.Km * i - loadTorque) * s.invJe) * s.speedDamping;
+        }
+    } else {
+        for (int k = 0; k < s.substeps; k++) {
+            float di = (voltage - s.R * i - s.Kb * w) * s.invL;
+            float dw = (s.Km * i - s.b * w - loadTorque) * s.invJe;
+            i += s.h * di;
+            w += s.h * dw;
+            if (fabsf(i) > s.currentLimit)
+                i = copysignf(s.currentLimit, i);
+        }
+    }
+
+    state.current = i;
+    state.speed = w;
+}
+
+// Function to drive 'car' through the motor for one step of s.dt. Steering
+// and the brake/reverse command work as in applyDriverInput(); throttle
+// sets the terminal voltage, and with the throttle released the inverter
+// holds zero current. The road load always acts. The motor speed follows
+// the car's speed, and car.acceleration is set to the speed change of the
+// step, so stepCar() and stepVehicle4W() reproduce the motor's solution.
+inline void applyMotorDrive(Car& car, MotorState& motor, const MotorStepper& s, const DriverInput& input) {
+    applyDriverInput(car, input, s.dt);
+
+    motor.speed = car.velocity / s.speedToVelocity;
+    float startSpeed = motor.speed;
+    float voltage = input.throttle > 0.0f ? s.maxVoltage * input.throttle : s.Kb * motor.speed;
+    if (input.throttle <= 0.0f)
+        motor.current = 0.0f;
+
+    // Rolling resistance and aerodynamic drag as a force, reflected to the motor
+    float roadLoad = car.mass * (0.015f * car.velocity + 0.001f * car.velocity * fabsf(car.velocity));
+    stepMotor(motor, s, voltage, roadLoad * s.speedToVelocity);
+
+    car.acceleration = (motor.speed - startSpeed) * s.speedToVelocity / s.dt;
+    if (input.throttle < 0.0f)
+        car.acceleration += -car.maxDeceleration * input.throttle;
+}
@@ -0,0 +1,364 @@
+// mpc.h
+//
+// Sampling model-predictive controller for the four-wheel model. Once per
+// control period it chooses a yaw moment (realized as a left/right drive
+// split, like the torque-vectoring controller's) and a correction to the
+// driver's steering angle, by rolling a batch of candidate control
+// sequences out over a short horizon and blending them by cost (MPPI, the
+// path-integral update: weights exp(-cost / temperature)).
+//
+// The rollout model is the dynamic single track: lateral speed and yaw
+// rate, axle forces linear in slip angle up to mu times the static axle
+// load, longitudinal speed held. The cost is the yaw rate's distance from
+// the torque-vectoring reference, sideslip, control effort and control
+// change. Candidates run in the lanes of simd.h vectors, SIMD_WIDTH
+// sequences per instruction, with the sampling noise hashed from a counter
+// so it needs no table and no generator state beyond one integer.
+//
+// Each solve is warm-started: the previous plan, shifted by one period,
+// is the mean the candidates are drawn around, and it and the all-zero
+// sequence are always among them. All scratch memory comes from one
+// arena per thread, carved up the first time the thread solves, so the
+// control loop never allocates. The plan itself (MpcPlan) is a few
+// hundred bytes of plain data and lives in the run's state.
+//
+// The work per solve is fixed (samples x horizon x iterations), so runs
+// stay deterministic. Every solve is timed against MPC_BUDGET and
+// counted into a log2 histogram and a deadline-miss count, which is how
+// a setting is checked to fit the real-time loop.
+
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "car.h"
+#include "simd.h"
+#include "torque_vectoring.h"
+#include "vehicle4w.h"
+
+const int MPC_MAX_HORIZON = 32;           // Knots per plan
+const int MPC_MAX_SAMPLES = 1024;         // Candidates per iteration
+const double MPC_BUDGET = 1e-3;           // Deadline for one solve (s)
+const float MPC_MIN_SPEED = 1.0f;         // Below this the controller stands down, like the PI one (m/s)
+const int MPC_TIMING_BUCKETS = 14;        // histogram: < 1 µs, then [2^(b-1), 2^b) µs, the last open
+
+struct MpcSettings {
+    // Solver
+    int horizon;              // Knots, one per control period
+    int samples;              // Candidates per iteration, a multiple of SIMD_WIDTH
+    int iterations;           // Sample-and-blend rounds per solve
+    float period;             // Control period, also the rollout step (s)
+    float temperature;        // Blend temperature, relative to the batch's mean cost above its best
+    float momentNoise;        // Spread of the yaw moment samples, relative to its limit
+    float steerNoise;         // Spread of the steering samples, relative to their limit
+
+    // Cost weights, per knot
+    float yawRateWeight;      // On (r - r_ref)² (s²/rad²)
+    float sideslipWeight;     // On beta² (1/rad²)
+    float effortWeight;       // On each control squared, relative to its limit
+    float changeWeight;       // On each control's change between knots, relative to its limit
+
+    // Limits
+    float maxYawMoment;       // (N·m)
+    float maxSteerCorrection; // (rad)
+
+    // Rollout model, from the car
+    float lf, lr;             // CG to front / rear axle (m)
+    float Cf, Cr;             // Axle cornering stiffness (N/rad)
+    float maxFyFront;         // mu * static front axle load (N)
+    float maxFyRear;          // mu * static rear axle load (N)
+    float invMass;            // (1/kg)
+    float invIz;              // (1/(kg·m²))
+};
+
+// Last solution and the control held until the next solve
+struct MpcPlan {
+    float moment[MPC_MAX_HORIZON];        // Yaw moment per knot (N·m)
+    float steer[MPC_MAX_HORIZON];         // Steering correction per knot (rad)
+    uint32_t solves;                      // Solves so far; seeds the sampling noise
+    int countdown;                        // Physics steps until the next solve
+    float yawMoment;                      // Held yaw moment (N·m)
+    float steerCorrection;                // Held steering correction (rad)
+    float yawRateRef;                     // Reference of the last solve (rad/s)
+    float cost;                           // Predicted cost of the last solve's best candidate
+};
+
+// Solve times of one thread
+struct MpcTiming {
+    long solves;
+    long misses;                          // Solves that took longer than MPC_BUDGET
+    double total;                         // (s)
+    double worst;                         // (s)
+    long buckets[MPC_TIMING_BUCKETS];
+};
+
+// Scratch memory for the solver, carved out of one aligned block
+struct MpcWorkspace {
+    unsigned char* arena;
+    size_t arenaSize;
+    size_t arenaUsed;
+    float* moment;            // Candidate yaw moments [knot][sample] (N·m)
+    float* steer;             // Candidate steering corrections [knot][sample] (rad)
+    float* cost;              // Cost per candidate
+    float* weight;            // Blend weight per candidate
+    MpcTiming timing;
+
+    MpcWorkspace() : arena(nullptr), arenaSize(0), arenaUsed(0) {}
+    ~MpcWorkspace() { free(arena); }
+    MpcWorkspace(const MpcWorkspace&) = delete;
+    MpcWorkspace& operator=(const MpcWorkspace&) = delete;
+};
+
+// Function to set the rollout model and limits of 'settings' for 'car'
+inline void setMpcModel(MpcSettings& settings, const Car& car) {
+    float frontShare = car.lr / car.wheelbase;
+    settings.lf = car.lf;
+    settings.lr = car.lr;
+    settings.Cf = car.Cf;
+    settings.Cr = car.Cr;
+    settings.maxFyFront = frontShare * car.mass * GRAVITY;
+    settings.maxFyRear = (1.0f - frontShare) * car.mass * GRAVITY;
+    settings.invMass = 1.0f / car.mass;
+    settings.invIz = 1.0f / car.Iz;
+    settings.maxYawMoment = makeTorqueVectoring(car).maxYawMoment;
+    settings.maxSteerCorrection = 0.25f * car.maxSteer;
+}
+
+// Function to create the default settings for 'car'
+inline MpcSettings makeMpcSettings(const Car& car) {
+    MpcSettings settings;
+    settings.horizon = 20;
+    settings.samples = 256;
+    settings.iterations = 2;
+    settings.period = 0.01f;
+    settings.temperature = 0.1f;
+    settings.momentNoise = 0.3f;
+    settings.steerNoise = 0.3f;
+    settings.yawRateWeight = 1.0f;
+    settings.sideslipWeight = 0.5f;
+    settings.effortWeight = 0.0002f;
+    settings.changeWeight = 0.0002f;
+    setMpcModel(settings, car);
+    return settings;
+}
+
+// Function to clear a plan, so the next step solves from scratch
+inline MpcPlan makeMpcPlan() {
+    MpcPlan plan;
+    memset(&plan, 0, sizeof(plan));
+    return plan;
+}
+
+// Function to take 'count' floats from the arena, 64-byte aligned and
+// padded to whole vectors
+inline float* takeFromArena(MpcWorkspace& workspace, size_t count) {
+    size_t bytes = (count * sizeof(float) + 63) & ~(size_t)63;
+    float* block = (float*)(workspace.arena + workspace.arenaUsed);
+    workspace.arenaUsed += bytes;
+    return block;
+}
+
+// Function to allocate the arena for the largest settings and carve it up
+inline void initMpcWorkspace(MpcWorkspace& workspace) {
+    const size_t controls = (size_t)MPC_MAX_HORIZON * MPC_MAX_SAMPLES;
+    workspace.arenaSize = (2 * controls + 2 * MPC_MAX_SAMPLES) * sizeof(float) + 4 * 64;
+    workspace.arena = (unsigned char*)aligned_alloc(64, workspace.arenaSize);
+    if (!workspace.arena)
+        throw std::bad_alloc();
+    memset(workspace.arena, 0, workspace.arenaSize);
+    workspace.arenaUsed = 0;
+    workspace.moment = takeFromArena(workspace, controls);
+    workspace.steer = takeFromArena(workspace, controls);
+    workspace.cost = takeFromArena(workspace, MPC_MAX_SAMPLES);
+    workspace.weight = takeFromArena(workspace, MPC_MAX_SAMPLES);
+    memset(&workspace.timing, 0, sizeof(workspace.timing));
+}
+
+// Function to get the calling thread's workspace, set up on first use
+inline MpcWorkspace& mpcWorkspace() {
+    thread_local MpcWorkspace workspace;
+    if (!workspace.arena)
+        initMpcWorkspace(workspace);
+    return workspace;
+}
+
+// Function to hash sample counters into unit-variance noise: two 16-bit
+// uniforms summed give a triangle on (-1, 1) with variance 1/6, which
+// is scaled by sqrt(6)
+inline vfloat mpcNoise(vuint counter) {
+    vuint h = counter * 0x9E3779B9u;
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    h *= 0x846CA68Bu;
+    h ^= h >> 16;
+    vint sum = (vint)((h & 0xFFFFu) + (h >> 16));
+    return toFloat(sum) * (2.44948974f / 65536.0f) - 2.44948974f;
+}
+
+// Function to count one solve of 'seconds' into 'timing'
+inline void recordMpcTiming(MpcTiming& timing, double seconds) {
+    timing.solves++;
+    timing.total += seconds;
+    if (seconds > timing.worst)
+        timing.worst = seconds;
+    if (seconds > MPC_BUDGET)
+        timing.misses++;
+    uint32_t us = (uint32_t)fmin(seconds * 1e6, 1e9);
+    int b = us == 0 ? 0 : 32 - __builtin_clz(us);
+    timing.buckets[b < MPC_TIMING_BUCKETS ? b : MPC_TIMING_BUCKETS - 1]++;
+}
+
+// Function to choose the control for the next period: shift the plan,
+// then draw, roll out and blend 'iterations' batches around it
+inline void solveMpc(const MpcSettings& s, MpcPlan& plan, MpcWorkspace& workspace, const Vehicle4W& v) {
+    auto start = std::chrono::steady_clock::now();
+    const Car& car = v.car;
+    int horizon = s.horizon < MPC_MAX_HORIZON ? s.horizon : MPC_MAX_HORIZON;
+    int samples = s.samples < MPC_MAX_SAMPLES ? s.samples : MPC_MAX_SAMPLES;
+    samples = (samples + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+    plan.yawRateRef = yawRateReference(v.tv, car);
+
+    if (fabsf(car.velocity) < MPC_MIN_SPEED) {
+        // Nothing useful to control; start afresh once moving
+        float reference = plan.yawRateRef;
+        uint32_t solves = plan.solves;
+        plan = makeMpcPlan();
+        plan.solves = solves + 1;
+        plan.yawRateRef = reference;
+    } else {
+        // Warm start: the previous plan one period on, its last knot held
+        for (int t = 0; t + 1 < horizon; t++) {
+            plan.moment[t] = plan.moment[t + 1];
+            plan.steer[t] = plan.steer[t + 1];
+        }
+
+        float* moment = workspace.moment;
+        float* steer = workspace.steer;
+        float* cost = workspace.cost;
+        float* weight = workspace.weight;
+        const float invMoment = 1.0f / s.maxYawMoment;
+        const float invSteer = 1.0f / s.maxSteerCorrection;
+        const float momentSpread = s.momentNoise * s.maxYawMoment;
+        const float steerSpread = s.steerNoise * s.maxSteerCorrection;
+        const float vx = car.velocity;
+        const float invSpeed = 1.0f / fmaxf(fabsf(vx), LOW_SPEED_LIMIT);
+        const float h = s.period;
+
+        vuint lane;
+        vfloat laneIndex;
+        for (int i = 0; i < SIMD_WIDTH; i++) {
+            lane[i] = (uint32_t)i;
+            laneIndex[i] = (float)i;
+        }
+
+        for (int iteration = 0; iteration < s.iterations; iteration++) {
+            // Candidates around the plan; sample 0 is the plan itself and
+            // sample 1 no intervention at all
+            uint32_t base = (plan.solves * (uint32_t)s.iterations + (uint32_t)iteration) *
+                            (uint32_t)(2 * MPC_MAX_HORIZON * MPC_MAX_SAMPLES);
+            for (int t = 0; t < horizon; t++) {
+                vfloat meanMoment = splat(plan.moment[t]);
+                vfloat meanSteer = splat(plan.steer[t]);
+                for (int k = 0; k < samples; k += SIMD_WIDTH) {
+                    vuint counter = lane + (base + (uint32_t)(2 * (t * samples + k)));
+                    vfloat m = meanMoment + momentSpread * mpcNoise(counter);
+                    vfloat d = meanSteer + steerSpread * mpcNoise(counter + (uint32_t)SIMD_WIDTH);
+                    vfloat index = laneIndex + (float)k;
+                    m = selectf(index == 0.0f, meanMoment, selectf(index == 1.0f, splat(0.0f), m));
+                    d = selectf(index == 0.0f, meanSteer, selectf(index == 1.0f, splat(0.0f), d));
+                    storev(moment + t * samples + k, maxf(minf(m, splat(s.maxYawMoment)), splat(-s.maxYawMoment)));
+                    storev(steer + t * samples + k,
+                           maxf(minf(d, splat(s.maxSteerCorrection)), splat(-s.maxSteerCorrection)));
+                }
+            }
+
+            // Roll every candidate out from the current state
+            for (int k = 0; k < samples; k += SIMD_WIDTH) {
+                vfloat vy = splat(v.vy);
+                vfloat r = splat(car.yawRate);
+                vfloat previousMoment = splat(plan.yawMoment);
+                vfloat previousSteer = splat(plan.steerCorrection);
+                vfloat total = splat(0.0f);
+                for (int t = 0; t < horizon; t++) {
+                    vfloat m = loadv(moment + t * samples + k);
+                    vfloat d = loadv(steer + t * samples + k);
+                    vfloat delta = car.steerAngle + d;
+                    vfloat alphaFront = (delta * vx - (vy + s.lf * r)) * invSpeed;
+                    vfloat alphaRear = (s.lr * r - vy) * invSpeed;
+                    vfloat front = maxf(minf(s.Cf * alphaFront, splat(s.maxFyFront)), splat(-s.maxFyFront));
+                    vfloat rear = maxf(minf(s.Cr * alphaRear, splat(s.maxFyRear)), splat(-s.maxFyRear));
+                    vy += ((front + rear) * s.invMass - vx * r) * h;
+                    r += (s.lf * front - s.lr * rear + m) * s.invIz * h;
+
+                    vfloat error = r - plan.yawRateRef;
+                    vfloat beta = vy * invSpeed;
+                    vfloat mn = m * invMoment, dn = d * invSteer;
+                    vfloat dm = (m - previousMoment) * invMoment, dd = (d - previousSteer) * invSteer;
+                    total += s.yawRateWeight * error * error + s.sideslipWeight * beta * beta +
+                             s.effortWeight * (mn * mn + dn * dn) + s.changeWeight * (dm * dm + dd * dd);
+                    previousMoment = m;
+                    previousSteer = d;
+                }
+                storev(cost + k, total);
+            }
+
+            // Blend: weights exp(-(J - J_min) / lambda), lambda relative to the spread
+            float best = cost[0], mean = 0.0f;
+            for (int k = 0; k < samples; k++) {
+                best = minf(best, cost[k]);
+                mean += cost[k];
+            }
+            mean /= (float)samples;
+            float invLambda = 1.0f / maxf(s.temperature * (mean - best), 1e-12f);
+            float sum = 0.0f;
+            for (int k = 0; k < samples; k++) {
+                weight[k] = expf(-(cost[k] - best) * invLambda);
+                sum += weight[k];
+            }
+            vfloat scale = splat(1.0f / sum);
+            for (int t = 0; t < horizon; t++) {
+                vfloat blendedMoment = splat(0.0f), blendedSteer = splat(0.0f);
+                for (int k = 0; k < samples; k += SIMD_WIDTH) {
+                    vfloat w = loadv(weight + k) * scale;
+                    blendedMoment += w * loadv(moment + t * samples + k);
+                    blendedSteer += w * loadv(steer + t * samples + k);
+                }
+                float m = 0.0f, d = 0.0f;
+                for (int i = 0; i < SIMD_WIDTH; i++) {
+                    m += blendedMoment[i];
+                    d += blendedSteer[i];
+                }
+                plan.moment[t] = m;
+                plan.steer[t] = d;
+            }
+            plan.cost = best;
+        }
+        plan.solves++;
+        plan.yawMoment = plan.moment[0];
+        plan.steerCorrection = plan.steer[0];
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    recordMpcTiming(workspace.timing, seconds);
+}
+
+// Function to run the controller for one physics step of dt: solve when
+// the period is up, hold the control in between. Leaves the reference and
+// moment in v.tv for the HUD and telemetry.
+inline void updateMpc(const MpcSettings& settings, MpcPlan& plan, MpcWorkspace& workspace, Vehicle4W& v,
+                      float dt) {
+    if (plan.countdown <= 0) {
+        solveMpc(settings, plan, workspace, v);
+        long steps = lroundf(settings.period / dt);
+        plan.countdown = steps > 1 ? (int)steps : 1;
+    }
+    plan.countdown--;
+    v.tv.yawRateRef = plan.yawRateRef;
+    v.tv.yawMoment = plan.yawMoment;
+}
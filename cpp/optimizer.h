@@ -0,0 +1,467 @@
+// optimizer.h
+//
+// Setup optimization: population-based search over the sweep parameters
+// of sweep.h (the Car setup, the drive split and controller gains, and
+// the parameters.m gear ratio and wheel radius) against an objective
+// measured by running the batch simulator, such as the best lap time on
+// a track or the yaw-rate tracking error on a scripted maneuver.
+//
+// The search is the separable CMA-ES (Ros & Hansen 2008): a Gaussian with
+// a diagonal covariance, its mean, step size and per-parameter variances
+// adapted from the ranked samples of each generation. Every parameter is
+// searched on [0, 1] between its bounds, so stiffnesses in N/rad and
+// lengths in metres get comparable steps. The diagonal model is linear in
+// the number of parameters per update and needs no eigendecomposition,
+// and the dozen parameters here do not need more.
+//
+// A generation's candidates are evaluated on the work-stealing pool of
+// sweep.h, each a full run from rest on a worker of its own. Parameters
+// are snapped to a grid of OPT_RESOLUTION steps across their bounds
+// before they are run, so a setup that is sampled again (a candidate
+// clamped to the same bound, a converged population) is recognized
+// exactly and taken from the cache instead of being simulated twice.
+// Everything the search carries between generations is OptimizerState,
+// plain data including the generator state, so a run saved after any
+// generation resumes where it stopped and continues as if it had not.
+// The per-generation work outside the simulations is a few vectors of a
+// dozen doubles, so the wall time is the simulations'.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "car.h"
+#include "driver.h"
+#include "maneuver.h"
+#include "scenario.h"
+#include "snapshot.h"
+#include "surface.h"
+#include "sweep.h"
+
+const int OPT_MAX_PARAMS = SWEEP_PARAM_COUNT;
+const int OPT_MAX_POPULATION = 256;
+const int OPT_RESOLUTION = 65535;         // Grid steps across each parameter's bounds
+const double OPT_INITIAL_SIGMA = 0.3;     // Initial step size, relative to the bounds
+
+// What a setup is scored on; lower is better
+enum Objective {
+    OBJECTIVE_LAP_TIME,       // Best lap time on the track (s)
+    OBJECTIVE_YAW_TRACKING,   // RMS yaw-rate error against the torque-vectoring reference (rad/s)
+};
+
+// Function to map an objective name to its enum value
+inline bool parseObjective(const char* name, Objective* objective) {
+    if (strcmp(name, "lap-time") == 0) {
+        *objective = OBJECTIVE_LAP_TIME;
+    } else if (strcmp(name, "yaw-tracking") == 0) {
+        *objective = OBJECTIVE_YAW_TRACKING;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// One searched parameter and its bounds
+struct OptimizeBound {
+    SweepParam param;
+    float lo, hi;             // In the units of setSweepParam() / setRunSweepParam()
+};
+
+// Function to parse a bound spec: "name=lo:hi"
+inline bool parseOptimizeBound(const char* spec, OptimizeBound* bound) {
+    const char* eq = strchr(spec, '=');
+    if (!eq)
+        return false;
+    std::string name(spec, eq - spec);
+    if (!parseSweepParam(name.c_str(), &bound->param))
+        return false;
+    return sscanf(eq + 1, "%f:%f", &bound->lo, &bound->hi) == 2 && bound->hi > bound->lo;
+}
+
+// The runs a setup is scored by
+struct OptimizeProblem {
+    Car base;                 // Setup the search starts from
+    Maneuver maneuver;
+    VehicleModel model;
+    bool motor;               // Drive through motor.h instead of maxAcceleration
+    TireModel tires;
+    long steps;
+    float dt;
+    const Track* track;       // Drive laps of this track instead of the maneuver, or nullptr
+    const char* scenarioPath; // Play this scenario file instead of the maneuver, or nullptr
+    const SurfaceMap* surface; // Road surface under the 4w models' wheels, or nullptr
+    Objective objective;
+    std::vector<OptimizeBound> bounds;
+};
+
+// Everything the search carries from one generation to the next
+struct OptimizerState {
+    uint64_t problemHash;     // Fingerprint of the OptimizeProblem, checked on resume
+    int dims;
+    int population;           // Candidates per generation (lambda)
+    int generation;
+    uint64_t rng;             // splitmix64 state
+    long evaluations;         // Simulated candidates
+    long cacheHits;           // Candidates taken from the cache
+    double sigma;             // Step size
+    double mean[OPT_MAX_PARAMS];
+    double variance[OPT_MAX_PARAMS];        // Diagonal of the covariance
+    double evolutionPath[OPT_MAX_PARAMS];   // p_c
+    double conjugatePath[OPT_MAX_PARAMS];   // p_sigma
+    double best[OPT_MAX_PARAMS];            // Best setup so far, on [0, 1]
+    double bestValue;
+    double lastBest;          // Best of the last generation
+};
+
+static_assert(std::is_trivially_copyable<OptimizerState>::value, "OptimizerState must stay a plain blob");
+
+// Objective values by snapped setup
+typedef std::unordered_map<std::string, double> OptimizerCache;
+
+// Where the wall time of the generations went
+struct OptimizerTiming {
+    double wall;              // (s)
+    double simulation;        // Summed over the workers (s)
+    long steps;               // Simulated steps
+};
+
+const char OPTIMIZER_MAGIC[8] = { 'T', 'V', 'S', 'O', 'P', 'T', 'M', '1' };
+
+struct OptimizerHeader {
+    char magic[8];
+    uint32_t stateSize;       // sizeof(OptimizerState) of the build that wrote it
+    uint32_t dims;
+    uint64_t cacheEntries;
+};
+
+// Function to hash bytes into a running FNV-1a value
+inline uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ p[i]) * 0x100000001B3ull;
+    return hash;
+}
+
+// Function to hash the contents of the file at 'path', streamed in
+// chunks; a file that cannot be read hashes as its path, and the runs
+// then fail on it anyway
+inline uint64_t hashFile(uint64_t hash, const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return hashBytes(hash, path, strlen(path));
+    static thread_local unsigned char buffer[65536];
+    size_t got;
+    while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        hash = hashBytes(hash, buffer, got);
+    fclose(file);
+    return hash;
+}
+
+// Function to fingerprint everything that decides a setup's score: the
+// configuration and the contents, not the names, of the track, scenario
+// and surface, so a resumed cache never scores against changed inputs
+inline uint64_t hashProblem(const OptimizeProblem& problem) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    hash = hashBytes(hash, &problem.base, sizeof(problem.base));
+    int config[5] = { (int)problem.maneuver, (int)problem.model, (int)problem.motor, (int)problem.tires,
+                      (int)problem.objective };
+    hash = hashBytes(hash, config, sizeof(config));
+    hash = hashBytes(hash, &problem.steps, sizeof(problem.steps));
+    hash = hashBytes(hash, &problem.dt, sizeof(problem.dt));
+    if (problem.track) {
+        const Track& track = *problem.track;
+        hash = hashBytes(hash, track.x.data(), track.x.size() * sizeof(float));
+        hash = hashBytes(hash, track.z.data(), track.z.size() * sizeof(float));
+        hash = hashBytes(hash, &track.params, sizeof(track.params));
+    }
+    if (problem.scenarioPath)
+        hash = hashFile(hash, problem.scenarioPath);
+    if (problem.surface)
+        hash = hashBytes(hash, problem.surface->data, problem.surface->size);
+    for (const OptimizeBound& bound : problem.bounds)
+        hash = hashBytes(hash, &bound, sizeof(bound));
+    return hash;
+}
+
+// Function to draw the next 64 random bits (splitmix64)
+inline uint64_t nextRandom(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Function to draw a standard normal (Box-Muller, one of the pair)
+inline double nextGaussian(uint64_t& state) {
+    double u1 = ((nextRandom(state) >> 11) + 1.0) * (1.0 / 9007199254740993.0);
+    double u2 = (nextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+    return sqrt(-2.0 * log(u1)) * cos(6.283185307179586 * u2);
+}
+
+// Function to snap a point of [0, 1] to the grid
+inline int32_t snapToGrid(double u) {
+    return (int32_t)lround(std::min(std::max(u, 0.0), 1.0) * OPT_RESOLUTION);
+}
+
+// Function to get a parameter's value at a grid step
+inline float boundValue(const OptimizeBound& bound, int32_t step) {
+    return bound.lo + (bound.hi - bound.lo) * ((float)step / (float)OPT_RESOLUTION);
+}
+
+// Function to score one setup: a run from rest with the parameters at
+// 'steps' on the grid. A run that completes no lap is scored by the lap
+// time its average progress extrapolates to, which is always worse than
+// a completed one. Returns false, with no score, if the run cannot open
+// the scenario file.
+inline bool evaluateSetup(const OptimizeProblem& problem, const int32_t* steps, double* value, long* simulated) {
+    Car car = problem.base;
+    for (size_t d = 0; d < problem.bounds.size(); d++) {
+        if (isCarSweepParam(problem.bounds[d].param))
+            setSweepParam(car, problem.bounds[d].param, boundValue(problem.bounds[d], steps[d]));
+    }
+    RunState state;
+    initRunState(state, car, problem.model, problem.motor, problem.tires, problem.dt, problem.track);
+    for (size_t d = 0; d < problem.bounds.size(); d++) {
+        if (!isCarSweepParam(problem.bounds[d].param))
+            setRunSweepParam(state, problem.bounds[d].param, boundValue(problem.bounds[d], steps[d]));
+    }
+    state.yawTracking = problem.objective == OBJECTIVE_YAW_TRACKING;
+
+    Scenario script;
+    bool scripted = problem.scenarioPath != nullptr;
+    if (scripted && !openScenario(script, problem.scenarioPath))
+        return false;
+    ScenarioResult result = continueScenario(state, problem.maneuver, problem.steps, nullptr, problem.track,
+                                             scripted ? &script : nullptr, nullptr, problem.surface);
+    if (scripted)
+        closeScenario(script);
+    *simulated = result.steps;
+
+    if (problem.objective == OBJECTIVE_YAW_TRACKING) {
+        *value = result.yawRateError;
+    } else if (result.laps > 0) {
+        *value = result.bestLap;
+    } else {
+        double elapsed = (double)result.steps * problem.dt;
+        *value = elapsed * problem.track->length / std::max((double)state.driver.distance, 1.0);
+    }
+    return true;
+}
+
+// Function to start a search from the problem's base setup
+inline void initOptimizer(OptimizerState& state, const OptimizeProblem& problem, int population, uint64_t seed) {
+    memset(&state, 0, sizeof(state));
+    state.problemHash = hashProblem(problem);
+    state.dims = (int)problem.bounds.size();
+    if (population <= 0)
+        population = 4 + (int)(3.0 * log((double)state.dims));
+    state.population = std::min(std::max(population, 4), OPT_MAX_POPULATION);
+    state.rng = seed;
+    state.sigma = OPT_INITIAL_SIGMA;
+    state.bestValue = INFINITY;
+    state.lastBest = INFINITY;
+
+    RunState base;
+    initRunState(base, problem.base, problem.model, problem.motor, problem.tires, problem.dt);
+    for (int d = 0; d < state.dims; d++) {
+        const OptimizeBound& bound = problem.bounds[d];
+        double u = (sweepParamValue(base, bound.param) - bound.lo) / (bound.hi - bound.lo);
+        state.mean[d] = std::min(std::max(u, 0.0), 1.0);
+        state.variance[d] = 1.0;
+        state.best[d] = state.mean[d];
+    }
+}
+
+// Function to run one generation: sample, score the setups not seen
+// before on 'threads' workers, and adapt the distribution to the ranking.
+// Returns false, without caching or adapting anything, if a run failed.
+inline bool stepOptimizer(OptimizerState& state, const OptimizeProblem& problem, OptimizerCache& cache,
+                          int threads, OptimizerTiming& timing) {
+    auto start = std::chrono::steady_clock::now();
+    const int n = state.dims;
+    const int lambda = state.population;
+    const int mu = lambda / 2;
+
+    // Recombination weights and the sep-CMA learning rates
+    double weights[OPT_MAX_POPULATION];
+    double weightSum = 0.0, weightSquares = 0.0;
+    for (int i = 0; i < mu; i++) {
+        weights[i] = log(mu + 0.5) - log(i + 1.0);
+        weightSum += weights[i];
+    }
+    for (int i = 0; i < mu; i++) {
+        weights[i] /= weightSum;
+        weightSquares += weights[i] * weights[i];
+    }
+    const double mueff = 1.0 / weightSquares;
+    const double cc = (4.0 + mueff / n) / (n + 4.0 + 2.0 * mueff / n);
+    const double cs = (mueff + 2.0) / (n + mueff + 5.0);
+    const double c1 = std::min(1.0, 2.0 / ((n + 1.3) * (n + 1.3) + mueff) * (n + 2.0) / 3.0);
+    const double cmu = std::min(1.0 - c1, 2.0 * (mueff - 2.0 + 1.0 / mueff) / ((n + 2.0) * (n + 2.0) + mueff) *
+                                              (n + 2.0) / 3.0);
+    const double damps = 1.0 + 2.0 * std::max(0.0, sqrt((mueff - 1.0) / (n + 1.0)) - 1.0) + cs;
+    const double chiN = sqrt((double)n) * (1.0 - 1.0 / (4.0 * n) + 1.0 / (21.0 * n * n));
+
+    // Sample, clamp to the bounds and snap to the grid
+    std::vector<int32_t> grid(lambda * n);
+    std::vector<double> values(lambda);
+    for (int k = 0; k < lambda; k++) {
+        for (int d = 0; d < n; d++) {
+            double x = state.mean[d] + state.sigma * sqrt(state.variance[d]) * nextGaussian(state.rng);
+            grid[k * n + d] = snapToGrid(x);
+        }
+    }
+
+    // Setups not in the cache, each once
+    std::vector<std::string> keys(lambda);
+    std::vector<int> pending;
+    std::unordered_map<std::string, int> first;
+    for (int k = 0; k < lambda; k++) {
+        keys[k].assign((const char*)&grid[k * n], n * sizeof(int32_t));
+        auto cached = cache.find(keys[k]);
+        if (cached != cache.end()) {
+            values[k] = cached->second;
+            state.cacheHits++;
+        } else if (first.emplace(keys[k], k).second) {
+            pending.push_back(k);
+        } else {
+            state.cacheHits++;
+        }
+    }
+
+    // Each job writes only its own slots
+    std::vector<double> seconds(pending.size());
+    std::vector<long> simulated(pending.size());
+    std::atomic<bool> failed(false);
+    parallelFor(pending.size(), threads, [&](size_t j) {
+        auto jobStart = std::chrono::steady_clock::now();
+        int k = pending[j];
+        if (!evaluateSetup(problem, &grid[k * n], &values[k], &simulated[j]))
+            failed.store(true, std::memory_order_relaxed);
+        seconds[j] = std::chrono::duration<double>(std::chrono::steady_clock::now() - jobStart).count();
+    });
+    if (failed.load())
+        return false;
+    for (size_t j = 0; j < pending.size(); j++) {
+        cache[keys[pending[j]]] = values[pending[j]];
+        timing.simulation += seconds[j];
+        timing.steps += simulated[j];
+    }
+    for (int k = 0; k < lambda; k++)
+        values[k] = cache.find(keys[k])->second;
+    state.evaluations += (long)pending.size();
+
+    // Rank; ties keep sample order so the update is deterministic
+    int order[OPT_MAX_POPULATION];
+    for (int k = 0; k < lambda; k++)
+        order[k] = k;
+    std::stable_sort(order, order + lambda, [&](int a, int b) { return values[a] < values[b]; });
+    state.lastBest = values[order[0]];
+    if (values[order[0]] < state.bestValue) {
+        state.bestValue = values[order[0]];
+        for (int d = 0; d < n; d++)
+            state.best[d] = (double)grid[order[0] * n + d] / OPT_RESOLUTION;
+    }
+
+    // Mean, evolution paths, step size and variances
+    double previous[OPT_MAX_PARAMS], shift[OPT_MAX_PARAMS];
+    for (int d = 0; d < n; d++) {
+        previous[d] = state.mean[d];
+        double m = 0.0;
+        for (int i = 0; i < mu; i++)
+            m += weights[i] * (double)grid[order[i] * n + d] / OPT_RESOLUTION;
+        state.mean[d] = m;
+        shift[d] = (m - previous[d]) / state.sigma;
+    }
+    double pathNorm = 0.0;
+    for (int d = 0; d < n; d++) {
+        state.conjugatePath[d] = (1.0 - cs) * state.conjugatePath[d] +
+                                 sqrt(cs * (2.0 - cs) * mueff) * shift[d] / sqrt(state.variance[d]);
+        pathNorm += state.conjugatePath[d] * state.conjugatePath[d];
+    }
+    pathNorm = sqrt(pathNorm);
+    double decay = 1.0 - pow(1.0 - cs, 2.0 * (state.generation + 1));
+    bool stalled = pathNorm / sqrt(decay) / chiN >= 1.4 + 2.0 / (n + 1.0);
+    double hsig = stalled ? 0.0 : 1.0;
+    for (int d = 0; d < n; d++) {
+        state.evolutionPath[d] =
+            (1.0 - cc) * state.evolutionPath[d] + hsig * sqrt(cc * (2.0 - cc) * mueff) * shift[d];
+        double rankMu = 0.0;
+        for (int i = 0; i < mu; i++) {
+            double y = ((double)grid[order[i] * n + d] / OPT_RESOLUTION - previous[d]) / state.sigma;
+            rankMu += weights[i] * y * y;
+        }
+        double p = state.evolutionPath[d];
+        state.variance[d] = (1.0 - c1 - cmu) * state.variance[d] +
+                            c1 * (p * p + (1.0 - hsig) * cc * (2.0 - cc) * state.variance[d]) + cmu * rankMu;
+        state.variance[d] = std::max(state.variance[d], 1e-20);
+    }
+    state.sigma *= exp(std::min(1.0, cs / damps * (pathNorm / chiN - 1.0)));
+    state.generation++;
+
+    timing.wall += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+// Function to save the search and its cache to 'path'. The file is
+// written next to it and renamed over it, so an interrupted save leaves
+// the previous checkpoint intact.
+inline bool writeOptimizerCheckpoint(const char* path, const OptimizerState& state, const OptimizerCache& cache) {
+    std::string temporary = std::string(path) + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (!file)
+        return false;
+    OptimizerHeader header;
+    memcpy(header.magic, OPTIMIZER_MAGIC, sizeof(OPTIMIZER_MAGIC));
+    header.stateSize = sizeof(OptimizerState);
+    header.dims = (uint32_t)state.dims;
+    header.cacheEntries = cache.size();
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(&state, sizeof(state), 1, file) == 1;
+    for (auto it = cache.begin(); ok && it != cache.end(); ++it)
+        ok = fwrite(it->first.data(), it->first.size(), 1, file) == 1 &&
+             fwrite(&it->second, sizeof(double), 1, file) == 1;
+    ok = fclose(file) == 0 && ok;
+    return ok && rename(temporary.c_str(), path) == 0;
+}
+
+// Function to load a search saved by writeOptimizerCheckpoint(); fails
+// for another build or another problem
+inline bool readOptimizerCheckpoint(const char* path, const OptimizeProblem& problem, OptimizerState& state,
+                                    OptimizerCache& cache) {
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return false;
+    OptimizerHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+              memcmp(header.magic, OPTIMIZER_MAGIC, sizeof(OPTIMIZER_MAGIC)) == 0 &&
+              header.stateSize == sizeof(OptimizerState) && header.dims == problem.bounds.size() &&
+              fread(&state, sizeof(state), 1, file) == 1 && state.problemHash == hashProblem(problem);
+    if (!ok) {
+        fclose(file);
+        return false;
+    }
+
+    // The header is only trusted with the cache as far as the file goes
+    cache.clear();
+    std::string key(problem.bounds.size() * sizeof(int32_t), '\0');
+    for (uint64_t i = 0; ok && i < header.cacheEntries; i++) {
+        double value;
+        ok = fread(&key[0], key.size(), 1, file) == 1 && fread(&value, sizeof(value), 1, file) == 1;
+        if (ok)
+            cache[key] = value;
+    }
+    fclose(file);
+    if (!ok)
+        cache.clear();
+    return ok;
+}
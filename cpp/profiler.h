@@ -0,0 +1,255 @@
+// profiler.h
+//
+// Scoped timing zones for the frame loop. PROFILE_ZONE("name") times the
+// rest of the enclosing block and appends one 16-byte event to a ring
+// owned by the calling thread: two timestamp reads and a store, no locks
+// and no heap after a thread's first zone. Timestamps are the TSC on x86
+// (converted to seconds against steady_clock) and steady_clock elsewhere.
+//
+// Once per frame, profileFrame() folds the calling thread's new events
+// into per-zone frame totals over a rolling window, which the overlay in
+// profiler_overlay.h draws as p50/p99 and a histogram. writeProfileTrace()
+// dumps the most recent events of every thread as Chrome trace-event JSON
+// (chrome://tracing, Perfetto).
+//
+// Everything is compiled only with -DTVS_PROFILE. Without it the macros
+// expand to nothing and the remaining functions are empty inlines.
+
+#pragma once
+
+#include <cstdint>
+
+#ifdef TVS_PROFILE
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+const int MAX_PROFILE_ZONES = 15;
+const int MAX_PROFILE_THREADS = 64;
+const int PROFILE_RING_SIZE = 1 << 16;    // events kept per thread
+const int PROFILE_WINDOW = 256;           // frames in the overlay statistics
+const int PROFILE_BUCKETS = 20;           // histogram: < 1 µs, then [2^(b-1), 2^b) µs
+
+// One completed zone
+struct ProfileEvent {
+    uint64_t start;           // Ticks
+    uint32_t duration;        // Ticks, saturated
+    uint32_t zone;            // Index into Profiler::zoneNames
+};
+
+// Event ring written only by its own thread
+struct ProfileThread {
+    uint32_t id;              // Trace "tid", in order of first use
+    std::atomic<uint64_t> head; // Events ever written
+    ProfileEvent events[PROFILE_RING_SIZE];
+};
+
+struct Profiler {
+    std::mutex mutex;         // Zone and thread registration only
+    const char* zoneNames[MAX_PROFILE_ZONES];
+    std::atomic<int> zoneCount;
+    ProfileThread* threads[MAX_PROFILE_THREADS];
+    std::atomic<int> threadCount;
+
+    // Tick clock calibration: a tick/steady_clock pair from startup
+    uint64_t startTicks;
+    std::chrono::steady_clock::time_point startTime;
+
+    // Rolling per-frame totals (ms); row MAX_PROFILE_ZONES is the whole frame
+    uint64_t frameStart;      // Ticks at the previous profileFrame()
+    uint64_t frameRead;       // Events of the frame thread already folded in
+    float window[MAX_PROFILE_ZONES + 1][PROFILE_WINDOW];
+    int windowFill;
+    int windowNext;
+};
+
+inline Profiler profiler;
+
+// Function to read the tick counter
+inline uint64_t profileTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Function to start the profiler clock; call once before the first zone
+inline void initProfiler() {
+    profiler.startTime = std::chrono::steady_clock::now();
+    profiler.startTicks = profileTicks();
+    profiler.frameStart = profiler.startTicks;
+}
+
+// Function to get the length of a tick in seconds, measured against
+// steady_clock since initProfiler(). Waits out the first 50 ms so the
+// estimate is good to well under 0.1%.
+inline double profileSecondsPerTick() {
+    for (;;) {
+        uint64_t ticks = profileTicks();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - profiler.startTime).count();
+        if (seconds >= 0.05 && ticks > profiler.startTicks)
+            return seconds / (double)(ticks - profiler.startTicks);
+    }
+}
+
+// Function to register a zone name; returns its index. Called once per
+// PROFILE_ZONE site; names are expected to be string literals.
+inline uint32_t registerProfileZone(const char* name) {
+    std::lock_guard<std::mutex> lock(profiler.mutex);
+    int count = profiler.zoneCount.load(std::memory_order_relaxed);
+    for (int i = 0; i < count; i++) {
+        if (profiler.zoneNames[i] == name)
+            return (uint32_t)i;
+    }
+    if (count >= MAX_PROFILE_ZONES) {
+        fprintf(stderr, "profiler: more than %d zones, '%s' is folded into '%s'\n", MAX_PROFILE_ZONES, name,
+                profiler.zoneNames[count - 1]);
+        return (uint32_t)(count - 1);
+    }
+    profiler.zoneNames[count] = name;
+    profiler.zoneCount.store(count + 1, std::memory_order_release);
+    return (uint32_t)count;
+}
+
+// Function to get the calling thread's event ring, creating it on first use
+inline ProfileThread* profileThread() {
+    thread_local ProfileThread* thread = [] {
+        ProfileThread* t = new ProfileThread;
+        t->head.store(0, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(profiler.mutex);
+        int count = profiler.threadCount.load(std::memory_order_relaxed);
+        t->id = (uint32_t)count;
+        if (count < MAX_PROFILE_THREADS) {
+            profiler.threads[count] = t;
+            profiler.threadCount.store(count + 1, std::memory_order_release);
+        }
+        return t;
+    }();
+    return thread;
+}
+
+// Times its own lifetime as one event of 'zone'
+struct ProfileScope {
+    ProfileThread* thread;
+    uint64_t start;
+    uint32_t zone;
+
+    explicit ProfileScope(uint32_t zone) : thread(profileThread()), start(profileTicks()), zone(zone) {}
+
+    ~ProfileScope() {
+        uint64_t duration = profileTicks() - start;
+        uint64_t head = thread->head.load(std::memory_order_relaxed);
+        ProfileEvent& event = thread->events[head & (PROFILE_RING_SIZE - 1)];
+        event.start = start;
+        event.duration = duration < UINT32_MAX ? (uint32_t)duration : UINT32_MAX;
+        event.zone = zone;
+        thread->head.store(head + 1, std::memory_order_release);
+    }
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name)                                                                 \
+    static const uint32_t PROFILE_CONCAT(profileZone, __LINE__) = registerProfileZone(name); \
+    ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(PROFILE_CONCAT(profileZone, __LINE__))
+
+// Function to close a frame: sums the calling thread's zones since the
+// previous call into one window slot per zone, plus the frame's length
+inline void profileFrame() {
+    ProfileThread* thread = profileThread();
+    uint64_t now = profileTicks();
+    double msPerTick = 1000.0 * profileSecondsPerTick();
+
+    double totals[MAX_PROFILE_ZONES] = {};
+    uint64_t head = thread->head.load(std::memory_order_acquire);
+    uint64_t first = profiler.frameRead;
+    if (head - first > (uint64_t)PROFILE_RING_SIZE)
+        first = head - PROFILE_RING_SIZE;
+    for (uint64_t i = first; i < head; i++) {
+        const ProfileEvent& event = thread->events[i & (PROFILE_RING_SIZE - 1)];
+        totals[event.zone] += (double)event.duration;
+    }
+    profiler.frameRead = head;
+
+    int slot = profiler.windowNext;
+    for (int z = 0; z < MAX_PROFILE_ZONES; z++)
+        profiler.window[z][slot] = (float)(totals[z] * msPerTick);
+    profiler.window[MAX_PROFILE_ZONES][slot] = (float)((double)(now - profiler.frameStart) * msPerTick);
+    profiler.frameStart = now;
+    profiler.windowNext = (slot + 1) % PROFILE_WINDOW;
+    if (profiler.windowFill < PROFILE_WINDOW)
+        profiler.windowFill++;
+}
+
+// Function to get the p50 and p99 (ms) of window row 'row'
+inline void profilePercentiles(int row, float* p50, float* p99) {
+    float values[PROFILE_WINDOW];
+    int n = profiler.windowFill;
+    if (n == 0) {
+        *p50 = *p99 = 0.0f;
+        return;
+    }
+    std::copy(profiler.window[row], profiler.window[row] + n, values);
+    std::nth_element(values, values + n / 2, values + n);
+    *p50 = values[n / 2];
+    int k99 = (n * 99) / 100;
+    std::nth_element(values, values + k99, values + n);
+    *p99 = values[k99];
+}
+
+// Function to count window row 'row' into PROFILE_BUCKETS log2 buckets
+inline void profileHistogram(int row, int* counts) {
+    for (int b = 0; b < PROFILE_BUCKETS; b++)
+        counts[b] = 0;
+    for (int i = 0; i < profiler.windowFill; i++) {
+        uint32_t us = (uint32_t)std::min(profiler.window[row][i] * 1000.0f, 1e9f);
+        int b = us == 0 ? 0 : 32 - __builtin_clz(us);
+        counts[b < PROFILE_BUCKETS ? b : PROFILE_BUCKETS - 1]++;
+    }
+}
+
+// Function to write the newest events of every thread as Chrome
+// trace-event JSON; returns false if the file cannot be written
+inline bool writeProfileTrace(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (!file)
+        return false;
+    double usPerTick = 1e6 * profileSecondsPerTick();
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    int threads = profiler.threadCount.load(std::memory_order_acquire);
+    for (int t = 0; t < threads; t++) {
+        ProfileThread* thread = profiler.threads[t];
+        uint64_t head = thread->head.load(std::memory_order_acquire);
+        uint64_t begin = head > (uint64_t)PROFILE_RING_SIZE ? head - PROFILE_RING_SIZE : 0;
+        for (uint64_t i = begin; i < head; i++) {
+            const ProfileEvent& event = thread->events[i & (PROFILE_RING_SIZE - 1)];
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    first ? "" : ",\n", profiler.zoneNames[event.zone], thread->id,
+                    (double)(event.start - profiler.startTicks) * usPerTick, (double)event.duration * usPerTick);
+            first = false;
+        }
+    }
+    fprintf(file, "\n]}\n");
+    return fclose(file) == 0;
+}
+
+#else
+
+#define PROFILE_ZONE(name)
+
+inline void initProfiler() {}
+inline void profileFrame() {}
+inline bool writeProfileTrace(const char*) { return false; }
+
+#endif
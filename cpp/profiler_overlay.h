@@ -0,0 +1,104 @@
+// profiler_overlay.h
+//
+// On-screen frame timeline for profiler.h: one line per zone with the p50
+// and p99 of its per-frame total over the last PROFILE_WINDOW frames, and
+// next to it a histogram of those totals in log2 microsecond buckets
+// (left edge < 1 µs, each bar twice the duration of the one before). The
+// last line is the whole frame. Text and bars are stb_easy_font quads,
+// rebuilt every PROFILE_OVERLAY_REFRESH frames (a readable rate, and it
+// keeps the statistics off most frames) and drawn with one call through
+// the renderer's text program. Compiles to nothing without -DTVS_PROFILE.
+
+#pragma once
+
+#include "profiler.h"
+#include "renderer.h"
+
+const float PROFILE_OVERLAY_WIDTH = 330.0f;   // pixels, text plus histogram
+const int PROFILE_OVERLAY_REFRESH = 15;        // frames between rebuilds
+
+#ifdef TVS_PROFILE
+
+#include "hud.h"
+
+const float PROFILE_HISTOGRAM_X = 230.0f;     // histogram offset from the text (pixels)
+
+struct ProfilerOverlay {
+    int framesToRefresh;
+    int quadCount;
+    char quads[MAX_TEXT_QUADS * 4 * 16]; // stb_easy_font vertex layout
+};
+
+// Function to append a solid rectangle to 'vertices' in stb_easy_font's
+// vertex layout (x, y, z floats and an RGBA byte color, 16 bytes)
+inline void addOverlayRect(char* vertices, int quad, float x0, float y0, float x1, float y1) {
+    const float corners[4][2] = { { x0, y0 }, { x1, y0 }, { x1, y1 }, { x0, y1 } };
+    for (int v = 0; v < 4; v++) {
+        char* vertex = vertices + (quad * 4 + v) * 16;
+        float position[3] = { corners[v][0], corners[v][1], 0.0f };
+        memcpy(vertex, position, sizeof(position));
+        memset(vertex + 12, 255, 4);
+    }
+}
+
+// Function to rebuild the overlay's quads from the current window
+inline void buildProfilerOverlay(ProfilerOverlay& overlay, float x, float y) {
+    char* vertices = overlay.quads;
+    int capacity = (int)sizeof(overlay.quads);
+    int quads = 0;
+    int zones = profiler.zoneCount.load(std::memory_order_acquire);
+
+    for (int line = 0; line <= zones; line++) {
+        int row = line < zones ? line : MAX_PROFILE_ZONES;
+        const char* name = line < zones ? profiler.zoneNames[row] : "frame";
+        float p50, p99;
+        profilePercentiles(row, &p50, &p99);
+
+        // Three columns, as stb_easy_font is proportional: name, "p50 x", "p99 x ms"
+        char p50Text[MAX_HUD_TEXT] = "p50 ";
+        char p99Text[MAX_HUD_TEXT] = "p99 ";
+        formatFixed(p50, 3, p50Text + 4, MAX_HUD_TEXT - 4);
+        int len = 4 + formatFixed(p99, 3, p99Text + 4, MAX_HUD_TEXT - 7);
+        memcpy(p99Text + len, " ms", 4);
+
+        float lineY = y + (float)(line * HUD_LINE_HEIGHT);
+        const float columns[3] = { 0.0f, 60.0f, 130.0f };
+        const char* texts[3] = { name, p50Text, p99Text };
+        for (int c = 0; c < 3; c++)
+            quads += stb_easy_font_print(x + columns[c], lineY, (char*)texts[c], NULL, vertices + quads * 4 * 16,
+                                         capacity - quads * 4 * 16);
+
+        // Histogram bars, scaled to the fullest bucket, bottom-aligned
+        int counts[PROFILE_BUCKETS];
+        int most = 1;
+        profileHistogram(row, counts);
+        for (int b = 0; b < PROFILE_BUCKETS; b++)
+            most = counts[b] > most ? counts[b] : most;
+        for (int b = 0; b < PROFILE_BUCKETS && quads < MAX_TEXT_QUADS; b++) {
+            if (counts[b] == 0)
+                continue;
+            float barX = x + PROFILE_HISTOGRAM_X + (float)(b * 4);
+            float barHeight = 1.0f + 8.0f * (float)counts[b] / (float)most;
+            addOverlayRect(vertices, quads++, barX, lineY + 9.0f - barHeight, barX + 3.0f, lineY + 9.0f);
+        }
+    }
+
+    overlay.quadCount = quads;
+}
+
+// Function to draw the overlay with its top-left corner at (x, y) pixels
+inline void drawProfilerOverlay(ProfilerOverlay& overlay, Renderer& renderer, int width, int height, float x, float y) {
+    if (--overlay.framesToRefresh <= 0) {
+        buildProfilerOverlay(overlay, x, y);
+        overlay.framesToRefresh = PROFILE_OVERLAY_REFRESH;
+    }
+    drawTextQuads(renderer, width, height, overlay.quads, overlay.quadCount, 1.0f, 0.85f, 0.2f); // Amber
+}
+
+#else
+
+struct ProfilerOverlay {};
+
+inline void drawProfilerOverlay(ProfilerOverlay&, Renderer&, int, int, float, float) {}
+
+#endif
@@ -0,0 +1,430 @@
+// renderer.h
+//
+// Retained-mode renderer for the simulator scene. The cube, load arrow and
+// ground tile meshes are built once into vertex buffers at startup; each
+// frame only the per-instance data (pose and scale of every car and arrow,
+// corner of every visible ground tile) and the HUD text quads are
+// uploaded, and the whole scene is a handful of draw calls through two
+// small GLSL 3.30 core-profile programs.
+//
+// Cars and their four per-wheel load arrows share one instance buffer:
+// [car 0 .. car N-1 | arrows of car 0 .. arrows of car N-1]. It is mapped
+// once per frame (orphaning the previous contents, so the driver never
+// waits for the GPU), filled straight from the simulation state, and drawn
+// with one instanced call per mesh however many cars there are.
+//
+// The world is tiled (world_tiles.h): the ground tiles that pass the
+// frustum test are drawn with one instanced call per level of detail, and
+// track tiles are uploaded as a TileStreamer finishes them, a few per
+// frame, and deleted once the camera leaves them behind.
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#include "car.h"
+#include "scene_mesh.h"
+#include "stb_easy_font.h"
+#include "world_tiles.h"
+
+// A static mesh
+struct Mesh {
+    GLuint vao;
+    GLuint vertexBuffer;
+    GLenum primitive;         // GL_TRIANGLES or GL_LINES
+    GLsizei vertexCount;
+};
+
+// A resident track tile: the fine lines, then the coarse ones
+struct TrackTile {
+    Mesh mesh;
+    GLsizei fineCount;
+};
+
+// Largest HUD string, in stb_easy_font quads
+const int MAX_TEXT_QUADS = 4096;
+
+struct Renderer {
+    GLuint meshProgram;
+    GLint meshViewProj;       // uniform locations
+    GLint meshLightDir;
+    GLint meshLit;
+    GLint meshLoadColor;
+
+    GLuint textProgram;
+    GLint textScreenSize;
+    GLint textColor;
+
+    Mesh cube;
+    Mesh arrow;
+    Mesh ground[TILE_LODS];       // One ground tile per level of detail
+
+    GLuint identityInstanceBuffer; // Single identity instance, for track tiles
+    GLuint groundInstanceBuffer;  // Visible ground tiles, TILE_MAX_VISIBLE per level
+    GLuint instanceBuffer;        // Cars then arrows, see above
+    GLsizei carCapacity;          // Cars the instance buffer can hold
+
+    std::unordered_map<uint64_t, TrackTile> trackTiles; // Resident track tiles by tileKey()
+    VisibleTiles visible;         // Ground tiles of the current frame
+    std::vector<uint64_t> evicted;        // Scratch for streamTrackTiles()
+    std::vector<TrackTileMesh> uploads;
+
+    GLuint textVao;
+    GLuint textVertexBuffer;
+    GLuint textIndexBuffer;
+    char textVertices[MAX_TEXT_QUADS * 4 * 16]; // stb_easy_font output, 16 bytes per vertex
+};
+
+const char* const MESH_VERTEX_SHADER = R"(
+#version 330 core
+layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec3 aColor;
+layout(location = 3) in vec4 iPose;   // x, y, z, heading
+layout(location = 4) in vec4 iScale;  // sx, sy, sz, shade
+
+uniform mat4 uViewProj;
+uniform float uLoadColor;             // 1: color by iScale.w as a load ratio
+
+out vec3 vNormal;
+out vec3 vColor;
+
+void main() {
+    // Arrow meshes keep their head (y > 1) a fixed size above the scaled
+    // shaft; for every other mesh y stays within [-0.5, 0.5] and this is a
+    // plain scale.
+    vec3 p = vec3(aPos.x * iScale.x,
+                  min(aPos.y, 1.0) * iScale.y + max(aPos.y - 1.0, 0.0),
+                  aPos.z * iScale.z);
+    float c = cos(iPose.w);
+    float s = sin(iPose.w);
+    vec3 world = vec3(c * p.x - s * p.z, p.y, s * p.x + c * p.z) + iPose.xyz;
+    vNormal = vec3(c * aNormal.x - s * aNormal.z, aNormal.y, s * aNormal.x + c * aNormal.z);
+
+    // Load coloring: blue (unloaded) through cyan (mean load) to red (double)
+    vec3 loadColor = iScale.w < 1.0 ? mix(vec3(0.0, 0.2, 1.0), vec3(0.0, 1.0, 1.0), max(iScale.w, 0.0))
+                                    : mix(vec3(0.0, 1.0, 1.0), vec3(1.0, 0.1, 0.0), min(iScale.w - 1.0, 1.0));
+    vColor = mix(aColor * iScale.w, loadColor, uLoadColor);
+    gl_Position = uViewProj * vec4(world, 1.0);
+}
+)";
+
+const char* const MESH_FRAGMENT_SHADER = R"(
+#version 330 core
+in vec3 vNormal;
+in vec3 vColor;
+
+uniform vec3 uLightDir;               // towards the light, world space
+uniform float uLit;
+
+out vec4 fragColor;
+
+void main() {
+    vec3 toLight = normalize(uLightDir);
+    float diffuse = max(dot(normalize(vNormal), toLight), 0.0);
+    float lighting = mix(1.0, 0.2 + 0.8 * diffuse, uLit);
+    fragColor = vec4(vColor * lighting, 1.0);
+}
+)";
+
+const char* const TEXT_VERTEX_SHADER = R"(
+#version 330 core
+layout(location = 0) in vec2 aPos;   // pixels, origin top-left
+
+uniform vec2 uScreenSize;
+
+void main() {
+    gl_Position = vec4(aPos.x / uScreenSize.x * 2.0 - 1.0, 1.0 - aPos.y / uScreenSize.y * 2.0, 0.0, 1.0);
+}
+)";
+
+const char* const TEXT_FRAGMENT_SHADER = R"(
+#version 330 core
+uniform vec3 uColor;
+out vec4 fragColor;
+
+void main() {
+    fragColor = vec4(uColor, 1.0);
+}
+)";
+
+// Function to compile and link a shader program; returns 0 on failure
+inline GLuint buildProgram(const char* vertexSource, const char* fragmentSource) {
+    GLuint shaders[2] = { glCreateShader(GL_VERTEX_SHADER), glCreateShader(GL_FRAGMENT_SHADER) };
+    const char* sources[2] = { vertexSource, fragmentSource };
+    GLuint program = glCreateProgram();
+    char log[1024];
+
+    for (int i = 0; i < 2; i++) {
+        glShaderSource(shaders[i], 1, &sources[i], NULL);
+        glCompileShader(shaders[i]);
+        GLint ok;
+        glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &ok);
+        if (!ok) {
+            glGetShaderInfoLog(shaders[i], sizeof(log), NULL, log);
+            std::cerr << "Failed to compile shader:\n" << log << "\n";
+            return 0;
+        }
+        glAttachShader(program, shaders[i]);
+    }
+
+    glLinkProgram(program);
+    glDeleteShader(shaders[0]);
+    glDeleteShader(shaders[1]);
+    GLint ok;
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        std::cerr << "Failed to link shader program:\n" << log << "\n";
+        return 0;
+    }
+    return program;
+}
+
+// Function to upload a mesh and set up its vertex attributes
+inline void createMesh(Mesh& mesh, const std::vector<MeshVertex>& vertices, GLenum primitive) {
+    mesh.primitive = primitive;
+    mesh.vertexCount = (GLsizei)vertices.size();
+
+    glGenVertexArrays(1, &mesh.vao);
+    glBindVertexArray(mesh.vao);
+
+    glGenBuffers(1, &mesh.vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(MeshVertex), vertices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, x));
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, nx));
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, r));
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+
+    glBindVertexArray(0);
+}
+
+// Function to point a mesh's instance attributes at 'buffer', starting at
+// instance 'first'
+inline void setInstanceSource(const Mesh& mesh, GLuint buffer, GLsizei first) {
+    size_t base = first * sizeof(MeshInstance);
+    glBindVertexArray(mesh.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(MeshInstance), (void*)(base + offsetof(MeshInstance, x)));
+    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(MeshInstance), (void*)(base + offsetof(MeshInstance, sx)));
+    glEnableVertexAttribArray(3);
+    glEnableVertexAttribArray(4);
+    glVertexAttribDivisor(3, 1);
+    glVertexAttribDivisor(4, 1);
+    glBindVertexArray(0);
+}
+
+// Function to make sure the shared instance buffer holds 'cars' cars
+inline void reserveInstances(Renderer& renderer, GLsizei cars) {
+    if (cars <= renderer.carCapacity)
+        return;
+    GLsizei capacity = renderer.carCapacity ? renderer.carCapacity : 16;
+    while (capacity < cars)
+        capacity *= 2;
+
+    glBindBuffer(GL_ARRAY_BUFFER, renderer.instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, capacity * INSTANCES_PER_CAR * sizeof(MeshInstance), NULL, GL_STREAM_DRAW);
+    setInstanceSource(renderer.cube, renderer.instanceBuffer, 0);
+    setInstanceSource(renderer.arrow, renderer.instanceBuffer, capacity);
+    renderer.carCapacity = capacity;
+}
+
+// Function to create the shader programs, meshes and text buffers
+inline bool initRenderer(Renderer& renderer) {
+    renderer.meshProgram = buildProgram(MESH_VERTEX_SHADER, MESH_FRAGMENT_SHADER);
+    renderer.textProgram = buildProgram(TEXT_VERTEX_SHADER, TEXT_FRAGMENT_SHADER);
+    if (!renderer.meshProgram || !renderer.textProgram)
+        return false;
+
+    renderer.meshViewProj = glGetUniformLocation(renderer.meshProgram, "uViewProj");
+    renderer.meshLightDir = glGetUniformLocation(renderer.meshProgram, "uLightDir");
+    renderer.meshLit = glGetUniformLocation(renderer.meshProgram, "uLit");
+    renderer.meshLoadColor = glGetUniformLocation(renderer.meshProgram, "uLoadColor");
+    renderer.textScreenSize = glGetUniformLocation(renderer.textProgram, "uScreenSize");
+    renderer.textColor = glGetUniformLocation(renderer.textProgram, "uColor");
+
+    createMesh(renderer.cube, buildCubeMesh(), GL_TRIANGLES);
+    createMesh(renderer.arrow, buildArrowMesh(), GL_TRIANGLES);
+
+    // Ground tiles: level 'lod' reads its instances from its own section
+    glGenBuffers(1, &renderer.groundInstanceBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, renderer.groundInstanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, TILE_LODS * TILE_MAX_VISIBLE * sizeof(MeshInstance), NULL, GL_STREAM_DRAW);
+    for (int lod = 0; lod < TILE_LODS; lod++) {
+        createMesh(renderer.ground[lod], buildGroundTileMesh(TILE_LOD_SPACING[lod]), GL_LINES);
+        setInstanceSource(renderer.ground[lod], renderer.groundInstanceBuffer, lod * TILE_MAX_VISIBLE);
+    }
+
+    // Track tiles never move: their single identity instance is uploaded once
+    MeshInstance identity = { 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+    glGenBuffers(1, &renderer.identityInstanceBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, renderer.identityInstanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(identity), &identity, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &renderer.instanceBuffer);
+    renderer.carCapacity = 0;
+    reserveInstances(renderer, 1);
+
+    // Text: stb_easy_font emits quads; a static index buffer splits each
+    // into two triangles so the raw output can be uploaded untouched
+    std::vector<GLuint> indices(MAX_TEXT_QUADS * 6);
+    for (GLuint q = 0; q < (GLuint)MAX_TEXT_QUADS; q++) {
+        const GLuint order[6] = { 0, 1, 2, 0, 2, 3 };
+        for (int k = 0; k < 6; k++)
+            indices[q * 6 + k] = q * 4 + order[k];
+    }
+
+    glGenVertexArrays(1, &renderer.textVao);
+    glBindVertexArray(renderer.textVao);
+    glGenBuffers(1, &renderer.textVertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, renderer.textVertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(renderer.textVertices), NULL, GL_STREAM_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 16, (void*)0);
+    glEnableVertexAttribArray(0);
+    glGenBuffers(1, &renderer.textIndexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer.textIndexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    glBindVertexArray(0);
+
+    return true;
+}
+
+// Function to delete a mesh's buffers
+inline void deleteMesh(Mesh& mesh) {
+    glDeleteBuffers(1, &mesh.vertexBuffer);
+    glDeleteVertexArrays(1, &mesh.vao);
+    mesh.vertexCount = 0;
+}
+
+// Function to follow the camera with the track tiles: delete the ones it
+// left behind and upload at most TILE_UPLOADS_PER_FRAME the streamer has
+// finished. Call once per frame before drawScene().
+inline void streamTrackTiles(Renderer& renderer, TileStreamer& streamer, const glm::vec3& eye) {
+    updateTileStreamer(streamer, eye.x, eye.z, renderer.evicted);
+    for (uint64_t key : renderer.evicted) {
+        auto it = renderer.trackTiles.find(key);
+        if (it != renderer.trackTiles.end()) {
+            deleteMesh(it->second.mesh);
+            renderer.trackTiles.erase(it);
+        }
+    }
+
+    takeLoadedTiles(streamer, renderer.uploads, TILE_UPLOADS_PER_FRAME);
+    for (const TrackTileMesh& loaded : renderer.uploads) {
+        auto it = renderer.trackTiles.find(loaded.key);
+        if (it != renderer.trackTiles.end())
+            deleteMesh(it->second.mesh);   // Asked for again before the first copy arrived
+        TrackTile& tile = renderer.trackTiles[loaded.key];
+        createMesh(tile.mesh, loaded.vertices, GL_LINES);
+        setInstanceSource(tile.mesh, renderer.identityInstanceBuffer, 0);
+        tile.fineCount = (GLsizei)loaded.fineCount;
+    }
+}
+
+// Function to map the instance buffer for 'cars' cars. Write the bodies to
+// the first returned pointer and CORNER_COUNT arrows per car (car-major) to
+// the second, then call drawVehicles().
+inline void beginInstances(Renderer& renderer, GLsizei cars, MeshInstance** bodies, MeshInstance** arrows) {
+    reserveInstances(renderer, cars);
+    glBindBuffer(GL_ARRAY_BUFFER, renderer.instanceBuffer);
+    MeshInstance* mapped = (MeshInstance*)glMapBufferRange(
+        GL_ARRAY_BUFFER, 0, renderer.carCapacity * INSTANCES_PER_CAR * sizeof(MeshInstance),
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    *bodies = mapped;
+    *arrows = mapped + renderer.carCapacity;
+}
+
+// Function to unmap the instance buffer and draw the ground and track
+// tiles seen from 'eye', 'cars' car bodies and their wheel load arrows
+inline void drawScene(Renderer& renderer, const glm::mat4& viewProj, const glm::vec3& eye, GLsizei cars) {
+    glBindBuffer(GL_ARRAY_BUFFER, renderer.instanceBuffer);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+
+    // Cull the ground tiles and upload the survivors, each level to its section
+    float rows[4][4];
+    for (int r = 0; r < 4; r++)
+        for (int c = 0; c < 4; c++)
+            rows[r][c] = viewProj[c][r];
+    Frustum frustum = makeFrustum(rows);
+    collectVisibleTiles(frustum, eye.x, eye.z, renderer.visible);
+    glBindBuffer(GL_ARRAY_BUFFER, renderer.groundInstanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, TILE_LODS * TILE_MAX_VISIBLE * sizeof(MeshInstance), NULL, GL_STREAM_DRAW);
+    for (int lod = 0; lod < TILE_LODS; lod++) {
+        if (renderer.visible.count[lod] > 0)
+            glBufferSubData(GL_ARRAY_BUFFER, lod * TILE_MAX_VISIBLE * sizeof(MeshInstance),
+                            renderer.visible.count[lod] * sizeof(MeshInstance), renderer.visible.instances[lod]);
+    }
+
+    glUseProgram(renderer.meshProgram);
+    glUniformMatrix4fv(renderer.meshViewProj, 1, GL_FALSE, &viewProj[0][0]);
+    glUniform3f(renderer.meshLightDir, 5.0f, 5.0f, 5.0f);
+    glUniform1f(renderer.meshLoadColor, 0.0f);
+
+    // Draw the ground, one call per level of detail, without writing depth:
+    // far away a pixel spans metres of ground, and its lines would hide
+    // the track and the cars. Then the visible track tiles.
+    glUniform1f(renderer.meshLit, 0.0f);
+    glDepthMask(GL_FALSE);
+    for (int lod = 0; lod < TILE_LODS; lod++) {
+        if (renderer.visible.count[lod] == 0)
+            continue;
+        glBindVertexArray(renderer.ground[lod].vao);
+        glDrawArraysInstanced(GL_LINES, 0, renderer.ground[lod].vertexCount, renderer.visible.count[lod]);
+    }
+    glDepthMask(GL_TRUE);
+    for (const auto& resident : renderer.trackTiles) {
+        int32_t ix = tileKeyX(resident.first), iz = tileKeyZ(resident.first);
+        if (!tileInFrustum(frustum, ix, iz))
+            continue;
+        const TrackTile& tile = resident.second;
+        glBindVertexArray(tile.mesh.vao);
+        if (tileDistanceSquared(eye.x, eye.z, ix, iz) > TRACK_COARSE_DISTANCE * TRACK_COARSE_DISTANCE)
+            glDrawArraysInstanced(GL_LINES, tile.fineCount, tile.mesh.vertexCount - tile.fineCount, 1);
+        else
+            glDrawArraysInstanced(GL_LINES, 0, tile.fineCount, 1);
+    }
+
+    // Draw the cars, scaled from the unit cube
+    glUniform1f(renderer.meshLit, 1.0f);
+    glBindVertexArray(renderer.cube.vao);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, renderer.cube.vertexCount, cars);
+
+    // Draw the normal load arrows, one per wheel
+    glUniform1f(renderer.meshLit, 0.0f);
+    glUniform1f(renderer.meshLoadColor, 1.0f);
+    glBindVertexArray(renderer.arrow.vao);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, renderer.arrow.vertexCount, cars * CORNER_COUNT);
+
+    glBindVertexArray(0);
+}
+
+// Function to draw 'numQuads' stb_easy_font quads from 'vertices', in
+// pixel coordinates from the top-left
+inline void drawTextQuads(Renderer& renderer, int width, int height, const char* vertices, int numQuads,
+                          float r, float g, float b) {
+    glDisable(GL_DEPTH_TEST);
+    glUseProgram(renderer.textProgram);
+    glUniform2f(renderer.textScreenSize, (float)width, (float)height);
+    glUniform3f(renderer.textColor, r, g, b);
+
+    glBindBuffer(GL_ARRAY_BUFFER, renderer.textVertexBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, numQuads * 4 * 16, vertices);
+    glBindVertexArray(renderer.textVao);
+    glDrawElements(GL_TRIANGLES, numQuads * 6, GL_UNSIGNED_INT, (void*)0);
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+}
+
+// Function to render text on the screen, in pixel coordinates from the top-left
+inline void renderText(Renderer& renderer, int width, int height, float x, float y, const char* text) {
+    int numQuads = stb_easy_font_print(x, y, (char*)text, NULL, renderer.textVertices, sizeof(renderer.textVertices));
+    drawTextQuads(renderer, width, height, renderer.textVertices, numQuads, 1.0f, 1.0f, 1.0f); // White color
+}
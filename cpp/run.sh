@@ -1,15 +1,60 @@
 #!/bin/bash
 
+# Usage: ./run.sh            build and launch the interactive simulator
+#        ./run.sh headless   build and run the display-less batch runner
+#                            (-march=native so the fleet kernels use AVX2/AVX-512)
+#                            (extra arguments are passed through)
+#        ./run.sh profile    build and launch the simulator with the profiler zones and
+#                            frame timeline overlay compiled in (-DTVS_PROFILE)
+#        ./run.sh bench      build and run the benchmark suite against the mock GL
+#                            layer (needs Google Benchmark and glm headers;
+#                            extra arguments are passed through)
+
+TARGET=${1:-main}
+
+if [ "$TARGET" == "headless" ]; then
+    # The headless runner only needs the C++ standard library
+    g++ -std=c++17 -O2 -march=native -pthread headless.cpp -o headless
+
+    if [ $? -eq 0 ]; then
+        ./headless "${@:2}"
+    else
+        echo "Compilation failed. Please check the errors above."
+    fi
+    exit
+fi
+
+if [ "$TARGET" == "bench" ]; then
+    # GL calls resolve to mock_gl/GL/glew.h, so no display or GL library is needed
+    g++ -std=c++17 -O2 -march=native -pthread -Imock_gl bench.cpp -o bench -lbenchmark
+
+    if [ $? -eq 0 ]; then
+        ./bench "${@:2}"
+    else
+        echo "Compilation failed. Please check the errors above."
+    fi
+    exit
+fi
+
+# Profiling instrumentation is compiled out unless asked for
+if [ "$TARGET" == "profile" ]; then
+    PROFILE_FLAGS="-DTVS_PROFILE"
+fi
+
 # Compile the program
-g++ main.cpp -o main \
--I/opt/homebrew/Cellar/glew/2.2.0_1/include \
--I/opt/homebrew/Cellar/glfw/3.4/include \
--I/opt/homebrew/include \
--I/opt/homebrew/include/glm \
--L/opt/homebrew/Cellar/glew/2.2.0_1/lib \
--L/opt/homebrew/Cellar/glfw/3.4/lib \
--L/opt/homebrew/lib \
--lglfw -lGLEW -lglut -framework OpenGL
+if [ "$(uname)" == "Linux" ]; then
+    g++ -std=c++17 -O2 -pthread $PROFILE_FLAGS main.cpp -o main $(pkg-config --cflags --libs glfw3 glew) -lGL
+else
+    g++ -std=c++17 $PROFILE_FLAGS main.cpp -o main \
+    -I/opt/homebrew/Cellar/glew/2.2.0_1/include \
+    -I/opt/homebrew/Cellar/glfw/3.4/include \
+    -I/opt/homebrew/include \
+    -I/opt/homebrew/include/glm \
+    -L/opt/homebrew/Cellar/glew/2.2.0_1/lib \
+    -L/opt/homebrew/Cellar/glfw/3.4/lib \
+    -L/opt/homebrew/lib \
+    -lglfw -lGLEW -lglut -framework OpenGL
+fi
 
 # Check if compilation was successful
 if [ $? -eq 0 ]; then
@@ -18,4 +63,4 @@ if [ $? -eq 0 ]; then
 else
     echo "Compilation failed. Please check the errors above."
     # exit 1
-fi
\ No newline at end of file
+fi
@@ -0,0 +1,421 @@
+// scenario.h
+//
+// Drive cycles read from a file: keyframes of time against steering,
+// throttle and brake, linearly interpolated at every physics step.
+//
+// A keyframe commands the steering angle as a fraction of maxSteer
+// (positive left), and throttle and brake in [0, 1]. The angle is reached
+// through the normal steering rate limit, like a steering robot, so a
+// cycle defined in angles (sine with dwell) plays back the same on every
+// car. Throttle minus brake becomes DriverInput::throttle.
+//
+// Two file forms hold the same keyframes:
+//
+//   text     one "t, steer, throttle[, brake]" per line (commas or
+//            blanks); lines not starting with a number, such as a
+//            header or '#' comments, are skipped
+//   binary   ScenarioFileHeader, then packed ScenarioKey records;
+//            written for paths ending in ".bin", recognized on reading
+//            by the magic
+//
+// Files are streamed: the reader holds one chunk of raw file and one chunk
+// of decoded keyframes and decodes the next only when the cursor reaches
+// it, so a multi-hour cycle costs the same memory as a short one. Queries
+// must come in non-decreasing time; each advances the cursor past the
+// keyframes it has overtaken, which is O(1) amortized per physics step.
+// A Scenario belongs to one simulation; threads open their own.
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "car.h"
+
+const char SCENARIO_MAGIC[8] = { 'T', 'V', 'S', 'S', 'C', 'N', '1', '\0' };
+const size_t SCENARIO_CHUNK_KEYS = 1024;          // keyframes decoded at a time
+const size_t SCENARIO_TEXT_CHUNK = 64 * 1024;     // bytes of text read at a time
+
+// One keyframe. Time is double so hours-long cycles keep millisecond steps.
+struct ScenarioKey {
+    double t;                 // Time (s)
+    float steer;              // Steering angle / maxSteer, positive left
+    float throttle;           // [0, 1]
+    float brake;              // [0, 1]
+    float reserved;           // Zero; pads the record to 24 bytes
+};
+
+// Binary file header
+struct ScenarioFileHeader {
+    char magic[8];            // SCENARIO_MAGIC
+    uint32_t keySize;         // sizeof(ScenarioKey)
+    uint32_t reserved;
+};
+
+struct Scenario {
+    FILE* file;
+    bool binary;
+    long dataOffset;          // File offset of the first keyframe
+    long line;                // Text: lines consumed, for messages
+    bool failed;              // A malformed keyframe ended the stream
+
+    // Raw text not yet parsed: text[textBegin .. textEnd)
+    std::vector<char> text;
+    size_t textBegin, textEnd;
+    bool textEof;
+
+    // Decoded keyframes not yet consumed: keys[keyNext .. keyCount)
+    std::vector<ScenarioKey> keys;
+    size_t keyNext, keyCount;
+    double lastTime;          // Time of the last decoded keyframe
+
+    // Cursor: the keyframes on either side of the last query
+    ScenarioKey previous, next;
+    bool hasNext;
+};
+
+// Function to parse one text line into a keyframe. Returns 1 for a
+// keyframe, 0 for a line to skip and -1 for a malformed one.
+inline int parseScenarioLine(const char* line, ScenarioKey* key) {
+    while (*line == ' ' || *line == '\t')
+        line++;
+    if (!((*line >= '0' && *line <= '9') || *line == '-' || *line == '+' || *line == '.'))
+        return 0;
+    double values[4] = { 0.0, 0.0, 0.0, 0.0 };
+    int count = 0;
+    const char* p = line;
+    while (count < 4) {
+        char* end;
+        double v = strtod(p, &end);
+        if (end == p)
+            break;
+        values[count++] = v;
+        p = end;
+        while (*p == ',' || *p == ' ' || *p == '\t' || *p == ';')
+            p++;
+    }
+    if (count < 3)
+        return -1;
+    key->t = values[0];
+    key->steer = (float)values[1];
+    key->throttle = (float)values[2];
+    key->brake = (float)values[3];
+    key->reserved = 0.0f;
+    return 1;
+}
+
+// Function to decode the next chunk of keyframes; false at the end of the
+// stream or on an error
+inline bool readScenarioChunk(Scenario& scenario) {
+    scenario.keyNext = 0;
+    scenario.keyCount = 0;
+    if (scenario.failed || !scenario.file)
+        return false;
+
+    if (scenario.binary) {
+        scenario.keyCount = fread(scenario.keys.data(), sizeof(ScenarioKey), SCENARIO_CHUNK_KEYS, scenario.file);
+    } else {
+        while (scenario.keyCount < SCENARIO_CHUNK_KEYS) {
+            // Find the end of the next line, reading more text if needed
+            char* begin = scenario.text.data() + scenario.textBegin;
+            char* newline = (char*)memchr(begin, '\n', scenario.textEnd - scenario.textBegin);
+            if (!newline && !scenario.textEof) {
+                size_t pending = scenario.textEnd - scenario.textBegin;
+                if (pending == SCENARIO_TEXT_CHUNK - 1) {
+                    std::cerr << "Scenario line " << scenario.line + 1 << " is too long\n";
+                    scenario.failed = true;
+                    break;
+                }
+                memmove(scenario.text.data(), begin, pending);
+                size_t got = fread(scenario.text.data() + pending, 1, SCENARIO_TEXT_CHUNK - 1 - pending, scenario.file);
+                scenario.textBegin = 0;
+                scenario.textEnd = pending + got;
+                scenario.textEof = got == 0;
+                continue;
+            }
+            if (!newline && scenario.textBegin == scenario.textEnd)
+                break;
+            char* end = newline ? newline : scenario.text.data() + scenario.textEnd;
+            *end = '\0';
+            scenario.textBegin = (size_t)(end - scenario.text.data()) + (newline ? 1 : 0);
+            if (!newline)
+                scenario.textBegin = scenario.textEnd;
+            scenario.line++;
+
+            ScenarioKey key;
+            int parsed = parseScenarioLine(begin, &key);
+            if (parsed < 0) {
+                std::cerr << "Scenario line " << scenario.line << ": expected t, steer, throttle[, brake]\n";
+                scenario.failed = true;
+                break;
+            }
+            if (parsed > 0)
+                scenario.keys[scenario.keyCount++] = key;
+        }
+    }
+
+    // Time must not run backwards; stop at the first keyframe where it does
+    for (size_t k = 0; k < scenario.keyCount; k++) {
+        if (scenario.keys[k].t < scenario.lastTime) {
+            std::cerr << "Scenario time goes backwards at t=" << scenario.keys[k].t << "\n";
+            scenario.keyCount = k;
+            scenario.failed = true;
+            break;
+        }
+        scenario.lastTime = scenario.keys[k].t;
+    }
+    return scenario.keyCount > 0;
+}
+
+// Function to take the next keyframe from the stream
+inline bool nextScenarioKey(Scenario& scenario, ScenarioKey* key) {
+    if (scenario.keyNext == scenario.keyCount && !readScenarioChunk(scenario))
+        return false;
+    *key = scenario.keys[scenario.keyNext++];
+    return true;
+}
+
+// Function to position the cursor on the first keyframe; false if there is none
+inline bool startScenarioCursor(Scenario& scenario) {
+    scenario.lastTime = -INFINITY;
+    if (!nextScenarioKey(scenario, &scenario.previous))
+        return false;
+    scenario.hasNext = nextScenarioKey(scenario, &scenario.next);
+    return true;
+}
+
+// Function to close a scenario file
+inline void closeScenario(Scenario& scenario) {
+    if (scenario.file)
+        fclose(scenario.file);
+    scenario.file = nullptr;
+}
+
+// Function to open a scenario file, text or binary; false if it cannot be
+// read or holds no keyframes
+inline bool openScenario(Scenario& scenario, const char* path) {
+    scenario.file = fopen(path, "rb");
+    if (!scenario.file)
+        return false;
+    scenario.keys.resize(SCENARIO_CHUNK_KEYS);
+    scenario.failed = false;
+    scenario.line = 0;
+
+    ScenarioFileHeader header;
+    scenario.binary = fread(&header, sizeof(header), 1, scenario.file) == 1
+                   && memcmp(header.magic, SCENARIO_MAGIC, sizeof(SCENARIO_MAGIC)) == 0;
+    if (scenario.binary && header.keySize != sizeof(ScenarioKey)) {
+        std::cerr << "Scenario " << path << " has " << header.keySize << "-byte keyframes, expected "
+                  << sizeof(ScenarioKey) << "\n";
+        closeScenario(scenario);
+        return false;
+    }
+    scenario.dataOffset = scenario.binary ? (long)sizeof(header) : 0L;
+    fseek(scenario.file, scenario.dataOffset, SEEK_SET);
+    if (!scenario.binary)
+        scenario.text.resize(SCENARIO_TEXT_CHUNK);
+    scenario.textBegin = scenario.textEnd = 0;
+    scenario.textEof = false;
+    scenario.keyNext = scenario.keyCount = 0;
+
+    if (!startScenarioCursor(scenario)) {
+        closeScenario(scenario);
+        return false;
+    }
+    return true;
+}
+
+// Function to start an open scenario over from its first keyframe
+inline bool rewindScenario(Scenario& scenario) {
+    if (!scenario.file || fseek(scenario.file, scenario.dataOffset, SEEK_SET) != 0)
+        return false;
+    scenario.failed = false;
+    scenario.line = 0;
+    scenario.textBegin = scenario.textEnd = 0;
+    scenario.textEof = false;
+    scenario.keyNext = scenario.keyCount = 0;
+    return startScenarioCursor(scenario);
+}
+
+// Function to interpolate the keyframes at time t, which must not be
+// earlier than at the previous call. Before the first keyframe its values
+// apply. Returns false once t is past the last keyframe; *key then holds it.
+inline bool sampleScenario(Scenario& scenario, double t, ScenarioKey* key) {
+    while (scenario.hasNext && scenario.next.t <= t) {
+        scenario.previous = scenario.next;
+        scenario.hasNext = nextScenarioKey(scenario, &scenario.next);
+    }
+    if (!scenario.hasNext) {
+        *key = scenario.previous;
+        return t <= scenario.previous.t;
+    }
+    const ScenarioKey& a = scenario.previous;
+    const ScenarioKey& b = scenario.next;
+    float u = t > a.t ? (float)((t - a.t) / (b.t - a.t)) : 0.0f;
+    key->t = t;
+    key->steer = a.steer + u * (b.steer - a.steer);
+    key->throttle = a.throttle + u * (b.throttle - a.throttle);
+    key->brake = a.brake + u * (b.brake - a.brake);
+    return true;
+}
+
+// Function to turn the scenario's command at time t into the driver input
+// for 'car' over the next dt. Returns false once the scenario has ended.
+inline bool scenarioInput(Scenario& scenario, const Car& car, double t, float dt, DriverInput* input) {
+    ScenarioKey key;
+    bool running = sampleScenario(scenario, t, &key);
+    float steer = fminf(fmaxf(key.steer, -1.0f), 1.0f) * car.maxSteer;
+    input->steer = fminf(fmaxf((steer - car.steerAngle) / (STEER_SPEED * dt), -1.0f), 1.0f);
+    input->throttle = fminf(fmaxf(key.throttle - key.brake, -1.0f), 1.0f);
+    return running;
+}
+
+// Streaming writer for either file form
+struct ScenarioWriter {
+    FILE* file;
+    bool binary;
+};
+
+// Function to create a scenario file; binary if the path ends in ".bin"
+inline bool openScenarioWriter(ScenarioWriter& writer, const char* path) {
+    size_t length = strlen(path);
+    writer.binary = length >= 4 && strcmp(path + length - 4, ".bin") == 0;
+    writer.file = fopen(path, writer.binary ? "wb" : "w");
+    if (!writer.file)
+        return false;
+    if (writer.binary) {
+        ScenarioFileHeader header;
+        memcpy(header.magic, SCENARIO_MAGIC, sizeof(SCENARIO_MAGIC));
+        header.keySize = sizeof(ScenarioKey);
+        header.reserved = 0;
+        fwrite(&header, sizeof(header), 1, writer.file);
+    } else {
+        fprintf(writer.file, "# t (s), steer (fraction of max angle, + left), throttle, brake\n");
+    }
+    return true;
+}
+
+// Function to print the shortest decimal that reads back to exactly value,
+// so text <-> binary conversion is lossless but hand-typed 3.1 stays 3.1
+inline void writeScenarioNumber(FILE* file, double value, bool isFloat) {
+    char text[32];
+    for (int digits = isFloat ? 6 : 15; ; digits++) {
+        snprintf(text, sizeof(text), "%.*g", digits, value);
+        double back = strtod(text, nullptr);
+        if (isFloat ? (float)back == (float)value : back == value)
+            break;
+    }
+    fputs(text, file);
+}
+
+// Function to append one keyframe; times must not decrease
+inline void writeScenarioKey(ScenarioWriter& writer, const ScenarioKey& key) {
+    if (writer.binary) {
+        fwrite(&key, sizeof(key), 1, writer.file);
+        return;
+    }
+    writeScenarioNumber(writer.file, key.t, false);
+    const float values[3] = { key.steer, key.throttle, key.brake };
+    for (float value : values) {
+        fputc(',', writer.file);
+        writeScenarioNumber(writer.file, value, true);
+    }
+    fputc('\n', writer.file);
+}
+
+// Function to finish a scenario file; false if anything failed to write
+inline bool closeScenarioWriter(ScenarioWriter& writer) {
+    bool ok = !ferror(writer.file);
+    return fclose(writer.file) == 0 && ok;
+}
+
+// Standard drive cycles
+enum DriveCycle {
+    CYCLE_STEP_STEER,         // Accelerate, then a fast ramp to half lock held for 5 s
+    CYCLE_SINE_WITH_DWELL,    // Coast, 0.7 Hz sine with a 0.5 s dwell at the second peak (FMVSS 126 style)
+    CYCLE_BRAKE_IN_TURN,      // Steady turn, then brake hard holding the wheel
+    CYCLE_COUNT
+};
+
+const char* const DRIVE_CYCLE_NAMES[CYCLE_COUNT] = { "step-steer", "sine-dwell", "brake-in-turn" };
+
+// Function to look up a drive cycle by name
+inline bool parseDriveCycle(const char* name, DriveCycle* cycle) {
+    for (int i = 0; i < CYCLE_COUNT; i++) {
+        if (strcmp(name, DRIVE_CYCLE_NAMES[i]) == 0) {
+            *cycle = (DriveCycle)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function to write 'repeats' back-to-back runs of a drive cycle. Returns
+// the length of one run (s).
+inline double writeDriveCycle(ScenarioWriter& writer, DriveCycle cycle, long repeats) {
+    std::vector<ScenarioKey> keys;
+    auto add = [&](double t, float steer, float throttle, float brake) {
+        ScenarioKey key = { t, steer, throttle, brake, 0.0f };
+        keys.push_back(key);
+    };
+    double length = 0.0;
+    switch (cycle) {
+    case CYCLE_STEP_STEER:
+        add(0.0, 0.0f, 0.6f, 0.0f);
+        add(3.0, 0.0f, 0.6f, 0.0f);
+        add(3.0, 0.0f, 0.1f, 0.0f);
+        add(3.1, 0.5f, 0.1f, 0.0f);
+        add(8.1, 0.5f, 0.1f, 0.0f);
+        add(8.1, 0.0f, 0.0f, 0.0f);
+        length = 10.0;
+        break;
+    case CYCLE_SINE_WITH_DWELL: {
+        // Speed up, then the sine: three quarter periods to the second
+        // peak, the dwell, and the last quarter back to center
+        const double frequency = 0.7, dwell = 0.5, start = 5.0;
+        const float amplitude = 0.6f;
+        add(0.0, 0.0f, 0.6f, 0.0f);
+        add(start - 1.0, 0.0f, 0.6f, 0.0f);
+        add(start - 1.0, 0.0f, 0.05f, 0.0f);
+        double quarter = 0.25 / frequency;
+        for (int k = 0; k <= 300; k++) {
+            double tau = 3.0 * quarter * k / 300.0;
+            add(start + tau, amplitude * (float)sin(2.0 * M_PI * frequency * tau), 0.05f, 0.0f);
+        }
+        for (int k = 0; k <= 100; k++) {
+            double tau = 3.0 * quarter + quarter * k / 100.0;
+            add(start + dwell + tau, amplitude * (float)sin(2.0 * M_PI * frequency * tau), 0.05f, 0.0f);
+        }
+        length = start + dwell + 4.0 * quarter + 2.0;
+        break;
+    }
+    case CYCLE_BRAKE_IN_TURN:
+        add(0.0, 0.0f, 0.6f, 0.0f);
+        add(4.0, 0.0f, 0.6f, 0.0f);
+        add(4.0, 0.0f, 0.2f, 0.0f);
+        add(5.0, 0.3f, 0.2f, 0.0f);
+        add(8.0, 0.3f, 0.2f, 0.0f);
+        add(8.0, 0.3f, 0.0f, 0.8f);
+        add(10.0, 0.3f, 0.0f, 0.8f);
+        add(10.0, 0.0f, 0.0f, 0.0f);
+        length = 11.0;
+        break;
+    default:
+        break;
+    }
+
+    for (long r = 0; r < repeats; r++) {
+        for (ScenarioKey key : keys) {
+            key.t += length * (double)r;
+            writeScenarioKey(writer, key);
+        }
+    }
+    ScenarioKey end = { length * (double)repeats, 0.0f, 0.0f, 0.0f, 0.0f };
+    writeScenarioKey(writer, end);
+    return length;
+}
@@ -0,0 +1,127 @@
+// scene_mesh.h
+//
+// Geometry of the simulator scene, independent of any graphics API: the
+// vertex and per-instance layouts, the static meshes (car body cube, load
+// arrow) and the per-car instance data. The ground and the track are cut
+// into tiles by world_tiles.h. renderer.h uploads these to OpenGL;
+// soft_raster.h draws the same data on the CPU for offscreen frames.
+
+#pragma once
+
+#include <cmath>
+#include <vector>
+
+#include "car.h"
+
+// Vertex of the static meshes
+struct MeshVertex {
+    float x, y, z;            // Position in model space
+    float nx, ny, nz;         // Normal
+    float r, g, b;            // Color
+};
+
+// Per-instance data. Model +x is rotated onto the direction of travel
+// (cos heading, sin heading) and model +z onto the side the car turns
+// towards with positive steering, matching the physics in car.h.
+struct MeshInstance {
+    float x, y, z;            // Translation (m)
+    float heading;            // Rotation about +y (radians)
+    float sx, sy, sz;         // Scale; for arrows sy is the shaft height (m)
+    float shade;              // Color multiplier, or for arrows load / mean wheel load
+};
+
+// Instances per car: the body and one arrow per wheel
+const int INSTANCES_PER_CAR = 1 + CORNER_COUNT;
+
+// Arrow shaft length per newton of normal load (m/N)
+const float LOAD_ARROW_SCALE = 0.0005f;
+
+// Function to add one flat-shaded quad (two triangles) to a vertex list
+inline void addQuad(std::vector<MeshVertex>& out, const float corners[4][3], float nx, float ny, float nz,
+                    float r, float g, float b) {
+    const int order[6] = { 0, 1, 2, 0, 2, 3 };
+    for (int i : order) {
+        MeshVertex v = { corners[i][0], corners[i][1], corners[i][2], nx, ny, nz, r, g, b };
+        out.push_back(v);
+    }
+}
+
+// Function to build the unit cube centered at the origin (the car body)
+inline std::vector<MeshVertex> buildCubeMesh() {
+    std::vector<MeshVertex> v;
+    const float front[4][3] = { {-0.5f, -0.5f, 0.5f}, {0.5f, -0.5f, 0.5f}, {0.5f, 0.5f, 0.5f}, {-0.5f, 0.5f, 0.5f} };
+    const float back[4][3] = { {-0.5f, -0.5f, -0.5f}, {-0.5f, 0.5f, -0.5f}, {0.5f, 0.5f, -0.5f}, {0.5f, -0.5f, -0.5f} };
+    const float left[4][3] = { {-0.5f, -0.5f, -0.5f}, {-0.5f, -0.5f, 0.5f}, {-0.5f, 0.5f, 0.5f}, {-0.5f, 0.5f, -0.5f} };
+    const float right[4][3] = { {0.5f, -0.5f, -0.5f}, {0.5f, 0.5f, -0.5f}, {0.5f, 0.5f, 0.5f}, {0.5f, -0.5f, 0.5f} };
+    const float top[4][3] = { {-0.5f, 0.5f, -0.5f}, {-0.5f, 0.5f, 0.5f}, {0.5f, 0.5f, 0.5f}, {0.5f, 0.5f, -0.5f} };
+    const float bottom[4][3] = { {-0.5f, -0.5f, -0.5f}, {0.5f, -0.5f, -0.5f}, {0.5f, -0.5f, 0.5f}, {-0.5f, -0.5f, 0.5f} };
+
+    addQuad(v, front, 0.0f, 0.0f, 1.0f, 0.8f, 0.0f, 0.0f);    // Dark Red
+    addQuad(v, back, 0.0f, 0.0f, -1.0f, 0.8f, 0.0f, 0.0f);    // Dark Red
+    addQuad(v, left, -1.0f, 0.0f, 0.0f, 0.8f, 0.0f, 0.0f);    // Dark Red
+    addQuad(v, right, 1.0f, 0.0f, 0.0f, 0.8f, 0.0f, 0.0f);    // Dark Red
+    addQuad(v, top, 0.0f, 1.0f, 0.0f, 0.9f, 0.1f, 0.1f);      // Lighter Red
+    addQuad(v, bottom, 0.0f, -1.0f, 0.0f, 0.6f, 0.0f, 0.0f);  // Darker Red
+    return v;
+}
+
+// Function to build the load arrow: a thin shaft from y = 0 to y = 1
+// (stretched to the load by the instance scale) and a 0.1 m pyramid head
+// above it (y from 1 to 1.1, never stretched)
+inline std::vector<MeshVertex> buildArrowMesh() {
+    std::vector<MeshVertex> v;
+    const float w = 0.015f;   // shaft half-width (m)
+    const float h = 0.05f;    // head half-width (m)
+    const float r = 0.0f, g = 1.0f, b = 1.0f; // Cyan color for load arrows
+
+    const float shaft[4][4][3] = {
+        { {-w, 0.0f, w}, {w, 0.0f, w}, {w, 1.0f, w}, {-w, 1.0f, w} },
+        { {w, 0.0f, -w}, {-w, 0.0f, -w}, {-w, 1.0f, -w}, {w, 1.0f, -w} },
+        { {-w, 0.0f, -w}, {-w, 0.0f, w}, {-w, 1.0f, w}, {-w, 1.0f, -w} },
+        { {w, 0.0f, w}, {w, 0.0f, -w}, {w, 1.0f, -w}, {w, 1.0f, w} },
+    };
+    const float normals[4][3] = { {0, 0, 1}, {0, 0, -1}, {-1, 0, 0}, {1, 0, 0} };
+    for (int i = 0; i < 4; i++)
+        addQuad(v, shaft[i], normals[i][0], normals[i][1], normals[i][2], r, g, b);
+
+    // Arrowhead
+    const float base[4][3] = { {-h, 1.0f, h}, {h, 1.0f, h}, {h, 1.0f, -h}, {-h, 1.0f, -h} };
+    for (int i = 0; i < 4; i++) {
+        const float* a = base[i];
+        const float* c = base[(i + 1) % 4];
+        float nx = a[0] + c[0], nz = a[2] + c[2];
+        MeshVertex tri[3] = {
+            { a[0], a[1], a[2], nx, 0.5f, nz, r, g, b },
+            { c[0], c[1], c[2], nx, 0.5f, nz, r, g, b },
+            { 0.0f, 1.1f, 0.0f, nx, 0.5f, nz, r, g, b },
+        };
+        v.insert(v.end(), tri, tri + 3);
+    }
+    return v;
+}
+
+// Function to write the body and wheel load arrows of one car. Arrows
+// stand 0.5 m above the car's center over each wheel, with shaft length
+// proportional to the load and color relative to the mean wheel load.
+inline void writeCarInstances(MeshInstance* body, MeshInstance* arrows, float x, float y, float z, float heading,
+                              float length, float width, float lf, float lr, float trackWidth,
+                              const float loads[CORNER_COUNT]) {
+    MeshInstance b = { x, y, z, heading, length, 1.0f, width, 1.0f };
+    *body = b;
+
+    // Wheel positions in the car frame: +x forward, +z towards the left
+    const float wheelX[CORNER_COUNT] = { lf, lf, -lr, -lr };
+    const float wheelZ[CORNER_COUNT] = { 0.5f * trackWidth, -0.5f * trackWidth, 0.5f * trackWidth, -0.5f * trackWidth };
+    float meanLoad = 0.25f * (loads[FRONT_LEFT] + loads[FRONT_RIGHT] + loads[REAR_LEFT] + loads[REAR_RIGHT]);
+    float invMean = meanLoad > 0.0f ? 1.0f / meanLoad : 0.0f;
+
+    float c = cosf(heading);
+    float s = sinf(heading);
+    for (int k = 0; k < CORNER_COUNT; k++) {
+        MeshInstance a = {
+            x + c * wheelX[k] - s * wheelZ[k], y + 0.5f, z + s * wheelX[k] + c * wheelZ[k], heading,
+            1.0f, loads[k] * LOAD_ARROW_SCALE, 1.0f, loads[k] * invMean,
+        };
+        arrows[k] = a;
+    }
+}
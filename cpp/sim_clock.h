@@ -0,0 +1,70 @@
+// sim_clock.h
+//
+// Fixed-timestep simulation clock. Wall-clock time from the render loop is
+// accumulated and spent in whole PHYSICS_DT steps, so the physics sees the
+// same dt on every machine and at any frame rate. The fraction of a step
+// left over is used to interpolate the rendered pose between the last two
+// physics states.
+
+#pragma once
+
+#include "car.h"
+
+// Physics rate: 1 kHz
+const double PHYSICS_DT = 0.001;
+
+// Longest frame the physics will catch up on. A stall beyond this (window
+// drag, debugger, slow GPU) drops simulated time instead of queueing an
+// unbounded burst of steps, so a frame never costs more than
+// MAX_FRAME_TIME / PHYSICS_DT steps.
+const double MAX_FRAME_TIME = 0.25;
+
+struct SimClock {
+    double lastTime;          // Wall time of the previous advance (s)
+    double accumulator;       // Wall time not yet simulated (s)
+    long stepCount;           // Physics steps taken so far
+};
+
+// Function to start the clock at wall time 'now'
+inline SimClock makeSimClock(double now) {
+    SimClock clock = { now, 0.0, 0 };
+    return clock;
+}
+
+// Function to add the wall time elapsed since the last call; returns how
+// many fixed physics steps to run this frame
+inline int advanceClock(SimClock& clock, double now) {
+    double frameTime = now - clock.lastTime;
+    clock.lastTime = now;
+    if (frameTime > MAX_FRAME_TIME)
+        frameTime = MAX_FRAME_TIME;
+    if (frameTime < 0.0)
+        frameTime = 0.0;
+
+    clock.accumulator += frameTime;
+    int steps = (int)(clock.accumulator / PHYSICS_DT);
+    clock.accumulator -= steps * PHYSICS_DT;
+    clock.stepCount += steps;
+    return steps;
+}
+
+// Function to get how far the wall clock is into the next physics step (0..1)
+inline float interpolationAlpha(const SimClock& clock) {
+    return (float)(clock.accumulator / PHYSICS_DT);
+}
+
+// The part of the car state the renderer needs
+struct CarPose {
+    float x, y, z;            // Position in world coordinates
+    float heading;            // Heading angle (radians)
+};
+
+// Function to blend the poses of two consecutive physics states
+inline CarPose interpolatePose(const Car& previous, const Car& current, float alpha) {
+    CarPose pose;
+    pose.x = previous.x + (current.x - previous.x) * alpha;
+    pose.y = previous.y + (current.y - previous.y) * alpha;
+    pose.z = previous.z + (current.z - previous.z) * alpha;
+    pose.heading = previous.heading + (current.heading - previous.heading) * alpha;
+    return pose;
+}
@@ -0,0 +1,154 @@
+// sim_thread.h
+//
+// Physics on its own thread, decoupled from rendering.
+//
+// The simulation thread keeps the 1 kHz fixed-step clock against the
+// steady clock: it sleeps until shortly before the next step is due, spins
+// the last stretch, and runs whatever steps fell due, so a slow frame or a
+// blocking buffer swap on the render thread never holds the physics back.
+//
+// State crosses threads in two lock-free structures:
+//   - TripleBuffer: the sim thread fills a back slot and publishes it with
+//     one atomic exchange; the render thread takes the newest published
+//     slot with another. Neither side ever waits and the reader always
+//     holds a complete, immutable snapshot.
+//   - SpscQueue: the render thread pushes driver input right after polling
+//     events; the sim thread drains it before each batch of steps, so new
+//     input reaches the physics within one step instead of one frame.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+#include "sim_clock.h"
+
+// Below this much time to the next step the sim thread yields in a loop
+// instead of sleeping; OS sleeps routinely overshoot by 50-100 us
+const double SIM_SPIN_MARGIN = 0.0002;
+
+// Three copies of T so writer and reader never touch the same one
+template <typename T>
+struct TripleBuffer {
+    static const uint32_t FRESH = 4;  // Set on 'middle' when it holds an unread publish
+
+    T slots[3];
+    alignas(64) std::atomic<uint32_t> middle;  // Spare slot index, plus FRESH
+    alignas(64) uint32_t back;                 // Slot the writer fills
+    alignas(64) uint32_t front;                // Slot the reader holds
+
+    TripleBuffer() : middle(1), back(2), front(0) {}
+
+    // Function to get the slot to fill before publish() (writer only)
+    T& writeSlot() { return slots[back]; }
+
+    // Function to hand the filled slot to the reader (writer only)
+    void publish() {
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & 3;
+    }
+
+    // Function to switch to the newest published slot; false if nothing was
+    // published since the last call and readSlot() is unchanged (reader only)
+    bool acquire() {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH))
+            return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+        return true;
+    }
+
+    // Function to get the reader's current snapshot (reader only)
+    const T& readSlot() const { return slots[front]; }
+};
+
+// Bounded single-producer/single-consumer queue. As in the telemetry ring,
+// each side caches the other's index and only reloads it when the queue
+// looks full (or empty).
+template <typename T, size_t N>
+struct SpscQueue {
+    static_assert((N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+
+    T items[N];
+    alignas(64) std::atomic<uint64_t> head;   // Written by the producer
+    uint64_t cachedTail;
+    alignas(64) std::atomic<uint64_t> tail;   // Written by the consumer
+    uint64_t cachedHead;
+
+    SpscQueue() : head(0), cachedTail(0), tail(0), cachedHead(0) {}
+
+    // Function to append an item; false if the queue is full (producer only)
+    bool push(const T& item) {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        if (h - cachedTail >= N) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (h - cachedTail >= N)
+                return false;
+        }
+        items[h & (N - 1)] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Function to take the oldest item; false if empty (consumer only)
+    bool pop(T& item) {
+        uint64_t t = tail.load(std::memory_order_relaxed);
+        if (t == cachedHead) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (t == cachedHead)
+                return false;
+        }
+        item = items[t & (N - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+struct SimThread {
+    std::thread thread;
+    std::atomic<bool> running;
+    std::atomic<long> stepCount;      // Physics steps taken
+    std::atomic<long> lateBatches;    // Wakeups that found more than one step due
+};
+
+// Function to start 'advance' on its own thread. It is called as
+// advance(clock, steps) each time 'steps' fixed steps have fallen due,
+// with clock.stepCount already counting them, until stopSimThread().
+template <typename F>
+void startSimThread(SimThread& sim, F advance) {
+    sim.running.store(true, std::memory_order_relaxed);
+    sim.stepCount.store(0, std::memory_order_relaxed);
+    sim.lateBatches.store(0, std::memory_order_relaxed);
+    sim.thread = std::thread([&sim, advance]() mutable {
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point start = Clock::now();
+        auto seconds = [start]() { return std::chrono::duration<double>(Clock::now() - start).count(); };
+        SimClock clock = makeSimClock(0.0);
+
+        while (sim.running.load(std::memory_order_acquire)) {
+            int steps = advanceClock(clock, seconds());
+            if (steps > 0) {
+                advance(clock, steps);
+                sim.stepCount.store(clock.stepCount, std::memory_order_relaxed);
+                if (steps > 1)
+                    sim.lateBatches.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            // Sleep to just short of the next step, then spin onto it
+            double due = clock.lastTime + PHYSICS_DT - clock.accumulator;
+            if (due - seconds() > SIM_SPIN_MARGIN)
+                std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(
+                                                          std::chrono::duration<double>(due - SIM_SPIN_MARGIN)));
+            while (seconds() < due && sim.running.load(std::memory_order_relaxed))
+                std::this_thread::yield();
+        }
+    });
+}
+
+// Function to stop the simulation thread and wait for it
+inline void stopSimThread(SimThread& sim) {
+    sim.running.store(false, std::memory_order_release);
+    if (sim.thread.joinable())
+        sim.thread.join();
+}
@@ -0,0 +1,183 @@
+// simd.h
+//
+// Portable SIMD float vectors built on the GCC/Clang vector extensions, plus
+// branch-free approximations of the transcendentals used by the vehicle
+// step. The vector width follows the target ISA (-march=native picks AVX-512
+// or AVX2 where available, SSE otherwise); the same source compiles for all.
+//
+// The approximation functions are templates so they work on plain floats as
+// well as on vectors, which keeps the scalar reference and the SIMD kernels
+// numerically identical.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX512F__)
+const int SIMD_WIDTH = 16;
+#elif defined(__AVX__)
+const int SIMD_WIDTH = 8;
+#else
+const int SIMD_WIDTH = 4;
+#endif
+
+typedef float vfloat __attribute__((vector_size(SIMD_WIDTH * sizeof(float))));
+typedef int32_t vint __attribute__((vector_size(SIMD_WIDTH * sizeof(int32_t))));
+typedef uint32_t vuint __attribute__((vector_size(SIMD_WIDTH * sizeof(uint32_t))));
+
+// Function to broadcast a scalar to all lanes
+inline vfloat splat(float value) {
+    return value - (vfloat){};
+}
+
+// Aligned loads and stores. Arrays handed to the kernels are allocated on
+// 64-byte boundaries and padded to a multiple of SIMD_WIDTH.
+inline vfloat loadv(const float* p) {
+    return *(const vfloat*)p;
+}
+
+inline void storev(float* p, vfloat v) {
+    *(vfloat*)p = v;
+}
+
+// Lane-wise select helpers so the templated math below reads the same for
+// floats and vectors
+inline float selectf(bool mask, float a, float b) { return mask ? a : b; }
+inline vfloat selectf(vint mask, vfloat a, vfloat b) { return mask ? a : b; }
+
+inline float minf(float a, float b) { return a < b ? a : b; }
+inline float maxf(float a, float b) { return a > b ? a : b; }
+inline vfloat minf(vfloat a, vfloat b) { return a < b ? a : b; }
+inline vfloat maxf(vfloat a, vfloat b) { return a > b ? a : b; }
+
+inline float absf(float a) { return a < 0.0f ? -a : a; }
+inline vfloat absf(vfloat a) { return a < 0.0f ? -a : a; }
+
+// Round to nearest integer (ties away from zero), returned as int
+inline int32_t roundToInt(float a) { return (int32_t)(a + (a < 0.0f ? -0.5f : 0.5f)); }
+inline vint roundToInt(vfloat a) {
+    return __builtin_convertvector(a + (a < 0.0f ? splat(-0.5f) : splat(0.5f)), vint);
+}
+
+inline float toFloat(int32_t a) { return (float)a; }
+inline vfloat toFloat(vint a) { return __builtin_convertvector(a, vfloat); }
+
+// Reinterpret float bits as int and back
+inline int32_t floatBits(float a) { int32_t i; memcpy(&i, &a, sizeof(i)); return i; }
+inline float bitsFloat(int32_t i) { float a; memcpy(&a, &i, sizeof(a)); return a; }
+inline vint floatBits(vfloat a) { return (vint)a; }
+inline vfloat bitsFloat(vint i) { return (vfloat)i; }
+
+// tan(x) for |x| < pi/2, the steering range. Padé [5/4] approximant on
+// |x| <= pi/4, max relative error below 2e-7 there, i.e. at float
+// precision; beyond it tan(x) = 1 / tan(pi/2 - x), taken by swapping the
+// approximant's numerator and denominator so it costs no extra division.
+template <typename T>
+inline T fastTanWide(T x) {
+    const float PI_2 = 1.57079632679489662f;
+    T a = absf(x);
+    auto reflect = a > 0.785398163397448310f;
+    T r = selectf(reflect, PI_2 - a, a);
+    T r2 = r * r;
+    T num = r * (945.0f - r2 * (105.0f - r2));
+    T den = 945.0f - r2 * (420.0f - 15.0f * r2);
+    T t = selectf(reflect, den, num) / selectf(reflect, num, den);
+    return selectf(x < 0.0f, -t, t);
+}
+
+// atan(x) for any x. Reduction to |r| <= tan(pi/8) with
+// atan(x) = pi/2 + atan(-1/x) and pi/4 + atan((x - 1) / (x + 1)), written
+// as one division, then the Cephes atanf polynomial; max absolute error
+// about 2e-7.
+template <typename T>
+inline T fastAtanReduced(T offset, T r) {
+    T z = r * r;
+    return offset + ((((8.05374449538e-2f * z - 1.38776856032e-1f) * z + 1.99777106478e-1f) * z
+                      - 3.33329491539e-1f) * z * r + r);
+}
+
+template <typename T>
+inline T fastAtan(T x) {
+    const float PI_2 = 1.57079632679489662f;
+    const float PI_4 = 0.785398163397448310f;
+    T a = absf(x);
+    auto big = a > 2.414213562373095f;
+    auto mid = a > 0.4142135623730950f;
+    T offset = selectf(big, T{} + PI_2, selectf(mid, T{} + PI_4, T{}));
+    T num = selectf(big, T{} - 1.0f, selectf(mid, a - 1.0f, a));
+    T den = selectf(big, a, selectf(mid, a + 1.0f, T{} + 1.0f));
+    T y = fastAtanReduced(offset, num / den);
+    return selectf(x < 0.0f, -y, y);
+}
+
+// atan2(y, x) with the same polynomial and error, and 0 for (0, 0) like
+// libm. The smaller magnitude over the larger is at most 1, so only the
+// pi/4 reduction applies and it folds into the same single division.
+template <typename T>
+inline T fastAtan2(T y, T x) {
+    const float PI = 3.14159265358979324f;
+    const float PI_2 = 1.57079632679489662f;
+    const float PI_4 = 0.785398163397448310f;
+    T ax = absf(x);
+    T ay = absf(y);
+    auto steep = ay > ax;
+    T n = selectf(steep, ax, ay);
+    T d = maxf(selectf(steep, ay, ax), T{} + 1e-30f);
+    auto mid = n > 0.4142135623730950f * d;
+    T t = fastAtanReduced(selectf(mid, T{} + PI_4, T{}), selectf(mid, n - d, n) / selectf(mid, n + d, d));
+    t = selectf(steep, PI_2 - t, t);
+    t = selectf(x < 0.0f, PI - t, t);
+    return selectf(y < 0.0f, -t, t);
+}
+
+// 1/sqrt(a) for a > 0: bit-level initial guess refined with three Newton
+// steps. Relative error is at float rounding level.
+template <typename T>
+inline T fastRsqrt(T a) {
+    T y = bitsFloat(0x5f3759df - (floatBits(a) >> 1));
+    T half = 0.5f * a;
+    y = y * (1.5f - half * y * y);
+    y = y * (1.5f - half * y * y);
+    y = y * (1.5f - half * y * y);
+    return y;
+}
+
+// sin(x) and cos(x) for any |x| < ~1e5. Cody-Waite reduction to
+// [-pi/4, pi/4] followed by minimax polynomials (the Cephes sinf/cosf
+// coefficients); max absolute error about 1e-7 after reduction, growing
+// with |x| only through the float rounding of x itself.
+template <typename T, typename I>
+inline void fastSinCosImpl(T x, T* s, T* c) {
+    const float TWO_OVER_PI = 0.636619772367581343f;
+    const float PIO2_HI = 1.5703125f;
+    const float PIO2_MID = 4.837512969970703125e-4f;
+    const float PIO2_LO = 7.54978995489188216e-8f;
+
+    I q = roundToInt(x * TWO_OVER_PI);
+    T fq = toFloat(q);
+    T r = x - fq * PIO2_HI;
+    r = r - fq * PIO2_MID;
+    r = r - fq * PIO2_LO;
+
+    T r2 = r * r;
+    T sinr = r + r * r2 * (-1.6666654611e-1f + r2 * (8.3321608736e-3f + r2 * -1.9515295891e-4f));
+    T cosr = 1.0f - 0.5f * r2 + r2 * r2 * (4.166664568298827e-2f + r2 * (-1.388731625493765e-3f + r2 * 2.443315711809948e-5f));
+
+    // Quadrant fix-up: q = 0: (s, c), 1: (c, -s), 2: (-s, -c), 3: (-c, s)
+    I swap = (q & 1) != 0;
+    T sv = selectf(swap, cosr, sinr);
+    T cv = selectf(swap, sinr, cosr);
+    I sinNeg = (q & 2) != 0;
+    I cosNeg = ((q + 1) & 2) != 0;
+    *s = selectf(sinNeg, -sv, sv);
+    *c = selectf(cosNeg, -cv, cv);
+}
+
+inline void fastSinCos(float x, float* s, float* c) {
+    fastSinCosImpl<float, int32_t>(x, s, c);
+}
+
+inline void fastSinCos(vfloat x, vfloat* s, vfloat* c) {
+    fastSinCosImpl<vfloat, vint>(x, s, c);
+}
@@ -0,0 +1,193 @@
+// snapshot.h
+//
+// Checkpoint, restore and fork for single-car runs.
+//
+// RunState is everything a run carries from one step to the next: the
+// car, the four-wheel model's body and tire state, the torque-vectoring
+// controller, the motor, the track driver, the last input and outputs,
+// the running peaks, and the per-run constants derived from them. It
+// holds no pointers and no heap memory, so a checkpoint is a plain copy
+// of a few cache lines, and forking N what-if branches from it is N
+// memcpys. What the branches have in common and never write (the track,
+// a scenario file, a surface map) stays outside and is shared by reference.
+//
+// The only random numbers are the predictive controller's sampling noise,
+// hashed from the solve counter in its plan, so the generator state is
+// part of the blob too; every branch is a deterministic function of its
+// RunState and the inputs it is driven with. The controller's scratch
+// memory is per thread and holds nothing between solves.
+//
+// writeCheckpoint() saves the blob with a small header, so a warm-up can
+// be run once and resumed by later processes of the same build.
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+#include "car.h"
+#include "driver.h"
+#include "motor.h"
+#include "mpc.h"
+#include "surface.h"
+#include "vehicle4w.h"
+
+struct alignas(64) RunState {
+    // Configuration, fixed unless retuned with retuneRunState()
+    VehicleModel model;
+    bool motor;               // Drive through motor.h instead of maxAcceleration
+    bool yawTracking;         // Accumulate the yaw-rate tracking error below
+    float dt;                 // Physics step (s)
+    RuntimeBicycle bicycle;
+    Vehicle4WConstants constants;
+    MotorParams motorParams;
+    MotorStepper stepper;
+    MpcSettings mpcSettings;
+
+    // Evolving state
+    long step;                // Steps taken
+    Vehicle4W vehicle;        // vehicle.car is the car for every model
+    MotorState motorState;
+    MpcPlan mpc;              // Predictive controller plan (MODEL_4W_MPC)
+    DriverState driver;       // Track driver
+    DriverInput input;        // Input of the last step
+    StepOutput output;        // Outputs of the last step
+    float maxFzFront;         // Peak front axle load so far (N)
+    float maxFzRear;          // Peak rear axle load so far (N)
+    float maxLatAccel;        // Peak |a_lat| so far (m/s²)
+    double yawErrorSquared;   // Sum of (r_ref - r)² over the tracked steps (rad²/s²)
+    long yawTrackedSteps;     // Steps above walking pace while yawTracking
+};
+
+static_assert(std::is_trivially_copyable<RunState>::value, "RunState must stay a plain blob");
+
+const char CHECKPOINT_MAGIC[8] = { 'T', 'V', 'S', 'C', 'K', 'P', 'T', '1' };
+
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t stateSize;       // sizeof(RunState) of the build that wrote it
+    uint32_t reserved;
+};
+
+// Function to start a run of 'car' at rest; with a track the car is
+// placed on its start line first
+inline void initRunState(RunState& state, Car car, VehicleModel model, bool motor, TireModel tires, float dt,
+                         const Track* track = nullptr) {
+    memset(&state, 0, sizeof(state));
+    if (track)
+        placeOnTrack(car, *track, 0.0f);
+    state.model = model;
+    state.motor = motor;
+    state.dt = dt;
+    state.bicycle = makeRuntimeBicycle(car);
+    state.constants = makeVehicle4WConstants(car);
+    state.constants.tireModel = tires;
+    state.motorParams = makeDefaultMotor();
+    state.stepper = makeMotorStepper(state.motorParams, car.mass, dt, MOTOR_IMPLICIT);
+    state.step = 0;
+    state.mpcSettings = makeMpcSettings(car);
+    state.vehicle = makeVehicle4W(car);
+    state.motorState = { 0.0f, 0.0f };
+    state.mpc = makeMpcPlan();
+    state.driver = makeDriverState();
+}
+
+// Function to rederive the per-run constants after the car's parameters
+// were changed mid-run (a what-if branch). The controller keeps its
+// integrator and last outputs but takes the gains for the new car, and
+// the predictive controller keeps its plan and solver settings but takes
+// the new car's rollout model; the drive split, tire model and motor
+// parameters are kept.
+inline void retuneRunState(RunState& state) {
+    const Car& car = state.vehicle.car;
+    Vehicle4WConstants previous = state.constants;
+    state.bicycle = makeRuntimeBicycle(car);
+    state.constants = makeVehicle4WConstants(car);
+    state.constants.frontDriveShare = previous.frontDriveShare;
+    state.constants.tireModel = previous.tireModel;
+    state.stepper = makeMotorStepper(state.motorParams, car.mass, state.dt, MOTOR_IMPLICIT);
+    setMpcModel(state.mpcSettings, car);
+
+    TorqueVectoring& tv = state.vehicle.tv;
+    TorqueVectoring tuned = makeTorqueVectoring(car);
+    tuned.integral = tv.integral;
+    tuned.yawRateRef = tv.yawRateRef;
+    tuned.yawMoment = tv.yawMoment;
+    tv = tuned;
+}
+
+// Function to advance the run by one step under 'input'; the four-wheel
+// models take the friction and grade under their wheels from 'surface'
+inline StepOutput stepRunState(RunState& state, const DriverInput& input, const SurfaceMap* surface = nullptr) {
+    Car& car = state.vehicle.car;
+    state.input = input;
+    if (state.motor)
+        applyMotorDrive(car, state.motorState, state.stepper, input);
+    else
+        applyDriverInput(car, input, state.dt);
+
+    StepOutput step;
+    if (surface && state.model != MODEL_BICYCLE)
+        sampleWheelSurface(state.vehicle, state.constants, *surface);
+    if (state.model == MODEL_BICYCLE) {
+        step = stepBicycle(car, state.bicycle, state.dt);
+    } else if (state.model == MODEL_4W_MPC) {
+        updateMpc(state.mpcSettings, state.mpc, mpcWorkspace(), state.vehicle, state.dt);
+        step = stepVehicle4WControlled(state.vehicle, state.constants, state.dt, state.mpc.yawMoment,
+                                       state.mpc.steerCorrection);
+    } else {
+        step = stepVehicle4W(state.vehicle, state.constants, state.dt, state.model == MODEL_4W_TV);
+    }
+    state.output = step;
+    state.step++;
+    if (step.Fz_front > state.maxFzFront)
+        state.maxFzFront = step.Fz_front;
+    if (step.Fz_rear > state.maxFzRear)
+        state.maxFzRear = step.Fz_rear;
+    if (fabsf(step.a_lat) > state.maxLatAccel)
+        state.maxLatAccel = fabsf(step.a_lat);
+    if (state.yawTracking && fabsf(car.velocity) >= 1.0f) {
+        float error = yawRateReference(state.vehicle.tv, car) - car.yawRate;
+        state.yawErrorSquared += (double)(error * error);
+        state.yawTrackedSteps++;
+    }
+    return step;
+}
+
+// Function to fork 'count' branches off 'parent'
+inline void forkRunState(const RunState& parent, RunState* children, size_t count) {
+    for (size_t i = 0; i < count; i++)
+        memcpy(&children[i], &parent, sizeof(RunState));
+}
+
+// Function to save a checkpoint to 'path'
+inline bool writeCheckpoint(const char* path, const RunState& state) {
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return false;
+    CheckpointHeader header;
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    header.stateSize = sizeof(RunState);
+    header.reserved = 0;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(&state, sizeof(state), 1, file) == 1;
+    return fclose(file) == 0 && ok;
+}
+
+// Function to load a checkpoint saved by the same build. The configuration
+// it carries is checked as well, since a run resumed from it takes its
+// model, tires and step from the file.
+inline bool readCheckpoint(const char* path, RunState& state) {
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return false;
+    CheckpointHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+              memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) == 0 &&
+              header.stateSize == sizeof(RunState) && fread(&state, sizeof(state), 1, file) == 1;
+    fclose(file);
+    return ok && std::isfinite(state.dt) && state.dt > 0.0f && state.step >= 0 &&
+           (unsigned)state.model <= MODEL_4W_MPC && (unsigned)state.constants.tireModel <= TIRE_MAGIC_FORMULA;
+}
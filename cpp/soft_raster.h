@@ -0,0 +1,464 @@
+// soft_raster.h
+//
+// CPU rasterizer for the simulator scene, for frames rendered where there
+// is no display or GPU (headless --frames). It draws the meshes and
+// instances of scene_mesh.h with the follow camera, lighting, load colors
+// and HUD layout of the interactive renderer into an RGB8 image:
+//
+//   - vertices go through the mesh vertex shader's math on the CPU and
+//     are clipped against the near plane in view space;
+//   - the ground and track tiles of world_tiles.h are culled against the
+//     view frustum, and lines are clipped to the viewport before they are
+//     walked, so a kilometre of ground costs only its visible pixels;
+//   - triangles are filled with incremental edge functions over their
+//     clamped bounding box. Every mesh face has a single color and normal,
+//     so flat shading per triangle matches GL's interpolation;
+//   - depth is z/w, tested GL_LESS against a float buffer;
+//   - HUD text is stb_easy_font's axis-aligned quads, filled as rectangles.
+//
+// A SoftTarget belongs to one thread; any number of them can render
+// frames from the same (read-only) SoftScene in parallel.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "car.h"
+#include "scene_mesh.h"
+#include "stb_easy_font.h"
+#include "world_tiles.h"
+
+// Camera and projection of main.cpp's follow view
+const float SOFT_FOV = 60.0f;             // Vertical field of view (degrees)
+const float SOFT_NEAR = 0.1f;             // Near and far planes (m)
+const float SOFT_FAR = 1000.0f;
+const float SOFT_CLEAR = 0.2f;            // Background gray, as glClearColor
+const int SOFT_HUD_LINE_HEIGHT = 12;      // pixels, as HUD_LINE_HEIGHT in hud.h
+const int SOFT_TEXT_QUADS = 512;          // stb_easy_font quads per HUD line
+
+// Image being drawn. Color rows run top to bottom.
+struct SoftTarget {
+    int width, height;
+    uint8_t* color;           // width * height RGB8 pixels, not owned
+    std::vector<float> depth; // width * height, z/w mapped to [0, 1]
+};
+
+// The static meshes, built once and shared by every SoftTarget. Offline
+// frames have no frame budget to keep, so every track tile is built up
+// front instead of streamed.
+struct SoftScene {
+    std::vector<MeshVertex> cube, arrow;
+    std::vector<MeshVertex> ground[TILE_LODS];
+    std::unordered_map<uint64_t, TrackTileMesh> track;
+};
+
+// Follow camera in the form the rasterizer consumes: view-space axes and
+// the two nonzero perspective terms besides the focal lengths
+struct SoftCamera {
+    float eye[3];
+    float right[3], up[3], back[3];
+    float focalX, focalY;     // Projection scale of x and y
+    float depthA, depthB;     // clip z = depthA * view z + depthB
+};
+
+// A vertex in clip space
+struct SoftVertex {
+    float x, y, z, w;
+};
+
+// Everything one offscreen frame shows: your car and the HUD readouts
+struct SoftFrame {
+    long index;               // Frame number, used in the file name
+    double time;              // Simulated time (s)
+    Car car;
+    StepOutput step;
+    float wheelLoads[CORNER_COUNT];
+    bool onTrack;             // Show the lap readouts
+    int laps;
+    float lastLap, bestLap;   // Lap times (s), 0 before the first lap
+};
+
+// Function to build the scene meshes; pass empty vectors when there is no track
+inline void initSoftScene(SoftScene& scene, const std::vector<float>& trackX, const std::vector<float>& trackZ) {
+    scene.cube = buildCubeMesh();
+    scene.arrow = buildArrowMesh();
+    for (int lod = 0; lod < TILE_LODS; lod++)
+        scene.ground[lod] = buildGroundTileMesh(TILE_LOD_SPACING[lod]);
+    scene.track.clear();
+    TrackTileIndex index;
+    buildTrackTileIndex(trackX, trackZ, index);
+    for (const auto& tile : index) {
+        TrackTileMesh& mesh = scene.track[tile.first];
+        mesh.key = tile.first;
+        buildTrackTileMesh(trackX, trackZ, tile.second, mesh);
+    }
+}
+
+// Function to size a target for 'color'
+inline void initSoftTarget(SoftTarget& target, int width, int height, uint8_t* color) {
+    target.width = width;
+    target.height = height;
+    target.color = color;
+    target.depth.resize((size_t)width * height);
+}
+
+// Function to set up the follow camera of main.cpp: 8 m behind and 5 m
+// above the car, looking at it
+inline SoftCamera makeSoftCamera(float x, float y, float z, float heading, float aspect) {
+    SoftCamera cam;
+    float c = cosf(heading), s = sinf(heading);
+    cam.eye[0] = x - 8.0f * c;
+    cam.eye[1] = 5.0f;
+    cam.eye[2] = z - 8.0f * s;
+
+    // Forward, then right = forward x up and up = right x forward
+    float f[3] = { x - cam.eye[0], y - cam.eye[1], z - cam.eye[2] };
+    float n = 1.0f / sqrtf(f[0] * f[0] + f[1] * f[1] + f[2] * f[2]);
+    f[0] *= n; f[1] *= n; f[2] *= n;
+    float r[3] = { -f[2], 0.0f, f[0] };
+    n = 1.0f / sqrtf(r[0] * r[0] + r[2] * r[2]);
+    r[0] *= n; r[2] *= n;
+    cam.right[0] = r[0]; cam.right[1] = r[1]; cam.right[2] = r[2];
+    cam.up[0] = r[1] * f[2] - r[2] * f[1];
+    cam.up[1] = r[2] * f[0] - r[0] * f[2];
+    cam.up[2] = r[0] * f[1] - r[1] * f[0];
+    cam.back[0] = -f[0]; cam.back[1] = -f[1]; cam.back[2] = -f[2];
+
+    float tanHalf = tanf(0.5f * SOFT_FOV * DEG2RAD);
+    cam.focalY = 1.0f / tanHalf;
+    cam.focalX = cam.focalY / aspect;
+    cam.depthA = -(SOFT_FAR + SOFT_NEAR) / (SOFT_FAR - SOFT_NEAR);
+    cam.depthB = -2.0f * SOFT_FAR * SOFT_NEAR / (SOFT_FAR - SOFT_NEAR);
+    return cam;
+}
+
+// Function to take a world-space point to clip space
+inline SoftVertex softProject(const SoftCamera& cam, float x, float y, float z) {
+    float d[3] = { x - cam.eye[0], y - cam.eye[1], z - cam.eye[2] };
+    float vx = cam.right[0] * d[0] + cam.right[1] * d[1] + cam.right[2] * d[2];
+    float vy = cam.up[0] * d[0] + cam.up[1] * d[1] + cam.up[2] * d[2];
+    float vz = cam.back[0] * d[0] + cam.back[1] * d[1] + cam.back[2] * d[2];
+    SoftVertex v = { cam.focalX * vx, cam.focalY * vy, cam.depthA * vz + cam.depthB, -vz };
+    return v;
+}
+
+// Function to get the view frustum of a camera, from the rows of its
+// world-to-clip transform (softProject() as a matrix)
+inline Frustum softFrustum(const SoftCamera& cam) {
+    const float* axes[3] = { cam.right, cam.up, cam.back };
+    float view[3][4];
+    for (int a = 0; a < 3; a++) {
+        view[a][0] = axes[a][0];
+        view[a][1] = axes[a][1];
+        view[a][2] = axes[a][2];
+        view[a][3] = -(axes[a][0] * cam.eye[0] + axes[a][1] * cam.eye[1] + axes[a][2] * cam.eye[2]);
+    }
+    float rows[4][4];
+    for (int k = 0; k < 4; k++) {
+        rows[0][k] = cam.focalX * view[0][k];
+        rows[1][k] = cam.focalY * view[1][k];
+        rows[2][k] = cam.depthA * view[2][k] + (k == 3 ? cam.depthB : 0.0f);
+        rows[3][k] = -view[2][k];
+    }
+    return makeFrustum(rows);
+}
+
+// Function to clear to the background color and the far plane
+inline void clearSoftTarget(SoftTarget& target) {
+    memset(target.color, (int)(SOFT_CLEAR * 255.0f + 0.5f), (size_t)target.width * target.height * 3);
+    std::fill(target.depth.begin(), target.depth.end(), 1.0f);
+}
+
+// Function to convert a linear color to RGB8
+inline void softColor(float r, float g, float b, uint8_t rgb[3]) {
+    rgb[0] = (uint8_t)(std::min(std::max(r, 0.0f), 1.0f) * 255.0f + 0.5f);
+    rgb[1] = (uint8_t)(std::min(std::max(g, 0.0f), 1.0f) * 255.0f + 0.5f);
+    rgb[2] = (uint8_t)(std::min(std::max(b, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+// Function to map a clip-space vertex to pixels (x, y from the top-left) and depth
+inline void softViewport(const SoftTarget& target, const SoftVertex& v, float out[3]) {
+    float invW = 1.0f / v.w;
+    out[0] = (0.5f + 0.5f * v.x * invW) * (float)target.width;
+    out[1] = (0.5f - 0.5f * v.y * invW) * (float)target.height;
+    out[2] = 0.5f + 0.5f * v.z * invW;
+}
+
+// Function to interpolate between two clip-space vertices
+inline SoftVertex softLerp(const SoftVertex& a, const SoftVertex& b, float t) {
+    SoftVertex v = { a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t };
+    return v;
+}
+
+// Function to fill a screen-space triangle, depth tested
+inline void fillSoftTriangle(SoftTarget& target, const float a[3], const float b[3], const float c[3],
+                             const uint8_t rgb[3]) {
+    float area = (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+    if (fabsf(area) < 1e-8f)
+        return;
+    int x0 = std::max(0, (int)floorf(std::min(a[0], std::min(b[0], c[0]))));
+    int x1 = std::min(target.width - 1, (int)ceilf(std::max(a[0], std::max(b[0], c[0]))));
+    int y0 = std::max(0, (int)floorf(std::min(a[1], std::min(b[1], c[1]))));
+    int y1 = std::min(target.height - 1, (int)ceilf(std::max(a[1], std::max(b[1], c[1]))));
+    if (x0 > x1 || y0 > y1)
+        return;
+
+    // Edge functions, oriented so inside is positive whatever the winding
+    float sign = area > 0.0f ? 1.0f : -1.0f;
+    float invArea = 1.0f / fabsf(area);
+    const float* v[3] = { a, b, c };
+    float stepX[3], stepY[3], row[3];
+    float px = (float)x0 + 0.5f, py = (float)y0 + 0.5f;
+    for (int e = 0; e < 3; e++) {
+        const float* p = v[(e + 1) % 3];
+        const float* q = v[(e + 2) % 3];
+        stepX[e] = sign * (p[1] - q[1]);
+        stepY[e] = sign * (q[0] - p[0]);
+        row[e] = sign * ((q[0] - p[0]) * (py - p[1]) - (q[1] - p[1]) * (px - p[0]));
+    }
+
+    for (int y = y0; y <= y1; y++) {
+        float w0 = row[0], w1 = row[1], w2 = row[2];
+        size_t pixel = (size_t)y * target.width + x0;
+        for (int x = x0; x <= x1; x++, pixel++) {
+            if (w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f) {
+                float z = (w0 * a[2] + w1 * b[2] + w2 * c[2]) * invArea;
+                if (z < target.depth[pixel]) {
+                    target.depth[pixel] = z;
+                    memcpy(target.color + pixel * 3, rgb, 3);
+                }
+            }
+            w0 += stepX[0];
+            w1 += stepX[1];
+            w2 += stepX[2];
+        }
+        row[0] += stepY[0];
+        row[1] += stepY[1];
+        row[2] += stepY[2];
+    }
+}
+
+// Function to clip a triangle against the near plane and fill what is left
+inline void drawSoftTriangle(SoftTarget& target, const SoftVertex in[3], const uint8_t rgb[3]) {
+    SoftVertex poly[4];
+    int count = 0;
+    for (int i = 0; i < 3; i++) {
+        const SoftVertex& p = in[i];
+        const SoftVertex& q = in[(i + 1) % 3];
+        bool pIn = p.w >= SOFT_NEAR, qIn = q.w >= SOFT_NEAR;
+        if (pIn)
+            poly[count++] = p;
+        if (pIn != qIn)
+            poly[count++] = softLerp(p, q, (SOFT_NEAR - p.w) / (q.w - p.w));
+    }
+    if (count < 3)
+        return;
+    float s[4][3];
+    for (int i = 0; i < count; i++)
+        softViewport(target, poly[i], s[i]);
+    fillSoftTriangle(target, s[0], s[1], s[2], rgb);
+    if (count == 4)
+        fillSoftTriangle(target, s[0], s[2], s[3], rgb);
+}
+
+// Function to draw a 1-pixel line, clipped to the near plane and the
+// viewport, depth tested and, if 'writeDepth', depth written
+inline void drawSoftLine(SoftTarget& target, SoftVertex p, SoftVertex q, const uint8_t rgb[3], bool writeDepth = true) {
+    if (p.w < SOFT_NEAR && q.w < SOFT_NEAR)
+        return;
+    if (p.w < SOFT_NEAR)
+        p = softLerp(p, q, (SOFT_NEAR - p.w) / (q.w - p.w));
+    else if (q.w < SOFT_NEAR)
+        q = softLerp(q, p, (SOFT_NEAR - q.w) / (p.w - q.w));
+    float a[3], b[3];
+    softViewport(target, p, a);
+    softViewport(target, q, b);
+
+    // Liang-Barsky against the pixel-center rectangle
+    float d[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    float t0 = 0.0f, t1 = 1.0f;
+    const float lo[2] = { 0.5f, 0.5f };
+    const float hi[2] = { (float)target.width - 0.5f, (float)target.height - 0.5f };
+    for (int axis = 0; axis < 2; axis++) {
+        float edges[2][2] = { { -d[axis], a[axis] - lo[axis] }, { d[axis], hi[axis] - a[axis] } };
+        for (auto& e : edges) {
+            if (e[0] == 0.0f) {
+                if (e[1] < 0.0f)
+                    return;
+            } else {
+                float t = e[1] / e[0];
+                if (e[0] < 0.0f)
+                    t0 = std::max(t0, t);
+                else
+                    t1 = std::min(t1, t);
+            }
+        }
+    }
+    if (t0 > t1)
+        return;
+
+    float x = a[0] + d[0] * t0, y = a[1] + d[1] * t0, z = a[2] + d[2] * t0;
+    float span = t1 - t0;
+    int steps = (int)ceilf(std::max(fabsf(d[0]), fabsf(d[1])) * span);
+    float inv = steps > 0 ? span / (float)steps : 0.0f;
+    float dx = d[0] * inv, dy = d[1] * inv, dz = d[2] * inv;
+    for (int i = 0; i <= steps; i++, x += dx, y += dy, z += dz) {
+        int px = std::min(std::max((int)x, 0), target.width - 1);
+        int py = std::min(std::max((int)y, 0), target.height - 1);
+        size_t pixel = (size_t)py * target.width + px;
+        if (z < target.depth[pixel]) {
+            if (writeDepth)
+                target.depth[pixel] = z;
+            memcpy(target.color + pixel * 3, rgb, 3);
+        }
+    }
+}
+
+// Function to draw instances of a mesh, as the mesh shaders in renderer.h
+// would: 'lit' applies the diffuse light, 'loadColor' colors arrows by
+// their load ratio (instance shade); lines leave the depth buffer alone
+// unless 'writeDepth'
+inline void drawSoftMesh(SoftTarget& target, const SoftCamera& cam, const MeshVertex* mesh, size_t vertexCount,
+                         bool lines, const MeshInstance* instances, size_t count, bool lit, bool loadColor,
+                         bool writeDepth = true) {
+    const float lightLength = 1.0f / sqrtf(3.0f);   // normalize(5, 5, 5)
+    int perPrimitive = lines ? 2 : 3;
+    for (size_t i = 0; i < count; i++) {
+        const MeshInstance& in = instances[i];
+        float c = cosf(in.heading), s = sinf(in.heading);
+        float load = in.shade;
+        float loadRgb[3];
+        if (load < 1.0f) {
+            float u = std::max(load, 0.0f);
+            loadRgb[0] = 0.0f; loadRgb[1] = 0.2f + 0.8f * u; loadRgb[2] = 1.0f;
+        } else {
+            float u = std::min(load - 1.0f, 1.0f);
+            loadRgb[0] = u; loadRgb[1] = 1.0f - 0.9f * u; loadRgb[2] = 1.0f - u;
+        }
+
+        for (size_t v = 0; v + perPrimitive <= vertexCount; v += perPrimitive) {
+            SoftVertex clip[3];
+            for (int k = 0; k < perPrimitive; k++) {
+                const MeshVertex& m = mesh[v + k];
+                float px = m.x * in.sx;
+                float py = std::min(m.y, 1.0f) * in.sy + std::max(m.y - 1.0f, 0.0f);
+                float pz = m.z * in.sz;
+                clip[k] = softProject(cam, c * px - s * pz + in.x, py + in.y, s * px + c * pz + in.z);
+            }
+
+            // Flat color from the first vertex
+            const MeshVertex& m = mesh[v];
+            float rgb[3] = { m.r * in.shade, m.g * in.shade, m.b * in.shade };
+            if (loadColor) {
+                rgb[0] = loadRgb[0]; rgb[1] = loadRgb[1]; rgb[2] = loadRgb[2];
+            }
+            if (lit) {
+                float nx = c * m.nx - s * m.nz, ny = m.ny, nz = s * m.nx + c * m.nz;
+                float n = sqrtf(nx * nx + ny * ny + nz * nz);
+                float diffuse = n > 0.0f ? std::max((nx + ny + nz) * lightLength / n, 0.0f) : 0.0f;
+                float lighting = 0.2f + 0.8f * diffuse;
+                rgb[0] *= lighting; rgb[1] *= lighting; rgb[2] *= lighting;
+            }
+            uint8_t color[3];
+            softColor(rgb[0], rgb[1], rgb[2], color);
+            if (lines)
+                drawSoftLine(target, clip[0], clip[1], color, writeDepth);
+            else
+                drawSoftTriangle(target, clip, color);
+        }
+    }
+}
+
+// Function to draw instances of a whole mesh
+inline void drawSoftMesh(SoftTarget& target, const SoftCamera& cam, const std::vector<MeshVertex>& mesh,
+                         bool lines, const MeshInstance* instances, size_t count, bool lit, bool loadColor) {
+    drawSoftMesh(target, cam, mesh.data(), mesh.size(), lines, instances, count, lit, loadColor);
+}
+
+// Function to draw the ground and track tiles the camera can see. The
+// ground goes first and leaves no depth: far away one pixel row spans
+// metres of ground, and a grid line there would hide the track or a car.
+inline void drawSoftWorld(SoftTarget& target, const SoftCamera& cam, const SoftScene& scene) {
+    static thread_local VisibleTiles visible;
+    collectVisibleTiles(softFrustum(cam), cam.eye[0], cam.eye[2], visible);
+    for (int lod = 0; lod < TILE_LODS; lod++) {
+        drawSoftMesh(target, cam, scene.ground[lod].data(), scene.ground[lod].size(), true, visible.instances[lod],
+                     visible.count[lod], false, false, false);
+    }
+    if (scene.track.empty())
+        return;
+    MeshInstance identity = { 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+    for (int lod = 0; lod < TILE_LODS; lod++) {
+        for (int i = 0; i < visible.count[lod]; i++) {
+            const MeshInstance& tile = visible.instances[lod][i];
+            int32_t ix = tileIndex(tile.x + 0.5f * TILE_SIZE), iz = tileIndex(tile.z + 0.5f * TILE_SIZE);
+            auto it = scene.track.find(tileKey(ix, iz));
+            if (it == scene.track.end())
+                continue;
+            const TrackTileMesh& mesh = it->second;
+            if (tileDistanceSquared(cam.eye[0], cam.eye[2], ix, iz) > TRACK_COARSE_DISTANCE * TRACK_COARSE_DISTANCE)
+                drawSoftMesh(target, cam, mesh.vertices.data() + mesh.fineCount, mesh.vertices.size() - mesh.fineCount,
+                             true, &identity, 1, false, false);
+            else
+                drawSoftMesh(target, cam, mesh.vertices.data(), mesh.fineCount, true, &identity, 1, false, false);
+        }
+    }
+}
+
+// Function to draw text in pixel coordinates from the top-left
+inline void drawSoftText(SoftTarget& target, float x, float y, const char* text, const uint8_t rgb[3]) {
+    static thread_local char quads[SOFT_TEXT_QUADS * 4 * 16];
+    int count = stb_easy_font_print(x, y, (char*)text, NULL, quads, sizeof(quads));
+    for (int q = 0; q < count; q++) {
+        const float* v0 = (const float*)(quads + q * 64);
+        const float* v2 = (const float*)(quads + q * 64 + 32);
+        // Pixels whose centers the quad covers
+        int xa = std::max(0, (int)ceilf(std::min(v0[0], v2[0]) - 0.5f));
+        int xb = std::min(target.width, (int)ceilf(std::max(v0[0], v2[0]) - 0.5f));
+        int ya = std::max(0, (int)ceilf(std::min(v0[1], v2[1]) - 0.5f));
+        int yb = std::min(target.height, (int)ceilf(std::max(v0[1], v2[1]) - 0.5f));
+        for (int py = ya; py < yb; py++)
+            for (int px = xa; px < xb; px++)
+                memcpy(target.color + ((size_t)py * target.width + px) * 3, rgb, 3);
+    }
+}
+
+// Function to render a whole frame: ground, track, car with its load
+// arrows and the HUD
+inline void renderSoftFrame(SoftTarget& target, const SoftScene& scene, const SoftFrame& frame) {
+    const Car& car = frame.car;
+    clearSoftTarget(target);
+    SoftCamera cam = makeSoftCamera(car.x, car.y, car.z, car.heading, (float)target.width / (float)target.height);
+
+    drawSoftWorld(target, cam, scene);
+
+    MeshInstance body, arrows[CORNER_COUNT];
+    writeCarInstances(&body, arrows, car.x, car.y, car.z, car.heading, car.length, car.width, car.lf, car.lr,
+                      car.trackWidth, frame.wheelLoads);
+    drawSoftMesh(target, cam, scene.cube, false, &body, 1, true, false);
+    drawSoftMesh(target, cam, scene.arrow, false, arrows, CORNER_COUNT, false, true);
+
+    // HUD, laid out as main.cpp's
+    char lines[10][64];
+    int n = 0;
+    snprintf(lines[n++], 64, "Speed: %.2f m/s", car.velocity);
+    snprintf(lines[n++], 64, "Acceleration: %.2f m/s^2", car.acceleration);
+    snprintf(lines[n++], 64, "Steering Angle: %.2f degrees", car.steerAngle * RAD2DEG);
+    snprintf(lines[n++], 64, "Heading: %.2f degrees", car.heading * RAD2DEG);
+    snprintf(lines[n++], 64, "Front Normal Load: %.2f N", frame.step.Fz_front);
+    snprintf(lines[n++], 64, "Rear Normal Load: %.2f N", frame.step.Fz_rear);
+    if (frame.onTrack) {
+        snprintf(lines[n++], 64, "Laps: %d", frame.laps);
+        snprintf(lines[n++], 64, "Last Lap: %.3f s", frame.lastLap);
+        snprintf(lines[n++], 64, "Best Lap: %.3f s", frame.bestLap);
+    }
+    snprintf(lines[n++], 64, "Time: %.3f s", frame.time);
+    const uint8_t white[3] = { 255, 255, 255 };
+    for (int i = 0; i < n; i++)
+        drawSoftText(target, 10.0f, 20.0f + (float)(i * SOFT_HUD_LINE_HEIGHT), lines[i], white);
+}
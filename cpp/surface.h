@@ -0,0 +1,313 @@
+// surface.h
+//
+// Road surface map: the friction coefficient and grade under every wheel,
+// for split-mu, wet patches, ice and hills instead of the same grip
+// everywhere.
+//
+// The map is a grid of square cells over a rectangle of the world, cut
+// into tiles of SURFACE_TILE_CELLS x SURFACE_TILE_CELLS cells. A tile
+// whose every cell is the map's fill surface is not stored at all, so a
+// kilometre of dry tarmac with a few wet patches costs a few tiles. Files
+// are mapped, not read: a run touches only the pages of the tiles its
+// cars drive over, however large the map.
+//
+// File layout (little-endian):
+//
+//   SurfaceHeader, padded to SURFACE_HEADER_SIZE bytes
+//   uint32 tile[tilesZ][tilesX]: 0 for a fill tile, else 1 + the stored
+//          tile's index, padded to SURFACE_HEADER_SIZE bytes
+//   stored tile 0: SurfaceCell[SURFACE_TILE_CELLS²] in Morton order
+//   stored tile 1: ...
+//
+// Within a tile cells are in Morton (Z-curve) order, bits of the cell's x
+// and z index interleaved, so nearby cells stay close in memory whichever
+// way the car is heading. A 64-byte line holds a 4x4 block of cells, 2 m
+// square, and the next level of the curve an 8x8 block in four lines; a
+// car's contact points usually share a block and otherwise fall in
+// neighbouring ones, rather than in four rows of a tile.
+//
+// A lookup is a range check, a directory load and a cell load: O(1) and
+// branch-light, so sampling four wheels costs a fraction of a step even
+// for thousands of cars. Cells are quantized to 4 bytes: mu in
+// steps of 0.01 up to 2.55, grade (rise per metre along world x and z) in
+// steps of 0.002 up to ±0.254. writeSurfaceMap() generates test maps.
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "car.h"
+#include "vehicle4w.h"
+
+const char SURFACE_MAGIC[8] = { 'T', 'V', 'S', 'S', 'U', 'R', 'F', '1' };
+const uint32_t SURFACE_VERSION = 1;
+const size_t SURFACE_HEADER_SIZE = 4096;
+const int SURFACE_TILE_SHIFT = 6;
+const uint32_t SURFACE_TILE_CELLS = 1u << SURFACE_TILE_SHIFT;  // Cells per tile side
+const uint32_t SURFACE_TILE_MASK = SURFACE_TILE_CELLS - 1;
+const float SURFACE_MU_SCALE = 0.01f;                            // mu per unit of SurfaceCell::mu
+const float SURFACE_GRADE_SCALE = 0.002f;                        // Grade per unit of SurfaceCell::grade*
+const double SURFACE_CELL_SIZE = 0.5;                            // Cell edge of generated maps (m)
+
+// One cell of road
+struct SurfaceCell {
+    uint8_t mu;               // Friction coefficient / SURFACE_MU_SCALE
+    int8_t gradeX;            // Rise per metre along world x / SURFACE_GRADE_SCALE
+    int8_t gradeZ;            // Rise per metre along world z / SURFACE_GRADE_SCALE
+    uint8_t reserved;
+};
+
+const size_t SURFACE_TILE_BYTES = SURFACE_TILE_CELLS * SURFACE_TILE_CELLS * sizeof(SurfaceCell);
+
+struct SurfaceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t tileCells;       // SURFACE_TILE_CELLS of the build that wrote it
+    uint32_t tilesX, tilesZ;  // Tiles across the map
+    uint32_t tileCount;       // Tiles stored
+    uint32_t reserved;
+    double originX, originZ;  // World position of the map's low corner (m)
+    double cellSize;          // Cell edge (m)
+    SurfaceCell fill;         // Surface of the tiles not stored
+    SurfaceCell outside;      // Surface beyond the map
+};
+
+static_assert(sizeof(SurfaceHeader) <= SURFACE_HEADER_SIZE, "surface header does not fit its page");
+
+// Read-only view of a surface map
+struct SurfaceMap {
+    const uint8_t* data;           // Whole file, mapped
+    size_t size;
+    const uint32_t* directory;     // Stored tile of every tile, see above
+    const SurfaceCell* tiles;
+    float originX, originZ;
+    float invCellSize;             // Cells per metre
+    float widthCells, depthCells;  // Map extent in cells
+    uint32_t tilesX, tilesZ;
+    SurfaceCell fill, outside;
+};
+
+// Function to spread the low 8 bits of v to the even bits
+inline uint32_t spreadBits(uint32_t v) {
+    v = (v | (v << 4)) & 0x0F0Fu;
+    v = (v | (v << 2)) & 0x3333u;
+    v = (v | (v << 1)) & 0x5555u;
+    return v;
+}
+
+// Function to get the Morton index of cell (cx, cz) within its tile
+inline uint32_t mortonIndex(uint32_t cx, uint32_t cz) {
+    return spreadBits(cx & SURFACE_TILE_MASK) | (spreadBits(cz & SURFACE_TILE_MASK) << 1);
+}
+
+// Function to pack a surface into a cell, rounding to the nearest step
+inline SurfaceCell makeSurfaceCell(float mu, float gradeX, float gradeZ) {
+    SurfaceCell cell;
+    cell.mu = (uint8_t)fminf(fmaxf(roundf(mu / SURFACE_MU_SCALE), 0.0f), 255.0f);
+    cell.gradeX = (int8_t)fminf(fmaxf(roundf(gradeX / SURFACE_GRADE_SCALE), -127.0f), 127.0f);
+    cell.gradeZ = (int8_t)fminf(fmaxf(roundf(gradeZ / SURFACE_GRADE_SCALE), -127.0f), 127.0f);
+    cell.reserved = 0;
+    return cell;
+}
+
+inline bool sameSurface(SurfaceCell a, SurfaceCell b) {
+    return a.mu == b.mu && a.gradeX == b.gradeX && a.gradeZ == b.gradeZ;
+}
+
+// Function to map a surface file; returns false if it is missing or malformed
+inline bool openSurfaceMap(SurfaceMap& map, const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < SURFACE_HEADER_SIZE) {
+        close(fd);
+        return false;
+    }
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    const SurfaceHeader* header = (const SurfaceHeader*)data;
+    size_t directoryCells = (size_t)header->tilesX * header->tilesZ;
+    size_t directoryBytes = (directoryCells * 4 + SURFACE_HEADER_SIZE - 1) / SURFACE_HEADER_SIZE * SURFACE_HEADER_SIZE;
+    bool ok = memcmp(header->magic, SURFACE_MAGIC, sizeof(SURFACE_MAGIC)) == 0 &&
+              header->version == SURFACE_VERSION && header->tileCells == SURFACE_TILE_CELLS &&
+              header->cellSize > 0.0 && header->tilesX > 0 && header->tilesZ > 0 &&
+              header->tilesX <= (1u << 16) && header->tilesZ <= (1u << 16) &&
+              (size_t)st.st_size >= SURFACE_HEADER_SIZE + directoryBytes + header->tileCount * SURFACE_TILE_BYTES;
+    const uint32_t* directory = (const uint32_t*)((const uint8_t*)data + SURFACE_HEADER_SIZE);
+    for (size_t t = 0; ok && t < directoryCells; t++)
+        ok = directory[t] <= header->tileCount;
+    if (!ok) {
+        munmap(data, (size_t)st.st_size);
+        return false;
+    }
+
+    map.data = (const uint8_t*)data;
+    map.size = (size_t)st.st_size;
+    map.directory = directory;
+    map.tiles = (const SurfaceCell*)(map.data + SURFACE_HEADER_SIZE + directoryBytes);
+    map.originX = (float)header->originX;
+    map.originZ = (float)header->originZ;
+    map.invCellSize = (float)(1.0 / header->cellSize);
+    map.tilesX = header->tilesX;
+    map.tilesZ = header->tilesZ;
+    map.widthCells = (float)(header->tilesX * SURFACE_TILE_CELLS);
+    map.depthCells = (float)(header->tilesZ * SURFACE_TILE_CELLS);
+    map.fill = header->fill;
+    map.outside = header->outside;
+    return true;
+}
+
+// Function to unmap a surface map
+inline void closeSurfaceMap(SurfaceMap& map) {
+    munmap((void*)map.data, map.size);
+}
+
+// Function to look up the cell under world point (x, z)
+inline SurfaceCell surfaceCell(const SurfaceMap& map, float x, float z) {
+    float fx = (x - map.originX) * map.invCellSize;
+    float fz = (z - map.originZ) * map.invCellSize;
+    if (!(fx >= 0.0f && fx < map.widthCells && fz >= 0.0f && fz < map.depthCells))
+        return map.outside;
+    uint32_t cx = (uint32_t)fx, cz = (uint32_t)fz;
+    uint32_t tile = map.directory[(cz >> SURFACE_TILE_SHIFT) * map.tilesX + (cx >> SURFACE_TILE_SHIFT)];
+    if (tile == 0)
+        return map.fill;
+    return map.tiles[(size_t)(tile - 1) * SURFACE_TILE_CELLS * SURFACE_TILE_CELLS + mortonIndex(cx, cz)];
+}
+
+// Function to look up 'count' points at once, for structure-of-arrays
+// fleets (BM_SurfaceLookup soa:1 measures it)
+inline void surfaceCells(const SurfaceMap& map, const float* x, const float* z, size_t count, SurfaceCell* out) {
+    for (size_t i = 0; i < count; i++)
+        out[i] = surfaceCell(map, x[i], z[i]);
+}
+
+// Function to set the friction and grade under each wheel of 'v' from the
+// map, with the grade turned into the body frame. The torque-vectoring
+// reference is capped by the mean friction of the four wheels.
+inline void sampleWheelSurface(Vehicle4W& v, const Vehicle4WConstants& k, const SurfaceMap& map) {
+    const Car& car = v.car;
+    float sinHeading, cosHeading;
+    DefaultMath::sincos(car.heading, &sinHeading, &cosHeading);
+    float meanMu = 0.0f;
+    for (int c = 0; c < CORNER_COUNT; c++) {
+        float x = car.x + cosHeading * k.cornerX[c] - sinHeading * k.cornerY[c];
+        float z = car.z + sinHeading * k.cornerX[c] + cosHeading * k.cornerY[c];
+        SurfaceCell cell = surfaceCell(map, x, z);
+        float gradeX = cell.gradeX * SURFACE_GRADE_SCALE;
+        float gradeZ = cell.gradeZ * SURFACE_GRADE_SCALE;
+        v.mu[c] = cell.mu * SURFACE_MU_SCALE;
+        v.gradeX[c] = cosHeading * gradeX + sinHeading * gradeZ;
+        v.gradeY[c] = cosHeading * gradeZ - sinHeading * gradeX;
+        meanMu += v.mu[c];
+    }
+    v.tv.mu = 0.25f * meanMu;
+}
+
+// Generated test surfaces
+enum SurfaceKind {
+    SURFACE_SPLIT_MU,         // mu 0.3 left of the x axis (z > 0), 1.0 right of it
+    SURFACE_WET,              // 6 m wet patches (mu 0.5) every 40 m on dry tarmac, from x = 20 m on the x axis
+    SURFACE_ICE,              // Ice (mu 0.1) across the road from x = 60 to 90 m
+    SURFACE_HILLS,            // Dry rolling hills along x, 200 m long, up to 8% grade
+};
+
+// Function to map a surface name to its enum value
+inline bool parseSurfaceKind(const char* name, SurfaceKind* kind) {
+    if (strcmp(name, "split-mu") == 0) {
+        *kind = SURFACE_SPLIT_MU;
+    } else if (strcmp(name, "wet") == 0) {
+        *kind = SURFACE_WET;
+    } else if (strcmp(name, "ice") == 0) {
+        *kind = SURFACE_ICE;
+    } else if (strcmp(name, "hills") == 0) {
+        *kind = SURFACE_HILLS;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Function to get the generated surface at world point (x, z)
+inline SurfaceCell generatedSurface(SurfaceKind kind, double x, double z) {
+    switch (kind) {
+    case SURFACE_SPLIT_MU:
+        return makeSurfaceCell(z > 0.0 ? 0.3f : 1.0f, 0.0f, 0.0f);
+    case SURFACE_WET: {
+        double dx = x - 20.0 - 40.0 * floor((x - 20.0) / 40.0 + 0.5), dz = z - 40.0 * floor(z / 40.0 + 0.5);
+        return makeSurfaceCell(dx * dx + dz * dz < 36.0 ? 0.5f : 1.0f, 0.0f, 0.0f);
+    }
+    case SURFACE_ICE:
+        return makeSurfaceCell(x >= 60.0 && x < 90.0 ? 0.1f : 1.0f, 0.0f, 0.0f);
+    case SURFACE_HILLS:
+        return makeSurfaceCell(1.0f, (float)(0.08 * sin(2.0 * PI * x / 200.0)), 0.0f);
+    }
+    return makeSurfaceCell(1.0f, 0.0f, 0.0f);
+}
+
+// Function to write a generated map 'size' metres square centered on the
+// origin, dry tarmac beyond it; returns false on error
+inline bool writeSurfaceMap(const char* path, SurfaceKind kind, double size) {
+    const double tileSize = SURFACE_TILE_CELLS * SURFACE_CELL_SIZE;
+    uint32_t tiles = (uint32_t)ceil(size / tileSize);
+    if (tiles == 0 || tiles > (1u << 16))
+        return false;
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return false;
+
+    SurfaceHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SURFACE_MAGIC, sizeof(SURFACE_MAGIC));
+    header.version = SURFACE_VERSION;
+    header.tileCells = SURFACE_TILE_CELLS;
+    header.tilesX = header.tilesZ = tiles;
+    header.originX = header.originZ = -0.5 * tiles * tileSize;
+    header.cellSize = SURFACE_CELL_SIZE;
+    header.fill = makeSurfaceCell(1.0f, 0.0f, 0.0f);
+    header.outside = header.fill;
+
+    // Tiles are generated and written one at a time, then the header and
+    // directory go in front
+    size_t directoryBytes =
+        ((size_t)tiles * tiles * 4 + SURFACE_HEADER_SIZE - 1) / SURFACE_HEADER_SIZE * SURFACE_HEADER_SIZE;
+    std::vector<uint32_t> directory(directoryBytes / 4, 0);
+    std::vector<SurfaceCell> tile(SURFACE_TILE_CELLS * SURFACE_TILE_CELLS);
+    bool ok = fseek(file, (long)(SURFACE_HEADER_SIZE + directoryBytes), SEEK_SET) == 0;
+    for (uint32_t tz = 0; ok && tz < tiles; tz++) {
+        for (uint32_t tx = 0; ok && tx < tiles; tx++) {
+            bool uniform = true;
+            for (uint32_t cz = 0; cz < SURFACE_TILE_CELLS; cz++) {
+                for (uint32_t cx = 0; cx < SURFACE_TILE_CELLS; cx++) {
+                    double x = header.originX + ((tx * SURFACE_TILE_CELLS + cx) + 0.5) * SURFACE_CELL_SIZE;
+                    double z = header.originZ + ((tz * SURFACE_TILE_CELLS + cz) + 0.5) * SURFACE_CELL_SIZE;
+                    SurfaceCell cell = generatedSurface(kind, x, z);
+                    tile[mortonIndex(cx, cz)] = cell;
+                    uniform = uniform && sameSurface(cell, header.fill);
+                }
+            }
+            if (uniform)
+                continue;
+            ok = fwrite(tile.data(), SURFACE_TILE_BYTES, 1, file) == 1;
+            directory[(size_t)tz * tiles + tx] = ++header.tileCount;
+        }
+    }
+
+    static const uint8_t zeros[SURFACE_HEADER_SIZE] = {};
+    ok = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(zeros, 1, SURFACE_HEADER_SIZE, file) == SURFACE_HEADER_SIZE &&
+         fwrite(directory.data(), 4, directory.size(), file) == directory.size() && fseek(file, 0, SEEK_SET) == 0 &&
+         fwrite(&header, sizeof(header), 1, file) == 1;
+    return fclose(file) == 0 && ok;
+}
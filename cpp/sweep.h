@@ -0,0 +1,454 @@
+// sweep.h
+//
+// Parameter sweeps over the Car setup, run in parallel on a work-stealing
+// thread pool.
+//
+// A SweepGrid describes the scenarios implicitly (base car, maneuver and a
+// list of axes), so scenario i is decoded on demand and a million-point
+// grid costs no memory up front. Each worker owns a contiguous range of
+// scenario indices and takes work from its front; idle workers steal the
+// back half of a victim's range. Both operations are a single CAS on a
+// packed 64-bit [begin, end) pair, so there are no locks anywhere. Every
+// scenario writes only to its own cache-line aligned result slot, which
+// is the whole reduction: no shared counters, no false sharing.
+//
+// With a fork step the grid's base setup is run once up to it, and every
+// scenario branches off a copy of that RunState (snapshot.h) with its
+// values applied from there on, so the shared warm-up is not repeated.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "car.h"
+#include "driver.h"
+#include "frame_writer.h"
+#include "maneuver.h"
+#include "motor.h"
+#include "scenario.h"
+#include "snapshot.h"
+#include "surface.h"
+#include "telemetry.h"
+#include "vehicle4w.h"
+
+// Car parameters that can be swept
+enum SweepParam {
+    SWEEP_CF,                 // Cornering stiffness front (N/rad)
+    SWEEP_CR,                 // Cornering stiffness rear (N/rad)
+    SWEEP_IZ,                 // Yaw moment of inertia (kg·m²)
+    SWEEP_MASS,               // Mass (kg)
+    SWEEP_H_CG,               // CG height (m)
+    SWEEP_MAX_STEER,          // Maximum steering angle (degrees on the command line, radians in Car)
+    SWEEP_LF,                 // CG to front axle (m); lr follows from the wheelbase
+    SWEEP_FRONT_DRIVE,        // Share of the drive force on the front axle (4w models)
+    SWEEP_TV_KP,              // Torque-vectoring proportional gain (N·m·s/rad)
+    SWEEP_TV_KI,              // Torque-vectoring integral gain (N·m/rad)
+    SWEEP_GEAR_RATIO,         // Motor turns per wheel turn, GR of parameters.m (--motor runs)
+    SWEEP_WHEEL_RADIUS,       // Wheel radius, Rw of parameters.m (m; --motor runs)
+    SWEEP_PARAM_COUNT
+};
+
+const char* const SWEEP_PARAM_NAMES[SWEEP_PARAM_COUNT] = {
+    "Cf", "Cr", "Iz", "mass", "h_cg", "maxSteer", "lf", "frontDrive", "tvKp", "tvKi", "GR", "Rw",
+};
+
+// Parameters from SWEEP_FRONT_DRIVE on belong to the run, not the Car
+inline bool isCarSweepParam(SweepParam param) {
+    return param < SWEEP_FRONT_DRIVE;
+}
+
+// Function to look up a sweep parameter by name
+inline bool parseSweepParam(const char* name, SweepParam* param) {
+    for (int i = 0; i < SWEEP_PARAM_COUNT; i++) {
+        if (strcmp(name, SWEEP_PARAM_NAMES[i]) == 0) {
+            *param = (SweepParam)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function to apply one swept value to a car
+inline void setSweepParam(Car& car, SweepParam param, float value) {
+    switch (param) {
+    case SWEEP_CF: car.Cf = value; break;
+    case SWEEP_CR: car.Cr = value; break;
+    case SWEEP_IZ: car.Iz = value; break;
+    case SWEEP_MASS: car.mass = value; break;
+    case SWEEP_H_CG: car.h_cg = value; break;
+    case SWEEP_MAX_STEER: car.maxSteer = value * DEG2RAD; break;
+    case SWEEP_LF:
+        car.lf = value;
+        car.lr = car.wheelbase - value;
+        break;
+    default: break;
+    }
+}
+
+// Function to apply one swept value that is not a Car field to a run
+inline void setRunSweepParam(RunState& state, SweepParam param, float value) {
+    switch (param) {
+    case SWEEP_FRONT_DRIVE: state.constants.frontDriveShare = value; break;
+    case SWEEP_TV_KP: state.vehicle.tv.kp = value; break;
+    case SWEEP_TV_KI: state.vehicle.tv.ki = value; break;
+    case SWEEP_GEAR_RATIO: state.motorParams.GR = value; break;
+    case SWEEP_WHEEL_RADIUS: state.motorParams.Rw = value; break;
+    default: break;
+    }
+    if (param == SWEEP_GEAR_RATIO || param == SWEEP_WHEEL_RADIUS)
+        state.stepper = makeMotorStepper(state.motorParams, state.vehicle.car.mass, state.dt, MOTOR_IMPLICIT);
+}
+
+// Function to read the current value of a parameter, in the units
+// setSweepParam() and setRunSweepParam() take
+inline float sweepParamValue(const RunState& state, SweepParam param) {
+    const Car& car = state.vehicle.car;
+    switch (param) {
+    case SWEEP_CF: return car.Cf;
+    case SWEEP_CR: return car.Cr;
+    case SWEEP_IZ: return car.Iz;
+    case SWEEP_MASS: return car.mass;
+    case SWEEP_H_CG: return car.h_cg;
+    case SWEEP_MAX_STEER: return car.maxSteer * RAD2DEG;
+    case SWEEP_LF: return car.lf;
+    case SWEEP_FRONT_DRIVE: return state.constants.frontDriveShare;
+    case SWEEP_TV_KP: return state.vehicle.tv.kp;
+    case SWEEP_TV_KI: return state.vehicle.tv.ki;
+    case SWEEP_GEAR_RATIO: return state.motorParams.GR;
+    case SWEEP_WHEEL_RADIUS: return state.motorParams.Rw;
+    default: return 0.0f;
+    }
+}
+
+// One swept parameter and the values it takes
+struct SweepAxis {
+    SweepParam param;
+    std::vector<float> values;
+};
+
+// Function to parse an axis spec: "name=v1,v2,..." or "name=start:stop:count"
+inline bool parseSweepAxis(const char* spec, SweepAxis* axis) {
+    const char* eq = strchr(spec, '=');
+    if (!eq)
+        return false;
+    std::string name(spec, eq - spec);
+    if (!parseSweepParam(name.c_str(), &axis->param))
+        return false;
+
+    axis->values.clear();
+    const char* values = eq + 1;
+    if (strchr(values, ':')) {
+        float start, stop;
+        int count;
+        if (sscanf(values, "%f:%f:%d", &start, &stop, &count) != 3 || count < 1)
+            return false;
+        for (int i = 0; i < count; i++) {
+            float u = count > 1 ? (float)i / (float)(count - 1) : 0.0f;
+            axis->values.push_back(start + (stop - start) * u);
+        }
+    } else {
+        const char* p = values;
+        while (*p) {
+            char* next;
+            axis->values.push_back(strtof(p, &next));
+            if (next == p)
+                return false;
+            p = *next == ',' ? next + 1 : next;
+        }
+    }
+    return !axis->values.empty();
+}
+
+// Implicit description of every scenario in a sweep
+struct SweepGrid {
+    Car base;                 // Setup shared by all scenarios
+    Maneuver maneuver;
+    VehicleModel model;
+    bool motor;               // Drive through motor.h instead of maxAcceleration
+    TireModel tires;          // Tires of the 4w models
+    long steps;
+    float dt;
+    std::vector<SweepAxis> axes;
+    bool zip;                 // false: cartesian product of the axes; true: i-th value of every axis
+    const Track* track;       // Drive laps of this track instead of the maneuver, or nullptr
+    const char* scenarioPath; // Play this scenario file instead of the maneuver, or nullptr
+    const SurfaceMap* surface; // Road surface under the 4w models' wheels, or nullptr
+    long forkStep;            // Run the base setup this far once and branch from there; 0 for no fork
+
+    // Function to count the scenarios
+    size_t size() const {
+        if (axes.empty())
+            return 1;
+        size_t n = zip ? axes[0].values.size() : 1;
+        for (const SweepAxis& axis : axes)
+            n = zip ? std::min(n, axis.values.size()) : n * axis.values.size();
+        return n;
+    }
+
+    // Function to get the value of 'axis' in scenario 'index' (mixed-radix decode, first axis fastest)
+    float axisValue(size_t axis, size_t index) const {
+        for (size_t a = 0; a < axis && !zip; a++)
+            index /= axes[a].values.size();
+        const std::vector<float>& values = axes[axis].values;
+        return values[zip ? index : index % values.size()];
+    }
+
+    // Function to build the car for scenario 'index'
+    Car scenarioCar(size_t index) const {
+        Car car = base;
+        for (size_t a = 0; a < axes.size(); a++)
+            setSweepParam(car, axes[a].param, axisValue(a, index));
+        return car;
+    }
+
+    // Function to apply the run parameters of scenario 'index'; with
+    // 'cars' the Car parameters too, retuning the run for them
+    void applyScenario(RunState& state, size_t index, bool cars) const {
+        bool changed = false;
+        for (size_t a = 0; a < axes.size(); a++) {
+            if (isCarSweepParam(axes[a].param)) {
+                if (cars)
+                    setSweepParam(state.vehicle.car, axes[a].param, axisValue(a, index));
+                changed = changed || cars;
+            }
+        }
+        if (changed)
+            retuneRunState(state);
+        for (size_t a = 0; a < axes.size(); a++) {
+            if (!isCarSweepParam(axes[a].param))
+                setRunSweepParam(state, axes[a].param, axisValue(a, index));
+        }
+    }
+};
+
+// Per-scenario reduction, one cache line per slot
+struct alignas(64) ScenarioResult {
+    float maxFzFront;         // Peak front axle load (N)
+    float maxFzRear;          // Peak rear axle load (N)
+    float maxLatAccel;        // Peak |a_lat| (m/s²)
+    float x, z;               // Final position (m)
+    float heading;            // Final heading (radians)
+    float velocity;           // Final speed (m/s)
+    int laps;                 // Completed laps when following a track
+    float bestLap;            // Fastest of them (s), INFINITY if none
+    long steps;               // Steps run; fewer than asked if a scenario file ended first
+    float yawRateError;       // RMS yaw-rate error against the reference (rad/s), 0 unless tracked
+};
+
+// Function to drive 'state' on until it has taken 'steps' steps in all.
+// With 'motor' the throttle drives the parameters.m motor (backward Euler)
+// instead of commanding maxAcceleration; with a 'recorder' every step is
+// logged. With a 'track' the track driver replaces the maneuver; with a
+// 'script' the scenario file does, and the run ends with it. With
+// 'frames', every frames->stepsPerFrame-th step is queued to be drawn.
+// With a 'surface' the four-wheel models drive on its friction and grade.
+inline ScenarioResult continueScenario(RunState& state, Maneuver maneuver, long steps,
+                                       TelemetryRecorder* recorder = nullptr, const Track* track = nullptr,
+                                       Scenario* script = nullptr, FrameWriter* frames = nullptr,
+                                       const SurfaceMap* surface = nullptr) {
+    const float dt = state.dt;
+    Car& car = state.vehicle.car;
+    while (state.step < steps) {
+        long i = state.step;
+        DriverInput input;
+        if (script) {
+            if (!scenarioInput(*script, car, (double)i * dt, dt, &input))
+                break;
+        } else {
+            float t = (float)i * dt;
+            input = track ? trackDriverInput(*track, state.driver, car, t, dt) : scriptedInput(maneuver, t);
+        }
+        StepOutput step = stepRunState(state, input, surface);
+
+        if (recorder || frames) {
+            // The bicycle has no wheel loads of its own; split the axle loads
+            float bicycleLoads[CORNER_COUNT];
+            const float* loads = state.vehicle.load;
+            if (state.model == MODEL_BICYCLE) {
+                computeCornerLoads(car, step.a_lat, bicycleLoads);
+                loads = bicycleLoads;
+            }
+            if (recorder)
+                recordTelemetry(*recorder, makeTelemetrySample(i, car, input, step, loads), true);
+            if (frames && i % frames->stepsPerFrame == 0) {
+                SoftFrame frame;
+                frame.index = i / frames->stepsPerFrame;
+                frame.time = (double)(i + 1) * dt;
+                frame.car = car;
+                frame.step = step;
+                memcpy(frame.wheelLoads, loads, sizeof(frame.wheelLoads));
+                frame.onTrack = track != nullptr;
+                frame.laps = state.driver.laps;
+                frame.lastLap = state.driver.lastLap;
+                frame.bestLap = state.driver.laps > 0 ? state.driver.bestLap : 0.0f;
+                submitSoftFrame(*frames, frame, true);
+            }
+        }
+    }
+
+    ScenarioResult result;
+    result.maxFzFront = state.maxFzFront;
+    result.maxFzRear = state.maxFzRear;
+    result.maxLatAccel = state.maxLatAccel;
+    result.x = car.x;
+    result.z = car.z;
+    result.heading = car.heading;
+    result.velocity = car.velocity;
+    result.laps = state.driver.laps;
+    result.bestLap = state.driver.bestLap;
+    result.steps = state.step;
+    result.yawRateError =
+        state.yawTrackedSteps > 0 ? (float)sqrt(state.yawErrorSquared / (double)state.yawTrackedSteps) : 0.0f;
+    return result;
+}
+
+// Function to run one scripted scenario from rest to completion (see
+// continueScenario()); with a 'track' the car starts on its line
+inline ScenarioResult runScenario(Car car, Maneuver maneuver, long steps, float dt,
+                                  VehicleModel model = MODEL_BICYCLE, bool motor = false,
+                                  TireModel tires = TIRE_LINEAR, TelemetryRecorder* recorder = nullptr,
+                                  const Track* track = nullptr, Scenario* script = nullptr,
+                                  FrameWriter* frames = nullptr, const SurfaceMap* surface = nullptr) {
+    RunState state;
+    initRunState(state, car, model, motor, tires, dt, track);
+    return continueScenario(state, maneuver, steps, recorder, track, script, frames, surface);
+}
+
+// A worker's share of the index space, packed as (end << 32) | begin so
+// that both ends move with one CAS
+struct alignas(64) WorkRange {
+    std::atomic<uint64_t> range;
+};
+
+inline uint64_t packRange(uint32_t begin, uint32_t end) {
+    return ((uint64_t)end << 32) | begin;
+}
+
+// Function for the owner to take the next index from the front of its range
+inline bool popFront(WorkRange& queue, uint32_t* index) {
+    uint64_t r = queue.range.load(std::memory_order_acquire);
+    for (;;) {
+        uint32_t begin = (uint32_t)r;
+        uint32_t end = (uint32_t)(r >> 32);
+        if (begin >= end)
+            return false;
+        if (queue.range.compare_exchange_weak(r, packRange(begin + 1, end), std::memory_order_acq_rel)) {
+            *index = begin;
+            return true;
+        }
+    }
+}
+
+// Function for a thief to take the back half of a victim's range
+inline bool stealHalf(WorkRange& victim, uint32_t* begin, uint32_t* end) {
+    uint64_t r = victim.range.load(std::memory_order_acquire);
+    for (;;) {
+        uint32_t b = (uint32_t)r;
+        uint32_t e = (uint32_t)(r >> 32);
+        if (b >= e)
+            return false;
+        uint32_t split = e - (e - b + 1) / 2;
+        if (victim.range.compare_exchange_weak(r, packRange(b, split), std::memory_order_acq_rel)) {
+            *begin = split;
+            *end = e;
+            return true;
+        }
+    }
+}
+
+// Function to run 'count' independent jobs, job(i) for i in [0, count), on
+// 'threads' workers with work stealing. job must only write state owned by i.
+template <typename Job>
+void parallelFor(size_t count, int threads, const Job& job) {
+    if (threads < 1)
+        threads = 1;
+    if ((size_t)threads > count)
+        threads = count > 0 ? (int)count : 1;
+
+    std::vector<WorkRange> queues(threads);
+    for (int w = 0; w < threads; w++) {
+        uint32_t begin = (uint32_t)(count * w / threads);
+        uint32_t end = (uint32_t)(count * (w + 1) / threads);
+        queues[w].range.store(packRange(begin, end), std::memory_order_relaxed);
+    }
+
+    auto worker = [&](int self) {
+        uint32_t index;
+        for (;;) {
+            while (popFront(queues[self], &index))
+                job(index);
+
+            // Own range is empty: steal from the others, starting next door.
+            // Work is never created, so finding every range empty means done.
+            bool stole = false;
+            for (int k = 1; k < threads && !stole; k++) {
+                uint32_t begin, end;
+                if (stealHalf(queues[(self + k) % threads], &begin, &end)) {
+                    queues[self].range.store(packRange(begin, end), std::memory_order_release);
+                    stole = true;
+                }
+            }
+            if (!stole)
+                return;
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int w = 1; w < threads; w++)
+        pool.emplace_back(worker, w);
+    worker(0);
+    for (std::thread& t : pool)
+        t.join();
+}
+
+// Function to run every scenario of a sweep; results[i] belongs to scenario i.
+// With a scenario file every run streams it through a reader of its own;
+// a branch's reader skips ahead to the fork on its first sample. Returns
+// false if any run could not open the scenario file, rather than letting
+// it fall back to the maneuver.
+inline bool runSweep(const SweepGrid& grid, std::vector<ScenarioResult>& results, int threads) {
+    results.resize(grid.size());
+
+    RunState checkpoint;
+    if (grid.forkStep > 0) {
+        initRunState(checkpoint, grid.base, grid.model, grid.motor, grid.tires, grid.dt, grid.track);
+        Scenario script;
+        bool scripted = grid.scenarioPath != nullptr;
+        if (scripted && !openScenario(script, grid.scenarioPath))
+            return false;
+        continueScenario(checkpoint, grid.maneuver, std::min(grid.forkStep, grid.steps), nullptr, grid.track,
+                         scripted ? &script : nullptr, nullptr, grid.surface);
+        if (scripted)
+            closeScenario(script);
+    }
+
+    std::atomic<bool> failed(false);
+    parallelFor(results.size(), threads, [&](size_t i) {
+        RunState state;
+        if (grid.forkStep > 0) {
+            forkRunState(checkpoint, &state, 1);
+            grid.applyScenario(state, i, true);
+        } else {
+            initRunState(state, grid.scenarioCar(i), grid.model, grid.motor, grid.tires, grid.dt, grid.track);
+            grid.applyScenario(state, i, false);
+        }
+        Scenario script;
+        bool scripted = grid.scenarioPath != nullptr;
+        if (scripted && !openScenario(script, grid.scenarioPath)) {
+            failed.store(true, std::memory_order_relaxed);
+            return;
+        }
+        results[i] = continueScenario(state, grid.maneuver, grid.steps, nullptr, grid.track,
+                                      scripted ? &script : nullptr, nullptr, grid.surface);
+        if (scripted)
+            closeScenario(script);
+    });
+    return !failed.load();
+}
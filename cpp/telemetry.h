@@ -0,0 +1,312 @@
+// telemetry.h
+//
+// Per-step telemetry recording and zero-copy playback.
+//
+// The simulation thread hands each step's sample to recordTelemetry(),
+// which copies it into a single-producer/single-consumer ring buffer and
+// returns; it never waits for the disk. If the ring is ever full the
+// sample is dropped and counted rather than stalling the physics. A
+// background writer thread drains the ring, transposes samples into
+// column-major chunks and appends each full chunk to the file.
+//
+// File layout (little-endian, everything 4-byte wide):
+//
+//   TelemetryHeader, padded to TELEMETRY_HEADER_SIZE bytes
+//   chunk 0: uint32 step[TELEMETRY_CHUNK], then float column[c][TELEMETRY_CHUNK]
+//            for every TelemetryColumn c
+//   chunk 1: ...
+//
+// Chunks are page-sized multiples and the last one is zero-padded, so
+// sample i of column c sits at a fixed offset. openTelemetry() maps the
+// file and reads values in place; seeking anywhere in an hour-long
+// recording costs nothing. The content depends only on the simulated
+// steps, never on wall time, so identical runs produce identical files.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#include "car.h"
+
+// Recorded quantities, one file column each
+enum TelemetryColumn {
+    TLM_X,                    // Position (m)
+    TLM_Z,
+    TLM_HEADING,              // Heading (radians)
+    TLM_VELOCITY,             // Speed (m/s)
+    TLM_ACCELERATION,         // Longitudinal acceleration (m/s²)
+    TLM_STEER_ANGLE,          // Steering angle (radians)
+    TLM_YAW_RATE,             // Yaw rate (radians per second)
+    TLM_STEER_INPUT,          // Driver steering command [-1, 1]
+    TLM_THROTTLE_INPUT,       // Driver throttle command [-1, 1]
+    TLM_A_LAT,                // Lateral acceleration (m/s²)
+    TLM_FZ_FRONT,             // Front axle normal load (N)
+    TLM_FZ_REAR,              // Rear axle normal load (N)
+    TLM_LOAD_FL,              // Corner normal loads, in Corner order (N)
+    TLM_LOAD_FR,
+    TLM_LOAD_RL,
+    TLM_LOAD_RR,
+    TLM_COLUMN_COUNT
+};
+
+const char* const TELEMETRY_COLUMN_NAMES[TLM_COLUMN_COUNT] = {
+    "x", "z", "heading", "velocity", "acceleration", "steerAngle", "yawRate",
+    "steerInput", "throttleInput", "a_lat", "Fz_front", "Fz_rear",
+    "load_FL", "load_FR", "load_RL", "load_RR",
+};
+
+const char TELEMETRY_MAGIC[8] = { 'T', 'V', 'S', 'T', 'L', 'M', '0', '1' };
+const uint32_t TELEMETRY_VERSION = 1;
+const size_t TELEMETRY_HEADER_SIZE = 4096;
+const size_t TELEMETRY_CHUNK = 4096;                  // Samples per chunk
+const size_t TELEMETRY_CHUNK_BYTES = TELEMETRY_CHUNK * (1 + TLM_COLUMN_COUNT) * 4;
+const size_t TELEMETRY_RING = 1 << 16;                // Samples buffered (65 s at 1 kHz)
+
+struct TelemetryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t columnCount;
+    uint32_t chunkSamples;
+    uint32_t reserved;
+    uint64_t sampleCount;     // Samples in the file
+    uint64_t droppedCount;    // Samples lost to a full ring
+    double dt;                // Physics step (s)
+    char columnNames[TLM_COLUMN_COUNT][16];
+};
+
+static_assert(sizeof(TelemetryHeader) <= TELEMETRY_HEADER_SIZE, "telemetry header does not fit its page");
+
+// One physics step
+struct TelemetrySample {
+    uint32_t step;
+    float value[TLM_COLUMN_COUNT];
+};
+
+struct TelemetryRecorder {
+    // Ring buffer: the producer owns head, the writer owns tail. Each side
+    // keeps a stale copy of the other's index and only reloads it when the
+    // ring looks full (or empty), so the shared lines are rarely touched.
+    TelemetrySample* ring;
+    alignas(64) std::atomic<uint64_t> head;
+    uint64_t cachedTail;
+    uint64_t dropped;
+    alignas(64) std::atomic<uint64_t> tail;
+    alignas(64) std::atomic<bool> running;
+
+    FILE* file;
+    TelemetryHeader header;
+    uint8_t* chunk;           // Column-major staging for the chunk being filled
+    size_t chunkFill;         // Samples in 'chunk'
+    long failedWrites;        // Chunks the file took short, e.g. on a full disk
+    std::thread writer;
+};
+
+// Function to fill a sample from the state after a step
+inline TelemetrySample makeTelemetrySample(long step, const Car& car, const DriverInput& input,
+                                           const StepOutput& out, const float loads[CORNER_COUNT]) {
+    TelemetrySample s;
+    s.step = (uint32_t)step;
+    s.value[TLM_X] = car.x;
+    s.value[TLM_Z] = car.z;
+    s.value[TLM_HEADING] = car.heading;
+    s.value[TLM_VELOCITY] = car.velocity;
+    s.value[TLM_ACCELERATION] = car.acceleration;
+    s.value[TLM_STEER_ANGLE] = car.steerAngle;
+    s.value[TLM_YAW_RATE] = car.yawRate;
+    s.value[TLM_STEER_INPUT] = input.steer;
+    s.value[TLM_THROTTLE_INPUT] = input.throttle;
+    s.value[TLM_A_LAT] = out.a_lat;
+    s.value[TLM_FZ_FRONT] = out.Fz_front;
+    s.value[TLM_FZ_REAR] = out.Fz_rear;
+    for (int c = 0; c < CORNER_COUNT; c++)
+        s.value[TLM_LOAD_FL + c] = loads[c];
+    return s;
+}
+
+// Function to append the staged chunk, zero-padding a partial one
+inline void flushTelemetryChunk(TelemetryRecorder& rec) {
+    if (rec.chunkFill == 0)
+        return;
+    if (rec.chunkFill < TELEMETRY_CHUNK) {
+        for (size_t c = 0; c <= TLM_COLUMN_COUNT; c++)
+            memset(rec.chunk + (c * TELEMETRY_CHUNK + rec.chunkFill) * 4, 0, (TELEMETRY_CHUNK - rec.chunkFill) * 4);
+    }
+    if (fwrite(rec.chunk, 1, TELEMETRY_CHUNK_BYTES, rec.file) != TELEMETRY_CHUNK_BYTES)
+        rec.failedWrites++;
+    rec.header.sampleCount += rec.chunkFill;
+    rec.chunkFill = 0;
+}
+
+// Function run by the writer thread: drain the ring into chunks until stopped
+inline void telemetryWriter(TelemetryRecorder& rec) {
+    uint32_t* steps = (uint32_t*)rec.chunk;
+    float* columns = (float*)(rec.chunk + TELEMETRY_CHUNK * 4);
+
+    for (;;) {
+        bool stopping = !rec.running.load(std::memory_order_acquire);
+        uint64_t tail = rec.tail.load(std::memory_order_relaxed);
+        uint64_t head = rec.head.load(std::memory_order_acquire);
+
+        if (tail == head) {
+            if (stopping)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
+        }
+
+        // Transpose everything available into the staging chunk
+        for (; tail != head; tail++) {
+            const TelemetrySample& s = rec.ring[tail & (TELEMETRY_RING - 1)];
+            steps[rec.chunkFill] = s.step;
+            for (int c = 0; c < TLM_COLUMN_COUNT; c++)
+                columns[c * TELEMETRY_CHUNK + rec.chunkFill] = s.value[c];
+            if (++rec.chunkFill == TELEMETRY_CHUNK) {
+                rec.tail.store(tail + 1, std::memory_order_release);
+                flushTelemetryChunk(rec);
+            }
+        }
+        rec.tail.store(tail, std::memory_order_release);
+    }
+}
+
+// Function to create the file and start the writer; returns false on error
+inline bool startTelemetry(TelemetryRecorder& rec, const char* path, double dt) {
+    rec.file = fopen(path, "wb");
+    if (!rec.file)
+        return false;
+
+    memset(&rec.header, 0, sizeof(rec.header));
+    memcpy(rec.header.magic, TELEMETRY_MAGIC, sizeof(TELEMETRY_MAGIC));
+    rec.header.version = TELEMETRY_VERSION;
+    rec.header.columnCount = TLM_COLUMN_COUNT;
+    rec.header.chunkSamples = TELEMETRY_CHUNK;
+    rec.header.dt = dt;
+    for (int c = 0; c < TLM_COLUMN_COUNT; c++)
+        strncpy(rec.header.columnNames[c], TELEMETRY_COLUMN_NAMES[c], sizeof(rec.header.columnNames[c]) - 1);
+
+    // Header is rewritten with the final counts by stopTelemetry()
+    static const uint8_t zeros[TELEMETRY_HEADER_SIZE] = {};
+    rec.ring = (TelemetrySample*)aligned_alloc(64, TELEMETRY_RING * sizeof(TelemetrySample));
+    rec.chunk = (uint8_t*)aligned_alloc(64, TELEMETRY_CHUNK_BYTES);
+    if (!rec.ring || !rec.chunk || fwrite(zeros, 1, TELEMETRY_HEADER_SIZE, rec.file) != TELEMETRY_HEADER_SIZE) {
+        free(rec.ring);
+        free(rec.chunk);
+        fclose(rec.file);
+        return false;
+    }
+    rec.chunkFill = 0;
+    rec.failedWrites = 0;
+    rec.head.store(0, std::memory_order_relaxed);
+    rec.tail.store(0, std::memory_order_relaxed);
+    rec.cachedTail = 0;
+    rec.dropped = 0;
+    rec.running.store(true, std::memory_order_release);
+    rec.writer = std::thread(telemetryWriter, std::ref(rec));
+    return true;
+}
+
+// Function to queue one sample from the simulation thread. In real time
+// this never blocks and returns false if the sample had to be dropped;
+// batch runs, which have no deadline, pass 'wait' to yield until the
+// writer has made room instead.
+inline bool recordTelemetry(TelemetryRecorder& rec, const TelemetrySample& sample, bool wait = false) {
+    uint64_t head = rec.head.load(std::memory_order_relaxed);
+    while (head - rec.cachedTail >= TELEMETRY_RING) {
+        rec.cachedTail = rec.tail.load(std::memory_order_acquire);
+        if (head - rec.cachedTail < TELEMETRY_RING)
+            break;
+        if (!wait) {
+            rec.dropped++;
+            return false;
+        }
+        std::this_thread::yield();
+    }
+    rec.ring[head & (TELEMETRY_RING - 1)] = sample;
+    rec.head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+// Function to drain the ring, finish the file and stop the writer; returns
+// false if any of it failed to reach the file
+inline bool stopTelemetry(TelemetryRecorder& rec) {
+    rec.running.store(false, std::memory_order_release);
+    rec.writer.join();
+    flushTelemetryChunk(rec);
+
+    rec.header.droppedCount = rec.dropped;
+    bool ok = rec.failedWrites == 0 && fseek(rec.file, 0, SEEK_SET) == 0 &&
+              fwrite(&rec.header, 1, sizeof(rec.header), rec.file) == sizeof(rec.header);
+    ok = fclose(rec.file) == 0 && ok;
+    free(rec.ring);
+    free(rec.chunk);
+    return ok;
+}
+
+// Read-only view of a recording
+struct TelemetryReplay {
+    const uint8_t* data;      // Whole file, mapped
+    size_t size;
+    const TelemetryHeader* header;
+    uint64_t sampleCount;
+    double dt;
+};
+
+// Function to map a recording; returns false if it is missing or malformed
+inline bool openTelemetry(TelemetryReplay& replay, const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < TELEMETRY_HEADER_SIZE) {
+        close(fd);
+        return false;
+    }
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    replay.data = (const uint8_t*)data;
+    replay.size = (size_t)st.st_size;
+    replay.header = (const TelemetryHeader*)data;
+    replay.sampleCount = replay.header->sampleCount;
+    replay.dt = replay.header->dt;
+
+    size_t chunks = (replay.sampleCount + TELEMETRY_CHUNK - 1) / TELEMETRY_CHUNK;
+    if (memcmp(replay.header->magic, TELEMETRY_MAGIC, sizeof(TELEMETRY_MAGIC)) != 0 ||
+        replay.header->version != TELEMETRY_VERSION ||
+        replay.header->columnCount != TLM_COLUMN_COUNT ||
+        replay.header->chunkSamples != TELEMETRY_CHUNK ||
+        replay.size < TELEMETRY_HEADER_SIZE + chunks * TELEMETRY_CHUNK_BYTES) {
+        munmap(data, replay.size);
+        return false;
+    }
+    return true;
+}
+
+// Function to unmap a recording
+inline void closeTelemetry(TelemetryReplay& replay) {
+    munmap((void*)replay.data, replay.size);
+}
+
+// Function to read column c of sample i straight from the mapping
+inline float telemetryValue(const TelemetryReplay& replay, uint64_t i, TelemetryColumn c) {
+    const uint8_t* chunk = replay.data + TELEMETRY_HEADER_SIZE + (i / TELEMETRY_CHUNK) * TELEMETRY_CHUNK_BYTES;
+    return ((const float*)(chunk + TELEMETRY_CHUNK * 4))[c * TELEMETRY_CHUNK + i % TELEMETRY_CHUNK];
+}
+
+// Function to read the physics step number of sample i
+inline uint32_t telemetryStep(const TelemetryReplay& replay, uint64_t i) {
+    const uint8_t* chunk = replay.data + TELEMETRY_HEADER_SIZE + (i / TELEMETRY_CHUNK) * TELEMETRY_CHUNK_BYTES;
+    return ((const uint32_t*)chunk)[i % TELEMETRY_CHUNK];
+}
@@ -0,0 +1,308 @@
+// tire.h
+//
+// Magic Formula tire forces with combined slip, baked into lookup tables.
+//
+// The pure-slip curves are Pacejka's F = D sin(C atan(Bx - E(Bx - atan Bx)))
+// with a load-sensitive peak D, a load-sensitive slip stiffness BCD and, on
+// the lateral side, a load-sensitive curvature E. Combined slip uses the
+// cosine weighting functions of MF 2002, Fx = Gxa(alpha, kappa) Fx0(kappa)
+// and Fy = Gyk(kappa, alpha) Fy0(alpha), so drive force eats into grip and
+// slip angle into traction.
+//
+// Everything is per unit of the tire's nominal load Fz0 (the four-wheel
+// model uses the static corner load), with the load as n = Fz / Fz0 and
+// the lateral slip as s = alpha * K0 / Fz0, where K0 is the cornering
+// stiffness at nominal load (the car's Cf or Cr per wheel). So one set of
+// tables serves every car and axle, and at n = 1 and small slip the curve
+// has exactly the slope of the linear tire. The road's friction mu scales
+// the forces and divides the slips, which is MF's lambda_mu with the slip
+// stiffness kept.
+//
+// magicFormulaForces() evaluates the formulas directly (atan, sin, cos and
+// a division per curve); tableTireForces() reads the same forces from four
+// bilinearly interpolated tables, 59 KB in all with the inverse below,
+// built once at startup.
+// slipRatioForDrive() inverts the pure longitudinal curve, for models that
+// command a drive force rather than integrate wheel speed.
+//
+// Max error against the formula in double precision over the tables'
+// range, per unit of mu * Fz0, and time per tire, as measured by headless
+// --tire-bench (glibc 2.36, -march=native on AVX-512):
+//
+//                         Fx        Fy        ns per tire
+//   magicFormulaForces    9.5e-7    1.0e-6    206
+//   tableTireForces       1.5e-3    2.2e-3    24
+//
+// Loads above TIRE_LOAD_MAX * Fz0 are taken as TIRE_LOAD_MAX * Fz0; slips
+// beyond the tables' range, where every curve has flattened out, as the
+// edge of the range.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "simd.h"
+
+// Tire models selectable at run time
+enum TireModel {
+    TIRE_LINEAR,              // Cornering stiffness times load, cut off by the friction circle
+    TIRE_MAGIC_FORMULA,       // Combined-slip Magic Formula through the lookup tables
+};
+
+// Function to map a tire model name to its enum value
+inline bool parseTireModel(const char* name, TireModel* model) {
+    if (strcmp(name, "linear") == 0) {
+        *model = TIRE_LINEAR;
+    } else if (strcmp(name, "magic") == 0) {
+        *model = TIRE_MAGIC_FORMULA;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Magic Formula coefficients, loosely after the MF 2002 sample passenger
+// car tire (dimensionless; n is the load over the nominal load)
+const double MF_CY = 1.3;                 // Lateral shape factor
+const double MF_EY1 = -0.8;               // Lateral curvature at nominal load
+const double MF_EY2 = -0.4;               // Change of lateral curvature per unit of n
+const double MF_DY2 = -0.08;              // Change of lateral peak friction per unit of n
+const double MF_KY2 = 1.8;                // Cornering stiffness goes as sin(2 atan(n / KY2))
+const double MF_CX = 1.65;                // Longitudinal shape factor
+const double MF_EX1 = -0.5;               // Longitudinal curvature
+const double MF_DX2 = -0.1;               // Change of longitudinal peak friction per unit of n
+const double MF_KX1 = 20.0;               // Slip stiffness per load at nominal load
+const double MF_KX3 = -0.2;               // Slip stiffness per load goes as exp(KX3 (n - 1))
+const double MF_RBX1 = 13.0;              // Gxa: slope of the weighting against slip angle
+const double MF_RBX2 = 9.7;               // Gxa: fall of that slope with slip ratio
+const double MF_RCX1 = 1.0;               // Gxa: shape factor
+const double MF_RBY1 = 10.6;              // Gyk: slope of the weighting against slip ratio
+const double MF_RBY2 = 7.8;               // Gyk: fall of that slope with slip angle
+const double MF_RCY1 = 1.06;              // Gyk: shape factor
+
+// Friction below this is taken as this, so the slip scaling stays finite
+const float TIRE_MIN_MU = 0.05f;
+
+// Table layout: rows over the load, columns over the slip
+const float TIRE_LOAD_MAX = 4.0f;         // Largest load in the tables (n)
+const int TIRE_LOAD_CELLS = 16;           // Intervals over [0, TIRE_LOAD_MAX]
+const int TIRE_SLIP_CELLS = 128;          // Intervals over each pure-slip axis
+const float TIRE_LATERAL_SLIP_MAX = 16.0f;// Pure lateral curve over s in [0, 16]
+const float TIRE_SLIP_RATIO_MAX = 1.0f;   // Pure longitudinal curve over kappa / mu in [0, 1]
+const int TIRE_WEIGHT_CELLS = 64;         // Intervals over each axis of the weighting tables
+const float TIRE_WEIGHT_ANGLE_MAX = 1.0f; // Weightings over alpha / mu in [0, 1] rad
+const float TIRE_WEIGHT_RATIO_MAX = 0.5f; // and kappa / mu in [0, 0.5]
+
+// Tire force per unit of nominal load, along and across the wheel
+struct TireForces {
+    float Fx;
+    float Fy;
+};
+
+// Function to evaluate the Magic Formula at x
+template <typename Real>
+inline Real magicFormula(Real x, Real B, Real C, Real D, Real E) {
+    Real Bx = B * x;
+    return D * std::sin(C * std::atan(Bx - E * (Bx - std::atan(Bx))));
+}
+
+// Function for the lateral peak force per nominal load at load n (the
+// Magic Formula peaks at D for C >= 1)
+template <typename Real>
+inline Real lateralPeak(Real n) {
+    n = std::min(std::max(n, (Real)1e-6), (Real)TIRE_LOAD_MAX);
+    return n * (1 + (Real)MF_DY2 * (n - 1));
+}
+
+// Function for the longitudinal peak force per nominal load at load n
+template <typename Real>
+inline Real longitudinalPeak(Real n) {
+    n = std::min(std::max(n, (Real)1e-6), (Real)TIRE_LOAD_MAX);
+    return n * (1 + (Real)MF_DX2 * (n - 1));
+}
+
+// Function for the pure lateral force per nominal load at lateral slip
+// s = alpha K0 / (mu Fz0) >= 0 and load n
+template <typename Real>
+inline Real pureLateralForce(Real s, Real n) {
+    n = std::min(std::max(n, (Real)1e-6), (Real)TIRE_LOAD_MAX);
+    Real D = lateralPeak(n);
+    Real K = std::sin(2 * std::atan(n / (Real)MF_KY2)) / std::sin(2 * std::atan(1 / (Real)MF_KY2));
+    Real E = std::min((Real)MF_EY1 + (Real)MF_EY2 * (n - 1), (Real)1);
+    return magicFormula(s, K / ((Real)MF_CY * D), (Real)MF_CY, D, E);
+}
+
+// Function for the pure longitudinal force per nominal load at slip ratio
+// k = kappa / mu >= 0 and load n
+template <typename Real>
+inline Real pureLongitudinalForce(Real k, Real n) {
+    n = std::min(std::max(n, (Real)1e-6), (Real)TIRE_LOAD_MAX);
+    Real D = longitudinalPeak(n);
+    Real K = (Real)MF_KX1 * n * std::exp((Real)MF_KX3 * (n - 1));
+    return magicFormula(k, K / ((Real)MF_CX * D), (Real)MF_CX, D, (Real)MF_EX1);
+}
+
+// Function for Gyk, the share of the pure lateral force left at slip
+// ratio k and slip angle a (both over mu, both >= 0)
+template <typename Real>
+inline Real lateralWeight(Real k, Real a) {
+    Real B = (Real)MF_RBY1 * std::cos(std::atan((Real)MF_RBY2 * a));
+    return std::max(std::cos((Real)MF_RCY1 * std::atan(B * k)), (Real)0);
+}
+
+// Function for Gxa, the share of the pure longitudinal force left at slip
+// angle a and slip ratio k (both over mu, both >= 0)
+template <typename Real>
+inline Real longitudinalWeight(Real a, Real k) {
+    Real B = (Real)MF_RBX1 * std::cos(std::atan((Real)MF_RBX2 * k));
+    return std::max(std::cos((Real)MF_RCX1 * std::atan(B * a)), (Real)0);
+}
+
+// Function to compute the combined-slip force per nominal load from the
+// formulas, for slip angle 'alpha' (rad), slip ratio 'kappa', load 'n',
+// 'cornering' = K0 / Fz0 (1/rad) and road friction 'mu'
+template <typename Real>
+inline TireForces magicFormulaForces(Real alpha, Real kappa, Real n, Real cornering, Real mu) {
+    mu = std::max(mu, (Real)TIRE_MIN_MU);
+    Real a = std::fabs(alpha) / mu;
+    Real k = std::fabs(kappa) / mu;
+    Real fx = mu * longitudinalWeight(a, k) * pureLongitudinalForce(k, n);
+    Real fy = mu * lateralWeight(k, a) * pureLateralForce(cornering * a, n);
+    return { (float)std::copysign(fx, kappa), (float)std::copysign(fy, alpha) };
+}
+
+// Function to find the slip ratio (over mu) of the pure longitudinal peak at load n
+template <typename Real>
+inline Real peakSlipRatio(Real n) {
+    // The curve is unimodal on the table's range: golden-section search
+    const Real ratio = (Real)0.618033988749894848;
+    Real lo = 0, hi = (Real)TIRE_SLIP_RATIO_MAX;
+    for (int i = 0; i < 60; i++) {
+        Real a = hi - ratio * (hi - lo);
+        Real b = lo + ratio * (hi - lo);
+        if (pureLongitudinalForce(a, n) < pureLongitudinalForce(b, n))
+            lo = a;
+        else
+            hi = b;
+    }
+    return (Real)0.5 * (lo + hi);
+}
+
+// Function to find the slip ratio (over mu) at which the pure
+// longitudinal force per nominal load reaches 'drive' >= 0 at load n; a
+// demand past the peak gets the peak's slip, the wheel running at the
+// most the road gives rather than spinning up
+template <typename Real>
+inline Real magicFormulaSlipRatio(Real drive, Real n) {
+    Real hi = peakSlipRatio(n);
+    if (drive >= longitudinalPeak(n))
+        return hi;
+    Real lo = 0;
+    for (int i = 0; i < 60; i++) {
+        Real mid = (Real)0.5 * (lo + hi);
+        if (pureLongitudinalForce(mid, n) < drive)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return (Real)0.5 * (lo + hi);
+}
+
+struct TireTables {
+    float lateral[TIRE_LOAD_CELLS + 1][TIRE_SLIP_CELLS + 1];           // Fy0 / Dy over [n][sqrt(s)]
+    float longitudinal[TIRE_LOAD_CELLS + 1][TIRE_SLIP_CELLS + 1];      // Fx0 / Dx over [n][sqrt(kappa / mu)]
+    float lateralWeight[TIRE_WEIGHT_CELLS + 1][TIRE_WEIGHT_CELLS + 1]; // Gyk over [sqrt(kappa / mu)][sqrt(alpha / mu)]
+    float longitudinalWeight[TIRE_WEIGHT_CELLS + 1][TIRE_WEIGHT_CELLS + 1]; // Gxa over [sqrt(alpha / mu)][sqrt(kappa / mu)]
+    float slipForDrive[TIRE_LOAD_CELLS + 1][TIRE_SLIP_CELLS + 1];      // kappa / mu over [n][1 - sqrt(1 - Fx / (mu Dx))]
+};
+
+// Function to fill the tire tables from the formulas in double precision.
+// The pure curves are stored over their peak, which takes out most of the
+// load dependence; the slip axes are spaced on the square root of the
+// slip, which puts the cells where the curves bend, and the inverse on
+// 1 - sqrt(1 - share of the peak), which straightens its vertical tangent
+// at the peak.
+inline TireTables buildTireTables() {
+    TireTables t;
+    for (int i = 0; i <= TIRE_LOAD_CELLS; i++) {
+        double n = (double)i * TIRE_LOAD_MAX / TIRE_LOAD_CELLS;
+        double lateralPeakForce = lateralPeak(n);
+        double longitudinalPeakForce = longitudinalPeak(n);
+        for (int j = 0; j <= TIRE_SLIP_CELLS; j++) {
+            double u = (double)j / TIRE_SLIP_CELLS;
+            double share = 1.0 - (1.0 - u) * (1.0 - u);
+            t.lateral[i][j] = (float)(pureLateralForce(u * u * TIRE_LATERAL_SLIP_MAX, n) / lateralPeakForce);
+            t.longitudinal[i][j] = (float)(pureLongitudinalForce(u * u * TIRE_SLIP_RATIO_MAX, n) / longitudinalPeakForce);
+            t.slipForDrive[i][j] = (float)magicFormulaSlipRatio(share * longitudinalPeakForce, n);
+        }
+    }
+    for (int i = 0; i <= TIRE_WEIGHT_CELLS; i++) {
+        double u = (double)i / TIRE_WEIGHT_CELLS;
+        for (int j = 0; j <= TIRE_WEIGHT_CELLS; j++) {
+            double v = (double)j / TIRE_WEIGHT_CELLS;
+            t.lateralWeight[i][j] = (float)lateralWeight(u * u * TIRE_WEIGHT_RATIO_MAX, v * v * TIRE_WEIGHT_ANGLE_MAX);
+            t.longitudinalWeight[i][j] = (float)longitudinalWeight(u * u * TIRE_WEIGHT_ANGLE_MAX, v * v * TIRE_WEIGHT_RATIO_MAX);
+        }
+    }
+    return t;
+}
+
+inline const TireTables TIRE_TABLES = buildTireTables();
+
+// Function to interpolate a table of rows x columns cells at (row, column)
+// in cell units, both >= 0; positions past the last cell read its edge
+template <int Rows, int Columns>
+inline float bilerpTable(const float (&table)[Rows + 1][Columns + 1], float row, float column) {
+    row = minf(row, (float)Rows);
+    column = minf(column, (float)Columns);
+    int i = (int)row;
+    int j = (int)column;
+    i = i < Rows - 1 ? i : Rows - 1;
+    j = j < Columns - 1 ? j : Columns - 1;
+    float fr = row - (float)i;
+    float fc = column - (float)j;
+    const float* a = &table[i][j];
+    const float* b = &table[i + 1][j];
+    float top = a[0] + fc * (a[1] - a[0]);
+    float bottom = b[0] + fc * (b[1] - b[0]);
+    return top + fr * (bottom - top);
+}
+
+// Function to compute the combined-slip force per nominal load from the
+// tables; same arguments as magicFormulaForces()
+inline TireForces tableTireForces(float alpha, float kappa, float n, float cornering, float mu) {
+    const TireTables& t = TIRE_TABLES;
+    mu = maxf(mu, TIRE_MIN_MU);
+    float invMu = 1.0f / mu;
+    float a = absf(alpha) * invMu;
+    float rootA = sqrtf(a);
+    float rootS = sqrtf(cornering * a);
+    float rootK = sqrtf(absf(kappa) * invMu);
+    float row = n * (TIRE_LOAD_CELLS / TIRE_LOAD_MAX);
+
+    float fx = bilerpTable<TIRE_LOAD_CELLS, TIRE_SLIP_CELLS>(
+        t.longitudinal, row, rootK * (float)(TIRE_SLIP_CELLS / std::sqrt(TIRE_SLIP_RATIO_MAX)));
+    float fy = bilerpTable<TIRE_LOAD_CELLS, TIRE_SLIP_CELLS>(
+        t.lateral, row, rootS * (float)(TIRE_SLIP_CELLS / std::sqrt(TIRE_LATERAL_SLIP_MAX)));
+    float wa = rootA * (float)(TIRE_WEIGHT_CELLS / std::sqrt(TIRE_WEIGHT_ANGLE_MAX));
+    float wk = rootK * (float)(TIRE_WEIGHT_CELLS / std::sqrt(TIRE_WEIGHT_RATIO_MAX));
+    fx *= bilerpTable<TIRE_WEIGHT_CELLS, TIRE_WEIGHT_CELLS>(t.longitudinalWeight, wa, wk);
+    fy *= bilerpTable<TIRE_WEIGHT_CELLS, TIRE_WEIGHT_CELLS>(t.lateralWeight, wk, wa);
+    fx *= mu * longitudinalPeak(n);
+    fy *= mu * lateralPeak(n);
+    return { copysignf(fx, kappa), copysignf(fy, alpha) };
+}
+
+// Function to look up the slip ratio that makes a drive force of 'drive'
+// per nominal load on a road of friction 'mu' at load n (see
+// magicFormulaSlipRatio())
+inline float slipRatioForDrive(float drive, float n, float mu) {
+    mu = maxf(mu, TIRE_MIN_MU);
+    float share = minf(absf(drive) / (mu * longitudinalPeak(n)), 1.0f);
+    float column = (1.0f - sqrtf(1.0f - share)) * TIRE_SLIP_CELLS;
+    float k = bilerpTable<TIRE_LOAD_CELLS, TIRE_SLIP_CELLS>(TIRE_TABLES.slipForDrive,
+                                                            n * (TIRE_LOAD_CELLS / TIRE_LOAD_MAX), column);
+    return copysignf(mu * k, drive);
+}
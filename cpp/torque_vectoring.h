@@ -0,0 +1,79 @@
+// torque_vectoring.h
+//
+// Yaw-moment torque-vectoring controller. The driver's steering defines a
+// reference yaw rate from the steady-state bicycle model (with half the
+// car's own understeer gradient, capped by the friction limit), so the
+// controller makes the car more agile than its passive setup and catches
+// it when it oversteers. A PI loop on the yaw-rate error produces a
+// corrective yaw moment, which the vehicle model realizes by shifting
+// drive force from the left to the right wheels.
+
+#pragma once
+
+#include <cmath>
+
+#include "car.h"
+
+struct TorqueVectoring {
+    // Gains and limits
+    float kp;                 // Yaw moment per yaw-rate error (N·m·s/rad)
+    float ki;                 // Yaw moment per integrated error (N·m/rad)
+    float maxYawMoment;       // Actuator limit (N·m)
+    float understeerGradient; // Target K_us of the reference (rad·s²/m)
+    float mu;                 // Friction coefficient used to cap the reference
+
+    // State
+    float integral;           // Integrated yaw-rate error (rad)
+    float yawRateRef;         // Last reference (rad/s)
+    float yawMoment;          // Last commanded moment (N·m)
+};
+
+// Function to create a controller tuned for 'car'
+inline TorqueVectoring makeTorqueVectoring(const Car& car) {
+    TorqueVectoring tv;
+    tv.kp = 10.0f * car.Iz;
+    tv.ki = 20.0f * car.Iz;
+    tv.maxYawMoment = 0.25f * car.mass * GRAVITY * car.trackWidth * 0.5f;
+    // Half the passive K_us = m / L * (lr / Cf - lf / Cr). An oversteering
+    // setup is tracked to neutral steer instead: its own steady-state gain
+    // grows without bound towards the critical speed.
+    tv.understeerGradient = fmaxf(0.5f * car.mass / car.wheelbase * (car.lr / car.Cf - car.lf / car.Cr), 0.0f);
+    tv.mu = 1.0f;
+    tv.integral = 0.0f;
+    tv.yawRateRef = 0.0f;
+    tv.yawMoment = 0.0f;
+    return tv;
+}
+
+// Function to compute the reference yaw rate: the steady-state bicycle
+// yaw rate for the current steering, limited to what the tires can
+// sustain (a_y = r * vx <= mu * g)
+inline float yawRateReference(const TorqueVectoring& tv, const Car& car) {
+    float vx = car.velocity;
+    float reference = vx * car.steerAngle / (car.wheelbase + tv.understeerGradient * vx * vx);
+    float limit = tv.mu * GRAVITY / fmaxf(fabsf(vx), 1.0f);
+    return fminf(fmaxf(reference, -limit), limit);
+}
+
+// Function to compute the corrective yaw moment for this step
+inline float updateTorqueVectoring(TorqueVectoring& tv, const Car& car, float yawRate, float dt) {
+    float vx = car.velocity;
+    float reference = yawRateReference(tv, car);
+    tv.yawRateRef = reference;
+
+    // Below walking pace there is nothing useful to control
+    if (fabsf(vx) < 1.0f) {
+        tv.integral = 0.0f;
+        tv.yawMoment = 0.0f;
+        return 0.0f;
+    }
+
+    float error = reference - yawRate;
+    float moment = tv.kp * error + tv.ki * (tv.integral + error * dt);
+
+    // Integrate only while the actuator is not saturated (anti-windup)
+    if (fabsf(moment) < tv.maxYawMoment)
+        tv.integral += error * dt;
+    tv.yawMoment = fminf(fmaxf(moment, -tv.maxYawMoment), tv.maxYawMoment);
+    return tv.yawMoment;
+}
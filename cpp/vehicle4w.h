@@ -0,0 +1,296 @@
+// vehicle4w.h
+//
+// Four-wheel dynamic vehicle model. Unlike the kinematic bicycle in car.h,
+// the body has its own longitudinal speed, lateral speed and yaw rate, and
+// each corner carries its own normal load, slip angle, drive force and
+// tire force. Yaw comes from the tire forces (through Iz), not from the
+// steering geometry, so torque vectoring can actually change it.
+//
+// Conventions match car.h: body x points forward, body y points to the
+// left (the side positive steer turns toward), heading rotates body x
+// toward world +z.
+//
+// Tires are linear with cornering stiffness proportional to normal load
+// (Cf and Cr are the axle stiffnesses at static load), limited by a
+// friction circle of radius mu * Fz. Slip angles use the small-angle form
+// alpha = steer * vx / |vx| - (vy + r * x) / |vx|, with |vx| floored at
+// LOW_SPEED_LIMIT, so the only trig per step is one sin/cos of the steering
+// angle and one of the heading.
+//
+// With tireModel = TIRE_MAGIC_FORMULA the tires are the combined-slip Magic
+// Formula of tire.h instead, read from its tables, with the static corner
+// load as the nominal load and the same cornering stiffness there. The
+// model has no wheel speeds, so each wheel's slip ratio is the one at
+// which the tire makes the requested drive force; past the tire's peak
+// the wheel stays at the peak.
+//
+// Each wheel carries the road's friction and grade under it (set from a
+// surface map by surface.h, dry and level otherwise). Gravity along the
+// grade pulls every corner with its normal load times the slope there.
+
+#pragma once
+
+#include <cmath>
+#include <cstring>
+
+#include "car.h"
+#include "tire.h"
+#include "torque_vectoring.h"
+
+// Below this longitudinal wheel speed slip angles are evaluated as if the
+// wheel rolled at it, which turns the tires into a viscous lateral damper
+// at standstill instead of a division by zero (m/s)
+const float LOW_SPEED_LIMIT = 1.0f;
+
+// Vehicle models selectable at run time
+enum VehicleModel {
+    MODEL_BICYCLE,            // Kinematic bicycle (stepCar)
+    MODEL_4W,                 // Four-wheel dynamic model, even left/right split
+    MODEL_4W_TV,              // Four-wheel dynamic model with torque vectoring
+    MODEL_4W_MPC,             // Four-wheel dynamic model with the predictive controller of mpc.h
+};
+
+// Function to map a model name to its enum value
+inline bool parseVehicleModel(const char* name, VehicleModel* model) {
+    if (strcmp(name, "bicycle") == 0) {
+        *model = MODEL_BICYCLE;
+    } else if (strcmp(name, "4w") == 0) {
+        *model = MODEL_4W;
+    } else if (strcmp(name, "4w-tv") == 0) {
+        *model = MODEL_4W_TV;
+    } else if (strcmp(name, "4w-mpc") == 0) {
+        *model = MODEL_4W_MPC;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Everything the step needs that depends only on the parameters
+struct Vehicle4WConstants {
+    float invMass;                        // 1 / mass (1/kg)
+    float invIz;                          // 1 / Iz (1/(kg·m²))
+    float mass;                           // (kg)
+    float cornerX[CORNER_COUNT];          // Wheel position ahead of the CG (m)
+    float cornerY[CORNER_COUNT];          // Wheel position left of the CG (m)
+    float staticLoad[CORNER_COUNT];       // Normal load at rest (N)
+    float invStaticLoad[CORNER_COUNT];    // 1 / staticLoad (1/N)
+    float stiffnessPerLoad[CORNER_COUNT]; // Cornering stiffness / normal load (1/rad)
+    float longTransfer;                   // h_cg / wheelbase * mass / 2 (kg), per wheel
+    float latTransferFront;               // h_cg / trackWidth * mass * lr / wheelbase (kg)
+    float latTransferRear;                // h_cg / trackWidth * mass * lf / wheelbase (kg)
+    float frontDriveShare;                // Share of the drive force on the front axle
+    float yawMomentToForce;               // 1 / (2 * trackWidth): wheel force per N·m (1/m)
+    TireModel tireModel;
+};
+
+struct Vehicle4W {
+    Car car;                              // Pose, speed (= vx), steering and parameters
+    float vy;                             // Lateral velocity in the body frame (m/s)
+    float ax, ay;                         // Body-frame CG acceleration of the last step (m/s²)
+    TorqueVectoring tv;
+
+    // Per-corner quantities of the last step
+    float mu[CORNER_COUNT];               // Friction coefficient under each wheel
+    float gradeX[CORNER_COUNT];           // Road rise per metre along body x under each wheel
+    float gradeY[CORNER_COUNT];           // Road rise per metre along body y under each wheel
+    float load[CORNER_COUNT];             // Normal load (N)
+    float slipAngle[CORNER_COUNT];        // Tire slip angle (radians)
+    float slipRatio[CORNER_COUNT];        // Tire slip ratio (0 with linear tires)
+    float driveForce[CORNER_COUNT];       // Requested drive force at the contact patch (N)
+    float Fx[CORNER_COUNT];               // Tire force along the wheel (N)
+    float Fy[CORNER_COUNT];               // Tire force across the wheel (N)
+};
+
+// Function to precompute the constants for 'car'
+inline Vehicle4WConstants makeVehicle4WConstants(const Car& car) {
+    Vehicle4WConstants k;
+    float halfTrack = 0.5f * car.trackWidth;
+    float frontShare = car.lr / car.wheelbase;
+
+    k.mass = car.mass;
+    k.invMass = 1.0f / car.mass;
+    k.invIz = 1.0f / car.Iz;
+
+    k.cornerX[FRONT_LEFT] = car.lf;
+    k.cornerX[FRONT_RIGHT] = car.lf;
+    k.cornerX[REAR_LEFT] = -car.lr;
+    k.cornerX[REAR_RIGHT] = -car.lr;
+    k.cornerY[FRONT_LEFT] = halfTrack;
+    k.cornerY[FRONT_RIGHT] = -halfTrack;
+    k.cornerY[REAR_LEFT] = halfTrack;
+    k.cornerY[REAR_RIGHT] = -halfTrack;
+
+    float front = 0.5f * frontShare * car.mass * GRAVITY;
+    float rear = 0.5f * (1.0f - frontShare) * car.mass * GRAVITY;
+    k.staticLoad[FRONT_LEFT] = front;
+    k.staticLoad[FRONT_RIGHT] = front;
+    k.staticLoad[REAR_LEFT] = rear;
+    k.staticLoad[REAR_RIGHT] = rear;
+    k.stiffnessPerLoad[FRONT_LEFT] = 0.5f * car.Cf / front;
+    k.stiffnessPerLoad[FRONT_RIGHT] = 0.5f * car.Cf / front;
+    k.stiffnessPerLoad[REAR_LEFT] = 0.5f * car.Cr / rear;
+    k.stiffnessPerLoad[REAR_RIGHT] = 0.5f * car.Cr / rear;
+    for (int c = 0; c < CORNER_COUNT; c++)
+        k.invStaticLoad[c] = 1.0f / k.staticLoad[c];
+
+    k.longTransfer = 0.5f * (car.h_cg / car.wheelbase) * car.mass;
+    k.latTransferFront = (car.h_cg / car.trackWidth) * car.mass * frontShare;
+    k.latTransferRear = (car.h_cg / car.trackWidth) * car.mass * (1.0f - frontShare);
+    k.frontDriveShare = 0.5f;
+    k.yawMomentToForce = 1.0f / (2.0f * car.trackWidth);
+    k.tireModel = TIRE_LINEAR;
+    return k;
+}
+
+// Function to wrap a car in the four-wheel model, at rest on level ground
+inline Vehicle4W makeVehicle4W(const Car& car) {
+    Vehicle4W v;
+    v.car = car;
+    v.vy = 0.0f;
+    v.ax = 0.0f;
+    v.ay = 0.0f;
+    v.tv = makeTorqueVectoring(car);
+    v.car.acceleration = 0.0f;
+    computeCornerLoads(v.car, 0.0f, v.load);
+    for (int c = 0; c < CORNER_COUNT; c++) {
+        v.mu[c] = 1.0f;
+        v.gradeX[c] = 0.0f;
+        v.gradeY[c] = 0.0f;
+        v.slipAngle[c] = 0.0f;
+        v.slipRatio[c] = 0.0f;
+        v.driveForce[c] = 0.0f;
+        v.Fx[c] = 0.0f;
+        v.Fy[c] = 0.0f;
+    }
+    return v;
+}
+
+// Function to advance the four-wheel model by dt under an externally
+// commanded yaw moment and a steering correction added to the driver's.
+// car.acceleration (set by applyDriverInput()) is the requested
+// longitudinal acceleration; it is turned into a total drive force, split
+// between the axles, and the yaw moment is added as a left/right force
+// difference. 'Math' is the fastmath.h policy for the steering and
+// heading sin/cos.
+template <typename Math = DefaultMath>
+inline StepOutput stepVehicle4WControlled(Vehicle4W& v, const Vehicle4WConstants& k, float dt, float yawMoment,
+                                          float steerCorrection) {
+    Car& car = v.car;
+    float vx = car.velocity;
+    float r = car.yawRate;
+    float steerAngle = car.steerAngle + steerCorrection;
+    StepOutput out;
+
+    // Normal loads from the previous step's acceleration (the load transfer
+    // lags the forces by one step, which avoids an algebraic loop)
+    float deltaFz_long = k.longTransfer * v.ax;
+    float deltaFz_latFront = k.latTransferFront * v.ay;
+    float deltaFz_latRear = k.latTransferRear * v.ay;
+    v.load[FRONT_LEFT] = fmaxf(k.staticLoad[FRONT_LEFT] - deltaFz_long - deltaFz_latFront, 0.0f);
+    v.load[FRONT_RIGHT] = fmaxf(k.staticLoad[FRONT_RIGHT] - deltaFz_long + deltaFz_latFront, 0.0f);
+    v.load[REAR_LEFT] = fmaxf(k.staticLoad[REAR_LEFT] + deltaFz_long - deltaFz_latRear, 0.0f);
+    v.load[REAR_RIGHT] = fmaxf(k.staticLoad[REAR_RIGHT] + deltaFz_long + deltaFz_latRear, 0.0f);
+
+    // Drive forces: axle split, then the torque-vectoring left/right offset
+    float totalDrive = k.mass * car.acceleration;
+    float frontDrive = 0.5f * k.frontDriveShare * totalDrive;
+    float rearDrive = 0.5f * (1.0f - k.frontDriveShare) * totalDrive;
+    float vectoring = yawMoment * k.yawMomentToForce;
+    v.driveForce[FRONT_LEFT] = frontDrive - vectoring;
+    v.driveForce[FRONT_RIGHT] = frontDrive + vectoring;
+    v.driveForce[REAR_LEFT] = rearDrive - vectoring;
+    v.driveForce[REAR_RIGHT] = rearDrive + vectoring;
+
+    // Tire forces in the wheel frame
+    float sinSteer, cosSteer;
+    Math::sincos(steerAngle, &sinSteer, &cosSteer);
+    for (int c = 0; c < CORNER_COUNT; c++) {
+        float steer = c < REAR_LEFT ? steerAngle : 0.0f;
+        float wheelVx = vx - r * k.cornerY[c];
+        float wheelVy = v.vy + r * k.cornerX[c];
+        float alpha = (steer * wheelVx - wheelVy) / fmaxf(fabsf(wheelVx), LOW_SPEED_LIMIT);
+        v.slipAngle[c] = alpha;
+
+        float fx = v.driveForce[c];
+        float fy;
+        if (k.tireModel == TIRE_MAGIC_FORMULA) {
+            // The drive force sets the slip ratio; both slips set both forces
+            float n = v.load[c] * k.invStaticLoad[c];
+            float kappa = slipRatioForDrive(fx * k.invStaticLoad[c], n, v.mu[c]);
+            TireForces f = tableTireForces(alpha, kappa, n, k.stiffnessPerLoad[c], v.mu[c]);
+            v.slipRatio[c] = kappa;
+            fx = f.Fx * k.staticLoad[c];
+            fy = f.Fy * k.staticLoad[c];
+        } else {
+            fy = k.stiffnessPerLoad[c] * v.load[c] * alpha;
+
+            // Friction circle
+            float limit = v.mu[c] * v.load[c];
+            float magnitudeSq = fx * fx + fy * fy;
+            if (magnitudeSq > limit * limit) {
+                float scale = limit / sqrtf(magnitudeSq);
+                fx *= scale;
+                fy *= scale;
+            }
+        }
+        v.Fx[c] = fx;
+        v.Fy[c] = fy;
+    }
+
+    // Sum into body-frame force and yaw moment; front wheels are rotated by
+    // the steering angle, and gravity pulls each corner down its grade
+    float sumFx = 0.0f, sumFy = 0.0f, sumMz = 0.0f;
+    for (int c = 0; c < CORNER_COUNT; c++) {
+        float fx = v.Fx[c];
+        float fy = v.Fy[c];
+        if (c < REAR_LEFT) {
+            float bodyFx = fx * cosSteer - fy * sinSteer;
+            fy = fx * sinSteer + fy * cosSteer;
+            fx = bodyFx;
+        }
+        fx -= v.load[c] * v.gradeX[c];
+        fy -= v.load[c] * v.gradeY[c];
+        sumFx += fx;
+        sumFy += fy;
+        sumMz += k.cornerX[c] * fy - k.cornerY[c] * fx;
+    }
+
+    // Rigid-body accelerations (ax, ay are the CG accelerations; the body
+    // frame rotates, hence the r * v terms)
+    v.ax = sumFx * k.invMass;
+    v.ay = sumFy * k.invMass;
+    float yawAccel = sumMz * k.invIz;
+
+    out.beta = v.vy / fmaxf(fabsf(vx), LOW_SPEED_LIMIT);
+    out.a_lat = v.ay;
+    out.Fz_front = v.load[FRONT_LEFT] + v.load[FRONT_RIGHT];
+    out.Fz_rear = v.load[REAR_LEFT] + v.load[REAR_RIGHT];
+
+    // Semi-implicit Euler: velocities first, then the pose with the new ones
+    vx += (v.ax + r * v.vy) * dt;
+    v.vy += (v.ay - r * vx) * dt;
+    r += yawAccel * dt;
+    if (vx > MAX_FORWARD_SPEED)
+        vx = MAX_FORWARD_SPEED;
+    if (vx < MAX_REVERSE_SPEED)
+        vx = MAX_REVERSE_SPEED;
+
+    float sinHeading, cosHeading;
+    Math::sincos(car.heading, &sinHeading, &cosHeading);
+    car.x += (vx * cosHeading - v.vy * sinHeading) * dt;
+    car.z += (vx * sinHeading + v.vy * cosHeading) * dt;
+    car.heading += r * dt;
+    car.velocity = vx;
+    car.yawRate = r;
+
+    return out;
+}
+
+// Function to advance the four-wheel model by dt, with the yaw moment of
+// the torque-vectoring controller or none
+template <typename Math = DefaultMath>
+inline StepOutput stepVehicle4W(Vehicle4W& v, const Vehicle4WConstants& k, float dt, bool torqueVectoring = true) {
+    float yawMoment = torqueVectoring ? updateTorqueVectoring(v.tv, v.car, v.car.yawRate, dt) : 0.0f;
+    return stepVehicle4WControlled<Math>(v, k, dt, yawMoment, 0.0f);
+}
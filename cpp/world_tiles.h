@@ -0,0 +1,395 @@
+// world_tiles.h
+//
+// The world the cars drive on, cut into square tiles so that what a frame
+// draws depends on what the camera can see, not on how large the course
+// is. API independent like scene_mesh.h: renderer.h uploads and draws the
+// tiles with OpenGL, soft_raster.h on the CPU.
+//
+// Ground: every tile is the same grid of lines in tile-local coordinates,
+// so there is one mesh per level of detail and a tile is just an instance
+// translated to its corner. Each frame the tiles within TILE_VIEW_RADIUS
+// of the eye (the far plane) are tested against the view frustum, and the
+// survivors are binned by distance into the levels: 1 m lines close to
+// the camera, 64 m lines (the tile outline) at the horizon, so lines stay
+// a few pixels apart instead of aliasing into noise. That is one
+// instanced draw per level, over a fixed number of candidate tiles.
+//
+// Track: the centerline segments are binned by tile, and a tile's lines
+// are built at two levels (every segment, and every TRACK_COARSE_STRIDE-th
+// point joined) only when the camera comes within TILE_VIEW_RADIUS of it.
+// A TileStreamer does the binning and the building on a loader thread of
+// its own; the render thread asks for the tiles that came into range,
+// picks up finished ones a few per frame, and drops the ones left behind,
+// so the resident set and the per-frame work stay bounded on any course.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "scene_mesh.h"
+
+const float TILE_SIZE = 64.0f;            // Edge of a tile (m)
+const float TILE_VIEW_RADIUS = 1000.0f;   // Tiles further than this are never drawn (the far plane, m)
+const int TILE_LODS = 4;
+const float TILE_LOD_SPACING[TILE_LODS] = { 1.0f, 4.0f, 16.0f, 64.0f };   // Ground line spacing (m)
+const float TILE_LOD_DISTANCE[TILE_LODS - 1] = { 80.0f, 250.0f, 600.0f };  // Where each level ends (m)
+const float TRACK_COARSE_DISTANCE = 400.0f;  // Track tiles further than this draw the coarse lines (m)
+const int TRACK_COARSE_STRIDE = 4;        // Points per coarse track line
+const int TILE_UPLOADS_PER_FRAME = 4;     // Finished track tiles taken per frame
+const int TILE_BLOCK = 4;                 // Tiles per side of a culling block
+
+// Tiles along one side of the square around the eye that can hold visible
+// tiles, rounded up to whole culling blocks
+const int TILE_SPAN = (2 * (int)(TILE_VIEW_RADIUS / TILE_SIZE + 1.0f) + 1 + TILE_BLOCK - 1) / TILE_BLOCK * TILE_BLOCK;
+const int TILE_MAX_VISIBLE = TILE_SPAN * TILE_SPAN;
+
+// Function to get the tile holding a world coordinate
+inline int32_t tileIndex(float v) {
+    return (int32_t)floorf(v / TILE_SIZE);
+}
+
+// Function to pack a tile's indices into one key
+inline uint64_t tileKey(int32_t ix, int32_t iz) {
+    return ((uint64_t)(uint32_t)ix << 32) | (uint32_t)iz;
+}
+
+inline int32_t tileKeyX(uint64_t key) { return (int32_t)(uint32_t)(key >> 32); }
+inline int32_t tileKeyZ(uint64_t key) { return (int32_t)(uint32_t)key; }
+
+// Function to get the squared horizontal distance from (x, z) to the nearest point of a tile
+inline float tileDistanceSquared(float x, float z, int32_t ix, int32_t iz) {
+    float x0 = ix * TILE_SIZE, z0 = iz * TILE_SIZE;
+    float dx = std::max(std::max(x0 - x, x - x0 - TILE_SIZE), 0.0f);
+    float dz = std::max(std::max(z0 - z, z - z0 - TILE_SIZE), 0.0f);
+    return dx * dx + dz * dz;
+}
+
+// Function to get the ground level of detail for a tile at squared distance 'distance2' from the eye
+inline int tileLod(float distance2) {
+    int lod = 0;
+    while (lod < TILE_LODS - 1 && distance2 > TILE_LOD_DISTANCE[lod] * TILE_LOD_DISTANCE[lod])
+        lod++;
+    return lod;
+}
+
+// Function to build the ground grid of one tile, as GL_LINES from its
+// corner: lines every 'spacing' metres along both axes. The lines on the
+// far edges belong to the neighbours.
+inline std::vector<MeshVertex> buildGroundTileMesh(float spacing) {
+    std::vector<MeshVertex> v;
+    const float c = 0.3f;
+    int lines = (int)(TILE_SIZE / spacing + 0.5f);
+    v.reserve(4 * lines);
+    for (int i = 0; i < lines; i++) {
+        float p = i * spacing;
+        MeshVertex line[4] = {
+            { p, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, c, c, c },
+            { p, 0.0f, TILE_SIZE, 0.0f, 1.0f, 0.0f, c, c, c },
+            { 0.0f, 0.0f, p, 0.0f, 1.0f, 0.0f, c, c, c },
+            { TILE_SIZE, 0.0f, p, 0.0f, 1.0f, 0.0f, c, c, c },
+        };
+        v.insert(v.end(), line, line + 4);
+    }
+    return v;
+}
+
+// Function to add the centerline from point i to point j, lifted a
+// little off the ground grid
+inline void addTrackLine(std::vector<MeshVertex>& v, const std::vector<float>& x, const std::vector<float>& z,
+                         size_t i, size_t j) {
+    MeshVertex line[2] = {
+        { x[i], 0.02f, z[i], 0.0f, 1.0f, 0.0f, 1.0f, 0.8f, 0.1f },
+        { x[j], 0.02f, z[j], 0.0f, 1.0f, 0.0f, 1.0f, 0.8f, 0.1f },
+    };
+    v.insert(v.end(), line, line + 2);
+}
+
+// Centerline segments by the tiles they cross; segment i runs from point
+// i to point (i + 1) % n
+typedef std::unordered_map<uint64_t, std::vector<uint32_t>> TrackTileIndex;
+
+// Function to bin a closed centerline's segments by tile
+inline void buildTrackTileIndex(const std::vector<float>& x, const std::vector<float>& z, TrackTileIndex& index) {
+    index.clear();
+    size_t n = x.size();
+    for (size_t i = 0; i < n; i++) {
+        size_t j = i + 1 < n ? i + 1 : 0;
+        int32_t x0 = tileIndex(std::min(x[i], x[j])), x1 = tileIndex(std::max(x[i], x[j]));
+        int32_t z0 = tileIndex(std::min(z[i], z[j])), z1 = tileIndex(std::max(z[i], z[j]));
+        for (int32_t ix = x0; ix <= x1; ix++)
+            for (int32_t iz = z0; iz <= z1; iz++)
+                index[tileKey(ix, iz)].push_back((uint32_t)i);
+    }
+}
+
+// A track tile's lines: 'fineCount' vertices with every segment, then
+// the coarse lines
+struct TrackTileMesh {
+    uint64_t key;
+    std::vector<MeshVertex> vertices;
+    size_t fineCount;
+};
+
+// Function to build the lines of the tile holding 'segments'
+inline void buildTrackTileMesh(const std::vector<float>& x, const std::vector<float>& z,
+                               const std::vector<uint32_t>& segments, TrackTileMesh& mesh) {
+    size_t n = x.size();
+    mesh.vertices.clear();
+    mesh.vertices.reserve(2 * segments.size() + 2 * (segments.size() / TRACK_COARSE_STRIDE + 1));
+    for (uint32_t i : segments)
+        addTrackLine(mesh.vertices, x, z, i, i + 1 < n ? i + 1 : 0);
+    mesh.fineCount = mesh.vertices.size();
+    for (uint32_t i : segments) {
+        if (i % TRACK_COARSE_STRIDE == 0)
+            addTrackLine(mesh.vertices, x, z, i, (i + TRACK_COARSE_STRIDE) % n);
+    }
+}
+
+// The six planes of a view frustum, inside where a x + b y + c z + d >= 0
+struct Frustum {
+    float planes[6][4];
+};
+
+// Function to extract the frustum planes from the rows of a
+// view-projection matrix (Gribb and Hartmann)
+inline Frustum makeFrustum(const float rows[4][4]) {
+    Frustum f;
+    for (int k = 0; k < 4; k++) {
+        f.planes[0][k] = rows[3][k] + rows[0][k];   // Left
+        f.planes[1][k] = rows[3][k] - rows[0][k];   // Right
+        f.planes[2][k] = rows[3][k] + rows[1][k];   // Bottom
+        f.planes[3][k] = rows[3][k] - rows[1][k];   // Top
+        f.planes[4][k] = rows[3][k] + rows[2][k];   // Near
+        f.planes[5][k] = rows[3][k] - rows[2][k];   // Far
+    }
+    return f;
+}
+
+// Function to test whether any of a box may be inside the frustum: false
+// only if its corner furthest along some plane's normal is outside it
+inline bool boxInFrustum(const Frustum& f, const float lo[3], const float hi[3]) {
+    for (int p = 0; p < 6; p++) {
+        const float* n = f.planes[p];
+        float x = n[0] >= 0.0f ? hi[0] : lo[0];
+        float y = n[1] >= 0.0f ? hi[1] : lo[1];
+        float z = n[2] >= 0.0f ? hi[2] : lo[2];
+        if (n[0] * x + n[1] * y + n[2] * z + n[3] < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+// Function to test whether an n x n block of tiles from (ix, iz) (ground
+// and track, up to 0.1 m high) may be visible
+inline bool tileInFrustum(const Frustum& f, int32_t ix, int32_t iz, int n = 1) {
+    const float lo[3] = { ix * TILE_SIZE, 0.0f, iz * TILE_SIZE };
+    const float hi[3] = { lo[0] + n * TILE_SIZE, 0.1f, lo[2] + n * TILE_SIZE };
+    return boxInFrustum(f, lo, hi);
+}
+
+// The frustum planes as functions of a block's tile indices: plane p
+// passes the block of n x n tiles from (ix, iz) if a[p] ix + b[p] iz +
+// c[p] >= 0. The corner each plane tests is the same for every block, so
+// it is folded into c once per frame.
+struct TilePlanes {
+    float a[6], b[6], c[6];
+};
+
+// Function to set up the plane tests for blocks of n x n tiles
+inline TilePlanes makeTilePlanes(const Frustum& f, int n) {
+    TilePlanes t;
+    for (int p = 0; p < 6; p++) {
+        const float* plane = f.planes[p];
+        t.a[p] = plane[0] * TILE_SIZE;
+        t.b[p] = plane[2] * TILE_SIZE;
+        t.c[p] = plane[3] + std::max(plane[0], 0.0f) * n * TILE_SIZE + std::max(plane[1], 0.0f) * 0.1f +
+                 std::max(plane[2], 0.0f) * n * TILE_SIZE;
+    }
+    return t;
+}
+
+// Function to test a block set up by makeTilePlanes(), as tileInFrustum()
+inline bool tilePlanesPass(const TilePlanes& t, int32_t ix, int32_t iz) {
+    bool inside = true;
+    for (int p = 0; p < 6; p++)
+        inside &= t.a[p] * ix + t.b[p] * iz + t.c[p] >= 0.0f;
+    return inside;
+}
+
+// Ground tiles that survived culling, one instance per tile, by level
+struct VisibleTiles {
+    int count[TILE_LODS];
+    MeshInstance instances[TILE_LODS][TILE_MAX_VISIBLE];
+};
+
+// Function to collect the ground tiles of one frame: those within the
+// view radius of the eye and inside the frustum. Blocks of tiles are
+// tested first, so most of the square around the eye (everything behind
+// and beside the camera) costs one test per block.
+inline void collectVisibleTiles(const Frustum& frustum, float eyeX, float eyeZ, VisibleTiles& out) {
+    for (int lod = 0; lod < TILE_LODS; lod++)
+        out.count[lod] = 0;
+    TilePlanes blocks = makeTilePlanes(frustum, TILE_BLOCK);
+    TilePlanes tiles = makeTilePlanes(frustum, 1);
+    int32_t x0 = tileIndex(eyeX) - TILE_SPAN / 2, z0 = tileIndex(eyeZ) - TILE_SPAN / 2;
+    for (int32_t bz = z0; bz < z0 + TILE_SPAN; bz += TILE_BLOCK) {
+        for (int32_t bx = x0; bx < x0 + TILE_SPAN; bx += TILE_BLOCK) {
+            if (!tilePlanesPass(blocks, bx, bz))
+                continue;
+            for (int32_t iz = bz; iz < bz + TILE_BLOCK; iz++) {
+                for (int32_t ix = bx; ix < bx + TILE_BLOCK; ix++) {
+                    float distance2 = tileDistanceSquared(eyeX, eyeZ, ix, iz);
+                    if (distance2 > TILE_VIEW_RADIUS * TILE_VIEW_RADIUS || !tilePlanesPass(tiles, ix, iz))
+                        continue;
+                    int lod = tileLod(distance2);
+                    MeshInstance tile = { ix * TILE_SIZE, 0.0f, iz * TILE_SIZE, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+                    out.instances[lod][out.count[lod]++] = tile;
+                }
+            }
+        }
+    }
+}
+
+// Builds track tiles on a loader thread. The track's points are shared,
+// never written while the streamer runs. Fields marked "guarded" belong to
+// 'mutex'; the index is written by the loader before 'indexed' is set and
+// only read after; the rest belongs to the render thread.
+struct TileStreamer {
+    const std::vector<float>* x;
+    const std::vector<float>* z;
+    std::thread loader;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<uint64_t> requests;       // Tiles to build (guarded)
+    std::vector<TrackTileMesh> loaded;    // Tiles built (guarded)
+    bool stop;                            // (guarded)
+
+    TrackTileIndex index;
+    std::atomic<bool> indexed;
+
+    std::unordered_set<uint64_t> wanted;  // Requested or resident
+    int32_t centerX, centerZ;             // Tile of the eye at the last update
+    bool started;
+    long built;                           // Tiles taken from the loader
+
+    TileStreamer() : x(nullptr), z(nullptr), stop(false), indexed(false), centerX(0), centerZ(0),
+                     started(false), built(0) {}
+};
+
+// Function for the loader thread: bin the track, then build tiles as asked
+inline void runTileLoader(TileStreamer& s) {
+    buildTrackTileIndex(*s.x, *s.z, s.index);
+    s.indexed.store(true, std::memory_order_release);
+
+    std::unique_lock<std::mutex> lock(s.mutex);
+    for (;;) {
+        s.wake.wait(lock, [&] { return s.stop || !s.requests.empty(); });
+        if (s.stop)
+            return;
+        std::vector<uint64_t> batch;
+        batch.swap(s.requests);
+        lock.unlock();
+        std::vector<TrackTileMesh> meshes(batch.size());
+        for (size_t i = 0; i < batch.size(); i++) {
+            meshes[i].key = batch[i];
+            buildTrackTileMesh(*s.x, *s.z, s.index.find(batch[i])->second, meshes[i]);
+        }
+        lock.lock();
+        for (TrackTileMesh& mesh : meshes)
+            s.loaded.push_back(std::move(mesh));
+    }
+}
+
+// Function to start streaming the centerline through the points (x[i], z[i])
+inline void startTileStreamer(TileStreamer& s, const std::vector<float>& x, const std::vector<float>& z) {
+    s.x = &x;
+    s.z = &z;
+    s.stop = false;
+    s.indexed.store(false, std::memory_order_relaxed);
+    s.centerX = s.centerZ = INT32_MIN;
+    s.built = 0;
+    s.loader = std::thread(runTileLoader, std::ref(s));
+    s.started = true;
+}
+
+// Function to stop the loader thread
+inline void stopTileStreamer(TileStreamer& s) {
+    if (!s.started)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.stop = true;
+    }
+    s.wake.notify_one();
+    s.loader.join();
+    s.started = false;
+}
+
+// Function to follow the eye: once it moves to another tile, ask for the
+// track tiles that came into range and list the ones that fell out of it
+// (with a tile of slack, so crossing a border back and forth does not
+// reload) in 'evicted'
+inline void updateTileStreamer(TileStreamer& s, float eyeX, float eyeZ, std::vector<uint64_t>& evicted) {
+    evicted.clear();
+    int32_t cx = tileIndex(eyeX), cz = tileIndex(eyeZ);
+    if (!s.started || !s.indexed.load(std::memory_order_acquire) || (cx == s.centerX && cz == s.centerZ))
+        return;
+    s.centerX = cx;
+    s.centerZ = cz;
+
+    const float evictRadius = TILE_VIEW_RADIUS + TILE_SIZE;
+    for (auto it = s.wanted.begin(); it != s.wanted.end();) {
+        if (tileDistanceSquared(eyeX, eyeZ, tileKeyX(*it), tileKeyZ(*it)) > evictRadius * evictRadius) {
+            evicted.push_back(*it);
+            it = s.wanted.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    std::vector<uint64_t> requests;
+    int32_t reach = TILE_SPAN / 2;
+    for (int32_t iz = cz - reach; iz <= cz + reach; iz++) {
+        for (int32_t ix = cx - reach; ix <= cx + reach; ix++) {
+            uint64_t key = tileKey(ix, iz);
+            if (tileDistanceSquared(eyeX, eyeZ, ix, iz) <= TILE_VIEW_RADIUS * TILE_VIEW_RADIUS && s.index.count(key) &&
+                !s.wanted.count(key)) {
+                s.wanted.insert(key);
+                requests.push_back(key);
+            }
+        }
+    }
+    if (!requests.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            s.requests.insert(s.requests.end(), requests.begin(), requests.end());
+        }
+        s.wake.notify_one();
+    }
+}
+
+// Function to take up to 'max' finished tiles that are still wanted
+inline void takeLoadedTiles(TileStreamer& s, std::vector<TrackTileMesh>& out, size_t max) {
+    out.clear();
+    if (!s.started)
+        return;
+    std::lock_guard<std::mutex> lock(s.mutex);
+    size_t taken = 0;
+    while (taken < s.loaded.size() && out.size() < max) {
+        TrackTileMesh& mesh = s.loaded[taken++];
+        if (s.wanted.count(mesh.key))
+            out.push_back(std::move(mesh));
+    }
+    s.loaded.erase(s.loaded.begin(), s.loaded.begin() + taken);
+    s.built += (long)out.size();
+}